@@ -0,0 +1,107 @@
+--[[
+    Interpreter throughput benchmark.
+
+    Usage:  benchmark [iterations]
+
+    Runs a handful of CPU-bound Lua workloads and reports the best time
+    for each. Run as a command, this measures scripts as they now run:
+    with no hook installed until CTRL+C is pressed.
+
+    To compare against the old always-on CTRL+C check (a C hook on every
+    line, and every 100 instructions), build tests/hookbench.cpp; it runs
+    this same script with and without that hook installed.
+--]]
+
+local iterations = tonumber(args and args[1]) or 3
+
+local workloads = {}
+
+workloads['arithmetic'] = function()
+    local sum = 0
+    for i = 1, 2000000 do
+        sum = sum + (i % 7) * 3 - (i // 5)
+    end
+    return sum
+end
+
+workloads['function calls'] = function()
+    local function add(a, b) return a + b end
+    local sum = 0
+    for i = 1, 1000000 do
+        sum = add(sum, i)
+    end
+    return sum
+end
+
+workloads['table insert/lookup'] = function()
+    local t = {}
+    for i = 1, 200000 do
+        t[i] = i * 2
+    end
+    local sum = 0
+    for i = 1, #t do
+        sum = sum + t[i]
+    end
+    local map = {}
+    for i = 1, 100000 do
+        map['k' .. (i % 1000)] = i
+    end
+    return sum
+end
+
+workloads['string building'] = function()
+    local parts = {}
+    for i = 1, 100000 do
+        parts[#parts + 1] = string.format('%d:%s', i, 'x')
+    end
+    return #table.concat(parts, ',')
+end
+
+workloads['grid search'] = function()
+    -- Breadth-first search over a grid; similar in shape to lib/pathfinding
+    local w, h = 200, 200
+    local visited = {}
+    local queue = {1}
+    local head = 1
+    visited[1] = true
+    while head <= #queue do
+        local node = queue[head]
+        head = head + 1
+        local x, y = (node - 1) % w, (node - 1) // w
+        if x > 0 and not visited[node - 1] then visited[node - 1] = true; queue[#queue + 1] = node - 1 end
+        if x < w - 1 and not visited[node + 1] then visited[node + 1] = true; queue[#queue + 1] = node + 1 end
+        if y > 0 and not visited[node - w] then visited[node - w] = true; queue[#queue + 1] = node - w end
+        if y < h - 1 and not visited[node + w] then visited[node + w] = true; queue[#queue + 1] = node + w end
+    end
+    return #queue
+end
+
+-- Returns the best (lowest) time in seconds out of all iterations
+local function measure(fn)
+    local best = math.huge
+    for i = 1, iterations do
+        collectgarbage('collect')
+        local start = time.getNow()
+        fn()
+        best = math.min(best, time.diff(time.getNow(), start))
+    end
+    return best
+end
+
+local names = {}
+for name in pairs(workloads) do
+    table.insert(names, name)
+end
+table.sort(names)
+
+printf("Interpreter throughput (best of %d; lower is better)\n\n", iterations)
+printf("%-22s %10s\n", 'Workload', 'Time (ms)')
+
+local total = 0
+for i, name in ipairs(names) do
+    local elapsed = measure(workloads[name])
+    total = total + elapsed
+    printf("%-22s %10.2f\n", name, elapsed * 1000)
+end
+
+printf("\n%-22s %10.2f\n", 'Total', total * 1000)
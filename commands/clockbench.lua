@@ -0,0 +1,49 @@
+--[[
+    Clock overhead benchmark.
+
+    Usage:  clockbench [calls]
+
+    Measures how long it takes to read the time through each available
+    clock source. Every figure includes the cost of calling into C from
+    Lua, so a trivial C function that takes no arguments, like the
+    clocks (coroutine.isyieldable), is timed as well; the "net" column
+    subtracts that to estimate the cost of the clock read itself.
+--]]
+
+local calls = tonumber(args and args[1]) or 2000000
+
+-- Returns the best (lowest) nanoseconds per call to fn(...) out of a few runs
+local function measure(fn, ...)
+    local best = math.huge
+    for run = 1, 5 do
+        local start = time.getNow()
+        for i = 1, calls do
+            fn(...)
+        end
+        local elapsed = time.diffNs(start)
+        best = math.min(best, elapsed / calls)
+    end
+    return best
+end
+
+local originalSource = time.getClockSource()
+local baseline = measure(coroutine.isyieldable)
+
+printf("Clock read overhead (best of 5 x %d calls)\n\n", calls)
+printf("%-26s %12s %12s\n", 'Clock', 'ns/call', 'net ns/call')
+printf("%-26s %12.1f %12s\n", 'isyieldable (baseline)', baseline, '-')
+
+for i, source in ipairs({'system', 'tsc'}) do
+    if( time.setClockSource(source) ) then
+        local cost = measure(time.getNow)
+        printf("%-26s %12.1f %12.1f\n", 'time.getNow() [' .. source .. ']', cost, math.max(cost - baseline, 0))
+    else
+        printf("%-26s %12s %12s\n", 'time.getNow() [' .. source .. ']', 'n/a', 'n/a')
+    end
+end
+
+-- os.clock() for comparison; note that it measures CPU time, not wall time
+local cost = measure(os.clock)
+printf("%-26s %12.1f %12.1f\n", 'os.clock()', cost, math.max(cost - baseline, 0))
+
+time.setClockSource(originalSource)
@@ -0,0 +1,110 @@
+--[[
+    Keyboard state diff test and benchmark.
+
+    Usage:  keybench [pairs] [calls]
+
+    Checks keyboard.diffStates() against the byte-wise definition of
+    pressed/released (bit 7 set now but not before, or the other way
+    around) over the given number of random state pairs (default 20000),
+    using both the bit mask that polling uses and the old per-key test.
+
+    Then times both methods over synthetic frames where, as in real use,
+    only a few keys change at a time. Every figure includes the cost of
+    calling into C and building the result tables; the "identical" row
+    (no keys changed) shows roughly how much of that is overhead.
+--]]
+
+local pairCount = tonumber(args and args[1]) or 20000
+local calls = tonumber(args and args[2]) or 200000
+
+math.randomseed(12345)
+
+local function randomState()
+    local bytes = {}
+    for i = 1, 256 do
+        bytes[i] = math.random(0, 255)
+    end
+    return string.char(table.unpack(bytes))
+end
+
+-- What pressed() and released() say, one key at a time
+local function reference(current, last)
+    local pressed, released = {}, {}
+    for vk = 0, 255 do
+        local now = current:byte(vk + 1) >= 128
+        local before = last:byte(vk + 1) >= 128
+        if( now and not before ) then
+            pressed[#pressed + 1] = vk
+        elseif( before and not now ) then
+            released[#released + 1] = vk
+        end
+    end
+    return pressed, released
+end
+
+local function sameList(a, b)
+    if( #a ~= #b ) then
+        return false
+    end
+    for i = 1, #a do
+        if( a[i] ~= b[i] ) then
+            return false
+        end
+    end
+    return true
+end
+
+printf("Checking %d random state pairs...\n", pairCount)
+for i = 1, pairCount do
+    local current, last = randomState(), randomState()
+    local expectPressed, expectReleased = reference(current, last)
+
+    for _, bytewise in ipairs({false, true}) do
+        local pressed, released = keyboard.diffStates(current, last, bytewise)
+        if( not sameList(pressed, expectPressed) or not sameList(released, expectReleased) ) then
+            error(sprintf("Mismatch on pair %d (%s).", i, bytewise and 'bytewise' or 'mask'))
+        end
+    end
+end
+printf("All pairs match.\n\n")
+
+-- Frames as polling sees them: each one changes up to 3 keys, and
+-- the low (toggle/repeat) bits flicker without counting as changes
+local frameCount = 1024
+local frames = {}
+local state = {}
+for i = 1, 256 do
+    state[i] = 0
+end
+local previous = string.char(table.unpack(state))
+for f = 1, frameCount do
+    for n = 1, math.random(0, 3) do
+        local vk = math.random(1, 256)
+        state[vk] = state[vk] ~ 0x80
+    end
+    local flicker = math.random(1, 256)
+    state[flicker] = state[flicker] ~ 0x01
+
+    local current = string.char(table.unpack(state))
+    frames[f] = {current, previous}
+    previous = current
+end
+
+-- Returns the best (lowest) nanoseconds per call out of a few runs
+local function measure(bytewise, identical)
+    local best = math.huge
+    for run = 1, 5 do
+        local start = time.getNow()
+        for i = 1, calls do
+            local frame = frames[(i % frameCount) + 1]
+            keyboard.diffStates(frame[1], identical and frame[1] or frame[2], bytewise)
+        end
+        best = math.min(best, time.diffNs(start) / calls)
+    end
+    return best
+end
+
+printf("Diff cost (best of 5 x %d calls)\n\n", calls)
+printf("%-22s %12s %12s\n", 'Frames', 'mask ns', 'bytewise ns')
+printf("%-22s %12.1f %12.1f\n", 'identical', measure(false, true), measure(true, true))
+printf("%-22s %12.1f %12.1f\n", 'up to 3 keys changed', measure(false, false), measure(true, false))
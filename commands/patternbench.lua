@@ -0,0 +1,74 @@
+--[[
+    Pattern scan benchmark.
+
+    Usage:  patternbench [megabytes] [processId]
+
+    Fills a string of the given size (default 256MB) with pseudo-random
+    bytes, then times process.findPattern() over it in MicroMacro's own
+    memory. The pattern to find is placed at the very end, so the whole
+    buffer has to be scanned.
+--]]
+
+local megabytes = tonumber(args and args[1]) or 256
+local procId = tonumber(args and args[2]) or process.findByExe('micromacro.exe')
+if( not procId ) then
+    error("Could not find our own process; pass its ID as the second argument.")
+end
+
+local proc = process.open(procId)
+
+-- Markers either side of the filler; the end marker is what we scan for
+local startMarker = "\x4D\x4D\x42\x45\x4E\x43\x48\x21\x5B\x7E\x13\x37"
+local endBytes = "\x48\x8B\x05\x00\x00\x00\x00\x48\x85\xC0\x74\x13\x8B\x0D"
+local endMask = "xxx????xxxxxxx"
+
+printf("Building a %dMB buffer...\n", megabytes)
+math.randomseed(12345)
+local block = {}
+for i = 1, 65536 do
+    -- Plenty of 0x48 and 0x8B so that anchor bytes turn up often
+    local r = math.random(0, 255)
+    if( r < 16 ) then r = 0x48 elseif( r < 24 ) then r = 0x8B end
+    block[i] = string.char(r)
+end
+block = table.concat(block)
+local fillerLen = megabytes * 1024 * 1024
+local buffer = startMarker .. string.rep(block, fillerLen // #block) .. endBytes
+local endOffset = #startMarker + fillerLen
+
+-- Find where the buffer lives; other copies of the start marker don't have the end marker after them
+local bufferAddr
+local searchFrom = 0
+while( true ) do
+    local addr = process.findPattern(proc, searchFrom, math.maxinteger, startMarker, string.rep('x', #startMarker))
+    if( not addr ) then
+        error("Could not locate the buffer in memory.")
+    end
+
+    if( process.findPattern(proc, addr + endOffset, 1, endBytes, endMask) ) then
+        bufferAddr = addr
+        break
+    end
+    searchFrom = addr + 1
+end
+
+printf("Scanning %dMB (best of 5)\n\n", megabytes)
+local best = math.huge
+local bestReported = 0
+for run = 1, 5 do
+    local start = time.getNow()
+    local found, throughput = process.findPattern(proc, bufferAddr, endOffset + 1, endBytes, endMask)
+    local elapsed = time.diff(time.getNow(), start)
+
+    if( found ~= bufferAddr + endOffset ) then
+        error("Pattern was not found where it should be.")
+    end
+    best = math.min(best, elapsed)
+    bestReported = math.max(bestReported, throughput)
+end
+
+printf("%-18s %10.2f\n", 'Time (ms)', best * 1000)
+printf("%-18s %10.0f\n", 'Throughput (MB/s)', megabytes / best)
+printf("%-18s %10.0f\n", 'Reported (MB/s)', bestReported)
+
+process.close(proc)
@@ -0,0 +1,176 @@
+--[[
+    Linux process memory test.
+
+    Usage:  proctest
+
+    Starts a child process whose memory holds known data (its command
+    line and environment, which the kernel places at addresses given in
+    /proc/<pid>/stat), then checks that process.read(), readBatch() and
+    readChunk() all return that data, that reads from unmapped memory
+    fail, and that the modules found agree with /proc/<pid>/maps.
+
+    The backend itself (ProcMem) is tested natively, without Lua, by
+    tests/procmem_test.cpp.
+--]]
+
+if( package.config:sub(1, 1) ~= '/' ) then
+    error("This test is for Linux only.")
+end
+
+local passed, failed = 0, 0
+local function check(ok, what, ...)
+    if( ok ) then
+        passed = passed + 1
+    else
+        failed = failed + 1
+        printf("FAIL: " .. what .. "\n", ...)
+    end
+end
+
+local function readFile(path)
+    local file = io.open(path, 'rb')
+    if( not file ) then
+        return nil
+    end
+    local data = file:read('a')
+    file:close()
+    return data
+end
+
+-- The child just sleeps; what we look for is in its environment
+local marker = sprintf("MM_PROCTEST=%08x%08x", math.random(0, 0x7FFFFFFF), math.random(0, 0x7FFFFFFF))
+local spawn = io.popen(marker .. " sleep 60 >/dev/null 2>&1 & echo $!")
+local pid = tonumber(spawn:read('l'))
+spawn:close()
+if( not pid ) then
+    error("Could not start the child process.")
+end
+
+-- Until it has exec'd, the child is still a copy of the shell
+for i = 1, 200 do
+    local cmdline = readFile(sprintf("/proc/%d/cmdline", pid))
+    if( cmdline and cmdline:match("^sleep%z") ) then
+        break
+    end
+    system.rest(10)
+end
+
+local proc = process.open(pid)
+if( not proc ) then
+    os.execute("kill " .. pid)
+    error(sprintf("Could not open process %d.", pid))
+end
+
+-- Where the kernel put the command line and environment (fields 48 to 51)
+local stat = readFile(sprintf("/proc/%d/stat", pid))
+local fields = {}
+for field in stat:match("%) (.*)$"):gmatch("%S+") do
+    fields[#fields + 1] = tonumber(field) or field
+end
+local argStart, envStart = fields[48 - 2], fields[50 - 2]
+local cmdline = readFile(sprintf("/proc/%d/cmdline", pid))
+local environ = readFile(sprintf("/proc/%d/environ", pid))
+
+printf("Child %d: command line at 0x%X (%d bytes), environment at 0x%X (%d bytes)\n",
+    pid, argStart, #cmdline, envStart, #environ)
+
+-- readBatch(): the command line, a byte at a time
+local bytes = process.readBatch(proc, argStart, #cmdline .. "B")
+check(bytes ~= nil, "readBatch() of the command line failed")
+if( bytes ) then
+    local same = #bytes == #cmdline
+    for i = 1, #cmdline do
+        same = same and bytes[i] == cmdline:byte(i)
+    end
+    check(same, "readBatch() of the command line does not match")
+end
+
+-- readChunk(): the environment, one string at a time
+local chunk = process.readChunk(proc, envStart, #environ)
+check(chunk ~= nil, "readChunk() of the environment failed")
+local markerOffset
+if( chunk ) then
+    local offset = 0
+    for entry in environ:gmatch("([^%z]*)%z") do
+        check(chunk:getData("string", offset, #entry + 1) == entry,
+            "readChunk() does not match environment entry at offset %d", offset)
+        if( entry == marker ) then
+            markerOffset = offset
+        end
+        offset = offset + #entry + 1
+    end
+end
+
+-- read(): our marker, as a string and as bytes
+check(markerOffset ~= nil, "Marker not found in the child's environment")
+if( markerOffset ) then
+    local address = envStart + markerOffset
+    check(process.read(proc, "string", address, #marker + 1) == marker, "read() of the marker does not match")
+    check(process.read(proc, "ubyte", address) == marker:byte(1), "read() of a byte does not match")
+end
+
+-- The child's memory map, as the kernel sees it
+local maps = {}
+for line in readFile(sprintf("/proc/%d/maps", pid)):gmatch("[^\n]+") do
+    local first, last, perms, path = line:match("^(%x+)%-(%x+)%s+(%S+)%s+%S+%s+%S+%s+%S+%s*(.*)$")
+    if( first ) then
+        maps[#maps + 1] = {start = tonumber(first, 16), finish = tonumber(last, 16), perms = perms, path = path}
+    end
+end
+
+-- getModules(): every mapped file, at its lowest address
+local expected = {}
+for i, map in ipairs(maps) do
+    if( map.path:sub(1, 1) == '/' ) then
+        local name = map.path:match("([^/]+)$")
+        if( not expected[name] or map.start < expected[name] ) then
+            expected[name] = map.start
+        end
+    end
+end
+
+local modules = process.getModules(pid) or {}
+for name, base in pairs(expected) do
+    check(modules[name] == base, "Module %s: expected 0x%X, got %s", name, base, tostring(modules[name]))
+end
+for name, base in pairs(modules) do
+    check(expected[name] ~= nil, "Module %s is not in the maps", name)
+end
+for name, base in pairs(expected) do
+    local magic = process.readBatch(proc, base, "4B")
+    if( name:match("%.so") or name == 'sleep' ) then
+        check(magic and magic[1] == 0x7F and magic[2] == 0x45 and magic[3] == 0x4C and magic[4] == 0x46,
+            "Module %s does not start with an ELF header", name)
+    end
+end
+
+-- Readable regions can be read; unmapped memory cannot
+for i, map in ipairs(maps) do
+    local special = map.path == '[vsyscall]' or map.path:match("^%[vvar")
+    if( map.perms:sub(1, 1) == 'r' and not special ) then
+        check(process.read(proc, "ubyte", map.start) ~= nil, "Could not read region at 0x%X (%s)", map.start, map.path)
+    end
+end
+
+local gap
+for i = 2, #maps do
+    if( maps[i].start > maps[i - 1].finish ) then
+        gap = maps[i - 1].finish
+        break
+    end
+end
+check(gap ~= nil, "No gap found between mappings")
+if( gap ) then
+    check(process.read(proc, "ubyte", gap) == nil, "Read from unmapped 0x%X succeeded", gap)
+    check(process.readBatch(proc, gap, "4B") == nil, "readBatch() from unmapped 0x%X succeeded", gap)
+    check(process.readChunk(proc, gap, 16) == nil, "readChunk() from unmapped 0x%X succeeded", gap)
+end
+check(process.read(proc, "ubyte", 0) == nil, "Read from address 0 succeeded")
+
+process.terminate(proc)
+process.close(proc)
+
+printf("\n%d passed, %d failed\n", passed, failed)
+if( failed > 0 ) then
+    error(sprintf("%d checks failed.", failed))
+end
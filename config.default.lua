@@ -16,8 +16,20 @@ scriptDirectory = "./scripts";
 
 --[[ Memory & Process settings ------------------------------------------------
     memoryStringBufferSize  Size of the buffer (in bytes) used when handling strings in memory.
+    memoryScanThreads       How many threads may share a memory scan (ie. process.findPattern()).
+                            0 uses one per processor; 1 scans on the script's thread only.
 ]]
 memoryStringBufferSize = 128;
+memoryScanThreads = 0;
+
+--[[ Gamepad settings ---------------------------------------------------------
+    gamepadDeadzone         How far (in percent of full deflection) a stick may move off
+                            center and still read as centered in axis events
+    gamepadAxisMinDelta     Smallest axis change (in axis units, 0-100) that raises an event
+    Both apply to every axis; scripts may change them per axis with gamepad.setAxisFilter()
+]]
+gamepadDeadzone = 0;
+gamepadAxisMinDelta = 0;
 
 --[[ Network settings ---------------------------------------------------------
     networkEnabled      Whether or not to enable network functions
@@ -46,5 +58,17 @@ errMessageStyle = "\x1b[38;5;228m";
 
 --[[ Other things -------------------------------------------------------------
     yieldTimeSlice  Whether to yield time back to the system (prevent 100% CPU)
+    idleMode        How the main loop idles between cycles: "spin", "sleep" or "wait".
+                    "wait" blocks until the next frame is due or an event arrives.
+                    Leave unset to pick "sleep" or "spin" based on yieldTimeSlice.
+    frameRate       Target main loop cycles per second (0 = as fast as idleMode allows)
+    statsLogInterval  Log main loop timing stats every this many seconds (0 = disable)
+    clockSource     Where time values come from: "system" (the OS's monotonic clock)
+                    or "tsc" (the CPU timestamp counter; cheaper to read, but needs
+                    an invariant TSC -- falls back to "system" if unavailable)
 ]]
 yieldTimeSlice = true;
+--idleMode = "wait";
+frameRate = 0;
+statsLogInterval = 0;
+clockSource = "system";
@@ -162,7 +162,7 @@ function RainbowConsoleProgressBarStyle:constructor(saturation, animSpeed)
 end
 
 function RainbowConsoleProgressBarStyle:getFilledStyle(position, filledWidth, totalWidth, step, minStep, maxStep)
-    local i64DiminishFactor<const> = 8388480 -- time.getNow() returns really big numbers; we need to scale it down a lot!
+    local i64DiminishFactor<const> = 838848000 -- time.getNow() returns nanoseconds; we need to scale it down a lot!
     local timeOffset = 0
     if (self.speed ~= nil) then
         timeOffset = math.round(time.getNow() / i64DiminishFactor * (-self.speed) * 10) % totalWidth
@@ -187,7 +187,7 @@ function OceanWaveConsoleProgressBarStyle:constructor(speed)
 end
 
 function OceanWaveConsoleProgressBarStyle:getFilledStyle(position, filledWidth, totalWidth, step, minStep, maxStep)
-    local i64DiminishFactor<const> = 16776960 -- time.getNow() returns really big numbers; we need to scale it down a lot!
+    local i64DiminishFactor<const> = 1677696000 -- time.getNow() returns nanoseconds; we need to scale it down a lot!
     local timeOffset<const> = math.round(math.sin(time.getNow() / (i64DiminishFactor / self.speed)) * 10)
     local colors<const> = {21, 25, 26, 27, 31, 32, 33, 37, 38, 39}
     local color<const> = math.round(timeOffset + position) % (#colors - 1) + 1
@@ -33,6 +33,15 @@ end
 function Redis:getResponse(timeout)
     timeout = timeout or DEFAULT_TIMEOUT
 
+    -- Inside a task, wait without holding up the rest of the script
+    if( async.isTask() ) then
+        local recvd = self.socket:recvAsync(timeout * 1000)
+        if( recvd ~= nil ) then
+            return self:parseResponse(recvd)
+        end
+        return nil
+    end
+
     local startTime = time.getNow()
     local recvd
 
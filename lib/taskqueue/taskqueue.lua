@@ -1,12 +1,18 @@
 require("taskqueue/task");
 local __TaskQueue = class.new();
 
+--[[
+	Tasks are backed by the native timer module (see timer.after()), so
+	they fire from the main loop on their own; update() is kept only so
+	that older scripts calling it every frame continue to work.
+--]]
 function __TaskQueue:constructor()
-	-- This is our table for holding upcoming tasks
+	-- Timer IDs of upcoming tasks (so we can cancel them)
 	self.tasks = {};
-	self.lastUpdate = time.getNow();
 end
 
+-- Schedule a function to run after 'trigger' seconds, or at a Timestamp.
+-- Returns an ID that can be given to TaskQueue:cancel()
 function __TaskQueue:push(task, trigger)
 	-- Make sure we were given a task object
 	if( type(task) ~= "function" ) then
@@ -14,27 +20,38 @@ function __TaskQueue:push(task, trigger)
 	end
 
 	-- Need to also know how long until we execute
-	if( not(type(trigger) == "number" or (type(trigger) and trigger.isPast)) ) then
+	local delay;
+	if( type(trigger) == "number" ) then
+		delay = trigger * 1000;
+	elseif( type(trigger) == "table" and trigger.isPast ) then
+		-- Timestamps only have whole second resolution; isPast() is true once we're beyond it
+		delay = (trigger.timevalue - os.time() + 1) * 1000;
+	else
 		error("Argument #2 to TaskQueue:push() needs to be a number or a timestamp.", 2);
 	end
 
-	table.insert(self.tasks, Task(task, trigger));
-end
-
-function __TaskQueue:update()
-	local now = time.getNow();
-	local dt = time.diff(now, self.lastUpdate);
+	local id;
+	id = timer.after(math.max(delay, 0), function()
+		self.tasks[id] = nil;
+		task();
+	end);
+	self.tasks[id] = true;
 
-	for i,v in pairs(self.tasks) do
-		local ret = v:update(dt);
+	return id;
+end
 
-		-- Remove this task
-		if( not ret ) then
-			table.remove(self.tasks, i);
-		end
+-- Cancel a task that has not run yet. Returns true if it was cancelled
+function __TaskQueue:cancel(id)
+	if( not self.tasks[id] ) then
+		return false;
 	end
 
-	self.lastUpdate = now;
+	self.tasks[id] = nil;
+	return timer.cancel(id);
+end
+
+function __TaskQueue:update()
+	-- Nothing to do; timers are driven by the main loop
 end
 
-TaskQueue = __TaskQueue();
\ No newline at end of file
+TaskQueue = __TaskQueue();
@@ -115,6 +115,17 @@ int App::run()
         }
     }
 
+    {   /* Pick the clock before anything starts taking timestamps */
+        std::string clockSourceName = Macro::instance()->getSettings()->getString(CONFVAR_CLOCK_SOURCE, CONFDEFAULT_CLOCK_SOURCE);
+        ClockSource clockSource;
+        if( !parseClockSource(clockSourceName.c_str(), clockSource) )
+            Logger::instance()->add("Unknown %s \'%s\' in config; using \'%s\'.", CONFVAR_CLOCK_SOURCE,
+                clockSourceName.c_str(), getClockSourceName(getClockSource()));
+        else if( !setClockSource(clockSource) )
+            Logger::instance()->add("Clock source \'%s\' is not available on this machine; using \'%s\'.",
+                clockSourceName.c_str(), getClockSourceName(getClockSource()));
+    }
+
     {   /* Initiate our macro singleton */
         int success;
         success = Macro::instance()->init();
@@ -634,6 +645,11 @@ int App::loadConfig(const char *filename)
     ival = getConfigInt(lstate, CONFVAR_MEMORY_STRING_BUFFER_SIZE, CONFDEFAULT_MEMORY_STRING_BUFFER_SIZE);
     psettings->setInt(CONFVAR_MEMORY_STRING_BUFFER_SIZE, ival);
 
+    ival = getConfigInt(lstate, CONFVAR_MEMORY_SCAN_THREADS, CONFDEFAULT_MEMORY_SCAN_THREADS);
+    if( ival < 0 )
+        ival = CONFDEFAULT_MEMORY_SCAN_THREADS;
+    psettings->setInt(CONFVAR_MEMORY_SCAN_THREADS, ival);
+
     ival = getConfigInt(lstate, CONFVAR_LOG_REMOVAL_DAYS, CONFDEFAULT_LOG_REMOVAL_DAYS);
     psettings->setInt(CONFVAR_LOG_REMOVAL_DAYS, ival);
 
@@ -653,8 +669,8 @@ int App::loadConfig(const char *filename)
     ival = getConfigInt(lstate, CONFVAR_NETWORK_BUFFER_SIZE, CONFDEFAULT_NETWORK_BUFFER_SIZE);
     if( ival < 16 ) // Make sure it is reasonable...
         ival = CONFDEFAULT_NETWORK_BUFFER_SIZE;
-    if( ival > 65535 ) // Maximum packet size
-        ival = 65535;
+    if( ival > EVENTDATA_MAX_PACKET_SIZE ) // Maximum packet size
+        ival = EVENTDATA_MAX_PACKET_SIZE;
     psettings->setInt(CONFVAR_NETWORK_BUFFER_SIZE, ival);
 
     ival = getConfigInt(lstate, CONFVAR_RECV_QUEUE_SIZE, CONFDEFAULT_RECV_QUEUE_SIZE);
@@ -668,6 +684,32 @@ int App::loadConfig(const char *filename)
     ival = getConfigInt(lstate, CONFVAR_YIELD_TIME_SLICE, CONFDEFAULT_YIELD_TIME_SLICE);
     psettings->setInt(CONFVAR_YIELD_TIME_SLICE, ival);
 
+    szval = getConfigString(lstate, CONFVAR_IDLE_MODE, CONFDEFAULT_IDLE_MODE);
+    psettings->setString(CONFVAR_IDLE_MODE, szval);
+
+    ival = getConfigInt(lstate, CONFVAR_FRAME_RATE, CONFDEFAULT_FRAME_RATE);
+    if( ival < 0 )
+        ival = CONFDEFAULT_FRAME_RATE;
+    psettings->setInt(CONFVAR_FRAME_RATE, ival);
+
+    ival = getConfigInt(lstate, CONFVAR_STATS_LOG_INTERVAL, CONFDEFAULT_STATS_LOG_INTERVAL);
+    if( ival < 0 )
+        ival = CONFDEFAULT_STATS_LOG_INTERVAL;
+    psettings->setInt(CONFVAR_STATS_LOG_INTERVAL, ival);
+
+    szval = getConfigString(lstate, CONFVAR_CLOCK_SOURCE, CONFDEFAULT_CLOCK_SOURCE);
+    psettings->setString(CONFVAR_CLOCK_SOURCE, szval);
+
+    fval = getConfigFloat(lstate, CONFVAR_GAMEPAD_DEADZONE, CONFDEFAULT_GAMEPAD_DEADZONE);
+    if( fval < 0.0 || fval > 100.0 )
+        fval = CONFDEFAULT_GAMEPAD_DEADZONE;
+    psettings->setFloat(CONFVAR_GAMEPAD_DEADZONE, fval);
+
+    fval = getConfigFloat(lstate, CONFVAR_GAMEPAD_AXIS_MIN_DELTA, CONFDEFAULT_GAMEPAD_AXIS_MIN_DELTA);
+    if( fval < 0.0 )
+        fval = CONFDEFAULT_GAMEPAD_AXIS_MIN_DELTA;
+    psettings->setFloat(CONFVAR_GAMEPAD_AXIS_MIN_DELTA, fval);
+
     ival = getConfigInt(lstate, CONFVAR_STYLE_ERRORS, CONFDEFAULT_STYLE_ERRORS);
     psettings->setInt(CONFVAR_STYLE_ERRORS, ival);
 
@@ -1163,7 +1205,23 @@ int App::runCommandFromFolder(const char *cmdFilePath, std::vector<std::string>
 
 void App::runScript(std::vector<std::string> args)
 {
-    bool yieldTimeSlice = Macro::instance()->getSettings()->getInt(CONFVAR_YIELD_TIME_SLICE, CONFDEFAULT_YIELD_TIME_SLICE);
+    {   /* Set up main loop pacing */
+        Settings *psettings = Macro::instance()->getSettings();
+        bool yieldTimeSlice = psettings->getInt(CONFVAR_YIELD_TIME_SLICE, CONFDEFAULT_YIELD_TIME_SLICE);
+        std::string idleModeName = psettings->getString(CONFVAR_IDLE_MODE, CONFDEFAULT_IDLE_MODE);
+
+        MicroMacro::IdleMode idleMode = yieldTimeSlice ? MicroMacro::IDLE_SLEEP : MicroMacro::IDLE_SPIN;
+        if( !idleModeName.empty() && !MicroMacro::Scheduler::parseIdleMode(idleModeName.c_str(), idleMode) )
+            Logger::instance()->add("Unknown %s \'%s\' in config; using \'%s\'.", CONFVAR_IDLE_MODE,
+                idleModeName.c_str(), MicroMacro::Scheduler::getIdleModeName(idleMode));
+
+        Macro::instance()->getScheduler()->reset(idleMode,
+            psettings->getInt(CONFVAR_FRAME_RATE, CONFDEFAULT_FRAME_RATE));
+
+        Macro::instance()->getStats()->reset();
+        Macro::instance()->getStats()->setLogInterval(
+            psettings->getInt(CONFVAR_STATS_LOG_INTERVAL, CONFDEFAULT_STATS_LOG_INTERVAL));
+    }
 
     if(args.size() == 0) {
         throw std::out_of_range("Missing arguments");
@@ -1207,6 +1265,8 @@ void App::runScript(std::vector<std::string> args)
     Macro::instance()->pollForegroundWindow();
 
     TimeType lastRepollGamepadMaxIndex = getNow();
+    MicroMacro::LoopStats *pstats = Macro::instance()->getStats();
+    TimeType phaseStart;
     int runState = success;
     while( runState == MicroMacro::ERR_OK )
     {
@@ -1216,8 +1276,12 @@ void App::runScript(std::vector<std::string> args)
             fprintf(stderr, "[WARN]: lua_gettop() is not 0 (zero).\n");
         #endif
 
+        pstats->beginFrame();
+
         // Update window focus
+        phaseStart = getNow();
         Macro::instance()->pollForegroundWindow();
+        pstats->record(MicroMacro::PHASE_FOREGROUND, phaseStart);
 
         // Repoll gamepads if needed
         if( deltaTime(getNow(), lastRepollGamepadMaxIndex) > GAMEPAD_REPOLL_SECONDS )
@@ -1232,11 +1296,13 @@ void App::runScript(std::vector<std::string> args)
         // Handle keyboard held queue
         Macro::instance()->getHid()->handleKeyHeldQueue();
 
-        // Handle keyboard input
+        // Handle keyboard input (times its own phases)
         Macro::instance()->handleHidInput();
 
         // Check for console resize
+        phaseStart = getNow();
         Macro::instance()->pollConsoleResize();
+        pstats->record(MicroMacro::PHASE_CONSOLE_RESIZE, phaseStart);
 
         // Handle hotkeys
         Hid *phid = Macro::instance()->getHid();
@@ -1252,7 +1318,9 @@ void App::runScript(std::vector<std::string> args)
         }
 
         // Handle events
+        phaseStart = getNow();
         success = Macro::instance()->handleEvents();
+        pstats->record(MicroMacro::PHASE_EVENTS, phaseStart);
         if( success != MicroMacro::ERR_OK )
         {
             LuaEngine *E = Macro::instance()->getEngine();
@@ -1274,11 +1342,29 @@ void App::runScript(std::vector<std::string> args)
         }
 
         // Dispatch messages before running macro.main() func
+        phaseStart = getNow();
         runState = Macro::instance()->getEngine()->dispatchWindowsMessages();
+        pstats->record(MicroMacro::PHASE_MESSAGES, phaseStart);
 
         if( runState == MicroMacro::ERR_OK )
         {   // Run main callback
+            phaseStart = getNow();
             runState = Macro::instance()->getEngine()->runMain();
+            pstats->record(MicroMacro::PHASE_MAIN, phaseStart);
+        }
+
+        if( runState == MicroMacro::ERR_OK )
+        {   // Fire any timers that are due
+            phaseStart = getNow();
+            runState = Macro::instance()->getEngine()->runTimers();
+            pstats->record(MicroMacro::PHASE_TIMERS, phaseStart);
+        }
+
+        if( runState == MicroMacro::ERR_OK )
+        {   // Resume any tasks whose waits have completed
+            phaseStart = getNow();
+            runState = Macro::instance()->getEngine()->runTasks();
+            pstats->record(MicroMacro::PHASE_TASKS, phaseStart);
         }
 
         if( runState == MicroMacro::ERR_CLOSE )
@@ -1309,10 +1395,11 @@ void App::runScript(std::vector<std::string> args)
             return;
         }
 
-        // Don't waste CPU cycles
-        if( yieldTimeSlice )
-            Sleep(1);
-        else
-            Sleep(0);
+        pstats->logIfDue();
+
+        // Don't waste CPU cycles; idle until the next frame, deadline, or event
+        phaseStart = getNow();
+        Macro::instance()->getScheduler()->idle();
+        pstats->record(MicroMacro::PHASE_IDLE, phaseStart);
     }
 }
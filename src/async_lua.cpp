@@ -0,0 +1,489 @@
+/******************************************************************************
+    Project:    MicroMacro
+    Author:     SolarStrike Software
+    URL:        www.solarstrike.net
+    License:    Modified BSD (see license.txt)
+******************************************************************************/
+
+#include "async_lua.h"
+#include "luaengine.h"
+#include "luatypes.h"
+#include "error.h"
+#include "macro.h"
+#include "types.h"
+
+#ifdef NETWORKING_ENABLED
+    #include "socket_lua.h"
+#endif
+
+extern "C"
+{
+#include <lua.h>
+#include <lauxlib.h>
+#include <lualib.h>
+}
+
+std::vector<Async_lua::Task *> Async_lua::tasks;
+std::map<lua_State *, Async_lua::Task *> Async_lua::taskByThread;
+unsigned int Async_lua::eventWaiters = 0;
+
+int Async_lua::regmod(lua_State *L)
+{
+    static const luaL_Reg _funcs[] = {
+        {"sleep", Async_lua::sleep},
+        {"waitEvent", Async_lua::waitEvent},
+        {"yield", Async_lua::yield},
+        {"isTask", Async_lua::isTask},
+        {"count", Async_lua::count},
+        {NULL, NULL}
+    };
+
+    luaL_newlib(L, _funcs);
+    lua_setglobal(L, ASYNC_MODULE_NAME);
+
+    return MicroMacro::ERR_OK;
+}
+
+// Called before the Lua state is closed; any references die with it
+int Async_lua::cleanup(lua_State *)
+{
+    for(size_t i = 0; i < tasks.size(); i++)
+        delete tasks.at(i);
+
+    tasks.clear();
+    taskByThread.clear();
+    eventWaiters = 0;
+
+    return MicroMacro::ERR_OK;
+}
+
+// Looks up the task that is currently running; raises an error if we're not inside one
+Async_lua::Task *Async_lua::getCurrentTask(lua_State *L, const char *funcName)
+{
+    std::map<lua_State *, Task *>::iterator found = taskByThread.find(L);
+    if( found == taskByThread.end() )
+    {
+        luaL_error(L, "%s() must be called from within a task (see macro.spawn()).", funcName);
+        return NULL;
+    }
+
+    return found->second;
+}
+
+// Set the task's deadline to 'msecs' from now; negative means no deadline
+void Async_lua::setDeadline(Task *task, double msecs)
+{
+    task->hasDeadline = (msecs >= 0);
+    if( !task->hasDeadline )
+        return;
+
+    task->wakeAt = getNow();
+    task->wakeAt.QuadPart += (LONGLONG)(getFrequency().QuadPart * msecs / 1000.0);
+}
+
+/*  Resume a task with 'nargs' values already on its stack.
+    On error, the message (with a traceback of the task) is stored
+    into errMsg and the task is discarded.
+*/
+int Async_lua::resume(lua_State *L, Task *task, int nargs, std::string &errMsg)
+{
+    task->wait = WAIT_READY;
+    task->hasDeadline = false;
+
+    // Make sure CTRL+C and the profiler can interrupt the task
+    lua_State *prevHookTarget = LuaEngine::setHookTarget(task->thread);
+    int nresults = 0;
+    int status = lua_resume(task->thread, L, nargs, &nresults);
+    LuaEngine::setHookTarget(prevHookTarget);
+
+    if( status == LUA_YIELD )
+    {   // Anything passed to a plain coroutine.yield() is discarded
+        lua_pop(task->thread, nresults);
+        return MicroMacro::ERR_OK;
+    }
+
+    if( status != LUA_OK )
+    {
+        const char *msg = lua_tostring(task->thread, -1);
+        luaL_traceback(L, task->thread, msg ? msg : "(error object is not a string)", 0);
+        errMsg = lua_tostring(L, -1);
+        lua_pop(L, 1);
+    }
+
+    release(L, task);
+    return (status == LUA_OK) ? MicroMacro::ERR_OK : mapLuaError(status);
+}
+
+/*  Mark a task as finished. It is removed from the list (and deleted)
+    the next time runTasks() passes over it, as we may be iterating the
+    list right now.
+*/
+void Async_lua::release(lua_State *L, Task *task)
+{
+    taskByThread.erase(task->thread);
+    luaL_unref(L, LUA_REGISTRYINDEX, task->threadRef);
+    luaL_unref(L, LUA_REGISTRYINDEX, task->socketRef);
+    luaL_unref(L, LUA_REGISTRYINDEX, task->resultRef);
+
+    task->thread = NULL;
+    task->threadRef = LUA_NOREF;
+    task->socketRef = LUA_NOREF;
+    task->resultRef = LUA_NOREF;
+}
+
+int Async_lua::yieldTask(lua_State *L, Task *task, TaskWait wait)
+{
+    task->wait = wait;
+    return lua_yield(L, 0);
+}
+
+/*  Resumes every task whose wait has completed. Call once per logic cycle,
+    after events have been dispatched.
+    Also lets the main loop know when it next needs to wake for us.
+*/
+int Async_lua::runTasks(lua_State *L, std::string &errMsg)
+{
+    if( tasks.empty() )
+        return MicroMacro::ERR_OK;
+
+    TimeType now = getNow();
+    int success = MicroMacro::ERR_OK;
+
+    // Tasks spawned while we're in here wait until the next cycle
+    size_t pending = tasks.size();
+    for(size_t i = 0; i < pending && success == MicroMacro::ERR_OK; i++)
+    {
+        Task *task = tasks.at(i);
+        if( !task->thread )
+            continue;
+
+        bool expired = task->hasDeadline && now.QuadPart >= task->wakeAt.QuadPart;
+        int nargs = -1;
+        switch( task->wait )
+        {
+            case WAIT_READY:
+                nargs = 0;
+                break;
+
+            case WAIT_SLEEP:
+                if( expired )
+                    nargs = 0;
+                break;
+
+            case WAIT_EVENT:
+                if( task->resultRef != LUA_NOREF )
+                {   // Unpack the event into the task's stack
+                    lua_rawgeti(L, LUA_REGISTRYINDEX, task->resultRef);
+                    nargs = (int)lua_rawlen(L, -1);
+                    luaL_checkstack(task->thread, nargs, NULL);
+                    for(int j = 1; j <= nargs; j++)
+                    {
+                        lua_rawgeti(L, -1, j);
+                        lua_xmove(L, task->thread, 1);
+                    }
+                    lua_pop(L, 1);
+
+                    luaL_unref(L, LUA_REGISTRYINDEX, task->resultRef);
+                    task->resultRef = LUA_NOREF;
+                }
+                else if( expired )
+                {
+                    --eventWaiters;
+                    lua_pushnil(task->thread);
+                    nargs = 1;
+                }
+                break;
+
+            case WAIT_SOCKET:
+                #ifdef NETWORKING_ENABLED
+                if( !task->socket )
+                {   // Deleted out from under us
+                    lua_pushnil(task->thread);
+                    lua_pushliteral(task->thread, "closed");
+                    nargs = 2;
+                }
+                else if( task->socket->mutex.lock(DEFAULT_LOCK_TIMEOUT, __FUNCTION__) )
+                {
+                    if( !task->socket->recvQueue.empty() )
+                    {
+                        const MicroMacro::EventData &front = task->socket->recvQueue.front();
+                        lua_pushlstring(task->thread, front.getString(), front.length);
+                        task->socket->recvQueue.pop();
+                        nargs = 1;
+                    }
+                    else if( !task->socket->open )
+                    {
+                        lua_pushnil(task->thread);
+                        lua_pushliteral(task->thread, "closed");
+                        nargs = 2;
+                    }
+
+                    task->socket->mutex.unlock(__FUNCTION__);
+                }
+                #endif
+
+                if( nargs < 0 && expired )
+                {
+                    lua_pushnil(task->thread);
+                    lua_pushliteral(task->thread, "timeout");
+                    nargs = 2;
+                }
+
+                if( nargs >= 0 )
+                {
+                    luaL_unref(L, LUA_REGISTRYINDEX, task->socketRef);
+                    task->socketRef = LUA_NOREF;
+                    task->socket = NULL;
+                }
+                break;
+        }
+
+        if( nargs >= 0 )
+            success = resume(L, task, nargs, errMsg);
+    }
+
+    // Drop finished tasks and figure out when we next need to run
+    bool wakeNow = false;
+    bool hasDeadline = false;
+    TimeType deadline;
+    size_t kept = 0;
+    for(size_t i = 0; i < tasks.size(); i++)
+    {
+        Task *task = tasks.at(i);
+        if( !task->thread )
+        {
+            delete task;
+            continue;
+        }
+        tasks[kept++] = task;
+
+        if( task->wait == WAIT_READY || task->resultRef != LUA_NOREF )
+            wakeNow = true;
+        else if( task->hasDeadline && (!hasDeadline || task->wakeAt.QuadPart < deadline.QuadPart) )
+        {
+            deadline = task->wakeAt;
+            hasDeadline = true;
+        }
+    }
+    tasks.resize(kept);
+
+    if( wakeNow )
+        Macro::instance()->getScheduler()->requestWakeAt(getNow());
+    else if( hasDeadline )
+        Macro::instance()->getScheduler()->requestWakeAt(deadline);
+
+    return success;
+}
+
+bool Async_lua::hasEventWaiters()
+{
+    return eventWaiters > 0;
+}
+
+/*  Hands an event to any tasks waiting on it. Expects the event's
+    values (name first) on top of the stack, and pops them.
+    Tasks are resumed by the next runTasks().
+*/
+void Async_lua::deliverEvent(lua_State *L, int nargs)
+{
+    int base = lua_gettop(L) - nargs + 1;
+    const char *name = (nargs > 0) ? lua_tostring(L, base) : NULL;
+
+    for(size_t i = 0; name && eventWaiters > 0 && i < tasks.size(); i++)
+    {
+        Task *task = tasks.at(i);
+        if( !task->thread || task->wait != WAIT_EVENT || task->resultRef != LUA_NOREF
+            || task->eventName.compare(name) != 0 )
+            continue;
+
+        lua_createtable(L, nargs, 0);
+        for(int j = 0; j < nargs; j++)
+        {
+            lua_pushvalue(L, base + j);
+            lua_rawseti(L, -2, j + 1);
+        }
+        task->resultRef = luaL_ref(L, LUA_REGISTRYINDEX);
+        --eventWaiters;
+    }
+
+    lua_pop(L, nargs);
+}
+
+#ifdef NETWORKING_ENABLED
+// Receive from the socket at index 1, yielding the current task until there is data
+int Async_lua::recvAsync(lua_State *L, MicroMacro::Socket *pSocket, double timeoutMsecs)
+{
+    int retVal = -1;
+    if( pSocket->mutex.lock(DEFAULT_LOCK_TIMEOUT, __FUNCTION__) )
+    {
+        if( !pSocket->recvQueue.empty() )
+        {
+            lua_pushlstring(L, pSocket->recvQueue.front().getString(), pSocket->recvQueue.front().length);
+            pSocket->recvQueue.pop();
+            retVal = 1;
+        }
+        else if( !pSocket->open )
+        {
+            lua_pushnil(L);
+            lua_pushliteral(L, "closed");
+            retVal = 2;
+        }
+
+        pSocket->mutex.unlock(__FUNCTION__);
+    }
+
+    if( retVal >= 0 )
+        return retVal;
+
+    Task *task = getCurrentTask(L, "socket:recvAsync");
+    task->socket = pSocket;
+    lua_pushvalue(L, 1);
+    task->socketRef = luaL_ref(L, LUA_REGISTRYINDEX);
+    setDeadline(task, timeoutMsecs);
+
+    return yieldTask(L, task, WAIT_SOCKET);
+}
+
+// The socket is about to be deleted; wake anything waiting on it
+void Async_lua::socketDeleted(MicroMacro::Socket *pSocket)
+{
+    for(size_t i = 0; i < tasks.size(); i++)
+    {
+        if( tasks.at(i)->socket == pSocket )
+            tasks.at(i)->socket = NULL;
+    }
+}
+#endif
+
+/*  macro.spawn(function fn [, ...])
+    Returns:    thread
+
+    Runs 'fn' (with any additional arguments) as a task: a
+    coroutine driven by the main loop. The task runs immediately
+    until it first waits (async.sleep(), async.waitEvent(),
+    socket:recvAsync(), ...), and is then resumed by the main
+    loop once whatever it waits on is ready; other tasks and
+    macro.main() keep running in the meantime.
+
+    An error inside a task ends the script, just like an error
+    in macro.main() would.
+*/
+int Async_lua::spawn(lua_State *L)
+{
+    int top = lua_gettop(L);
+    if( top < 1 )
+        wrongArgs(L);
+    checkType(L, LT_FUNCTION, 1);
+
+    Task *task = new Task;
+    task->thread = lua_newthread(L);
+    lua_pushvalue(L, -1);
+    task->threadRef = luaL_ref(L, LUA_REGISTRYINDEX);
+    task->wait = WAIT_READY;
+    task->hasDeadline = false;
+    task->socket = NULL;
+    task->socketRef = LUA_NOREF;
+    task->resultRef = LUA_NOREF;
+
+    tasks.push_back(task);
+    taskByThread[task->thread] = task;
+
+    // Move a copy of the function and its arguments over to the new thread
+    for(int i = 1; i <= top; i++)
+        lua_pushvalue(L, i);
+    lua_xmove(L, task->thread, top);
+
+    std::string errMsg;
+    if( resume(L, task, top - 1, errMsg) != MicroMacro::ERR_OK )
+        return luaL_error(L, "%s", errMsg.c_str());
+
+    return 1;
+}
+
+/*  async.sleep(number msecs)
+    Returns:    nil
+
+    Suspends the current task for (at least) 'msecs' milliseconds
+    without blocking the rest of the script.
+    Must be called from within a task (see macro.spawn()).
+*/
+int Async_lua::sleep(lua_State *L)
+{
+    if( lua_gettop(L) != 1 )
+        wrongArgs(L);
+    checkType(L, LT_NUMBER, 1);
+
+    Task *task = getCurrentTask(L, "async.sleep");
+    setDeadline(task, lua_tonumber(L, 1) > 0 ? lua_tonumber(L, 1) : 0);
+
+    return yieldTask(L, task, WAIT_SLEEP);
+}
+
+/*  async.waitEvent(string name [, number timeout])
+    Returns (on event):     string name, ...
+    Returns (on timeout):   nil
+
+    Suspends the current task until the next event named 'name'
+    (ie. "keypressed") is dispatched, and returns that event's
+    values, the same as macro.event() receives them. If 'timeout'
+    (in milliseconds) is given and passes first, returns nil.
+    Must be called from within a task (see macro.spawn()).
+*/
+int Async_lua::waitEvent(lua_State *L)
+{
+    int top = lua_gettop(L);
+    if( top != 1 && top != 2 )
+        wrongArgs(L);
+    checkType(L, LT_STRING, 1);
+    if( top >= 2 )
+        checkType(L, LT_NIL | LT_NUMBER, 2);
+
+    Task *task = getCurrentTask(L, "async.waitEvent");
+    task->eventName = lua_tostring(L, 1);
+    task->resultRef = LUA_NOREF;
+    setDeadline(task, lua_isnumber(L, 2) ? lua_tonumber(L, 2) : -1);
+    ++eventWaiters;
+
+    return yieldTask(L, task, WAIT_EVENT);
+}
+
+/*  async.yield()
+    Returns:    nil
+
+    Suspends the current task until the next logic cycle.
+    Must be called from within a task (see macro.spawn()).
+*/
+int Async_lua::yield(lua_State *L)
+{
+    if( lua_gettop(L) != 0 )
+        wrongArgs(L);
+
+    Task *task = getCurrentTask(L, "async.yield");
+    return yieldTask(L, task, WAIT_READY);
+}
+
+/*  async.isTask()
+    Returns:    boolean
+
+    Returns true if called from within a task (see macro.spawn());
+    that is, if it is safe to call functions that wait.
+*/
+int Async_lua::isTask(lua_State *L)
+{
+    lua_pushboolean(L, taskByThread.find(L) != taskByThread.end());
+    return 1;
+}
+
+/*  async.count()
+    Returns:    number
+
+    Returns the number of tasks that have not yet finished.
+*/
+int Async_lua::count(lua_State *L)
+{
+    if( lua_gettop(L) != 0 )
+        wrongArgs(L);
+
+    lua_pushinteger(L, taskByThread.size());
+    return 1;
+}
@@ -0,0 +1,80 @@
+/******************************************************************************
+	Project: 	MicroMacro
+	Author: 	SolarStrike Software
+	URL:		www.solarstrike.net
+	License:	Modified BSD (see license.txt)
+******************************************************************************/
+
+#ifndef ASYNC_LUA_H
+#define ASYNC_LUA_H
+
+	#include "timer.h"
+	#include <map>
+	#include <vector>
+	#include <string>
+
+	#define ASYNC_MODULE_NAME		"async"
+
+	typedef struct lua_State lua_State;
+
+	namespace MicroMacro
+	{
+		struct Socket;
+	}
+
+	class Async_lua
+	{
+		protected:
+			enum TaskWait
+			{
+				WAIT_READY,					// Resume on the next cycle
+				WAIT_SLEEP,					// Resume once wakeAt has passed
+				WAIT_EVENT,					// Resume when an event named eventName is dispatched
+				WAIT_SOCKET					// Resume when the socket has data (or closes)
+			};
+
+			struct Task
+			{
+				lua_State *thread;
+				int threadRef;				// Registry reference; keeps the coroutine alive
+				TaskWait wait;
+				bool hasDeadline;
+				TimeType wakeAt;			// Sleep target, or timeout for event/socket waits
+				std::string eventName;
+				MicroMacro::Socket *socket;
+				int socketRef;				// Keeps the socket's userdata alive while we wait
+				int resultRef;				// Table of values to resume with, if already known
+			};
+
+			static std::vector<Task *> tasks;
+			static std::map<lua_State *, Task *> taskByThread;
+			static unsigned int eventWaiters;
+
+			static Task *getCurrentTask(lua_State *, const char *);
+			static void setDeadline(Task *, double);
+			static int resume(lua_State *, Task *, int, std::string &);
+			static void release(lua_State *, Task *);
+			static int yieldTask(lua_State *, Task *, TaskWait);
+
+			static int sleep(lua_State *);
+			static int waitEvent(lua_State *);
+			static int yield(lua_State *);
+			static int isTask(lua_State *);
+			static int count(lua_State *);
+
+		public:
+			static int regmod(lua_State *);
+			static int cleanup(lua_State *);
+
+			static int spawn(lua_State *);
+			static int runTasks(lua_State *, std::string &);
+			static bool hasEventWaiters();
+			static void deliverEvent(lua_State *, int);
+
+			#ifdef NETWORKING_ENABLED
+			static int recvAsync(lua_State *, MicroMacro::Socket *, double);
+			static void socketDeleted(MicroMacro::Socket *);
+			#endif
+	};
+
+#endif
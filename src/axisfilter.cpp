@@ -0,0 +1,115 @@
+/******************************************************************************
+    Project:    MicroMacro
+    Author:     SolarStrike Software
+    URL:        www.solarstrike.net
+    License:    Modified BSD (see license.txt)
+******************************************************************************/
+
+#include "axisfilter.h"
+
+#include <math.h>
+
+namespace MicroMacro
+{
+    AxisFilter::AxisFilter()
+    {
+        setDefaults(0.0f, 0.0f);
+        reset();
+    }
+
+    // Apply the same dead zone and minimum delta to every axis
+    void AxisFilter::setDefaults(float deadzone, float minDelta)
+    {
+        for(unsigned int a = 1; a <= GAMEPAD_AXIS_COUNT; a++)
+            setSettings(a, deadzone, minDelta);
+    }
+
+    bool AxisFilter::setSettings(int axisId, float deadzone, float minDelta)
+    {
+        if( axisId < 1 || axisId > GAMEPAD_AXIS_COUNT )
+            return false;
+
+        AxisFilterSettings &s = settings[axisId - 1];
+        s.deadzone = deadzone < 0.0f ? 0.0f : (deadzone > 100.0f ? 100.0f : deadzone);
+        s.minDelta = minDelta < 0.0f ? 0.0f : minDelta;
+        return true;
+    }
+
+    bool AxisFilter::getSettings(int axisId, AxisFilterSettings &out)
+    {
+        if( axisId < 1 || axisId > GAMEPAD_AXIS_COUNT )
+            return false;
+
+        out = settings[axisId - 1];
+        return true;
+    }
+
+    float AxisFilter::applyDeadzone(int axisId, float value)
+    {
+        float deflection = fabs(value - AXIS_CENTER) / AXIS_CENTER * 100.0f;
+        if( deflection < settings[axisId - 1].deadzone )
+            return AXIS_CENTER;
+        return value;
+    }
+
+    /*  Feed in a new reading (0-100) for a pad's axis. Returns true if
+        an event should be queued for it, with the value to report in
+        'value'. Returns false if the change is noise, or an event for
+        this axis is already queued (it will pick up this reading).
+    */
+    bool AxisFilter::update(int padId, int axisId, float raw, float &value)
+    {
+        if( padId < 0 || padId >= GAMEPADS || axisId < 1 || axisId > GAMEPAD_AXIS_COUNT )
+            return false;
+
+        AxisState &state = states[padId][axisId - 1];
+        state.latest = applyDeadzone(axisId, raw);
+        if( state.queued || state.latest == state.reported )
+            return false;
+
+        // Always let the axis settle at center or an end, however small the step
+        bool settled = state.latest == AXIS_CENTER || state.latest <= 0.0f || state.latest >= 100.0f;
+        if( !settled && fabs(state.latest - state.reported) < settings[axisId - 1].minDelta )
+            return false;
+
+        value = state.latest;
+        return true;
+    }
+
+    // The event update() asked for was successfully queued
+    void AxisFilter::markQueued(int padId, int axisId)
+    {
+        if( padId < 0 || padId >= GAMEPADS || axisId < 1 || axisId > GAMEPAD_AXIS_COUNT )
+            return;
+
+        AxisState &state = states[padId][axisId - 1];
+        state.queued = true;
+        state.reported = state.latest;
+    }
+
+    // An axis event is being dispatched; returns the value it should carry
+    float AxisFilter::takeLatest(int padId, int axisId)
+    {
+        if( padId < 0 || padId >= GAMEPADS || axisId < 1 || axisId > GAMEPAD_AXIS_COUNT )
+            return AXIS_CENTER;
+
+        AxisState &state = states[padId][axisId - 1];
+        state.queued = false;
+        state.reported = state.latest;
+        return state.latest;
+    }
+
+    // Forget what was reported; ie. after queued events were thrown away
+    void AxisFilter::reset()
+    {
+        for(unsigned int i = 0; i < GAMEPADS; i++)
+        {
+            for(unsigned int a = 0; a < GAMEPAD_AXIS_COUNT; a++)
+            {
+                states[i][a].reported = AXIS_CENTER;
+                states[i][a].latest = AXIS_CENTER;
+                states[i][a].queued = false;
+            }
+        }
+    }
+}
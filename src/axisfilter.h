@@ -0,0 +1,59 @@
+/******************************************************************************
+	Project: 	MicroMacro
+	Author: 	SolarStrike Software
+	URL:		www.solarstrike.net
+	License:	Modified BSD (see license.txt)
+******************************************************************************/
+
+#ifndef AXISFILTER_H
+#define AXISFILTER_H
+
+	#include "hid.h"
+
+	#define AXIS_CENTER				50.0f
+
+	namespace MicroMacro
+	{
+		struct AxisFilterSettings
+		{
+			float deadzone;			// Percent of deflection from center that reads as centered
+			float minDelta;			// Smallest change (in axis units, 0-100) worth reporting
+		};
+
+		/*	Decides which gamepad axis movements become events. Values
+			inside the dead zone snap to center and changes smaller than
+			the minimum delta are ignored. While an axis event is waiting
+			in the queue no other is queued for that pad and axis; instead
+			it is given the latest value when dispatched.
+			Axis IDs are 1-based, as in Hid; pad IDs are 0-based.
+		*/
+		class AxisFilter
+		{
+			protected:
+				struct AxisState
+				{
+					float reported;		// Last value queued for the script
+					float latest;		// Most recent filtered reading
+					bool queued;		// An event for this axis is waiting to be dispatched
+				};
+
+				AxisFilterSettings settings[GAMEPAD_AXIS_COUNT];
+				AxisState states[GAMEPADS][GAMEPAD_AXIS_COUNT];
+
+				float applyDeadzone(int, float);
+
+			public:
+				AxisFilter();
+
+				void setDefaults(float, float);
+				bool setSettings(int, float, float);
+				bool getSettings(int, AxisFilterSettings &);
+
+				bool update(int, int, float, float &);
+				void markQueued(int, int);
+				float takeLatest(int, int);
+				void reset();
+		};
+	}
+
+#endif
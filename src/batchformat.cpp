@@ -0,0 +1,243 @@
+/******************************************************************************
+    Project:    MicroMacro
+    Author:     SolarStrike Software
+    URL:        www.solarstrike.net
+    License:    Modified BSD (see license.txt)
+******************************************************************************/
+
+#include "batchformat.h"
+
+namespace MicroMacro
+{
+    struct FormatType
+    {
+        char c;
+        BatchJob_type type;
+        size_t size;
+    };
+
+    static const FormatType formatTypes[] = {
+        {'b', MEM_BYTE, sizeof(char)},
+        {'B', MEM_UBYTE, sizeof(unsigned char)},
+        {'s', MEM_SHORT, sizeof(short)},
+        {'S', MEM_USHORT, sizeof(unsigned short)},
+        {'i', MEM_INT, sizeof(int)},
+        {'I', MEM_UINT, sizeof(unsigned int)},
+        {'h', MEM_INT64, sizeof(long long)},
+        {'H', MEM_UINT64, sizeof(unsigned long long)},
+        {'f', MEM_FLOAT, sizeof(float)},
+        {'F', MEM_DOUBLE, sizeof(double)},
+        {'c', MEM_STRING, sizeof(char)},
+        {'_', MEM_SKIP, sizeof(char)},
+        {0, MEM_SKIP, 0}
+    };
+
+    static const FormatType *getFormatType(char c)
+    {
+        for(unsigned int i = 0; formatTypes[i].c != 0; i++)
+        {
+            if( formatTypes[i].c == c )
+                return &formatTypes[i];
+        }
+        return NULL;
+    }
+
+    // Reads a decimal number and advances past it; false if there isn't one
+    static bool readNumber(const char *&p, unsigned int &out, std::string &err)
+    {
+        if( *p < '0' || *p > '9' )
+            return false;
+
+        unsigned long long value = 0;
+        while( *p >= '0' && *p <= '9' )
+        {
+            value = value * 10 + (*p - '0');
+            if( value > BATCH_FORMAT_MAX_NUMBER )
+            {
+                err = "Number too large in format";
+                return false;
+            }
+            ++p;
+        }
+
+        out = (unsigned int)value;
+        return true;
+    }
+
+    // cursor += count * size, unless that would overflow
+    static bool advance(size_t &cursor, size_t count, size_t size, std::string &err)
+    {
+        if( size != 0 && count > ((size_t)-1 - cursor) / size )
+        {
+            err = "Format describes more memory than can be read";
+            return false;
+        }
+        cursor += count * size;
+        return true;
+    }
+
+    /*  Compiles jobs up to the end of the format or a closing parenthesis.
+        'cursor' ends up where the next value would go, and 'extent' at the
+        end of the furthest value read, both relative to the start of this
+        group.
+    */
+    static bool compileGroup(const char *&p, std::vector<BatchJob> &jobs, unsigned int depth,
+                             size_t &cursor, size_t &extent, std::string &err)
+    {
+        cursor = 0;
+        extent = 0;
+
+        while( *p != 0 )
+        {
+            if( *p == ')' )
+            {
+                if( depth == 0 )
+                {
+                    err = "Unmatched ')' in format";
+                    return false;
+                }
+                return true;
+            }
+
+            unsigned int count = 1;
+            bool counted = readNumber(p, count, err);
+            if( !err.empty() )
+                return false;
+
+            char c = *p;
+            if( c == '@' || c == '!' )
+            {   // Explicit offset, or alignment
+                unsigned int value = 0;
+                ++p;
+                if( counted || !readNumber(p, value, err) )
+                {
+                    if( err.empty() )
+                        err = std::string("'") + c + "' must be followed by a number, and not preceded by one";
+                    return false;
+                }
+
+                if( c == '@' )
+                    cursor = value;
+                else if( value == 0 )
+                {
+                    err = "Cannot align to 0";
+                    return false;
+                }
+                else if( cursor % value != 0 && !advance(cursor, 1, value - cursor % value, err) )
+                    return false;
+                continue;
+            }
+
+            if( c == '(' )
+            {   // Repeat group
+                if( depth + 1 >= BATCH_FORMAT_MAX_DEPTH )
+                {
+                    err = "Groups nested too deeply in format";
+                    return false;
+                }
+
+                size_t groupIndex = jobs.size();
+                BatchJob group;
+                group.type = MEM_GROUP;
+                group.count = count;
+                group.offset = cursor;
+                jobs.push_back(group);
+
+                size_t stride = 0;
+                size_t groupExtent = 0;
+                ++p;
+                if( !compileGroup(p, jobs, depth + 1, stride, groupExtent, err) )
+                    return false;
+                if( *p != ')' )
+                {
+                    err = "Missing ')' in format";
+                    return false;
+                }
+                ++p;
+
+                jobs.at(groupIndex).stride = stride;
+                jobs.at(groupIndex).length = (unsigned int)(jobs.size() - groupIndex - 1);
+
+                // The last repeat may read past its stride (by going back with '@')
+                if( count > 0 )
+                {
+                    size_t end = cursor;
+                    if( !advance(end, count - 1, stride, err) || !advance(end, 1, groupExtent, err) )
+                        return false;
+                    if( end > extent )
+                        extent = end;
+                }
+
+                if( !advance(cursor, count, stride, err) )
+                    return false;
+                continue;
+            }
+
+            const FormatType *formatType = getFormatType(c);
+            if( c != 0 )
+                ++p;
+            if( formatType == NULL )
+                continue;   // Spaces, etc.
+
+            if( formatType->type != MEM_SKIP )
+            {
+                BatchJob job;
+                job.type = formatType->type;
+                job.count = count;
+                job.offset = cursor;
+                jobs.push_back(job);
+            }
+
+            if( !advance(cursor, count, formatType->size, err) )
+                return false;
+            if( formatType->type != MEM_SKIP && cursor > extent )
+                extent = cursor;
+        }
+
+        return true;
+    }
+
+    bool BatchFormat::compile(const char *fmt, std::string &err)
+    {
+        jobs.clear();
+        length = 0;
+        err.clear();
+
+        size_t cursor = 0;
+        const char *p = fmt;
+        return compileGroup(p, jobs, 0, cursor, length, err);
+    }
+
+
+    BatchFormatCache::BatchFormatCache(size_t capacity)
+    {
+        this->capacity = capacity;
+    }
+
+    // The compiled format; stays valid until the next call. NULL (and 'err' set) if it is invalid
+    const BatchFormat *BatchFormatCache::get(const char *fmt, std::string &err)
+    {
+        std::string key = fmt;
+        std::unordered_map<std::string, FormatList::iterator>::iterator found = index.find(key);
+        if( found != index.end() )
+        {
+            formats.splice(formats.begin(), formats, found->second);
+            return &formats.front().second;
+        }
+
+        BatchFormat compiled;
+        if( !compiled.compile(fmt, err) )
+            return NULL;
+
+        formats.push_front(std::make_pair(key, compiled));
+        index[key] = formats.begin();
+
+        if( formats.size() > capacity )
+        {
+            index.erase(formats.back().first);
+            formats.pop_back();
+        }
+
+        return &formats.front().second;
+    }
+}
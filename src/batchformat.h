@@ -0,0 +1,59 @@
+/******************************************************************************
+	Project: 	MicroMacro
+	Author: 	SolarStrike Software
+	URL:		www.solarstrike.net
+	License:	Modified BSD (see license.txt)
+******************************************************************************/
+
+#ifndef BATCHFORMAT_H
+#define BATCHFORMAT_H
+
+	#include "types.h"
+	#include <list>
+	#include <string>
+	#include <unordered_map>
+	#include <vector>
+	#include <stddef.h>
+
+	#define BATCH_FORMAT_CACHE_SIZE		64			// Compiled formats kept by each Lua state
+	#define BATCH_FORMAT_MAX_DEPTH		16			// How deeply repeat groups may nest
+	#define BATCH_FORMAT_MAX_NUMBER		0x0FFFFFFF	// Largest count, offset or alignment
+
+	namespace MicroMacro
+	{
+		/*	A process.readBatch() format, compiled.
+			Every job knows its own offset from the start of the group it is
+			in (or of the read, at the top level), so skipping costs nothing
+			when the results are unpacked. A MEM_GROUP job is followed by the
+			'length' jobs that make up its body, which is repeated 'count'
+			times, 'stride' bytes apart.
+		*/
+		struct BatchFormat
+		{
+			std::vector<BatchJob> jobs;
+			size_t length;		// Bytes that must be read
+
+			bool compile(const char *, std::string &);
+		};
+
+		/*	Most recently used formats, so that scripts calling readBatch()
+			with the same few formats every frame only parse them once.
+			Not thread-safe; each Lua state keeps its own.
+		*/
+		class BatchFormatCache
+		{
+			protected:
+				typedef std::list<std::pair<std::string, BatchFormat> > FormatList;
+				FormatList formats;		// Most recently used first
+				std::unordered_map<std::string, FormatList::iterator> index;
+				size_t capacity;
+
+			public:
+				BatchFormatCache(size_t = BATCH_FORMAT_CACHE_SIZE);
+
+				const BatchFormat *get(const char *, std::string &);
+				size_t getCount() const { return formats.size(); }
+		};
+	}
+
+#endif
@@ -0,0 +1,116 @@
+/******************************************************************************
+    Project:    MicroMacro
+    Author:     SolarStrike Software
+    URL:        www.solarstrike.net
+    License:    Modified BSD (see license.txt)
+******************************************************************************/
+
+#include "channel.h"
+#include "timer.h"
+
+using MicroMacro::Channel;
+using MicroMacro::ChannelResult;
+
+Channel::Channel()
+{
+    hSignal = CreateEvent(NULL, FALSE, FALSE, NULL); // Auto-reset
+    closed = false;
+}
+
+Channel::~Channel()
+{
+    if( hSignal )
+        CloseHandle(hSignal);
+    hSignal = NULL;
+}
+
+// Queue a message; returns false if the channel has been closed
+bool Channel::send(std::string &&message)
+{
+    if( !mutex.lock(INFINITE, __FUNCTION__) )
+        return false;
+
+    bool sent = !closed;
+    if( sent )
+        messages.push(std::move(message));
+    mutex.unlock(__FUNCTION__);
+
+    if( sent )
+        SetEvent(hSignal);
+    return sent;
+}
+
+/*  Take the next message, waiting up to 'timeoutMsecs' for one to arrive
+    (INFINITE to wait forever).
+*/
+ChannelResult Channel::receive(std::string &message, unsigned int timeoutMsecs)
+{
+    TimeType start = getNow();
+    while( true )
+    {
+        bool isClosed = false;
+        if( mutex.lock(INFINITE, __FUNCTION__) )
+        {
+            if( !messages.empty() )
+            {
+                message = std::move(messages.front());
+                messages.pop();
+                mutex.unlock(__FUNCTION__);
+                return MicroMacro::CHANNEL_OK;
+            }
+
+            isClosed = closed;
+            mutex.unlock(__FUNCTION__);
+        }
+
+        if( isClosed )
+            return MicroMacro::CHANNEL_CLOSED;
+
+        DWORD wait = timeoutMsecs;
+        if( timeoutMsecs != INFINITE )
+        {
+            double elapsed = deltaTime(getNow(), start) * 1000;
+            if( elapsed >= timeoutMsecs )
+                return MicroMacro::CHANNEL_EMPTY;
+            wait = timeoutMsecs - (DWORD)elapsed;
+        }
+
+        WaitForSingleObject(hSignal, wait);
+    }
+}
+
+// Refuse any further messages and wake up anybody waiting in receive()
+void Channel::close()
+{
+    if( mutex.lock(INFINITE, __FUNCTION__) )
+    {
+        closed = true;
+        mutex.unlock(__FUNCTION__);
+    }
+
+    SetEvent(hSignal);
+}
+
+bool Channel::isClosed()
+{
+    bool isClosed = false;
+    if( mutex.lock(INFINITE, __FUNCTION__) )
+    {
+        isClosed = closed;
+        mutex.unlock(__FUNCTION__);
+    }
+
+    return isClosed;
+}
+
+size_t Channel::size()
+{
+    size_t count = 0;
+    if( mutex.lock(INFINITE, __FUNCTION__) )
+    {
+        count = messages.size();
+        mutex.unlock(__FUNCTION__);
+    }
+
+    return count;
+}
@@ -0,0 +1,55 @@
+/******************************************************************************
+	Project: 	MicroMacro
+	Author: 	SolarStrike Software
+	URL:		www.solarstrike.net
+	License:	Modified BSD (see license.txt)
+******************************************************************************/
+
+#ifndef CHANNEL_H
+#define CHANNEL_H
+
+	#include "wininclude.h"
+	#include "mutex.h"
+	#include <queue>
+	#include <string>
+
+	namespace MicroMacro
+	{
+		enum ChannelResult
+		{
+			CHANNEL_OK,
+			CHANNEL_EMPTY,			// Nothing arrived before the timeout
+			CHANNEL_CLOSED,			// Closed, and everything sent has been received
+		};
+
+		/*	A one-way queue of opaque messages between two threads. Any
+			thread may send; receive() is meant to be called by one thread
+			(the owner of the receiving end) and can block until a message
+			arrives.
+			Once closed, sends are refused but anything already queued can
+			still be received.
+		*/
+		class Channel
+		{
+			private:
+				std::queue<std::string> messages;
+				Mutex mutex;
+				HANDLE hSignal;				// Set whenever a message is sent or the channel closes
+				bool closed;
+
+				Channel(const Channel &);
+				Channel &operator=(const Channel &);
+
+			public:
+				Channel();
+				~Channel();
+
+				bool send(std::string &&);
+				ChannelResult receive(std::string &, unsigned int = 0);
+				void close();
+				bool isClosed();
+				size_t size();
+		};
+	}
+
+#endif
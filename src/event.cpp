@@ -6,17 +6,204 @@
 ******************************************************************************/
 
 #include "event.h"
+#include "pool.h"
 #include "strl.h"
 #include "error.h"
 #include <string.h>
 #include <new>
+#include <stdexcept>
 
-MicroMacro::Event &MicroMacro::Event::operator=(const MicroMacro::Event &o)
+using MicroMacro::Event;
+using MicroMacro::EventData;
+using MicroMacro::EventDataList;
+using MicroMacro::BlockPool;
+
+#define EVENTS_PER_SLAB         64
+
+static BlockPool &getEventPool()
+{
+    static BlockPool pool(sizeof(Event), EVENTS_PER_SLAB);
+    return pool;
+}
+
+// Slots beyond those held inline, for the few events that need them
+static BlockPool &getOverflowPool()
+{
+    static BlockPool pool((CUSTOM_EVENT_DATA_SLOTS - EVENT_INLINE_DATA_SLOTS) * sizeof(EventData), EVENTS_PER_SLAB / 4);
+    return pool;
+}
+
+// Returns the name scripts know this event by (as passed to macro.event())
+const char *MicroMacro::getEventTypeName(EventType type)
+{
+    switch( type )
+    {
+        case EVENT_ERROR:               return "error";
+        case EVENT_WARNING:             return "warning";
+        case EVENT_KEYPRESSED:          return "keypressed";
+        case EVENT_KEYRELEASED:         return "keyreleased";
+        case EVENT_MOUSEPRESSED:        return "mousepressed";
+        case EVENT_MOUSERELEASED:       return "mousereleased";
+        case EVENT_GAMEPADPRESSED:      return "gamepadpressed";
+        case EVENT_GAMEPADRELEASED:     return "gamepadreleased";
+        case EVENT_GAMEPADPOVCHANGED:   return "gamepadpovchanged";
+        case EVENT_GAMEPADAXISCHANGED:  return "gamepadaxischanged";
+        case EVENT_FOCUSCHANGED:        return "focuschanged";
+        case EVENT_CONSOLERESIZED:      return "consoleresized";
+        case EVENT_SOCKETCONNECTED:     return "socketconnected";
+        case EVENT_SOCKETDISCONNECTED:  return "socketdisconnected";
+        case EVENT_SOCKETRECEIVED:      return "socketreceived";
+        case EVENT_SOCKETERROR:         return "socketerror";
+        case EVENT_QUIT:                return "quit";
+        case EVENT_THREADFINISHED:      return "threadfinished";
+        case EVENT_MEMORYCHANGED:       return "memorychanged";
+        case EVENT_CUSTOM:              return "custom";
+        case EVENT_UNKNOWN:
+        default:                        return "unknown";
+    }
+}
+
+EventDataList::EventDataList(const EventDataList &o) : overflow(NULL), count(0)
+{
+    *this = o;
+}
+
+EventDataList::EventDataList(EventDataList &&o) : overflow(NULL), count(0)
+{
+    *this = std::move(o);
+}
+
+EventDataList::~EventDataList()
+{
+    clear();
+}
+
+EventDataList &EventDataList::operator=(const EventDataList &o)
+{
+    if( this == &o )
+        return *this;
+
+    clear();
+    for(size_t i = 0; i < o.count; i++)
+        push_back(*o.slot(i));
+
+    return *this;
+}
+
+EventDataList &EventDataList::operator=(EventDataList &&o)
+{
+    if( this == &o )
+        return *this;
+
+    clear();
+    for(size_t i = 0; i < o.count; i++)
+        push_back(std::move(*o.slot(i)));
+    o.clear();
+
+    return *this;
+}
+
+// Makes sure there is somewhere to put the next piece of data; false if all slots are in use
+bool EventDataList::reserveSlot()
+{
+    if( count >= CUSTOM_EVENT_DATA_SLOTS )
+        return false;
+
+    if( count == EVENT_INLINE_DATA_SLOTS && !overflow )
+    {
+        overflow = static_cast<EventData *>(getOverflowPool().alloc());
+        if( !overflow )
+            return false;
+    }
+    return true;
+}
+
+// Returns false (and discards the data) if all slots are in use
+bool EventDataList::push_back(const EventData &ed)
+{
+    if( !reserveSlot() )
+        return false;
+
+    new (slot(count)) EventData(ed);
+    ++count;
+    return true;
+}
+
+bool EventDataList::push_back(EventData &&ed)
+{
+    if( !reserveSlot() )
+        return false;
+
+    new (slot(count)) EventData(std::move(ed));
+    ++count;
+    return true;
+}
+
+EventData &EventDataList::at(size_t index)
+{
+    if( index >= count )
+        throw std::out_of_range("EventDataList::at");
+
+    return *slot(index);
+}
+
+const EventData &EventDataList::at(size_t index) const
+{
+    if( index >= count )
+        throw std::out_of_range("EventDataList::at");
+
+    return *slot(index);
+}
+
+void EventDataList::clear()
+{
+    while( count > 0 )
+    {
+        --count;
+        slot(count)->~EventData();
+    }
+
+    if( overflow )
+    {
+        getOverflowPool().release(overflow);
+        overflow = NULL;
+    }
+}
+
+Event &Event::operator=(const Event &o)
 {
     type = o.type;
-    data.clear();
-    for(unsigned int i = 0; i < data.size(); i++)
-        data.push_back(o.data.at(i));
+    data = o.data;
 
     return *this;
 }
+
+void *Event::operator new(size_t size)
+{
+    if( size != sizeof(Event) )
+        return ::operator new(size);
+
+    void *ptr = getEventPool().alloc();
+    if( !ptr )
+        throw std::bad_alloc();
+
+    return ptr;
+}
+
+void Event::operator delete(void *ptr, size_t size)
+{
+    if( size != sizeof(Event) )
+        ::operator delete(ptr);
+    else
+        getEventPool().release(ptr);
+}
+
+size_t Event::getPoolSlabCount()
+{
+    return getEventPool().getSlabCount();
+}
+
+size_t Event::getPoolInUse()
+{
+    return getEventPool().getBlocksInUse();
+}
@@ -9,12 +9,15 @@
 #define EVENT_H
 
 	#include <string>
-	#include <vector>
+	#include <utility>
 	#include "eventdata.h"
 
 	// How many pieces of data can be passed to custom events
 	#define CUSTOM_EVENT_DATA_SLOTS			16
 
+	// How many of those are held inside the event itself; enough for any built-in event
+	#define EVENT_INLINE_DATA_SLOTS			4
+
 	namespace MicroMacro
 	{
 		struct Socket;
@@ -39,34 +42,71 @@
 			EVENT_SOCKETRECEIVED,
 			EVENT_SOCKETERROR,
 			EVENT_QUIT,
+			EVENT_THREADFINISHED,
+			EVENT_MEMORYCHANGED,
 			EVENT_CUSTOM,
 		};
 
+		/*	Fixed-capacity, vector-like container for an event's data.
+			The first EVENT_INLINE_DATA_SLOTS slots live inline in the
+			event; custom events that need more take the rest from a pool.
+			Slots are only constructed when pushed, so building an event
+			never touches the heap.
+		*/
+		class EventDataList
+		{
+			private:
+				alignas(EventData) unsigned char storage[EVENT_INLINE_DATA_SLOTS * sizeof(EventData)];
+				EventData *overflow;	// The remaining slots, once needed
+				size_t count;
+
+				EventData *slot(size_t index) { return index < EVENT_INLINE_DATA_SLOTS ?
+					reinterpret_cast<EventData *>(storage) + index : overflow + (index - EVENT_INLINE_DATA_SLOTS); };
+				const EventData *slot(size_t index) const { return index < EVENT_INLINE_DATA_SLOTS ?
+					reinterpret_cast<const EventData *>(storage) + index : overflow + (index - EVENT_INLINE_DATA_SLOTS); };
+				bool reserveSlot();
+
+			public:
+				EventDataList() : overflow(NULL), count(0) { };
+				EventDataList(const EventDataList &);
+				EventDataList(EventDataList &&);
+				~EventDataList();
+				EventDataList &operator=(const EventDataList &);
+				EventDataList &operator=(EventDataList &&);
+
+				bool push_back(const EventData &);
+				bool push_back(EventData &&);
+				EventData &at(size_t);
+				const EventData &at(size_t) const;
+				EventData &operator[](size_t index) { return *slot(index); };
+				const EventData &operator[](size_t index) const { return *slot(index); };
+				size_t size() const { return count; };
+				bool empty() const { return count == 0; };
+				void clear();
+		};
+
+		const char *getEventTypeName(EventType);
+
+		/*	Events are allocated from a pool (see operator new below),
+			so `new Event` / `delete pe` do not hit the heap once the
+			pool has grown to fit the usual number of in-flight events.
+		*/
 		class Event
 		{
 			protected:
 			public:
 				enum MicroMacro::EventType type;
-				/*std::string msg;
+				EventDataList data;
 
-				union {
-					size_t idata1;
-					double fdata1;
-					MicroMacro::Socket *pSocket;
-				};
-				union {
-					size_t idata2;
-					double fdata2;
-				};
-				union {
-					size_t idata3;
-					double fdata3;
-				};*/
-
-
-				std::vector<EventData> data;
 				Event() : type(EVENT_UNKNOWN){ };
+				Event(const Event &o) : type(o.type), data(o.data) { };
+				Event(Event &&o) : type(o.type), data(std::move(o.data)) { };
 				Event &operator=(const Event &);
+
+				static void *operator new(size_t);
+				static void operator delete(void *, size_t);
+				static size_t getPoolSlabCount();
+				static size_t getPoolInUse();
 		};
 	}
 
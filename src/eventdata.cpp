@@ -6,8 +6,12 @@
 ******************************************************************************/
 
 #include "eventdata.h"
+#include "pool.h"
 #include "strl.h"
 
+#include <string.h>
+#include <new>
+
 extern "C"
 {
 #include <lua.h>
@@ -17,61 +21,175 @@ extern "C"
 
 using namespace MicroMacro;
 
+/*  Size classes used for strings that don't fit inline. The largest
+    class covers the maximum network buffer size and its NULL-terminator,
+    so socket packets never fall through to the heap.
+*/
+static const size_t STRING_POOL_COUNT = 5;
+static BlockPool &getStringPool(size_t index)
+{
+    static BlockPool pools[STRING_POOL_COUNT] = {
+        {256, 64},
+        {1024, 32},
+        {4096, 16},
+        {16384, 8},
+        {EVENTDATA_MAX_PACKET_SIZE + 1, 2},
+    };
+    return pools[index];
+}
+
+// Returns the index of the smallest pool that fits, or STRING_POOL_COUNT if none do
+static size_t getStringPoolIndex(size_t size)
+{
+    for(size_t i = 0; i < STRING_POOL_COUNT; i++)
+    {
+        if( size <= getStringPool(i).getBlockSize() )
+            return i;
+    }
+    return STRING_POOL_COUNT;
+}
+
 EventData::EventData()
 {
-    type    =   ED_NIL;
-    length  =   0;
-    iNumber =   0;
-    pSocket =   NULL;
+    heapStr         =   NULL;
+    heapCapacity    =   0;
+    inlineStr[0]    =   0;
+    type            =   ED_NIL;
+    length          =   0;
+    i64Number       =   0;
+    pSocket         =   NULL;
+}
+
+EventData::EventData(const EventData &o) : EventData()
+{
+    copyFrom(o);
+}
+
+EventData::EventData(EventData &&o) : EventData()
+{
+    *this = std::move(o);
 }
 
 EventData::~EventData()
 {
-    str = "";
+    releaseString();
+}
+
+// Returns a buffer with room for at least `size` bytes, reusing what we already hold where possible
+char *EventData::reserve(size_t size)
+{
+    if( size <= EVENTDATA_INLINE_STRING_SIZE )
+        return inlineStr;
+
+    if( heapStr && size <= heapCapacity )
+        return heapStr;
+
+    releaseString();
+
+    size_t index = getStringPoolIndex(size);
+    if( index < STRING_POOL_COUNT )
+    {
+        heapStr         =   (char *)getStringPool(index).alloc();
+        heapCapacity    =   getStringPool(index).getBlockSize();
+    }
+    else
+    {
+        heapStr         =   new (std::nothrow) char[size];
+        heapCapacity    =   size;
+    }
+
+    if( !heapStr )
+        heapCapacity = 0;
+
+    return heapStr;
+}
+
+void EventData::releaseString()
+{
+    if( !heapStr )
+        return;
+
+    size_t index = getStringPoolIndex(heapCapacity);
+    if( index < STRING_POOL_COUNT && getStringPool(index).getBlockSize() == heapCapacity )
+        getStringPool(index).release(heapStr);
+    else
+        delete []heapStr;
+
+    heapStr         =   NULL;
+    heapCapacity    =   0;
+}
+
+void EventData::copyFrom(const EventData &o)
+{
+    type    =   o.type;
+    pSocket =   o.pSocket;
+    length  =   o.length;
+
+    // Copy only necessary data
+    switch( type )
+    {
+        case ED_STRING:
+            setValue(o.getString(), o.length);
+            break;
+        case ED_SOCKADDR:
+            memcpy(&remoteAddr, &o.remoteAddr, sizeof(struct sockaddr_in));
+            break;
+        default:
+            i64Number   =   o.i64Number;
+            break;
+    }
 }
 
 void EventData::setValue()
 {
-    str     =   "";
+    length  =   0;
     type    =   ED_NIL;
 }
 
 void EventData::setValue(int newNumber)
 {
-    str     =   "";
+    length  =   0;
     iNumber =   newNumber;
     type    =   ED_INTEGER;
 }
 
 void EventData::setValue(unsigned long long newNumber)
 {
-    str         =   "";
+    length      =   0;
     i64Number   =   newNumber;
     type        =   ED_64INTEGER;
 }
 
 void EventData::setValue(double newNumber)
 {
-    str     =   "";
+    length  =   0;
     fNumber =   newNumber;
     type    =   ED_NUMBER;
 }
 
-void EventData::setValue(std::string newStr, size_t newLength)
+void EventData::setValue(const std::string &newStr, size_t newLength)
 {
-    type    =   ED_STRING;
-    if( newLength != 0 )
-        length  =   newLength;
-    else
-        length  =   newStr.length();
-    str     =   std::string(newStr, newLength);
+    if( newLength == 0 || newLength > newStr.length() )
+        newLength = newStr.length();
+
+    setValue(newStr.c_str(), newLength);
 }
 
-void EventData::setValue(char *newStr, size_t newLength)
+void EventData::setValue(const char *newStr, size_t newLength)
 {
+    char *buffer = reserve(newLength + 1);
+    if( !buffer )
+    {   // Out of memory; keep what we can inline rather than fail
+        buffer = inlineStr;
+        newLength = EVENTDATA_INLINE_STRING_SIZE - 1;
+    }
+
+    if( newLength )
+        memmove(buffer, newStr, newLength);
+    buffer[newLength] = 0;
+
     type    =   ED_STRING;
     length  =   newLength;
-    str     =   std::string(newStr, newLength);
 }
 
 void EventData::setValue(MicroMacro::Socket *npSocket)
@@ -86,35 +204,43 @@ void EventData::setValue(struct sockaddr_in *newSockAddr)
     memcpy(&remoteAddr, newSockAddr, sizeof(struct sockaddr_in));
 }
 
+const char *EventData::getString() const
+{
+    if( type != ED_STRING )
+        return "";
+
+    return (length + 1 <= EVENTDATA_INLINE_STRING_SIZE) ? inlineStr : heapStr;
+}
+
 EventData &EventData::operator=(const EventData &o)
 {
-    type    =   o.type;
-    length  =   length;
+    if( this != &o )
+        copyFrom(o);
 
-    // Copy only necessary data
-    switch( type )
+    return *this;
+}
+
+// Steals the other's pooled buffer (if any) instead of copying the payload
+EventData &EventData::operator=(EventData &&o)
+{
+    if( this == &o )
+        return *this;
+
+    if( o.type == ED_STRING && o.length + 1 > EVENTDATA_INLINE_STRING_SIZE )
     {
-        case ED_STRING:
-            str =   std::string(o.str, length);
-            break;
-        case ED_INTEGER:
-            iNumber =   o.iNumber;
-            break;
-        case ED_64INTEGER:
-            i64Number   =   o.i64Number;
-            break;
-        case ED_NUMBER:
-            fNumber =   o.fNumber;
-            break;
-        case ED_SOCKET:
-            pSocket =   o.pSocket;
-            break;
-        case ED_SOCKADDR:
-            setValue((struct sockaddr_in *)&o.remoteAddr);
-            break;
-        default:
-            break;
+        releaseString();
+        heapStr         =   o.heapStr;
+        heapCapacity    =   o.heapCapacity;
+        o.heapStr       =   NULL;
+        o.heapCapacity  =   0;
+
+        type    =   ED_STRING;
+        length  =   o.length;
+        pSocket =   o.pSocket;
+        o.setValue();
     }
+    else
+        copyFrom(o);
 
     return *this;
 }
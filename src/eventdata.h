@@ -12,6 +12,12 @@
 	#include <string>
 	#include <Winsock2.h>
 
+	// Strings up to this length (including NULL-terminator) are stored inline without allocating
+	#define EVENTDATA_INLINE_STRING_SIZE		48
+
+	// The largest network buffer (see app.cpp); a full one, plus NULL-terminator, is still pooled
+	#define EVENTDATA_MAX_PACKET_SIZE			65536
+
 	namespace MicroMacro
 	{
 		struct Socket;
@@ -29,6 +35,15 @@
 
 		class EventData
 		{
+			private:
+				char *heapStr;			// Pooled buffer for strings that don't fit inline
+				size_t heapCapacity;
+				char inlineStr[EVENTDATA_INLINE_STRING_SIZE];
+
+				char *reserve(size_t);
+				void releaseString();
+				void copyFrom(const EventData &);
+
 			public:
 				EventDataType	type;
 				size_t			length;
@@ -39,21 +54,24 @@
 					double fNumber;
 					struct sockaddr_in remoteAddr;
 				};
-				std::string str;
 
 				MicroMacro::Socket *pSocket;
 
 				EventData();
+				EventData(const EventData &);
+				EventData(EventData &&);
 				~EventData();
-				void setValue();						// NIL
-				void setValue(int);						// Integer
-				void setValue(unsigned long long);		// 64-bit Ints
-				void setValue(double);					// Number
-				void setValue(std::string, size_t = 0);	// String
-				void setValue(char *, size_t);			// String
-				void setValue(MicroMacro::Socket *);	// Socket
-				void setValue(struct sockaddr_in *);	// SockAddr
+				void setValue();							// NIL
+				void setValue(int);							// Integer
+				void setValue(unsigned long long);			// 64-bit Ints
+				void setValue(double);						// Number
+				void setValue(const std::string &, size_t = 0);	// String
+				void setValue(const char *, size_t);		// String
+				void setValue(MicroMacro::Socket *);		// Socket
+				void setValue(struct sockaddr_in *);		// SockAddr
+				const char *getString() const;				// NULL-terminated; see length for binary data
 				EventData &operator=(const EventData &);
+				EventData &operator=(EventData &&);
 		};
 	}
 
@@ -0,0 +1,101 @@
+/******************************************************************************
+    Project:    MicroMacro
+    Author:     SolarStrike Software
+    URL:        www.solarstrike.net
+    License:    Modified BSD (see license.txt)
+******************************************************************************/
+
+#include "eventqueue.h"
+
+using MicroMacro::EventQueue;
+using MicroMacro::Event;
+
+static_assert((EVENT_QUEUE_SIZE & (EVENT_QUEUE_SIZE - 1)) == 0,
+              "EVENT_QUEUE_SIZE must be a power of 2");
+
+/*  Each cell's sequence number tells producers and the consumer
+    whose turn it is: a cell at position `pos` is free to write when
+    sequence == pos, and ready to read when sequence == pos + 1.
+*/
+EventQueue::EventQueue()
+{
+    for(size_t i = 0; i < EVENT_QUEUE_SIZE; i++)
+    {
+        cells[i].sequence.store(i, std::memory_order_relaxed);
+        cells[i].pEvent = NULL;
+    }
+
+    enqueuePos.store(0, std::memory_order_relaxed);
+    dequeuePos.store(0, std::memory_order_relaxed);
+    overflowCount.store(0, std::memory_order_relaxed);
+}
+
+// Safe to call from any thread. Returns false (and counts an overflow) if full.
+bool EventQueue::push(Event *pe)
+{
+    Cell *cell;
+    size_t pos = enqueuePos.load(std::memory_order_relaxed);
+    while( true )
+    {
+        cell = &cells[pos & mask];
+        size_t seq = cell->sequence.load(std::memory_order_acquire);
+        ptrdiff_t diff = (ptrdiff_t)seq - (ptrdiff_t)pos;
+
+        if( diff == 0 )
+        {   // Cell is free; try to claim it
+            if( enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed) )
+                break;
+        }
+        else if( diff < 0 )
+        {   // Consumer hasn't caught up; queue is full
+            overflowCount.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        else // Another producer beat us to it
+            pos = enqueuePos.load(std::memory_order_relaxed);
+    }
+
+    cell->pEvent = pe;
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+// Must only be called from the consumer (main) thread.
+bool EventQueue::pop(Event *&pe)
+{
+    size_t pos = dequeuePos.load(std::memory_order_relaxed);
+    Cell *cell = &cells[pos & mask];
+    size_t seq = cell->sequence.load(std::memory_order_acquire);
+    if( (ptrdiff_t)seq - (ptrdiff_t)(pos + 1) < 0 )
+        return false; // Empty (or a producer hasn't finished writing yet)
+
+    pe = cell->pEvent;
+    cell->pEvent = NULL;
+    cell->sequence.store(pos + mask + 1, std::memory_order_release);
+    dequeuePos.store(pos + 1, std::memory_order_relaxed);
+    return true;
+}
+
+// Approximate number of queued events; may be momentarily stale while producers are active
+size_t EventQueue::size()
+{
+    size_t tail = dequeuePos.load(std::memory_order_relaxed);
+    size_t head = enqueuePos.load(std::memory_order_relaxed);
+    return head > tail ? head - tail : 0;
+}
+
+size_t EventQueue::capacity()
+{
+    return EVENT_QUEUE_SIZE;
+}
+
+size_t EventQueue::getOverflowCount()
+{
+    return overflowCount.load(std::memory_order_relaxed);
+}
+
+// Returns the number of events rejected since the last call, and resets the counter
+size_t EventQueue::takeOverflowCount()
+{
+    return overflowCount.exchange(0, std::memory_order_relaxed);
+}
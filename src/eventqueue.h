@@ -0,0 +1,59 @@
+/******************************************************************************
+	Project: 	MicroMacro
+	Author: 	SolarStrike Software
+	URL:		www.solarstrike.net
+	License:	Modified BSD (see license.txt)
+******************************************************************************/
+
+#ifndef EVENTQUEUE_H
+#define EVENTQUEUE_H
+
+	#include <atomic>
+	#include <cstddef>
+
+	// Number of slots in the event queue; must be a power of 2
+	#define EVENT_QUEUE_SIZE			4096
+
+	namespace MicroMacro
+	{
+		class Event;
+
+		/*	Bounded, lock-free multi-producer/single-consumer queue.
+			Any thread may push(); only the main (Lua) thread may pop().
+			Producers never block: if the queue is full, the event is
+			rejected and counted as an overflow so it can be reported.
+		*/
+		class EventQueue
+		{
+			private:
+				struct Cell
+				{
+					std::atomic<size_t> sequence;
+					Event *pEvent;
+				};
+
+				Cell cells[EVENT_QUEUE_SIZE];
+				static const size_t mask = EVENT_QUEUE_SIZE - 1;
+
+				// Keep producer and consumer indices on separate cache lines
+				alignas(64) std::atomic<size_t> enqueuePos;
+				alignas(64) std::atomic<size_t> dequeuePos;
+				alignas(64) std::atomic<size_t> overflowCount;
+
+				EventQueue(const EventQueue &);
+				EventQueue &operator=(const EventQueue &);
+
+			public:
+				EventQueue();
+
+				bool push(Event *);
+				bool pop(Event *&);
+
+				size_t size();
+				size_t capacity();
+				size_t getOverflowCount();
+				size_t takeOverflowCount();
+		};
+	}
+
+#endif
@@ -0,0 +1,593 @@
+/******************************************************************************
+    Project:    MicroMacro
+    Author:     SolarStrike Software
+    URL:        www.solarstrike.net
+    License:    Modified BSD (see license.txt)
+******************************************************************************/
+
+#include "frozen_lua.h"
+#include "luatypes.h"
+#include "error.h"
+#include "strl.h"
+
+#include <string.h>
+
+extern "C"
+{
+#include <lua.h>
+#include <lauxlib.h>
+#include <lualib.h>
+}
+
+using MicroMacro::FrozenStore;
+using MicroMacro::FrozenValue;
+using MicroMacro::FrozenEntry;
+using MicroMacro::FrozenNode;
+
+const char *LuaType::metatable_frozen = "frozen";
+
+void FrozenStore::retain()
+{
+    ++refCount;
+}
+
+// Safe to call from any thread; whoever drops the last reference frees it
+void FrozenStore::release()
+{
+    if( --refCount == 0 )
+        delete this;
+}
+
+int Frozen_lua::regmod(lua_State *L)
+{
+    const luaL_Reg meta[] = {
+        {"__gc", gc},
+        {"__tostring", tostring},
+        {"__index", index},
+        {"__newindex", newindex},
+        {"__len", len},
+        {"__pairs", pairs},
+        {"__eq", eq},
+        {NULL, NULL}
+    };
+
+    static const luaL_Reg _funcs[] = {
+        {"new", Frozen_lua::_new},
+        {"isFrozen", Frozen_lua::isFrozen},
+        {"thaw", Frozen_lua::thaw},
+        {NULL, NULL}
+    };
+
+    luaL_newmetatable(L, LuaType::metatable_frozen);
+    luaL_setfuncs(L, meta, 0);
+    lua_pop(L, 1); // Pop metatable
+
+    luaL_newlib(L, _funcs);
+    lua_setglobal(L, FROZEN_MODULE_NAME);
+
+    return MicroMacro::ERR_OK;
+}
+
+void Frozen_lua::push(lua_State *L, FrozenStore *store, unsigned int node)
+{
+    store->retain();
+    Frozen *frozen = static_cast<Frozen *>(lua_newuserdata(L, sizeof(Frozen)));
+    frozen->store = store;
+    frozen->node = node;
+    luaL_getmetatable(L, LuaType::metatable_frozen);
+    lua_setmetatable(L, -2);
+}
+
+bool Frozen_lua::get(lua_State *L, int index, FrozenStore *&store, unsigned int &node)
+{
+    Frozen *frozen = static_cast<Frozen *>(luaL_testudata(L, index, LuaType::metatable_frozen));
+    if( !frozen )
+        return false;
+
+    store = frozen->store;
+    node = frozen->node;
+    return true;
+}
+
+Frozen_lua::Frozen *Frozen_lua::checkFrozen(lua_State *L, int index)
+{
+    return static_cast<Frozen *>(luaL_checkudata(L, index, LuaType::metatable_frozen));
+}
+
+// FNV-1a for strings; a multiplicative mix for everything else
+unsigned long long Frozen_lua::hashKey(const FrozenValue &key, const char *str)
+{
+    unsigned long long hash;
+    switch( key.type )
+    {
+        case MicroMacro::FT_STRING:
+            hash = 14695981039346656037ULL;
+            for(unsigned int i = 0; i < key.length; i++)
+            {
+                hash ^= (unsigned char)str[i];
+                hash *= 1099511628211ULL;
+            }
+            return hash;
+
+        case MicroMacro::FT_INTEGER:
+        case MicroMacro::FT_NUMBER:
+            hash = (unsigned long long)key.i;
+            break;
+
+        default:
+            hash = key.type;
+            break;
+    }
+
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+// 'key' is a stored key; 'other' came from toKey(), with 'str' its string bytes
+bool Frozen_lua::keysEqual(FrozenStore *store, const FrozenValue &key, const FrozenValue &other, const char *str)
+{
+    if( key.type != other.type )
+        return false;
+
+    switch( key.type )
+    {
+        case MicroMacro::FT_INTEGER:
+            return key.i == other.i;
+        case MicroMacro::FT_NUMBER:
+            return key.n == other.n;
+        case MicroMacro::FT_STRING:
+            return key.length == other.length && memcmp(store->strings.data() + key.offset, str, key.length) == 0;
+        default:
+            return true;
+    }
+}
+
+/*  Describe the Lua value at 'index' as a key we can look up. Strings are
+    not copied; 'str' points at the Lua string's bytes.
+    Returns false for values that cannot be keys of a frozen table.
+*/
+bool Frozen_lua::toKey(lua_State *L, int index, FrozenValue &key, const char *&str)
+{
+    str = NULL;
+    switch( lua_type(L, index) )
+    {
+        case LUA_TBOOLEAN:
+            key.type = lua_toboolean(L, index) ? MicroMacro::FT_TRUE : MicroMacro::FT_FALSE;
+            key.i = 0;
+            return true;
+
+        case LUA_TNUMBER:
+            {
+                int isnum = 0;
+                lua_Integer value = lua_tointegerx(L, index, &isnum);
+                if( isnum )
+                {   // Same as Lua: 2.0 and 2 are the same key
+                    key.type = MicroMacro::FT_INTEGER;
+                    key.i = value;
+                }
+                else
+                {
+                    key.type = MicroMacro::FT_NUMBER;
+                    key.n = lua_tonumber(L, index);
+                }
+            }
+            return true;
+
+        case LUA_TSTRING:
+            {
+                size_t length;
+                str = lua_tolstring(L, index, &length);
+                key.type = MicroMacro::FT_STRING;
+                key.length = (unsigned int)length;
+                key.offset = 0;
+            }
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+const FrozenValue *Frozen_lua::find(FrozenStore *store, unsigned int node, lua_State *L, int keyIndex)
+{
+    FrozenValue key;
+    const char *str;
+    if( !toKey(L, keyIndex, key, str) )
+        return NULL;
+
+    const FrozenNode &fn = store->nodes[node];
+    if( key.type == MicroMacro::FT_INTEGER && key.i >= 1 && key.i <= (long long)fn.arrayCount )
+        return &store->arrayValues[fn.arrayStart + key.i - 1];
+
+    if( fn.hashCapacity == 0 )
+        return NULL;
+
+    unsigned int mask = fn.hashCapacity - 1;
+    unsigned int slot = (unsigned int)hashKey(key, str) & mask;
+    const FrozenEntry *entries = &store->hashEntries[fn.hashStart];
+    while( entries[slot].key.type != MicroMacro::FT_NIL )
+    {
+        if( keysEqual(store, entries[slot].key, key, str) )
+            return &entries[slot].value;
+        slot = (slot + 1) & mask;
+    }
+
+    return NULL;
+}
+
+void Frozen_lua::pushValue(lua_State *L, FrozenStore *store, const FrozenValue &value)
+{
+    switch( value.type )
+    {
+        case MicroMacro::FT_FALSE:      lua_pushboolean(L, false);      break;
+        case MicroMacro::FT_TRUE:       lua_pushboolean(L, true);       break;
+        case MicroMacro::FT_INTEGER:    lua_pushinteger(L, value.i);    break;
+        case MicroMacro::FT_NUMBER:     lua_pushnumber(L, value.n);     break;
+        case MicroMacro::FT_STRING:
+            lua_pushlstring(L, store->strings.data() + value.offset, value.length);
+            break;
+        case MicroMacro::FT_TABLE:      push(L, store, value.node);     break;
+        case MicroMacro::FT_NIL:
+        default:
+            lua_pushnil(L);
+            break;
+    }
+}
+
+bool Frozen_lua::freezeValue(lua_State *L, int index, BuildState &bs, FrozenValue &value, int depth)
+{
+    value.length = 0;
+    value.i = 0;
+    switch( lua_type(L, index) )
+    {
+        case LUA_TBOOLEAN:
+        case LUA_TNUMBER:
+            {
+                const char *unused;
+                return toKey(L, index, value, unused);
+            }
+
+        case LUA_TSTRING:
+            {
+                size_t length;
+                const char *str = lua_tolstring(L, index, &length);
+                std::pair<std::unordered_map<std::string, unsigned long long>::iterator, bool> inserted
+                    = bs.strings.insert(std::make_pair(std::string(str, length), (unsigned long long)bs.store->strings.size()));
+                if( inserted.second )
+                    bs.store->strings.append(str, length);
+
+                value.type = MicroMacro::FT_STRING;
+                value.length = (unsigned int)length;
+                value.offset = inserted.first->second;
+            }
+            return true;
+
+        case LUA_TTABLE:
+            value.type = MicroMacro::FT_TABLE;
+            return freezeTable(L, index, bs, value.node, depth + 1);
+
+        default:
+            bs.err = std::string("cannot freeze a value of type ") + luaL_typename(L, index);
+            return false;
+    }
+}
+
+bool Frozen_lua::freezeTable(lua_State *L, int index, BuildState &bs, unsigned int &node, int depth)
+{
+    index = lua_absindex(L, index);
+    const void *ptr = lua_topointer(L, index);
+    std::map<const void *, unsigned int>::iterator found = bs.seen.find(ptr);
+    if( found != bs.seen.end() )
+    {
+        node = found->second;
+        return true;
+    }
+
+    if( depth > FROZEN_MAX_DEPTH )
+    {
+        bs.err = "tables are nested too deeply";
+        return false;
+    }
+
+    luaL_checkstack(L, 3, NULL);
+    node = (unsigned int)bs.store->nodes.size();
+    bs.store->nodes.push_back(FrozenNode());
+    bs.seen[ptr] = node;
+
+    // Sequence part (1..n) first, then everything else
+    std::vector<FrozenValue> values;
+    while( true )
+    {
+        FrozenValue value;
+        if( lua_rawgeti(L, index, (lua_Integer)values.size() + 1) == LUA_TNIL )
+        {
+            lua_pop(L, 1);
+            break;
+        }
+
+        if( !freezeValue(L, -1, bs, value, depth) )
+        {
+            lua_pop(L, 1);
+            return false;
+        }
+        lua_pop(L, 1);
+        values.push_back(value);
+    }
+
+    std::vector<FrozenEntry> entries;
+    lua_pushnil(L);
+    while( lua_next(L, index) )
+    {
+        if( lua_isinteger(L, -2) )
+        {
+            lua_Integer key = lua_tointeger(L, -2);
+            if( key >= 1 && key <= (lua_Integer)values.size() )
+            {
+                lua_pop(L, 1);
+                continue;
+            }
+        }
+
+        FrozenEntry entry;
+        int keyType = lua_type(L, -2);
+        if( keyType != LUA_TBOOLEAN && keyType != LUA_TNUMBER && keyType != LUA_TSTRING )
+        {
+            bs.err = std::string("cannot freeze a table with a key of type ") + luaL_typename(L, -2);
+            lua_pop(L, 2);
+            return false;
+        }
+
+        if( !freezeValue(L, -2, bs, entry.key, depth) || !freezeValue(L, -1, bs, entry.value, depth) )
+        {
+            lua_pop(L, 2);
+            return false;
+        }
+        lua_pop(L, 1);
+        entries.push_back(entry);
+    }
+
+    FrozenNode fn;
+    fn.arrayStart = (unsigned int)bs.store->arrayValues.size();
+    fn.arrayCount = (unsigned int)values.size();
+    bs.store->arrayValues.insert(bs.store->arrayValues.end(), values.begin(), values.end());
+
+    // Keep the hash at most 2/3 full so probes stay short
+    fn.hashStart = (unsigned int)bs.store->hashEntries.size();
+    fn.hashCount = (unsigned int)entries.size();
+    fn.hashCapacity = 0;
+    if( !entries.empty() )
+    {
+        fn.hashCapacity = 2;
+        while( fn.hashCapacity < entries.size() + entries.size()/2 + 1 )
+            fn.hashCapacity <<= 1;
+
+        FrozenEntry empty;
+        memset(&empty, 0, sizeof(empty));
+        bs.store->hashEntries.resize(fn.hashStart + fn.hashCapacity, empty);
+
+        unsigned int mask = fn.hashCapacity - 1;
+        FrozenEntry *slots = &bs.store->hashEntries[fn.hashStart];
+        for(size_t i = 0; i < entries.size(); i++)
+        {
+            const FrozenEntry &entry = entries.at(i);
+            const char *str = bs.store->strings.data() + (entry.key.type == MicroMacro::FT_STRING ? entry.key.offset : 0);
+            unsigned int slot = (unsigned int)hashKey(entry.key, str) & mask;
+            while( slots[slot].key.type != MicroMacro::FT_NIL )
+                slot = (slot + 1) & mask;
+            slots[slot] = entry;
+        }
+    }
+
+    bs.store->nodes[node] = fn;
+    return true;
+}
+
+// Pushes a plain Lua copy of 'value'; 'cacheIdx' maps node+1 to tables already copied
+void Frozen_lua::pushThawed(lua_State *L, FrozenStore *store, const FrozenValue &value, int cacheIdx)
+{
+    if( value.type != MicroMacro::FT_TABLE )
+    {
+        pushValue(L, store, value);
+        return;
+    }
+
+    luaL_checkstack(L, 4, NULL);
+    if( lua_rawgeti(L, cacheIdx, (lua_Integer)value.node + 1) != LUA_TNIL )
+        return;
+    lua_pop(L, 1);
+
+    const FrozenNode &fn = store->nodes[value.node];
+    lua_createtable(L, fn.arrayCount, fn.hashCount);
+    lua_pushvalue(L, -1);
+    lua_rawseti(L, cacheIdx, (lua_Integer)value.node + 1);
+
+    for(unsigned int i = 0; i < fn.arrayCount; i++)
+    {
+        pushThawed(L, store, store->arrayValues[fn.arrayStart + i], cacheIdx);
+        lua_rawseti(L, -2, (lua_Integer)i + 1);
+    }
+
+    for(unsigned int i = 0; i < fn.hashCapacity; i++)
+    {
+        const FrozenEntry &entry = store->hashEntries[fn.hashStart + i];
+        if( entry.key.type == MicroMacro::FT_NIL )
+            continue;
+
+        pushValue(L, store, entry.key);
+        pushThawed(L, store, entry.value, cacheIdx);
+        lua_rawset(L, -3);
+    }
+}
+
+int Frozen_lua::gc(lua_State *L)
+{
+    Frozen *frozen = checkFrozen(L, 1);
+    frozen->store->release();
+    return 0;
+}
+
+int Frozen_lua::tostring(lua_State *L)
+{
+    Frozen *frozen = checkFrozen(L, 1);
+    lua_pushfstring(L, "frozen table: %p", &frozen->store->nodes[frozen->node]);
+    return 1;
+}
+
+int Frozen_lua::index(lua_State *L)
+{
+    Frozen *frozen = checkFrozen(L, 1);
+    const FrozenValue *value = find(frozen->store, frozen->node, L, 2);
+    if( value )
+        pushValue(L, frozen->store, *value);
+    else
+        lua_pushnil(L);
+    return 1;
+}
+
+int Frozen_lua::newindex(lua_State *L)
+{
+    return luaL_error(L, "attempt to modify a frozen table");
+}
+
+int Frozen_lua::len(lua_State *L)
+{
+    Frozen *frozen = checkFrozen(L, 1);
+    lua_pushinteger(L, frozen->store->nodes[frozen->node].arrayCount);
+    return 1;
+}
+
+// The iterator keeps its position (array slots, then hash slots) as an upvalue
+int Frozen_lua::pairs_next(lua_State *L)
+{
+    Frozen *frozen = checkFrozen(L, 1);
+    FrozenStore *store = frozen->store;
+    const FrozenNode &fn = store->nodes[frozen->node];
+    unsigned int pos = (unsigned int)lua_tointeger(L, lua_upvalueindex(1));
+
+    if( pos < fn.arrayCount )
+    {
+        lua_pushinteger(L, pos + 1);
+        lua_replace(L, lua_upvalueindex(1));
+        lua_pushinteger(L, (lua_Integer)pos + 1);
+        pushValue(L, store, store->arrayValues[fn.arrayStart + pos]);
+        return 2;
+    }
+
+    for(unsigned int slot = pos - fn.arrayCount; slot < fn.hashCapacity; slot++)
+    {
+        const FrozenEntry &entry = store->hashEntries[fn.hashStart + slot];
+        if( entry.key.type == MicroMacro::FT_NIL )
+            continue;
+
+        lua_pushinteger(L, (lua_Integer)fn.arrayCount + slot + 1);
+        lua_replace(L, lua_upvalueindex(1));
+        pushValue(L, store, entry.key);
+        pushValue(L, store, entry.value);
+        return 2;
+    }
+
+    lua_pushnil(L);
+    return 1;
+}
+
+int Frozen_lua::pairs(lua_State *L)
+{
+    checkFrozen(L, 1);
+    lua_pushinteger(L, 0);
+    lua_pushcclosure(L, pairs_next, 1);
+    lua_pushvalue(L, 1);
+    lua_pushnil(L);
+    return 3;
+}
+
+int Frozen_lua::eq(lua_State *L)
+{
+    Frozen *frozen1 = checkFrozen(L, 1);
+    Frozen *frozen2 = checkFrozen(L, 2);
+    lua_pushboolean(L, frozen1->store == frozen2->store && frozen1->node == frozen2->node);
+    return 1;
+}
+
+/*  frozen.new(table tab)
+    Returns:    frozen
+
+    Makes a read-only copy of 'tab' (and every table inside of it) in a
+    compact native layout. The result is indexed, measured (#) and
+    iterated (pairs/ipairs) like a table, but cannot be changed.
+
+    Frozen tables may be passed to and from threads (see thread.spawn())
+    without being copied; the data stays alive as long as any state
+    still holds a reference to it.
+
+    Keys must be booleans, numbers or strings; values may also be
+    tables. Metatables are not kept. A table that appears more than
+    once (even inside of itself) is stored only once.
+*/
+int Frozen_lua::_new(lua_State *L)
+{
+    if( lua_gettop(L) != 1 )
+        wrongArgs(L);
+    checkType(L, LT_TABLE, 1);
+
+    FrozenStore *store = new FrozenStore;
+    unsigned int root;
+    char errBuf[256] = "";
+    {   // Scoped so nothing is left behind if we raise an error below
+        BuildState bs;
+        bs.store = store;
+        if( !freezeTable(L, 1, bs, root, 0) )
+            strlcpy(errBuf, bs.err.c_str(), sizeof(errBuf));
+    }
+
+    if( errBuf[0] )
+    {
+        delete store;
+        return luaL_error(L, "Cannot freeze table: %s", errBuf);
+    }
+
+    store->nodes.shrink_to_fit();
+    store->arrayValues.shrink_to_fit();
+    store->hashEntries.shrink_to_fit();
+    store->strings.shrink_to_fit();
+
+    push(L, store, root);
+    return 1;
+}
+
+/*  frozen.isFrozen(value)
+    Returns:    boolean
+
+    Returns true if 'value' is a frozen table.
+*/
+int Frozen_lua::isFrozen(lua_State *L)
+{
+    if( lua_gettop(L) != 1 )
+        wrongArgs(L);
+
+    lua_pushboolean(L, luaL_testudata(L, 1, LuaType::metatable_frozen) != NULL);
+    return 1;
+}
+
+/*  frozen.thaw(frozen tab)
+    Returns:    table
+
+    Returns an ordinary, writable copy of a frozen table.
+*/
+int Frozen_lua::thaw(lua_State *L)
+{
+    if( lua_gettop(L) != 1 )
+        wrongArgs(L);
+    Frozen *frozen = checkFrozen(L, 1);
+
+    lua_newtable(L); // Cache of tables already copied
+    int cacheIdx = lua_gettop(L);
+
+    FrozenValue root;
+    root.type = MicroMacro::FT_TABLE;
+    root.length = 0;
+    root.node = frozen->node;
+    pushThawed(L, frozen->store, root, cacheIdx);
+    return 1;
+}
@@ -0,0 +1,140 @@
+/******************************************************************************
+	Project: 	MicroMacro
+	Author: 	SolarStrike Software
+	URL:		www.solarstrike.net
+	License:	Modified BSD (see license.txt)
+******************************************************************************/
+
+#ifndef FROZEN_LUA_H
+#define FROZEN_LUA_H
+
+	#include <atomic>
+	#include <map>
+	#include <string>
+	#include <unordered_map>
+	#include <vector>
+
+	#define FROZEN_MODULE_NAME		"frozen"
+	#define FROZEN_MAX_DEPTH		64		// Deepest nesting of tables we'll freeze
+
+	typedef struct lua_State lua_State;
+
+	namespace LuaType
+	{
+		extern const char *metatable_frozen;
+	}
+
+	namespace MicroMacro
+	{
+		enum FrozenType
+		{
+			FT_NIL,				// Also marks an empty hash slot
+			FT_FALSE,
+			FT_TRUE,
+			FT_INTEGER,
+			FT_NUMBER,
+			FT_STRING,
+			FT_TABLE,
+		};
+
+		struct FrozenValue
+		{
+			unsigned int type;
+			unsigned int length;		// FT_STRING
+			union
+			{
+				long long i;
+				double n;
+				unsigned long long offset;	// FT_STRING: into the string pool
+				unsigned int node;			// FT_TABLE
+			};
+		};
+
+		struct FrozenEntry
+		{
+			FrozenValue key;
+			FrozenValue value;
+		};
+
+		/*	One table: values for keys 1..arrayCount are kept in order, the
+			rest in an open-addressed hash of hashCapacity (a power of 2)
+			slots.
+		*/
+		struct FrozenNode
+		{
+			unsigned int arrayStart;
+			unsigned int arrayCount;
+			unsigned int hashStart;
+			unsigned int hashCapacity;
+			unsigned int hashCount;
+		};
+
+		/*	Everything frozen from one Lua table (and the tables inside of
+			it). Never changes once built, so any number of states on any
+			number of threads may read it; each reference holds a count.
+		*/
+		class FrozenStore
+		{
+			public:
+				std::vector<FrozenNode> nodes;
+				std::vector<FrozenValue> arrayValues;
+				std::vector<FrozenEntry> hashEntries;
+				std::string strings;
+				std::atomic<int> refCount;
+
+				FrozenStore() : refCount(0) { };
+				void retain();
+				void release();
+		};
+	}
+
+	class Frozen_lua
+	{
+		protected:
+			struct Frozen
+			{
+				MicroMacro::FrozenStore *store;
+				unsigned int node;
+			};
+
+			struct BuildState
+			{
+				MicroMacro::FrozenStore *store;
+				std::map<const void *, unsigned int> seen;	// Lua table -> node, so shared (and cyclic) tables freeze once
+				std::unordered_map<std::string, unsigned long long> strings;	// Pool offsets; each distinct string is stored once
+				std::string err;
+			};
+
+			static bool freezeValue(lua_State *, int, BuildState &, MicroMacro::FrozenValue &, int);
+			static bool freezeTable(lua_State *, int, BuildState &, unsigned int &, int);
+			static bool toKey(lua_State *, int, MicroMacro::FrozenValue &, const char *&);
+			static unsigned long long hashKey(const MicroMacro::FrozenValue &, const char *);
+			static bool keysEqual(MicroMacro::FrozenStore *, const MicroMacro::FrozenValue &, const MicroMacro::FrozenValue &, const char *);
+			static const MicroMacro::FrozenValue *find(MicroMacro::FrozenStore *, unsigned int, lua_State *, int);
+			static void pushValue(lua_State *, MicroMacro::FrozenStore *, const MicroMacro::FrozenValue &);
+			static void pushThawed(lua_State *, MicroMacro::FrozenStore *, const MicroMacro::FrozenValue &, int);
+			static Frozen *checkFrozen(lua_State *, int);
+
+			static int gc(lua_State *);
+			static int tostring(lua_State *);
+			static int index(lua_State *);
+			static int newindex(lua_State *);
+			static int len(lua_State *);
+			static int pairs(lua_State *);
+			static int pairs_next(lua_State *);
+			static int eq(lua_State *);
+
+			static int _new(lua_State *);
+			static int isFrozen(lua_State *);
+			static int thaw(lua_State *);
+
+		public:
+			static int regmod(lua_State *);
+
+			// Pushes a new reference to a node of 'store'
+			static void push(lua_State *, MicroMacro::FrozenStore *, unsigned int);
+			// Returns true if the value at the given index is a frozen table
+			static bool get(lua_State *, int, MicroMacro::FrozenStore *&, unsigned int &);
+	};
+
+#endif
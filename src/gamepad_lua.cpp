@@ -9,6 +9,7 @@
 #include "event.h"
 #include "error.h"
 #include "macro.h"
+#include "settings.h"
 
 extern "C"
 {
@@ -26,6 +27,8 @@ int Gamepad_lua::regmod(lua_State *L)
         {"getPOV", Gamepad_lua::getPOV},
         {"getAxis", Gamepad_lua::getAxis},
         {"getCount", Gamepad_lua::getCount},
+        {"setAxisFilter", Gamepad_lua::setAxisFilter},
+        {"getAxisFilter", Gamepad_lua::getAxisFilter},
         {NULL, NULL}
     };
 
@@ -47,6 +50,12 @@ int Gamepad_lua::regmod(lua_State *L)
     lua_pushnumber(L, JOY_POVRIGHT / 100);
     lua_setglobal(L, "JOY_POVRIGHT");
 
+    // Each script starts out with the configured axis filtering
+    Settings *psettings = Macro::instance()->getSettings();
+    Macro::instance()->getAxisFilter()->setDefaults(
+        (float)psettings->getFloat(CONFVAR_GAMEPAD_DEADZONE, CONFDEFAULT_GAMEPAD_DEADZONE),
+        (float)psettings->getFloat(CONFVAR_GAMEPAD_AXIS_MIN_DELTA, CONFDEFAULT_GAMEPAD_AXIS_MIN_DELTA));
+
     return MicroMacro::ERR_OK;
 }
 
@@ -219,3 +228,57 @@ int Gamepad_lua::getCount(lua_State *L)
     lua_pushnumber(L, Macro::instance()->getHid()->getGamepadCount());
     return 1;
 }
+
+/*  gamepad.setAxisFilter(number axisId, number deadzone [, number minDelta])
+    Returns:    nil
+
+    Controls which movements of an axis raise "gamepadaxischanged"
+    events. Readings within 'deadzone' percent of full deflection from
+    center are reported as centered (50), and changes smaller than
+    'minDelta' (in axis units, 0-100) are ignored. Applies to that
+    axis on every gamepad; pass nil as 'axisId' to change all axes.
+
+    The defaults come from the gamepadDeadzone and gamepadAxisMinDelta
+    config options. gamepad.getAxis() is not affected.
+*/
+int Gamepad_lua::setAxisFilter(lua_State *L)
+{
+    int top = lua_gettop(L);
+    if( top != 2 && top != 3 )
+        wrongArgs(L);
+    checkType(L, LT_NIL | LT_NUMBER, 1);
+    checkType(L, LT_NUMBER, 2);
+    if( top >= 3 )
+        checkType(L, LT_NIL | LT_NUMBER, 3);
+
+    float deadzone = (float)lua_tonumber(L, 2);
+    float minDelta = (float)luaL_optnumber(L, 3, 0);
+    MicroMacro::AxisFilter *filter = Macro::instance()->getAxisFilter();
+    if( lua_isnil(L, 1) )
+        filter->setDefaults(deadzone, minDelta);
+    else if( !filter->setSettings((int)lua_tointeger(L, 1), deadzone, minDelta) )
+        return luaL_argerror(L, 1, "invalid axis ID");
+
+    return 0;
+}
+
+/*  gamepad.getAxisFilter(number axisId)
+    Returns:    number deadzone, number minDelta
+
+    Returns the dead zone and minimum change currently applied to the
+    given axis's events. See gamepad.setAxisFilter().
+*/
+int Gamepad_lua::getAxisFilter(lua_State *L)
+{
+    if( lua_gettop(L) != 1 )
+        wrongArgs(L);
+    checkType(L, LT_NUMBER, 1);
+
+    MicroMacro::AxisFilterSettings settings;
+    if( !Macro::instance()->getAxisFilter()->getSettings((int)lua_tointeger(L, 1), settings) )
+        return luaL_argerror(L, 1, "invalid axis ID");
+
+    lua_pushnumber(L, settings.deadzone);
+    lua_pushnumber(L, settings.minDelta);
+    return 2;
+}
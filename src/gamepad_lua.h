@@ -21,6 +21,8 @@
 			static int getPOV(lua_State *);
 			static int getAxis(lua_State *);
 			static int getCount(lua_State *);
+			static int setAxisFilter(lua_State *);
+			static int getAxisFilter(lua_State *);
 
 			/*static int press(lua_State *);
 			static int hold(lua_State *);
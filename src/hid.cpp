@@ -10,6 +10,7 @@
 #include "settings.h"
 #include "macro.h"
 #include "strl.h"
+#include "simd.h"
 
 #include "wininclude.h"
 #include <stdio.h>
@@ -45,7 +46,7 @@ int Hid::init()
     }
 
     // Use securezero instead of memset to prevent compiler optimization from ignoring the call
-    securezero((void *)lastks, sizeof(lastks));
+    securezero((void *)lastks, KS_SIZE);
     memset(joyinfo, 0, sizeof(JOYINFOEX) * GAMEPADS);
     memset(lastjoyinfo, 0, sizeof(JOYINFOEX) * GAMEPADS);
 
@@ -55,6 +56,7 @@ int Hid::init()
     int unused = 0;
     GetKeyState(unused); // To get around a Windows bug
     GetKeyboardState(ks);
+    memset(changedKeys, 0, sizeof(changedKeys));
 
     unsigned int gamepadsPolled =  0;
     for(unsigned int gamepad = 0; gamepad < GAMEPADS; gamepad++)
@@ -101,6 +103,7 @@ void Hid::poll()
 
     // Poll keyboard
     GetKeyboardState(ks);
+    diffKeyStates(ks, lastks, changedKeys);
 
     // Poll gamepad
     unsigned int gamepadsPolled =  0;
@@ -138,6 +141,62 @@ BYTE *Hid::getLastState()
 
 
 
+/*  Sets a bit in 'mask' (KS_MASK_WORDS words, key N in bit N%32 of word
+    N/32) for each key whose down bit (0x80) differs between 'current'
+    and 'last'. movemask picks up exactly that bit of every byte.
+*/
+void Hid::diffKeyStates(const BYTE *current, const BYTE *last, unsigned int *mask)
+{
+    #if defined(SIMD_AVX2)
+    for(unsigned int w = 0; w < KS_MASK_WORDS; w++)
+    {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(current + w * 32));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(last + w * 32));
+        mask[w] = (unsigned int)_mm256_movemask_epi8(_mm256_xor_si256(a, b));
+    }
+    #elif defined(SIMD_SSE2)
+    for(unsigned int w = 0; w < KS_MASK_WORDS; w++)
+    {
+        const BYTE *pc = current + w * 32;
+        const BYTE *pl = last + w * 32;
+        __m128i lo = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(pc)),
+                                   _mm_loadu_si128(reinterpret_cast<const __m128i *>(pl)));
+        __m128i hi = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(pc + 16)),
+                                   _mm_loadu_si128(reinterpret_cast<const __m128i *>(pl + 16)));
+        mask[w] = (unsigned int)_mm_movemask_epi8(lo) | ((unsigned int)_mm_movemask_epi8(hi) << 16);
+    }
+    #else
+    for(unsigned int w = 0; w < KS_MASK_WORDS; w++)
+    {
+        unsigned int bits = 0;
+        for(unsigned int b = 0; b < 32; b++)
+            bits |= (unsigned int)(((current[w * 32 + b] ^ last[w * 32 + b]) >> 7) & 1) << b;
+        mask[w] = bits;
+    }
+    #endif
+}
+
+/*  Returns the first key at or after 'vk' that was pressed or released
+    by the last poll, or -1 if there are no more.
+*/
+int Hid::nextChangedKey(int vk)
+{
+    if( vk < 0 )
+        vk = 0;
+
+    for(unsigned int w = vk / 32; w < KS_MASK_WORDS; w++)
+    {
+        unsigned int bits = changedKeys[w];
+        if( w == (unsigned int)vk / 32 )
+            bits &= ~0u << (vk % 32);
+
+        if( bits )
+            return w * 32 + lowestSetBit(bits);
+    }
+
+    return -1;
+}
+
 bool Hid::pressed(int vk)
 {
     return ( (ks[vk] & 128) && !(lastks[vk] & 128) );
@@ -13,6 +13,7 @@
 	#include "wininclude.h"
 
 	#define KS_SIZE				256
+	#define KS_MASK_WORDS		(KS_SIZE / 32)
 	#define GAMEPADS			16
 	#define GAMEPAD_BUTTONS		32
 	#define GAMEPAD_AXIS_COUNT	6
@@ -34,6 +35,7 @@
 		protected:
 			BYTE *ks;
 			BYTE *lastks;
+			unsigned int changedKeys[KS_MASK_WORDS];	// Bit per key whose up/down state changed this poll
 			JOYINFOEX *joyinfo;
 			JOYINFOEX *lastjoyinfo;
 			int keyHoldDelayMs;
@@ -71,6 +73,8 @@
 			void setVirtualMousePos(int, int);
 
 			bool keyIsExtended(int);
+			int nextChangedKey(int);
+			static void diffKeyStates(const BYTE *, const BYTE *, unsigned int *);
 
 			// Gamepads
 			bool joyPressed(int, int);
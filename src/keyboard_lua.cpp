@@ -8,6 +8,8 @@
 #include "keyboard_lua.h"
 #include "error.h"
 #include "macro.h"
+#include "hid.h"
+#include "simd.h"
 
 extern "C"
 {
@@ -36,6 +38,7 @@ int Keyboard_lua::regmod(lua_State *L)
         {"virtualRelease", Keyboard_lua::virtualRelease},
         {"virtualType", Keyboard_lua::virtualType},
         {"getKeyName", Keyboard_lua::getKeyName},
+        {"diffStates", Keyboard_lua::diffStates},
         {"setHookCallback", Keyboard_lua::setHookCallback},
         {NULL, NULL}
     };
@@ -94,6 +97,79 @@ int Keyboard_lua::released(lua_State *L)
     return 1;
 }
 
+/*  keyboard.diffStates(string current, string last [, boolean bytewise])
+    Returns:    table pressed, table released
+
+    Compares two keyboard states (256 bytes each, one per virtual key,
+    as kept between polls) the way polling does, and returns the keys
+    that went down and the keys that came up, in order.
+    Polling builds a bit mask of the changed keys and visits only
+    those; if 'bytewise' is true, every key is tested one at a time
+    instead (as polling used to). Meant for testing and benchmarking.
+*/
+int Keyboard_lua::diffStates(lua_State *L)
+{
+    int top = lua_gettop(L);
+    if( top != 2 && top != 3 )
+        wrongArgs(L);
+    checkType(L, LT_STRING, 1);
+    checkType(L, LT_STRING, 2);
+    if( top >= 3 )
+        checkType(L, LT_NIL | LT_BOOLEAN, 3);
+
+    size_t currentLen = 0;
+    size_t lastLen = 0;
+    const BYTE *current = (const BYTE *)lua_tolstring(L, 1, &currentLen);
+    const BYTE *last = (const BYTE *)lua_tolstring(L, 2, &lastLen);
+    bool bytewise = lua_toboolean(L, 3) != 0;
+
+    luaL_argcheck(L, currentLen >= KS_SIZE, 1, "state must be at least 256 bytes");
+    luaL_argcheck(L, lastLen >= KS_SIZE, 2, "state must be at least 256 bytes");
+
+    lua_newtable(L);
+    lua_newtable(L);
+    int pressedCount = 0;
+    int releasedCount = 0;
+
+    if( bytewise )
+    {
+        for(int vk = 0; vk < KS_SIZE; vk++)
+        {
+            if( (current[vk] & 128) && !(last[vk] & 128) )
+            {
+                lua_pushinteger(L, vk);
+                lua_rawseti(L, -3, ++pressedCount);
+            }
+            else if( !(current[vk] & 128) && (last[vk] & 128) )
+            {
+                lua_pushinteger(L, vk);
+                lua_rawseti(L, -2, ++releasedCount);
+            }
+        }
+        return 2;
+    }
+
+    unsigned int mask[KS_MASK_WORDS];
+    Hid::diffKeyStates(current, last, mask);
+    for(unsigned int w = 0; w < KS_MASK_WORDS; w++)
+    {
+        unsigned int bits = mask[w];
+        while( bits )
+        {
+            int vk = w * 32 + lowestSetBit(bits);
+            bits &= bits - 1;
+
+            lua_pushinteger(L, vk);
+            if( current[vk] & 128 )
+                lua_rawseti(L, -3, ++pressedCount);
+            else
+                lua_rawseti(L, -2, ++releasedCount);
+        }
+    }
+
+    return 2;
+}
+
 /*  keyboard.isDown(number vk)
     Returns:    boolean
 
@@ -33,6 +33,7 @@
 			static int virtualType(lua_State *);
 
 			static int getKeyName(lua_State *);
+			static int diffStates(lua_State *);
 
 			static int setHookCallback(lua_State *);
 
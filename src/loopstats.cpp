@@ -0,0 +1,207 @@
+/******************************************************************************
+    Project:    MicroMacro
+    Author:     SolarStrike Software
+    URL:        www.solarstrike.net
+    License:    Modified BSD (see license.txt)
+******************************************************************************/
+
+#include "loopstats.h"
+#include "eventqueue.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <string.h>
+
+extern "C"
+{
+#include <lua.h>
+#include <lauxlib.h>
+#include <lualib.h>
+}
+
+using MicroMacro::LoopStats;
+using MicroMacro::LoopPhase;
+using MicroMacro::PhaseSummary;
+
+LoopStats::LoopStats()
+{
+    logInterval = 0;
+    reset();
+}
+
+// Start fresh; called whenever a new script is run
+void LoopStats::reset()
+{
+    memset(phases, 0, sizeof(phases));
+    memset(eventCounts, 0, sizeof(eventCounts));
+    frames          =   0;
+    queueDepth      =   0;
+    maxQueueDepth   =   0;
+    eventsDropped   =   0;
+    frameStarted    =   false;
+    lastLogTime     =   getNow();
+}
+
+// Call at the top of each main loop cycle; records the length of the previous one
+void LoopStats::beginFrame()
+{
+    if( frameStarted )
+        record(PHASE_FRAME, frameStart);
+
+    frameStart = getNow();
+    frameStarted = true;
+    ++frames;
+}
+
+// Records the time elapsed from `start` until now against the given phase
+void LoopStats::record(LoopPhase phase, TimeType start)
+{
+    PhaseWindow &window = phases[phase];
+    window.samples[window.next] = deltaTime(getNow(), start) * 1000;
+    window.next = (window.next + 1) % LOOPSTATS_WINDOW;
+    if( window.count < LOOPSTATS_WINDOW )
+        ++window.count;
+}
+
+void LoopStats::countEvent(EventType type)
+{
+    if( (unsigned int)type <= EVENT_CUSTOM )
+        ++eventCounts[type];
+}
+
+void LoopStats::sampleQueue(size_t depth, size_t dropped)
+{
+    queueDepth = depth;
+    if( depth > maxQueueDepth )
+        maxQueueDepth = depth;
+    eventsDropped = dropped;
+}
+
+PhaseSummary LoopStats::summarize(LoopPhase phase)
+{
+    PhaseSummary summary;
+    memset(&summary, 0, sizeof(summary));
+
+    PhaseWindow &window = phases[phase];
+    summary.samples = window.count;
+    if( window.count == 0 )
+        return summary;
+
+    double sorted[LOOPSTATS_WINDOW];
+    memcpy(sorted, window.samples, window.count * sizeof(double));
+    std::sort(sorted, sorted + window.count);
+
+    double total = 0;
+    for(size_t i = 0; i < window.count; i++)
+        total += sorted[i];
+
+    summary.min = sorted[0];
+    summary.max = sorted[window.count - 1];
+    summary.avg = total / window.count;
+    summary.p50 = sorted[(window.count - 1) * 50 / 100];
+    summary.p99 = sorted[(window.count - 1) * 99 / 100];
+    return summary;
+}
+
+void LoopStats::setLogInterval(unsigned int seconds)
+{
+    logInterval = seconds;
+}
+
+// Dump to the log if logging is enabled and the interval has passed
+void LoopStats::logIfDue()
+{
+    if( logInterval == 0 )
+        return;
+
+    TimeType now = getNow();
+    if( deltaTime(now, lastLogTime) < logInterval )
+        return;
+
+    lastLogTime = now;
+    log();
+}
+
+void LoopStats::log()
+{
+    Logger *logger = Logger::instance();
+    logger->add("Main loop stats over last %u frames (ms; min/avg/p50/p99/max):",
+        (unsigned int)phases[PHASE_FRAME].count);
+
+    for(unsigned int i = 0; i < PHASE_COUNT; i++)
+    {
+        PhaseSummary s = summarize((LoopPhase)i);
+        logger->add("  %-14s %8.3f %8.3f %8.3f %8.3f %8.3f", getPhaseName((LoopPhase)i),
+            s.min, s.avg, s.p50, s.p99, s.max);
+    }
+
+    logger->add("  Event queue depth: %u (max %u), dropped: %u",
+        (unsigned int)queueDepth, (unsigned int)maxQueueDepth, (unsigned int)eventsDropped);
+}
+
+/*  Pushes a table:
+    {
+        frames = number,
+        phases = { [phase name] = {samples, min, avg, p50, p99, max}, ... },
+        events = { [event name] = count, ... },
+        queue = {depth, maxDepth, capacity, dropped},
+    }
+*/
+void LoopStats::push(lua_State *L)
+{
+    lua_newtable(L);
+
+    lua_pushinteger(L, frames);
+    lua_setfield(L, -2, "frames");
+
+    lua_createtable(L, 0, PHASE_COUNT);
+    for(unsigned int i = 0; i < PHASE_COUNT; i++)
+    {
+        PhaseSummary s = summarize((LoopPhase)i);
+        lua_createtable(L, 0, 6);
+        lua_pushinteger(L, s.samples);  lua_setfield(L, -2, "samples");
+        lua_pushnumber(L, s.min);       lua_setfield(L, -2, "min");
+        lua_pushnumber(L, s.avg);       lua_setfield(L, -2, "avg");
+        lua_pushnumber(L, s.p50);       lua_setfield(L, -2, "p50");
+        lua_pushnumber(L, s.p99);       lua_setfield(L, -2, "p99");
+        lua_pushnumber(L, s.max);       lua_setfield(L, -2, "max");
+        lua_setfield(L, -2, getPhaseName((LoopPhase)i));
+    }
+    lua_setfield(L, -2, "phases");
+
+    lua_newtable(L);
+    for(unsigned int i = 0; i <= EVENT_CUSTOM; i++)
+    {
+        if( eventCounts[i] == 0 )
+            continue;
+        lua_pushinteger(L, eventCounts[i]);
+        lua_setfield(L, -2, getEventTypeName((EventType)i));
+    }
+    lua_setfield(L, -2, "events");
+
+    lua_createtable(L, 0, 4);
+    lua_pushinteger(L, queueDepth);     lua_setfield(L, -2, "depth");
+    lua_pushinteger(L, maxQueueDepth);  lua_setfield(L, -2, "maxDepth");
+    lua_pushinteger(L, EVENT_QUEUE_SIZE); lua_setfield(L, -2, "capacity");
+    lua_pushinteger(L, eventsDropped);  lua_setfield(L, -2, "dropped");
+    lua_setfield(L, -2, "queue");
+}
+
+const char *LoopStats::getPhaseName(LoopPhase phase)
+{
+    switch( phase )
+    {
+        case PHASE_FOREGROUND:      return "foreground";
+        case PHASE_HID_POLL:        return "hidpoll";
+        case PHASE_HID_INPUT:       return "hidinput";
+        case PHASE_CONSOLE_RESIZE:  return "consoleresize";
+        case PHASE_EVENTS:          return "events";
+        case PHASE_MESSAGES:        return "messages";
+        case PHASE_MAIN:            return "main";
+        case PHASE_TIMERS:          return "timers";
+        case PHASE_TASKS:           return "tasks";
+        case PHASE_IDLE:            return "idle";
+        case PHASE_FRAME:           return "frame";
+        default:                    return "unknown";
+    }
+}
@@ -0,0 +1,88 @@
+/******************************************************************************
+	Project: 	MicroMacro
+	Author: 	SolarStrike Software
+	URL:		www.solarstrike.net
+	License:	Modified BSD (see license.txt)
+******************************************************************************/
+
+#ifndef LOOPSTATS_H
+#define LOOPSTATS_H
+
+	#include "timer.h"
+	#include "event.h"
+	#include <cstddef>
+
+	// Number of most recent samples kept per phase
+	#define LOOPSTATS_WINDOW			512
+
+	typedef struct lua_State lua_State;
+
+	namespace MicroMacro
+	{
+		enum LoopPhase
+		{
+			PHASE_FOREGROUND,		// pollForegroundWindow()
+			PHASE_HID_POLL,			// Hid::poll()
+			PHASE_HID_INPUT,		// handleHidInput() (not including Hid::poll())
+			PHASE_CONSOLE_RESIZE,	// pollConsoleResize()
+			PHASE_EVENTS,			// handleEvents()
+			PHASE_MESSAGES,			// dispatchWindowsMessages()
+			PHASE_MAIN,				// runMain()
+			PHASE_TIMERS,			// runTimers()
+			PHASE_TASKS,			// runTasks()
+			PHASE_IDLE,				// Scheduler::idle()
+			PHASE_FRAME,			// The whole cycle, start to start
+			PHASE_COUNT
+		};
+
+		struct PhaseSummary
+		{
+			size_t samples;
+			double min, avg, p50, p99, max;		// In milliseconds
+		};
+
+		/*	Rolling per-phase timing for the main loop, plus event and
+			queue counters. Only touched from the main thread.
+		*/
+		class LoopStats
+		{
+			private:
+				struct PhaseWindow
+				{
+					double samples[LOOPSTATS_WINDOW];
+					size_t next;
+					size_t count;
+				};
+
+				PhaseWindow phases[PHASE_COUNT];
+				unsigned long long eventCounts[EVENT_CUSTOM + 1];
+				unsigned long long frames;
+				size_t queueDepth;
+				size_t maxQueueDepth;
+				size_t eventsDropped;
+
+				TimeType frameStart;
+				bool frameStarted;
+				TimeType lastLogTime;
+				unsigned int logInterval;	// Seconds; 0 = never
+
+			public:
+				LoopStats();
+
+				void reset();
+				void beginFrame();
+				void record(LoopPhase, TimeType);
+				void countEvent(EventType);
+				void sampleQueue(size_t, size_t);
+
+				PhaseSummary summarize(LoopPhase);
+				void setLogInterval(unsigned int);
+				void logIfDue();
+				void log();
+				void push(lua_State *);
+
+				static const char *getPhaseName(LoopPhase);
+		};
+	}
+
+#endif
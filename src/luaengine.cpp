@@ -27,9 +27,17 @@
 #include "hash_lua.h"
 #include "cli_lua.h"
 #include "memorychunk_lua.h"
+#include "scanresult_lua.h"
+#include "pointerpath_lua.h"
+#include "snapshot_lua.h"
 #include "serial_lua.h"
 #include "serial_port_lua.h"
 #include "sqlite_lua.h"
+#include "profiler_lua.h"
+#include "async_lua.h"
+#include "timer_lua.h"
+#include "thread_lua.h"
+#include "frozen_lua.h"
 
 #ifdef NETWORKING_ENABLED
     #include "network_lua.h"
@@ -54,13 +62,29 @@ extern "C"
 #include <lualib.h>
 }
 
-bool LuaEngine::closeState;
+std::atomic<bool> LuaEngine::closeState(false);
+std::atomic<bool> LuaEngine::sampleRequested(false);
+std::atomic<SampleHandler> LuaEngine::sampleHandler(NULL);
+std::atomic<lua_State *> LuaEngine::hookState(NULL);
 
+LuaEngine::LuaEngine()
+{
+    lstate              =   NULL;
+    lastErrorMsg        =   "";
+    fDeltaTime          =   0;
+    keyHookErrorState   =   MicroMacro::ERR_OK;
+    eventFuncRef        =   LUA_NOREF;
+    eventsFuncRef       =   LUA_NOREF;
+    batchStackBase      =   0;
+    batchSize           =   0;
+}
 
 LuaEngine::~LuaEngine()
 {
     if( lstate )
     {
+        if( hookState == lstate )
+            hookState = NULL;
         lua_close(lstate);
         lstate = NULL;
     }
@@ -80,20 +104,187 @@ void LuaEngine::stdError()
     lua_pop(lstate, 1);
 }
 
-void LuaEngine::closeHook(lua_State *L, lua_Debug *ar)
+/*  Only installed when something asks to interrupt the script (CTRL+C
+    or a profiler sample; see armInterruptHook()), so normal execution
+    pays nothing for it.
+    While the close state is set it stays armed, so a script can't simply
+    pcall() its way past it.
+*/
+void LuaEngine::interruptHook(lua_State *L, lua_Debug *ar)
 {
+    if( sampleRequested.exchange(false) )
+    {
+        SampleHandler handler = sampleHandler;
+        if( handler )
+            handler(L);
+    }
+
     if( closeState )
     {
         lua_pushliteral(L, "CTRL+C pressed.");
         lua_error(L);
     }
+
+    // Nothing left to do; disarm. Re-check afterwards in case a request
+    // (CTRL+C or a sample) slipped in while we were busy, since its arm
+    // may have preceded ours.
+    lua_sethook(L, NULL, 0, 0);
+    if( closeState || sampleRequested )
+        lua_sethook(L, interruptHook, LUA_MASKCALL | LUA_MASKRET | LUA_MASKCOUNT, 1);
+}
+
+/*  May be called from any thread. lua_sethook() is safe to call
+    asynchronously (it is what the standalone interpreter does from its
+    SIGINT handler), so we arm a count hook that fires on the very next
+    instruction rather than checking flags on every line.
+*/
+void LuaEngine::armInterruptHook()
+{
+    lua_State *L = hookState;
+    if( L )
+        lua_sethook(L, interruptHook, LUA_MASKCALL | LUA_MASKRET | LUA_MASKCOUNT, 1);
 }
 
+// May be called from the console control handler thread
 void LuaEngine::setCloseState(bool newState)
 {
     closeState = newState;
+
+    if( newState )
+        armInterruptHook();
+    else if( !sampleRequested )
+    {
+        lua_State *L = hookState;
+        if( L )
+            lua_sethook(L, NULL, 0, 0);
+    }
+}
+
+// Ask for the sample handler to be run (on the Lua thread) as soon as Lua executes
+void LuaEngine::requestSample()
+{
+    sampleRequested = true;
+    armInterruptHook();
+}
+
+void LuaEngine::setSampleHandler(SampleHandler handler)
+{
+    sampleHandler = handler;
+    if( !handler )
+        sampleRequested = false;
+}
+
+/*  Hooks are per-thread, so whoever resumes a coroutine should point the
+    interrupt hook at it for the duration (and restore the previous target
+    afterwards). Returns the previous target.
+*/
+lua_State *LuaEngine::setHookTarget(lua_State *L)
+{
+    lua_State *prev = hookState.exchange(L);
+
+    // A request may have been armed on the previous target just now
+    if( closeState || sampleRequested )
+        armInterruptHook();
+
+    return prev;
+}
+
+/*  The standard library's coroutine.resume()/wrap() know nothing of the
+    interrupt hook, and a coroutine only inherits whatever hook was set
+    when it was created (usually none), so a tight loop inside one would
+    never see CTRL+C or a profiler sample. These replacements point the
+    hook at the coroutine while it runs, as Async_lua::resume() does for
+    tasks; otherwise they behave as the originals.
+*/
+int LuaEngine::resumeCoroutine(lua_State *L, lua_State *co, int narg)
+{
+    if( !lua_checkstack(co, narg) )
+    {
+        lua_pushliteral(L, "too many arguments to resume");
+        return -1;
+    }
+
+    lua_xmove(L, co, narg);
+
+    // Only retarget if we are what the hook is on (ie. not in a worker state)
+    bool retarget = (hookState == L);
+    lua_State *prevHookTarget = retarget ? setHookTarget(co) : NULL;
+    int nres = 0;
+    int status = lua_resume(co, L, narg, &nres);
+    if( retarget )
+        setHookTarget(prevHookTarget);
+
+    if( status == LUA_OK || status == LUA_YIELD )
+    {
+        if( !lua_checkstack(L, nres + 1) )
+        {
+            lua_pop(co, nres);
+            lua_pushliteral(L, "too many results to resume");
+            return -1;
+        }
+        lua_xmove(co, L, nres);
+        return nres;
+    }
+
+    lua_xmove(co, L, 1); // Error message
+    return -1;
+}
+
+int LuaEngine::coroutine_resume(lua_State *L)
+{
+    lua_State *co = lua_tothread(L, 1);
+    luaL_argcheck(L, co, 1, "coroutine expected");
+
+    int nres = resumeCoroutine(L, co, lua_gettop(L) - 1);
+    if( nres < 0 )
+    {
+        lua_pushboolean(L, false);
+        lua_insert(L, -2);
+        return 2;
+    }
+
+    lua_pushboolean(L, true);
+    lua_insert(L, -(nres + 1));
+    return nres + 1;
+}
+
+int LuaEngine::coroutine_wrap(lua_State *L)
+{
+    luaL_checktype(L, 1, LUA_TFUNCTION);
+    lua_State *co = lua_newthread(L);
+    lua_pushvalue(L, 1);
+    lua_xmove(L, co, 1);
+    lua_pushcclosure(L, LuaEngine::coroutine_wrapped, 1);
+    return 1;
 }
 
+// The function returned by coroutine.wrap(); the coroutine is its upvalue
+int LuaEngine::coroutine_wrapped(lua_State *L)
+{
+    lua_State *co = lua_tothread(L, lua_upvalueindex(1));
+    int nres = resumeCoroutine(L, co, lua_gettop(L));
+    if( nres >= 0 )
+        return nres;
+
+    int status = lua_status(co);
+    if( status != LUA_OK && status != LUA_YIELD )
+    {   // Dead by error; close its to-be-closed variables, as the original does
+        #if LUA_VERSION_RELEASE_NUM >= 50406
+        lua_closethread(co, L);
+        #else
+        lua_resetthread(co);
+        #endif
+        lua_xmove(co, L, 1);
+    }
+
+    if( lua_type(L, -1) == LUA_TSTRING )
+    {   // Add where the error happened
+        luaL_where(L, 1);
+        lua_insert(L, -2);
+        lua_concat(L, 2);
+    }
+    return lua_error(L);
+}
 
 // Placeholder; this gets replaced by user script
 int LuaEngine::_macrotab_init(lua_State *)
@@ -171,6 +362,88 @@ int LuaEngine::fireEvent(lua_State *L)
     return 0;
 }
 
+/*  macro.setFrameRate(number hz)
+    Returns:    nil
+
+    Sets the target number of main loop cycles per second.
+    0 disables frame pacing.
+*/
+int LuaEngine::setFrameRate(lua_State *L)
+{
+    if( lua_gettop(L) != 1 )
+        wrongArgs(L);
+    checkType(L, LT_NUMBER, 1);
+
+    lua_Number hz = lua_tonumber(L, 1);
+    if( hz < 0 )
+        hz = 0;
+
+    Macro::instance()->getScheduler()->setFrameRate((unsigned int)hz);
+    return 0;
+}
+
+/*  macro.getFrameRate()
+    Returns:    number
+
+    Returns the target main loop cycles per second (0 = unpaced).
+*/
+int LuaEngine::getFrameRate(lua_State *L)
+{
+    lua_pushinteger(L, Macro::instance()->getScheduler()->getFrameRate());
+    return 1;
+}
+
+/*  macro.setIdleMode(string mode)
+    Returns:    nil
+
+    Sets how the main loop idles between cycles:
+        "spin"      Yield without sleeping (lowest latency, highest CPU)
+        "sleep"     Sleep in 1ms steps
+        "wait"      Block until the next frame is due or an event arrives
+*/
+int LuaEngine::setIdleMode(lua_State *L)
+{
+    if( lua_gettop(L) != 1 )
+        wrongArgs(L);
+    checkType(L, LT_STRING, 1);
+
+    MicroMacro::IdleMode mode;
+    if( !MicroMacro::Scheduler::parseIdleMode(lua_tostring(L, 1), mode) )
+        return luaL_argerror(L, 1, "expected \"spin\", \"sleep\", or \"wait\"");
+
+    Macro::instance()->getScheduler()->setIdleMode(mode);
+    return 0;
+}
+
+/*  macro.getIdleMode()
+    Returns:    string
+
+    Returns the current idle mode ("spin", "sleep", or "wait").
+*/
+int LuaEngine::getIdleMode(lua_State *L)
+{
+    lua_pushstring(L, MicroMacro::Scheduler::getIdleModeName(Macro::instance()->getScheduler()->getIdleMode()));
+    return 1;
+}
+
+/*  macro.getStats()
+    Returns:    table
+
+    Returns main loop timing and event statistics:
+        frames      Number of cycles run by this script
+        phases      Per-phase timing (in ms) over recent cycles, keyed by phase:
+                    foreground, hidpoll, hidinput, consoleresize, events,
+                    messages, main, idle, frame.
+                    Each is a table of {samples, min, avg, p50, p99, max}
+        events      Number of events dispatched, keyed by event name
+        queue       {depth, maxDepth, capacity, dropped}
+*/
+int LuaEngine::getStats(lua_State *L)
+{
+    Macro::instance()->getStats()->push(L);
+    return 1;
+}
+
 /*  Push this into the stack and use it as the message handler
     for lua_pcall(). This appends the stacktrace to any error
     messages we might catch.
@@ -215,61 +488,34 @@ int LuaEngine::is32bit(lua_State *L)
     return 1;
 }
 
-// Basic initialization stuff
-int LuaEngine::init()
+/*  Registers our types, modules and addons with a fresh state and
+    points package.path at our lib directory. Worker states (see
+    Thread_lua) get everything except the modules that belong to the
+    main loop.
+*/
+int LuaEngine::openModules(lua_State *L, bool isWorker, const std::string &basePath)
 {
-    if( lstate )
-        return MicroMacro::ERR_DOUBLE_INIT;
-
-    // Create the Lua state
-    lstate = luaL_newstate();
-    if( !lstate )
-        return MicroMacro::ERR_INIT_FAIL;
-
-    // Load Lua libraries
-    luaL_openlibs(lstate);
-
-    // Load our own library
-    static const luaL_Reg _macrotab[] = {
-        {MACRO_INIT_NAME, LuaEngine::_macrotab_init},
-        {MACRO_MAIN_NAME, LuaEngine::_macrotab_main},
-        {MACRO_EVENT_NAME, LuaEngine::_macrotab_event},
-        {"getVersion", LuaEngine::_macrotab_getVersion},
-        {"is64bit", LuaEngine::is64bit},
-        {"is32bit", LuaEngine::is32bit},
-        {"fireEvent", LuaEngine::fireEvent},
-        {NULL, NULL}
-    };
-
-    luaL_newlib(lstate, _macrotab);
-    lua_setglobal(lstate, MACRO_TABLE_NAME);
-
     /* Register types (metatables) */
-    registerLuaTypes(lstate);
+    registerLuaTypes(L);
 
     /* Register modules & addons */
     const lua_CFunction regModFuncs[] = {
         /* Modules */
         Clipper_lua::regmod,
-        Ncurses_lua::regmod,
         Time_lua::regmod,
-        Keyboard_lua::regmod,
-        Mouse_lua::regmod,
         Key_lua::regmod,
-        Gamepad_lua::regmod,
         System_lua::regmod,
         Filesystem_lua::regmod,
         Process_lua::regmod,
         Window_lua::regmod,
         MemoryChunk_lua::regmod,    // Is this needed?
+        ScanResult_lua::regmod,
+        PointerPath_lua::regmod,
+        Snapshot_lua::regmod,
         Serial_lua::regmod,
         Serial_port_lua::regmod,
         Sqlite_lua::regmod,
-        #ifdef NETWORKING_ENABLED
-        Network_lua::regmod,
-        Socket_lua::regmod,
-        #endif
-
+        Frozen_lua::regmod,
         Class_lua::regmod,
         Log_lua::regmod,
         Hash_lua::regmod,
@@ -284,42 +530,121 @@ int LuaEngine::init()
         0 // NULL terminator
     };
 
-    unsigned int i = 0;
-    while( regModFuncs[i] != 0 )
+    /* Modules that belong to the main loop (input, console, timers, ...) */
+    const lua_CFunction mainModFuncs[] = {
+        Ncurses_lua::regmod,
+        Keyboard_lua::regmod,
+        Mouse_lua::regmod,
+        Gamepad_lua::regmod,
+        Profiler_lua::regmod,
+        Async_lua::regmod,
+        Timer_lua::regmod,
+        #ifdef NETWORKING_ENABLED
+        Network_lua::regmod,
+        Socket_lua::regmod,
+        #endif
+        Thread_lua::regmod,
+        0 // NULL terminator
+    };
+
+    /* Worker threads talk to the main state instead */
+    const lua_CFunction workerModFuncs[] = {
+        Thread_lua::regworker,
+        0 // NULL terminator
+    };
+
+    const lua_CFunction *modLists[] = {regModFuncs, isWorker ? workerModFuncs : mainModFuncs};
+    for(unsigned int list = 0; list < sizeof(modLists)/sizeof(modLists[0]); list++)
     {
-        int regSuccess = regModFuncs[i](lstate);
-        if( regSuccess != MicroMacro::ERR_OK )
-        {   // Error occurred while loading module
-            const char *err = "One or more modules failed to load.";
-            fprintf(stderr, err);
-            Logger::instance()->add("%s", err);
-            return regSuccess;
+        unsigned int i = 0;
+        while( modLists[list][i] != 0 )
+        {
+            int regSuccess = modLists[list][i](L);
+            if( regSuccess != MicroMacro::ERR_OK )
+            {   // Error occurred while loading module
+                const char *err = "One or more modules failed to load.";
+                fprintf(stderr, err);
+                Logger::instance()->add("%s", err);
+                return regSuccess;
+            }
+            ++i; // Next module
         }
-        ++i; // Next module
     }
 
     /* Set path */
-    lua_getglobal(lstate, "package");
-    lua_getfield(lstate, -1, "path");
-    std::string curPath = lua_tostring(lstate, -1);     // Grab path
-    lua_pop(lstate, 1);                                 // Remove the old
+    lua_getglobal(L, "package");
+    lua_getfield(L, -1, "path");
+    std::string curPath = lua_tostring(L, -1);          // Grab path
+    lua_pop(L, 1);                                      // Remove the old
     curPath.append(";");                                // Add the new
     curPath.append(basePath);
     curPath.append("/lib/?;");
     curPath.append(basePath);
     curPath.append("/lib/?.lua");
-    lua_pushstring(lstate, curPath.c_str());
-    lua_setfield(lstate, -2, "path");
-    lua_pop(lstate, 1);                                 // Reset stack
+    lua_pushstring(L, curPath.c_str());
+    lua_setfield(L, -2, "path");
+    lua_pop(L, 1);                                      // Reset stack
+
+    return MicroMacro::ERR_OK;
+}
+
+// Basic initialization stuff
+int LuaEngine::init()
+{
+    if( lstate )
+        return MicroMacro::ERR_DOUBLE_INIT;
+
+    // Create the Lua state
+    lstate = luaL_newstate();
+    if( !lstate )
+        return MicroMacro::ERR_INIT_FAIL;
+
+    // Load Lua libraries
+    luaL_openlibs(lstate);
+
+    // Load our own library
+    static const luaL_Reg _macrotab[] = {
+        {MACRO_INIT_NAME, LuaEngine::_macrotab_init},
+        {MACRO_MAIN_NAME, LuaEngine::_macrotab_main},
+        {MACRO_EVENT_NAME, LuaEngine::_macrotab_event},
+        {"getVersion", LuaEngine::_macrotab_getVersion},
+        {"is64bit", LuaEngine::is64bit},
+        {"is32bit", LuaEngine::is32bit},
+        {"fireEvent", LuaEngine::fireEvent},
+        {"setFrameRate", LuaEngine::setFrameRate},
+        {"getFrameRate", LuaEngine::getFrameRate},
+        {"setIdleMode", LuaEngine::setIdleMode},
+        {"getIdleMode", LuaEngine::getIdleMode},
+        {"getStats", LuaEngine::getStats},
+        {"spawn", Async_lua::spawn},
+        {NULL, NULL}
+    };
+
+    luaL_newlib(lstate, _macrotab);
+    lua_setglobal(lstate, MACRO_TABLE_NAME);
+
+    // Coroutines need to carry the interrupt hook along with them
+    lua_getglobal(lstate, LUA_COLIBNAME);
+    lua_pushcfunction(lstate, LuaEngine::coroutine_resume);
+    lua_setfield(lstate, -2, "resume");
+    lua_pushcfunction(lstate, LuaEngine::coroutine_wrap);
+    lua_setfield(lstate, -2, "wrap");
+    lua_pop(lstate, 1);
+
+    int success = openModules(lstate, false, basePath);
+    if( success != MicroMacro::ERR_OK )
+        return success;
 
     lastTimestamp.QuadPart = 0;
     fDeltaTime = 0.0;
     keyHookErrorState = MicroMacro::ERR_OK;
+    eventFuncRef = LUA_NOREF;
+    eventsFuncRef = LUA_NOREF;
 
-    // Install hook(s)
-    lua_sethook(lstate, closeHook, LUA_MASKLINE | LUA_MASKCOUNT, 100);
-
+    // The interrupt hook is armed on demand (see armInterruptHook())
     closeState = false;
+    sampleRequested = false;
+    hookState = lstate;
 
     return MicroMacro::ERR_OK;
 }
@@ -348,9 +673,18 @@ int LuaEngine::cleanup()
     Process_lua::cleanup(lstate);
     Keyboard_lua::cleanup(lstate);
     Mouse_lua::cleanup(lstate);
+    Profiler_lua::cleanup(lstate);
+    Async_lua::cleanup(lstate);
+    Timer_lua::cleanup(lstate);
+    Thread_lua::cleanup(lstate);
+
+    if( hookState == lstate )
+        hookState = NULL;
 
     lua_close(lstate);
     lstate = NULL;
+    eventFuncRef = LUA_NOREF;   // References died with the state
+    eventsFuncRef = LUA_NOREF;
 
     #ifdef NETWORKING_ENABLED
     // Run network cleanup *after* closing the Lua state (to ensure sockets aren't going to be hitting the GC during/after cleanup)
@@ -514,29 +848,13 @@ int LuaEngine::runMain()
     return retval;
 }
 
-/*  Run the script's macro.event() function.
-    Arguments passed depend on event type
+/*  Pushes the arguments for an event onto the stack, as they are
+    passed to macro.event() (the event name first).
+    Returns the number of values pushed, or -1 if the event should
+    be skipped (in which case nothing is pushed).
 */
-int LuaEngine::runEvent(MicroMacro::Event *pe)
+int LuaEngine::pushEventArgs(MicroMacro::Event *pe)
 {
-    // Push our message handler before arguments
-    int stackbase = lua_gettop(lstate);
-    lua_pushcfunction(lstate, LuaEngine::err_msgh);
-
-    lua_getglobal(lstate, MACRO_TABLE_NAME);
-    if( lua_type(lstate, -1) != LUA_TTABLE )
-    {
-        lua_pop(lstate, 1);
-        return MicroMacro::ERR_NOFUNCTION;
-    }
-
-    lua_getfield(lstate, -1, MACRO_EVENT_NAME);
-    if( lua_type(lstate, -1) != LUA_TFUNCTION )
-    {
-        lua_pop(lstate, 2);
-        return MicroMacro::ERR_NOFUNCTION;
-    }
-
     int nargs = 0; // The number of arguments we're pushing onto the stack
     switch( pe->type )
     {
@@ -605,13 +923,13 @@ int LuaEngine::runEvent(MicroMacro::Event *pe)
 
         case MicroMacro::EVENT_ERROR:
             lua_pushstring(lstate, "error");
-            lua_pushstring(lstate, pe->data.at(0).str.c_str());
+            lua_pushlstring(lstate, pe->data.at(0).getString(), pe->data.at(0).length);
             nargs = 2;
             break;
 
         case MicroMacro::EVENT_WARNING:
             lua_pushstring(lstate, "warning");
-            lua_pushstring(lstate, pe->data.at(0).str.c_str());
+            lua_pushlstring(lstate, pe->data.at(0).getString(), pe->data.at(0).length);
             nargs = 2;
             break;
 
@@ -627,10 +945,7 @@ int LuaEngine::runEvent(MicroMacro::Event *pe)
 
                 // Ensure that the socket is still valid, if not then don't do anything
                 if( pSocket->socket == INVALID_SOCKET )
-                {
-                    lua_pop(lstate, 3); // Pop msgh, stacktrace, macro table
-                    return 0;
-                }
+                    return -1;
 
                 lua_pushstring(lstate, "socketconnected");
 
@@ -664,7 +979,7 @@ int LuaEngine::runEvent(MicroMacro::Event *pe)
             }
             else
                 lua_pushinteger(lstate, pe->data.at(0).iNumber);
-            lua_pushlstring(lstate, pe->data.at(1).str.c_str(), pe->data.at(1).length);
+            lua_pushlstring(lstate, pe->data.at(1).getString(), pe->data.at(1).length);
             nargs = 3;
             break;
 
@@ -687,6 +1002,36 @@ int LuaEngine::runEvent(MicroMacro::Event *pe)
             nargs = 1;
             break;
 
+        case MicroMacro::EVENT_THREADFINISHED:
+            lua_pushstring(lstate, "threadfinished");
+            lua_pushinteger(lstate, pe->data.at(0).iNumber);
+            lua_pushboolean(lstate, pe->data.at(1).iNumber != 0);
+            nargs = 3;
+            if( pe->data.size() > 2 )
+            {
+                const MicroMacro::EventData &ced = pe->data.at(2);
+                lua_pushlstring(lstate, ced.getString(), ced.length);
+                nargs = 4;
+            }
+            break;
+
+        case MicroMacro::EVENT_MEMORYCHANGED:
+            lua_pushstring(lstate, "memorychanged");
+            lua_pushinteger(lstate, pe->data.at(0).iNumber);
+            for(unsigned int i = 1; i <= 2; i++)
+            {   // New value, then the one before
+                const MicroMacro::EventData &ced = pe->data.at(i);
+                if( ced.type == MicroMacro::ED_NIL )
+                    lua_pushnil(lstate);    // Not read
+                else if( ced.type == MicroMacro::ED_NUMBER )
+                    lua_pushnumber(lstate, ced.fNumber);
+                else
+                    lua_pushinteger(lstate, (lua_Integer)ced.i64Number);
+            }
+            lua_pushlstring(lstate, pe->data.at(3).getString(), pe->data.at(3).length);
+            nargs = 5;
+            break;
+
         case MicroMacro::EVENT_CUSTOM:
             {
                 unsigned int c = 0; // We count our pushes independently just in case there's weird data we don't push
@@ -704,13 +1049,14 @@ int LuaEngine::runEvent(MicroMacro::Event *pe)
                             break;
                         case MicroMacro::ED_64INTEGER:
                             lua_pushinteger(lstate, pe->data.at(i).i64Number);
+                            c++;
                             break;
                         case MicroMacro::ED_NUMBER:
                             lua_pushnumber(lstate, pe->data.at(i).fNumber);
                             c++;
                             break;
                         case MicroMacro::ED_STRING:
-                            lua_pushstring(lstate, (char *)pe->data.at(i).str.c_str());
+                            lua_pushlstring(lstate, pe->data.at(i).getString(), pe->data.at(i).length);
                             c++;
                             break;
                         case MicroMacro::ED_SOCKET:
@@ -735,6 +1081,100 @@ int LuaEngine::runEvent(MicroMacro::Event *pe)
             break;
     }
 
+    return nargs;
+}
+
+/*  Looks up macro.event and macro.events, and re-references them in
+    the registry only if the script has assigned something new.
+    Called once per cycle, so each event doesn't need to look them up.
+*/
+void LuaEngine::refreshHandlers()
+{
+    lua_getglobal(lstate, MACRO_TABLE_NAME);
+    if( lua_type(lstate, -1) != LUA_TTABLE )
+    {
+        lua_pop(lstate, 1);
+        releaseHandlerRef(eventFuncRef);
+        releaseHandlerRef(eventsFuncRef);
+        return;
+    }
+
+    updateHandlerRef(eventFuncRef, MACRO_EVENT_NAME);
+    updateHandlerRef(eventsFuncRef, MACRO_EVENTS_NAME);
+    lua_pop(lstate, 1); // Pop macro table
+}
+
+// Expects the macro table on top of the stack; leaves the stack unchanged
+void LuaEngine::updateHandlerRef(int &ref, const char *name)
+{
+    lua_getfield(lstate, -1, name);
+    if( lua_type(lstate, -1) != LUA_TFUNCTION )
+    {
+        lua_pop(lstate, 1);
+        releaseHandlerRef(ref);
+        return;
+    }
+
+    if( ref != LUA_NOREF )
+    {
+        lua_rawgeti(lstate, LUA_REGISTRYINDEX, ref);
+        bool unchanged = lua_rawequal(lstate, -1, -2);
+        lua_pop(lstate, 1);
+        if( unchanged )
+        {
+            lua_pop(lstate, 1);
+            return;
+        }
+        luaL_unref(lstate, LUA_REGISTRYINDEX, ref);
+    }
+
+    ref = luaL_ref(lstate, LUA_REGISTRYINDEX); // Pops the function
+}
+
+void LuaEngine::releaseHandlerRef(int &ref)
+{
+    if( ref != LUA_NOREF && lstate )
+        luaL_unref(lstate, LUA_REGISTRYINDEX, ref);
+    ref = LUA_NOREF;
+}
+
+bool LuaEngine::hasBatchHandler()
+{
+    return eventsFuncRef != LUA_NOREF;
+}
+
+/*  Run the script's macro.event() function.
+    Arguments passed depend on event type.
+    If the script uses macro.events() instead, the event is
+    delivered to it as a batch of one.
+*/
+int LuaEngine::runEvent(MicroMacro::Event *pe)
+{
+    if( eventFuncRef == LUA_NOREF && eventsFuncRef == LUA_NOREF )
+        refreshHandlers(); // We may not have looked them up yet
+
+    if( hasBatchHandler() )
+    {
+        beginEventBatch();
+        addEventToBatch(pe);
+        return endEventBatch();
+    }
+
+    if( eventFuncRef == LUA_NOREF )
+        return MicroMacro::ERR_NOFUNCTION;
+
+    // Push our message handler before arguments
+    int stackbase = lua_gettop(lstate);
+    lua_pushcfunction(lstate, LuaEngine::err_msgh);
+    lua_rawgeti(lstate, LUA_REGISTRYINDEX, eventFuncRef);
+
+    int nargs = pushEventArgs(pe);
+    if( nargs < 0 )
+    {
+        lua_settop(lstate, stackbase);
+        return MicroMacro::ERR_OK;
+    }
+
     int failstate = lua_pcall(lstate, nargs, 0, stackbase + 1);
     int retval = MicroMacro::ERR_OK;
     if( failstate )
@@ -743,7 +1183,93 @@ int LuaEngine::runEvent(MicroMacro::Event *pe)
         retval = mapLuaError(failstate);
     }
 
-    lua_pop(lstate, 2); // Pop stacktrace, macro table
+    lua_settop(lstate, stackbase); // Pop message handler
+    return retval;
+}
+
+// Call any timer.after()/timer.every() callbacks that are due
+int LuaEngine::runTimers()
+{
+    int stackbase = lua_gettop(lstate);
+    lua_pushcfunction(lstate, LuaEngine::err_msgh);
+
+    int success = Timer_lua::runTimers(lstate, stackbase + 1, lastErrorMsg);
+
+    lua_settop(lstate, stackbase);
+    return success;
+}
+
+// Resume any tasks (see macro.spawn()) that are ready to continue
+int LuaEngine::runTasks()
+{
+    std::string errMsg;
+    int success = Async_lua::runTasks(lstate, errMsg);
+    if( success != MicroMacro::ERR_OK )
+        lastErrorMsg = errMsg;
+
+    return success;
+}
+
+// Hand the event to any tasks blocked in async.waitEvent()
+void LuaEngine::notifyTaskEvent(MicroMacro::Event *pe)
+{
+    if( !Async_lua::hasEventWaiters() )
+        return;
+
+    int stackbase = lua_gettop(lstate);
+    int nargs = pushEventArgs(pe);
+    if( nargs > 0 )
+        Async_lua::deliverEvent(lstate, nargs);
+
+    lua_settop(lstate, stackbase);
+}
+
+/*  Batched delivery to macro.events(batch). Usage:
+        beginEventBatch(); addEventToBatch(pe)...; endEventBatch();
+    Each record in the batch is an array of the same values that
+    macro.event() would receive, ie. {"keypressed", 65, false}
+*/
+void LuaEngine::beginEventBatch()
+{
+    batchStackBase = lua_gettop(lstate);
+    lua_pushcfunction(lstate, LuaEngine::err_msgh);
+    lua_rawgeti(lstate, LUA_REGISTRYINDEX, eventsFuncRef);
+    lua_newtable(lstate);
+    batchSize = 0;
+}
+
+void LuaEngine::addEventToBatch(MicroMacro::Event *pe)
+{
+    lua_createtable(lstate, 4, 0);
+    int nargs = pushEventArgs(pe);
+    if( nargs < 0 )
+    {
+        lua_pop(lstate, 1);
+        return;
+    }
+
+    // Move the values we just pushed into the record, top first
+    for(int i = nargs; i > 0; i--)
+        lua_rawseti(lstate, -(i + 1), i);
+
+    lua_rawseti(lstate, -2, ++batchSize);
+}
+
+int LuaEngine::endEventBatch()
+{
+    int retval = MicroMacro::ERR_OK;
+    if( batchSize > 0 )
+    {
+        int failstate = lua_pcall(lstate, 1, 0, batchStackBase + 1);
+        if( failstate )
+        {
+            stdError();
+            retval = mapLuaError(failstate);
+        }
+    }
+
+    lua_settop(lstate, batchStackBase);
+    batchSize = 0;
     return retval;
 }
 
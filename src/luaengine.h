@@ -10,6 +10,7 @@
 
 	#include "error.h"
 	#include "timer.h"
+	#include <atomic>
 	#include <string>
 	#include <vector>
 
@@ -21,11 +22,13 @@
 	typedef struct lua_State lua_State;
 	typedef struct lua_Debug lua_Debug;
 	typedef void (*lua_Hook) (lua_State *L, lua_Debug *ar);
+	typedef void (*SampleHandler) (lua_State *L);
 
 	#define MACRO_TABLE_NAME					"macro"
 	#define MACRO_INIT_NAME						"init"
 	#define MACRO_MAIN_NAME						"main"
 	#define MACRO_EVENT_NAME					"event"
+	#define MACRO_EVENTS_NAME					"events"
 	#define	MAX_WINDOWS_MESSAGES_PER_CYCLE		100
 
 
@@ -37,25 +40,49 @@
 			static int _macrotab_main(lua_State *);
 			static int _macrotab_event(lua_State *);
 			static int _macrotab_getVersion(lua_State *);
-			static int err_msgh(lua_State *);
 
 			static int is64bit(lua_State *);
 			static int is32bit(lua_State *);
 
 			static int fireEvent(lua_State *);
+			static int setFrameRate(lua_State *);
+			static int getFrameRate(lua_State *);
+			static int setIdleMode(lua_State *);
+			static int getIdleMode(lua_State *);
+			static int getStats(lua_State *);
 
 			std::string basePath;
 			std::string lastErrorMsg;
 			TimeType lastTimestamp;			// Holds the timestamp so we can compute delta time
 			float fDeltaTime;				// Holds the time elapsed between last cycle and current logic cycle
 			int keyHookErrorState;
-			static bool closeState;			// Flag for whether or not we need to force terminate the script (CTRL+C)
-
-			static void closeHook(lua_State *L, lua_Debug *ar);
+			static std::atomic<bool> closeState;		// Flag for whether or not we need to force terminate the script (CTRL+C)
+			static std::atomic<bool> sampleRequested;	// Set by the profiler's timer thread
+			static std::atomic<SampleHandler> sampleHandler;
+			static std::atomic<lua_State *> hookState;	// State the interrupt hook is armed on
+
+			static void interruptHook(lua_State *L, lua_Debug *ar);
+			static void armInterruptHook();
+			static int resumeCoroutine(lua_State *, lua_State *, int);
+			static int coroutine_resume(lua_State *);
+			static int coroutine_wrap(lua_State *);
+			static int coroutine_wrapped(lua_State *);
+
+			int eventFuncRef;				// Registry references to macro.event and macro.events
+			int eventsFuncRef;
+			int batchStackBase;
+			int batchSize;
+
+			void updateHandlerRef(int &, const char *);
+			void releaseHandlerRef(int &);
+			int pushEventArgs(MicroMacro::Event *);
 		public:
-			LuaEngine() : lstate(NULL), lastErrorMsg(""), fDeltaTime(0), keyHookErrorState(MicroMacro::ERR_OK) { };
+			LuaEngine();
 			~LuaEngine();
 
+			static int err_msgh(lua_State *);
+			static int openModules(lua_State *, bool, const std::string &);
+
 			int init();
 			int reinit();
 			int cleanup();
@@ -67,6 +94,14 @@
 			int runInit(std::vector<std::string> * = NULL);
 			int runMain();
 			int runEvent(MicroMacro::Event *);
+			int runTimers();
+			int runTasks();
+			void notifyTaskEvent(MicroMacro::Event *);
+			void refreshHandlers();
+			bool hasBatchHandler();
+			void beginEventBatch();
+			void addEventToBatch(MicroMacro::Event *);
+			int endEventBatch();
 			int dispatchWindowsMessages();
 
 			float getDeltaTime();
@@ -81,6 +116,9 @@
 			void setKeyHookErrorState(int);
 
 			static void setCloseState(bool = false);
+			static void requestSample();
+			static void setSampleHandler(SampleHandler);
+			static lua_State *setHookTarget(lua_State *);
 	};
 
 
@@ -14,6 +14,7 @@
 #include "event.h"
 #include "macro.h"
 #include "ncurses_lua.h"
+#include "pointerpath.h"
 
 #include <math.h>
 #include <cmath>
@@ -108,8 +109,13 @@ int LuaType::handle_gc(lua_State *L)
     checkType(L, LT_USERDATA, 1);
     ProcHandle *pHandle = static_cast<ProcHandle *>(lua_touserdata(L, 1));
 
-    CloseHandle(pHandle->handle);
-    pHandle->handle = NULL;
+    if( MicroMacro::ProcMem::isValid(pHandle->handle) )
+        MicroMacro::ProcMem::close(pHandle->handle);
+    pHandle->handle = 0;
+
+    if( pHandle->pointerCache )
+        pHandle->pointerCache->release();
+    pHandle->pointerCache = NULL;
     return 0;
 }
 
@@ -119,7 +125,11 @@ int LuaType::handle_tostring(lua_State *L)
     ProcHandle *pHandle = static_cast<ProcHandle *>(lua_touserdata(L, 1));
 
     char buffer[128];
+    #ifdef WIN32
     slprintf(buffer, sizeof(buffer) - 1, "Process handle: 0x%p", pHandle->handle);
+    #else
+    slprintf(buffer, sizeof(buffer) - 1, "Process handle: %d", pHandle->handle);
+    #endif
     lua_pushstring(L, buffer);
     return 1;
 }
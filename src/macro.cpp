@@ -13,6 +13,7 @@
 
 #ifdef NETWORKING_ENABLED
     #include "socket_lua.h"
+    #include "async_lua.h"
 #endif
 
 extern "C"
@@ -32,7 +33,6 @@ BOOL WINAPI GetCurrentConsoleFont(HANDLE hConsoleOutput, BOOL bMaximumWindow, PC
 
 using MicroMacro::Event;
 using MicroMacro::EventType;
-using MicroMacro::Mutex;
 
 CMacro *CMacro::pinstance = 0;
 CMacro *CMacro::instance()
@@ -59,6 +59,7 @@ CMacro::CMacro()
     consoleDefaultAttributes = 0;
     lastConsoleSizeX = 0;
     lastConsoleSizeY = 0;
+    eventsDropped = 0;
 }
 
 CMacro::~CMacro()
@@ -137,6 +138,21 @@ Hid *CMacro::getHid()
     return &hid;
 }
 
+MicroMacro::Scheduler *CMacro::getScheduler()
+{
+    return &scheduler;
+}
+
+MicroMacro::LoopStats *CMacro::getStats()
+{
+    return &stats;
+}
+
+MicroMacro::AxisFilter *CMacro::getAxisFilter()
+{
+    return &axisFilter;
+}
+
 DWORD CMacro::getProcId()
 {
     if( procId == 0 )
@@ -220,40 +236,81 @@ DWORD CMacro::getConsoleDefaultAttributes()
     return consoleDefaultAttributes;
 }
 
-void CMacro::pushEvent(Event *pe)
+/*  Takes ownership of the event. Safe to call from any thread; never blocks.
+    If the queue is full the event is discarded and counted so that
+    handleEvents() can report the overflow.
+*/
+bool CMacro::pushEvent(Event *pe)
 {
-    if( eventQueueLock.lock(5, __FUNCTION__) )
+    if( eventQueue.push(pe) )
     {
-        eventQueue.push(pe);
-        eventQueueLock.unlock(__FUNCTION__);
+        scheduler.wake();
+        return true;
     }
+
+    delete pe;
+    return false;
 }
 
 void CMacro::flushEvents()
 {
-    if( eventQueueLock.lock(INFINITE, __FUNCTION__) )
-    {
-        // Foreach and delete all
-        while( eventQueue.size() )
-        {
-            Event *pe = eventQueue.front();
-            delete pe;
-            eventQueue.pop();
-        }
-        /*
-        // Quickest and easiest way is to just make a new queue, then swap.
-        std::queue<Event *> emptyQueue;
-        swap(eventQueue, emptyQueue);*/
-        eventQueueLock.unlock(__FUNCTION__);
+    // Foreach and delete all
+    Event *pe;
+    while( eventQueue.pop(pe) )
+        delete pe;
+    axisFilter.reset();
+
+    eventsDropped += eventQueue.takeOverflowCount();
+}
+
+size_t CMacro::getEventQueueDepth()
+{
+    return eventQueue.size();
+}
+
+// Total number of events discarded due to a full queue during this run
+size_t CMacro::getEventsDropped()
+{
+    return eventsDropped + eventQueue.getOverflowCount();
+}
+
+/*  If any events were rejected since we last checked, log it and
+    let the script know through a warning event.
+*/
+void CMacro::reportEventOverflow()
+{
+    size_t dropped = eventQueue.takeOverflowCount();
+    if( dropped == 0 )
+        return;
+
+    eventsDropped += dropped;
+
+    char buffer[256];
+    slprintf(buffer, sizeof(buffer), "Event queue overflow; %u event(s) were dropped.", (unsigned int)dropped);
+    Logger::instance()->add("%s", buffer);
+
+    try {
+        Event *pe = new Event;
+        pe->type = MicroMacro::EVENT_WARNING;
+        MicroMacro::EventData ced;
+        ced.setValue(std::string(buffer));
+        pe->data.push_back(ced);
+        pushEvent(pe);
+    }
+    catch( std::bad_alloc &ba ) {
+        badAllocation();
     }
 }
 
 int CMacro::handleHidInput()
 {
+    TimeType phaseStart = getNow();
     hid.poll();
+    stats.record(MicroMacro::PHASE_HID_POLL, phaseStart);
+    phaseStart = getNow();
 
-    // Handle keyboard/mouse
-    for(unsigned int i = 0; i < KS_SIZE; i++)
+    // Handle keyboard/mouse; only visit the keys poll() saw change
+    for(int i = hid.nextChangedKey(0); i >= 0; i = hid.nextChangedKey(i + 1))
     {
         if( hid.released(i) )
         {   // Key released
@@ -377,16 +434,14 @@ int CMacro::handleHidInput()
             }
         }
 
-        // Check axis
+        // Check axis; the filter drops jitter and coalesces while an event is queued
         for(unsigned int a = 1; a <= GAMEPAD_AXIS_COUNT; a++)
         {
-            if( hid.joyAxisChanged(i, a) )
+            float value;
+            if( hid.joyAxisChanged(i, a) && axisFilter.update(i, a, (float)hid.joyAxis(i, a) / 65535.0f * 100, value) )
             {
                 Event *pe = new Event;
                 pe->type = MicroMacro::EVENT_GAMEPADAXISCHANGED;
-                /*pe->idata1 = i + 1;
-                pe->idata2 = a;
-                pe->fdata3 = hid.joyAxis(i, a)/65535.0f*100;*/
 
                 MicroMacro::EventData ced;
                 ced.setValue((int)(i + 1));
@@ -395,11 +450,12 @@ int CMacro::handleHidInput()
                 ced.setValue((int)a);
                 pe->data.push_back(ced);
 
-                ced.setValue((float)hid.joyAxis(i, a) / 65535.0f * 100);
+                ced.setValue(value);
                 pe->data.push_back(ced);
 
                 try {
-                    pushEvent(pe);
+                    if( pushEvent(pe) )
+                        axisFilter.markQueued(i, a);
                 }
                 catch( std::bad_alloc &ba ) {
                     badAllocation();
@@ -408,6 +464,7 @@ int CMacro::handleHidInput()
         }
     }
 
+    stats.record(MicroMacro::PHASE_HID_INPUT, phaseStart);
     return MicroMacro::ERR_OK;
 }
 
@@ -415,22 +472,42 @@ int CMacro::handleEvents()
 {
     int success = MicroMacro::ERR_OK;
 
-    if( eventQueueLock.lock(INFINITE, __FUNCTION__) )
+    reportEventOverflow();
+
+    /* If the script provides macro.events(), everything queued this
+        cycle is collected and handed over in a single call.
+    */
+    engine.refreshHandlers();
+    bool batched = engine.hasBatchHandler();
+    if( batched )
+        engine.beginEventBatch();
+
+    /* Only dispatch what was queued when we started; anything pushed while
+        Lua is running (ie. by macro.fireEvent()) waits for the next cycle
+        so a handler that fires events can't starve the main loop.
+    */
+    size_t pending = eventQueue.size();
+    stats.sampleQueue(pending, getEventsDropped());
+
+    Event *pe;
+    while( pending-- > 0 && eventQueue.pop(pe) )
     {
-        while( !eventQueue.empty() )
-        {
-            Event *pe = eventQueue.front();
+        if( pe->type == MicroMacro::EVENT_GAMEPADAXISCHANGED )
+        {   // Hand over the newest reading, not the one it was queued with
+            MicroMacro::EventData &value = pe->data.at(2);
+            value.setValue(axisFilter.takeLatest(pe->data.at(0).iNumber - 1, pe->data.at(1).iNumber));
+        }
+
+        stats.countEvent(pe->type);
+        engine.notifyTaskEvent(pe);
+        if( batched )
+            engine.addEventToBatch(pe);
+        else
             success = engine.runEvent(pe);
-            delete pe;
-            eventQueue.pop();
+        delete pe;
 
-            if( success != MicroMacro::ERR_OK )
-            {
-                lua_pop(engine.getLuaState(), 1);
-                break;
-            }
-        }
-        eventQueueLock.unlock(__FUNCTION__);
+        if( success != MicroMacro::ERR_OK )
+            break;
     }
 
     #ifdef NETWORKING_ENABLED
@@ -444,23 +521,28 @@ int CMacro::handleEvents()
             MicroMacro::Socket *pSocket = *i;
             if( pSocket->mutex.lock(INFINITE, __FUNCTION__) )
             {
-                while( !pSocket->eventQueue.empty() )
+                while( success == MicroMacro::ERR_OK && !pSocket->eventQueue.empty() )
                 {
-                    MicroMacro::Event *pe = &pSocket->eventQueue.front();
-                    success = engine.runEvent(pe);
+                    MicroMacro::Event *pe = pSocket->eventQueue.front();
+                    stats.countEvent(pe->type);
+                    engine.notifyTaskEvent(pe);
+                    if( batched )
+                        engine.addEventToBatch(pe);
+                    else
+                        success = engine.runEvent(pe);
                     pSocket->eventQueue.pop();
-
-                    if( success != MicroMacro::ERR_OK )
-                    {
-                        lua_pop(engine.getLuaState(), 1);
-                        break;
-                    }
+                    delete pe;
                 }
 
                 pSocket->mutex.unlock(__FUNCTION__);
             }
         }
 
+        if( batched )
+        {   // Deliver before any sockets referenced by the batch can be deleted
+            success = engine.endEventBatch();
+            batched = false;
+        }
 
         // Now iterate over the list again and delete those marked for deletion
         i   =   Socket_lua::socketList.begin();
@@ -471,6 +553,7 @@ int CMacro::handleEvents()
             {
                 if( pSocket->deleteMe )
                 {
+                    Async_lua::socketDeleted(pSocket);
                     i = Socket_lua::socketList.erase(i);
                     delete pSocket;
                     pSocket = NULL;
@@ -488,5 +571,8 @@ int CMacro::handleEvents()
     }
     #endif
 
+    if( batched )
+        success = engine.endEventBatch();
+
     return success;
 }
@@ -8,13 +8,14 @@
 #ifndef MACRO_H
 #define MACRO_H
 
-	#include <queue>
-
 	#include "luaengine.h"
 	#include "settings.h"
 	#include "hid.h"
 	#include "event.h"
-	#include "mutex.h"
+	#include "eventqueue.h"
+	#include "scheduler.h"
+	#include "loopstats.h"
+	#include "axisfilter.h"
 
 	class CMacro;
 	typedef CMacro Macro;
@@ -40,11 +41,17 @@
 			LuaEngine engine;
 			Settings settings;
 			Hid hid;
+			MicroMacro::Scheduler scheduler;
+			MicroMacro::LoopStats stats;
+			MicroMacro::AxisFilter axisFilter;
 
 			int lastConsoleSizeX;
 			int lastConsoleSizeY;
 
-			std::queue<MicroMacro::Event *> eventQueue;
+			MicroMacro::EventQueue eventQueue;
+			size_t eventsDropped;
+
+			void reportEventOverflow();
 
 		public:
 			static CMacro *instance();
@@ -53,6 +60,9 @@
 			LuaEngine *getEngine();
 			Settings *getSettings();
 			Hid *getHid();
+			MicroMacro::Scheduler *getScheduler();
+			MicroMacro::LoopStats *getStats();
+			MicroMacro::AxisFilter *getAxisFilter();
 
 			DWORD getProcId();
 			HWND getAppHwnd();
@@ -65,13 +75,13 @@
 			int getConsoleFontHeight();
 			DWORD getConsoleDefaultAttributes();
 
-			void pushEvent(MicroMacro::Event *);
+			bool pushEvent(MicroMacro::Event *);
 			void flushEvents();
+			size_t getEventQueueDepth();
+			size_t getEventsDropped();
 
 			int handleHidInput();
 			int handleEvents();
-
-			MicroMacro::Mutex eventQueueLock;
 	};
 
 #endif
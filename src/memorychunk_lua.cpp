@@ -9,6 +9,10 @@
 #include "error.h"
 #include "strl.h"
 #include "types.h"
+#include "valuescan.h"
+#include "scanresult_lua.h"
+
+#include <string.h>
 
 extern "C"
 {
@@ -18,8 +22,11 @@ extern "C"
 }
 
 const char *LuaType::metatable_memorychunk = "memorychunk";
+const char *LuaType::metatable_memorylayout = "memorylayout";
 
 using MicroMacro::MemoryChunk;
+using MicroMacro::MemoryLayout;
+using MicroMacro::LayoutField;
 using MicroMacro::getChunkVariable;
 
 int MemoryChunk_lua::regmod(lua_State *L)
@@ -34,6 +41,18 @@ int MemoryChunk_lua::regmod(lua_State *L)
         {"getSize", getSize},
         {"getAddress", getAddress},
         {"getData", getData},
+        {"unpack", unpack},
+        {NULL, NULL}
+    };
+
+    const luaL_Reg layoutMeta[] = {
+        {"__gc", layout_gc},
+        {"__tostring", layout_tostring},
+        {NULL, NULL}
+    };
+
+    const luaL_Reg funcs[] = {
+        {"layout", layout},
         {NULL, NULL}
     };
 
@@ -44,6 +63,13 @@ int MemoryChunk_lua::regmod(lua_State *L)
 
     lua_pop(L, 1); // Pop table
 
+    luaL_newmetatable(L, LuaType::metatable_memorylayout);
+    luaL_setfuncs(L, layoutMeta, 0);
+    lua_pop(L, 1);
+
+    luaL_newlib(L, funcs);
+    lua_setglobal(L, MEMORYCHUNK_MODULE_NAME);
+
     return MicroMacro::ERR_OK;
 }
 
@@ -172,3 +198,186 @@ int MemoryChunk_lua::getData(lua_State *L)
 
     return 1;
 }
+
+/*  memorychunk.layout(table fields)
+    Returns:    layout
+
+    Compiles a description of a struct, for memorychunk:unpack().
+    Each field should be a table: {name, type, offset [, count]}, where
+    'type' is as for memorychunk:getData() and 'offset' is from the start
+    of the chunk. A 'count' above 1 gives an array of that many values,
+    one after another; for strings, 'count' is the length instead.
+
+    Example:
+        local layout = memorychunk.layout{
+            {"hp", "int", 0x10},
+            {"pos", "float", 0x20, 3},
+            {"name", "string", 0x40, 32},
+        }
+*/
+int MemoryChunk_lua::layout(lua_State *L)
+{
+    if( lua_gettop(L) != 1 )
+        wrongArgs(L);
+    checkType(L, LT_TABLE, 1);
+
+    size_t count = lua_rawlen(L, 1);
+    MemoryLayout compiled;
+    lua_createtable(L, (int)count, 0); // Field names, in order
+    int namesIndex = lua_gettop(L);
+
+    for(size_t i = 1; i <= count; i++)
+    {
+        lua_rawgeti(L, 1, i);
+        bool valid = lua_istable(L, -1);
+        if( valid )
+        {
+            lua_rawgeti(L, -1, 1);
+            lua_rawgeti(L, -2, 2);
+            lua_rawgeti(L, -3, 3);
+            lua_rawgeti(L, -4, 4);
+
+            LayoutField field;
+            field.offset = (size_t)lua_tointeger(L, -2);
+            field.count = lua_isnumber(L, -1) ? (unsigned int)lua_tointeger(L, -1) : 1;
+            valid = lua_type(L, -4) == LUA_TSTRING && lua_type(L, -3) == LUA_TSTRING && lua_isnumber(L, -2)
+                && (lua_isnoneornil(L, -1) || (lua_isnumber(L, -1) && lua_tointeger(L, -1) > 0));
+
+            if( valid && strcmp(lua_tostring(L, -3), "string") == 0 )
+            {
+                field.type = MicroMacro::MEM_STRING;
+                field.size = field.count;
+                field.count = 1;
+                valid = lua_isnumber(L, -1);
+            }
+            else if( valid )
+            {
+                valid = ScanResult_lua::getValueType(lua_tostring(L, -3), field.type);
+                field.size = valid ? MicroMacro::ValueScan::getValueSize(field.type) : 0;
+            }
+
+            if( valid )
+            {
+                compiled.fields.push_back(field);
+                lua_pushvalue(L, -4);
+                lua_rawseti(L, namesIndex, (int)compiled.fields.size());
+            }
+            lua_pop(L, 4);
+        }
+        lua_pop(L, 1);
+
+        if( !valid )
+        {
+            luaL_error(L, "Invalid field at index %d; expected {name, type, offset [, count]}.", (int)i);
+            return 0;
+        }
+    }
+
+    MemoryLayout **ppLayout = static_cast<MemoryLayout **>(lua_newuserdata(L, sizeof(MemoryLayout *)));
+    try {
+        *ppLayout = new MemoryLayout(compiled);
+    } catch( std::bad_alloc &ba ) {
+        badAllocation();
+    }
+    luaL_getmetatable(L, LuaType::metatable_memorylayout);
+    lua_setmetatable(L, -2);
+
+    // Names stay as Lua strings, so unpacking doesn't have to make them again
+    lua_pushvalue(L, namesIndex);
+    lua_setuservalue(L, -2);
+
+    return 1;
+}
+
+int MemoryChunk_lua::layout_gc(lua_State *L)
+{
+    MemoryLayout **ppLayout = static_cast<MemoryLayout **>(lua_touserdata(L, 1));
+    delete *ppLayout;
+    *ppLayout = NULL;
+    return 0;
+}
+
+int MemoryChunk_lua::layout_tostring(lua_State *L)
+{
+    MemoryLayout **ppLayout = static_cast<MemoryLayout **>(lua_touserdata(L, 1));
+    char buffer[64];
+    slprintf(buffer, sizeof(buffer), "Memory layout (%u fields)", (unsigned int)(*ppLayout)->fields.size());
+
+    lua_pushstring(L, buffer);
+    return 1;
+}
+
+/*  memorychunk:unpack(layout [, table out])
+    Returns:    table
+
+    Reads every field of a layout (see memorychunk.layout()) from a
+    memory chunk, returning them in a table keyed by field name.
+    If 'out' is given, the fields are stored in it (and it is returned)
+    rather than in a new table; arrays already in it are reused too.
+    Fields that lie beyond the end of the chunk are set to nil.
+*/
+int MemoryChunk_lua::unpack(lua_State *L)
+{
+    int top = lua_gettop(L);
+    if( top != 2 && top != 3 )
+        wrongArgs(L);
+    checkType(L, LT_USERDATA, 1);
+    checkType(L, LT_USERDATA, 2);
+    if( top >= 3 )
+        checkType(L, LT_TABLE, 3);
+
+    MemoryChunk *pChunk = static_cast<MemoryChunk *>(lua_touserdata(L, 1));
+    MemoryLayout **ppLayout = static_cast<MemoryLayout **>(
+        luaL_testudata(L, 2, LuaType::metatable_memorylayout));
+    if( ppLayout == NULL )
+    {
+        luaL_error(L, "Expected a layout from memorychunk.layout().");
+        return 0;
+    }
+
+    const std::vector<LayoutField> &fields = (*ppLayout)->fields;
+    lua_getuservalue(L, 2);
+    int namesIndex = lua_gettop(L);
+    if( top >= 3 )
+        lua_pushvalue(L, 3);
+    else
+        lua_createtable(L, 0, (int)fields.size());
+    int outIndex = lua_gettop(L);
+
+    const unsigned char *data = reinterpret_cast<const unsigned char *>(pChunk->data);
+    for(size_t i = 0; i < fields.size(); i++)
+    {
+        const LayoutField &field = fields[i];
+        lua_rawgeti(L, namesIndex, (int)(i + 1));
+
+        if( field.offset > pChunk->size || field.size * field.count > pChunk->size - field.offset )
+            lua_pushnil(L);
+        else if( field.type == MicroMacro::MEM_STRING )
+        {
+            const char *str = pChunk->data + field.offset;
+            lua_pushlstring(L, str, strnlen(str, field.size));
+        }
+        else if( field.count == 1 )
+            ScanResult_lua::pushValue(L, field.type, data + field.offset);
+        else
+        {
+            lua_pushvalue(L, -1);
+            lua_rawget(L, outIndex);
+            if( !lua_istable(L, -1) )
+            {
+                lua_pop(L, 1);
+                lua_createtable(L, (int)field.count, 0);
+            }
+
+            for(unsigned int k = 0; k < field.count; k++)
+            {
+                ScanResult_lua::pushValue(L, field.type, data + field.offset + k * field.size);
+                lua_rawseti(L, -2, k + 1);
+            }
+        }
+
+        lua_rawset(L, outIndex);
+    }
+
+    return 1;
+}
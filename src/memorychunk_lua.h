@@ -8,11 +8,14 @@
 #ifndef MEMORYCHUNK_LUA_H
 #define MEMORYCHUNK_LUA_H
 
+	#define MEMORYCHUNK_MODULE_NAME		"memorychunk"
+
 	typedef struct lua_State lua_State;
 
 	namespace LuaType
 	{
 		extern const char *metatable_memorychunk;
+		extern const char *metatable_memorylayout;
 	}
 
 	class MemoryChunk_lua
@@ -23,6 +26,11 @@
 			static int getSize(lua_State *);
 			static int getAddress(lua_State *);
 			static int getData(lua_State *);
+			static int unpack(lua_State *);
+
+			static int layout(lua_State *);
+			static int layout_gc(lua_State *);
+			static int layout_tostring(lua_State *);
 
 		public:
 			static int regmod(lua_State *);
@@ -0,0 +1,507 @@
+/******************************************************************************
+    Project:    MicroMacro
+    Author:     SolarStrike Software
+    URL:        www.solarstrike.net
+    License:    Modified BSD (see license.txt)
+******************************************************************************/
+
+#include "memorywatch.h"
+#include "valuescan.h"
+#include "timer.h"
+
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <new>
+
+#ifdef WIN32
+    #include <mmsystem.h>
+#else
+    #include <time.h>
+#endif
+
+namespace MicroMacro
+{
+    template <class T>
+    static double loadDouble(const unsigned char *in)
+    {
+        T value;
+        memcpy(&value, in, sizeof(T));
+        return (double)value;
+    }
+
+    // For comparing against thresholds
+    static double toDouble(BatchJob_type type, const unsigned char *in)
+    {
+        switch( type )
+        {
+            case MEM_BYTE:      return loadDouble<char>(in);
+            case MEM_UBYTE:     return loadDouble<unsigned char>(in);
+            case MEM_SHORT:     return loadDouble<short>(in);
+            case MEM_USHORT:    return loadDouble<unsigned short>(in);
+            case MEM_INT:       return loadDouble<int>(in);
+            case MEM_UINT:      return loadDouble<unsigned int>(in);
+            case MEM_INT64:     return loadDouble<long long>(in);
+            case MEM_UINT64:    return loadDouble<unsigned long long>(in);
+            case MEM_FLOAT:     return loadDouble<float>(in);
+            case MEM_DOUBLE:    return loadDouble<double>(in);
+            default:            return 0;
+        }
+    }
+
+    MemoryWatcher::MemoryWatcher(WatchCallback callback)
+    {
+        this->callback = callback;
+        nextId = 1;
+        stopping = false;
+
+        #ifdef WIN32
+        hThread = NULL;
+        hWakeEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+        InitializeCriticalSection(&lock);
+        #else
+        threadRunning = false;
+        pthread_mutex_init(&lock, NULL);
+        pthread_cond_init(&wake, NULL);
+        #endif
+    }
+
+    MemoryWatcher::~MemoryWatcher()
+    {
+        clear();
+
+        #ifdef WIN32
+        CloseHandle(hWakeEvent);
+        DeleteCriticalSection(&lock);
+        #else
+        pthread_cond_destroy(&wake);
+        pthread_mutex_destroy(&lock);
+        #endif
+    }
+
+    #ifdef WIN32
+    DWORD WINAPI MemoryWatcher::pollThread(LPVOID param)
+    {
+        static_cast<MemoryWatcher *>(param)->run();
+        return 0;
+    }
+    #else
+    void *MemoryWatcher::pollThread(void *param)
+    {
+        static_cast<MemoryWatcher *>(param)->run();
+        return NULL;
+    }
+    #endif
+
+    /*  Sleeps between polls. Holds the lock whenever it is not sleeping,
+        reading memory or passing changes to the callback.
+    */
+    void MemoryWatcher::run()
+    {
+        #ifdef WIN32
+        timeBeginPeriod(1);
+        #endif
+        lockWatches();
+
+        std::vector<WatchChange> changes;
+        while( !stopping )
+        {
+            changes.clear();
+            long long wait = 0;
+            try {
+                wait = poll(getNow().QuadPart, changes);
+            } catch( std::bad_alloc &ba ) {
+                // Those that were due are skipped until next time
+            }
+
+            if( !changes.empty() )
+            {   // The callback may take a while, so watches can be added or removed meanwhile
+                unlockWatches();
+                for(size_t i = 0; i < changes.size(); i++)
+                    callback(changes[i]);
+                lockWatches();
+                continue;   // Anything could have changed; work out the wait again
+            }
+
+            #ifdef WIN32
+            DWORD ms = INFINITE;
+            if( wait >= 0 )
+                ms = (DWORD)((wait + NANOSECONDS_PER_MILLISECOND - 1) / NANOSECONDS_PER_MILLISECOND);
+            unlockWatches();
+            WaitForSingleObject(hWakeEvent, ms);
+            lockWatches();
+            #else
+            if( wait < 0 )
+                pthread_cond_wait(&wake, &lock);
+            else
+            {
+                struct timespec until;
+                clock_gettime(CLOCK_REALTIME, &until);
+                long long nsec = until.tv_nsec + wait;
+                until.tv_sec += nsec / NANOSECONDS_PER_SECOND;
+                until.tv_nsec = nsec % NANOSECONDS_PER_SECOND;
+                pthread_cond_timedwait(&wake, &lock, &until);
+            }
+            #endif
+        }
+
+        unlockWatches();
+        #ifdef WIN32
+        timeEndPeriod(1);
+        #endif
+    }
+
+    /*  Reads every watch that is due, a process at a time, and adds any
+        changes to 'changes'. Returns how long until the next watch is
+        due, or -1 if there are none.
+        Called with the lock held, but lets go of it while reading; the
+        processes being read are held on to meanwhile, and watches removed
+        in the meantime are skipped.
+    */
+    long long MemoryWatcher::poll(long long now, std::vector<WatchChange> &changes)
+    {
+        struct DueWatch
+        {
+            unsigned int id;
+            unsigned int procId;
+            size_t address;
+        };
+
+        std::vector<DueWatch> due;
+        std::vector<ReadRequest> requests;
+        for(std::map<unsigned int, Watch>::iterator it = watches.begin(); it != watches.end(); ++it)
+        {
+            Watch &watch = it->second;
+            if( watch.nextDue > now )
+                continue;
+
+            DueWatch dueWatch = {it->first, watch.procId, watch.address};
+            ReadRequest request = {watch.address, NULL, watch.size, false};
+            due.push_back(dueWatch);
+            requests.push_back(request);
+
+            // Keep to the schedule, unless we have fallen behind it
+            watch.nextDue += watch.interval;
+            if( watch.nextDue <= now )
+                watch.nextDue = now + watch.interval;
+        }
+
+        if( !due.empty() )
+        {
+            std::vector<size_t> order(due.size());
+            for(size_t i = 0; i < order.size(); i++)
+                order[i] = i;
+            std::sort(order.begin(), order.end(), [&due](size_t a, size_t b) {
+                if( due[a].procId != due[b].procId )
+                    return due[a].procId < due[b].procId;
+                return due[a].address < due[b].address;
+            });
+
+            std::vector<unsigned char> values(due.size() * MEMORY_WATCH_VALUE_SIZE);
+            std::vector<ReadRequest> sorted(due.size());
+            for(size_t i = 0; i < order.size(); i++)
+            {
+                sorted[i] = requests[order[i]];
+                sorted[i].buffer = &values[i * MEMORY_WATCH_VALUE_SIZE];
+            }
+
+            // Each process read from, and a hold on it so that it stays open while unlocked.
+            // Nothing is allocated once a hold is taken, so nothing can throw before it is let go
+            std::vector<std::pair<size_t, size_t> > spans;
+            std::vector<unsigned int> procIds;
+            std::vector<ProcessHandle> handles;
+            spans.reserve(order.size());
+            procIds.reserve(order.size());
+            handles.reserve(order.size());
+            changes.reserve(changes.size() + order.size());
+            for(size_t first = 0; first < order.size(); )
+            {
+                size_t end = first + 1;
+                unsigned int procId = due[order[first]].procId;
+                while( end < order.size() && due[order[end]].procId == procId )
+                    ++end;
+
+                WatchedProcess &process = processes[procId];
+                ++process.watchCount;
+                spans.push_back(std::make_pair(first, end));
+                procIds.push_back(procId);
+                handles.push_back(process.handle);
+                first = end;
+            }
+
+            unlockWatches();
+            for(size_t i = 0; i < spans.size(); i++)
+            {
+                try {
+                    ProcMem::readCoalesced(handles[i], &sorted[spans[i].first],
+                                           spans[i].second - spans[i].first, MEMORY_WATCH_READ_GAP);
+                } catch( std::bad_alloc &ba ) {
+                    // Left marked as failed
+                }
+            }
+            lockWatches();
+
+            for(size_t i = 0; i < order.size(); i++)
+            {
+                std::map<unsigned int, Watch>::iterator found = watches.find(due[order[i]].id);
+                if( found == watches.end() )
+                    continue;   // Removed while we were reading
+
+                if( sorted[i].ok )
+                    check(found->first, found->second, &values[i * MEMORY_WATCH_VALUE_SIZE], changes);
+                else
+                    readFailed(found->first, found->second, changes);
+            }
+
+            for(size_t i = 0; i < procIds.size(); i++)
+                releaseProcess(procIds[i]);
+        }
+
+        if( watches.empty() )
+            return -1;
+
+        long long nextDue = watches.begin()->second.nextDue;
+        for(std::map<unsigned int, Watch>::iterator it = watches.begin(); it != watches.end(); ++it)
+            nextDue = std::min(nextDue, it->second.nextDue);
+        return std::max(nextDue - now, 0LL);
+    }
+
+    // Compare a fresh value against the last; true if there was a change to report
+    bool MemoryWatcher::check(unsigned int id, Watch &watch, const unsigned char *value,
+                              std::vector<WatchChange> &changes)
+    {
+        watch.failed = false;
+        if( !watch.known )
+        {   // First read; nothing to compare against yet
+            memcpy(watch.last, value, watch.size);
+            memcpy(watch.reported, value, watch.size);
+            watch.known = true;
+            return false;
+        }
+
+        const WatchOptions &options = watch.options;
+        double current = toDouble(watch.type, value);
+        double last = toDouble(watch.type, watch.last);
+
+        bool report = false;
+        WatchReason reason = WATCH_CHANGED;
+        if( options.hasAbove && last <= options.above && current > options.above )
+        {
+            report = true;
+            reason = WATCH_ABOVE;
+        }
+        else if( options.hasBelow && last >= options.below && current < options.below )
+        {
+            report = true;
+            reason = WATCH_BELOW;
+        }
+        else if( !options.hasAbove && !options.hasBelow && memcmp(value, watch.reported, watch.size) != 0 )
+        {
+            double reported = toDouble(watch.type, watch.reported);
+            report = options.delta <= 0 || fabs(current - reported) >= options.delta;
+        }
+
+        if( report )
+        {
+            WatchChange change;
+            change.id = id;
+            change.address = watch.address;
+            change.type = watch.type;
+            change.reason = reason;
+            change.hasPrevious = true;
+            memset(change.value, 0, sizeof(change.value));
+            memset(change.previous, 0, sizeof(change.previous));
+            memcpy(change.value, value, watch.size);
+            memcpy(change.previous, reason == WATCH_CHANGED ? watch.reported : watch.last, watch.size);
+            memcpy(watch.reported, value, watch.size);
+
+            changes.push_back(change);
+        }
+
+        memcpy(watch.last, value, watch.size);
+        return report;
+    }
+
+    // A watch could not be read; reported once, until it can be read again
+    void MemoryWatcher::readFailed(unsigned int id, Watch &watch, std::vector<WatchChange> &changes)
+    {
+        if( watch.failed )
+            return;
+        watch.failed = true;
+
+        WatchChange change;
+        change.id = id;
+        change.address = watch.address;
+        change.type = watch.type;
+        change.reason = WATCH_FAILED;
+        change.hasPrevious = watch.known;
+        memset(change.value, 0, sizeof(change.value));
+        memset(change.previous, 0, sizeof(change.previous));
+        if( watch.known )
+            memcpy(change.previous, watch.last, watch.size);
+
+        changes.push_back(change);
+    }
+
+    // Drop a watch's hold on its process; called with the lock held
+    void MemoryWatcher::releaseProcess(unsigned int procId)
+    {
+        std::map<unsigned int, WatchedProcess>::iterator found = processes.find(procId);
+        if( found == processes.end() )
+            return;
+
+        if( --found->second.watchCount == 0 )
+        {
+            ProcMem::close(found->second.handle);
+            processes.erase(found);
+        }
+    }
+
+    void MemoryWatcher::lockWatches()
+    {
+        #ifdef WIN32
+        EnterCriticalSection(&lock);
+        #else
+        pthread_mutex_lock(&lock);
+        #endif
+    }
+
+    void MemoryWatcher::unlockWatches()
+    {
+        #ifdef WIN32
+        LeaveCriticalSection(&lock);
+        #else
+        pthread_mutex_unlock(&lock);
+        #endif
+    }
+
+    void MemoryWatcher::wakeThread()
+    {
+        #ifdef WIN32
+        SetEvent(hWakeEvent);
+        #else
+        pthread_cond_signal(&wake);
+        #endif
+    }
+
+    /*  Watch the value at 'address' in a process, polling it every
+        'intervalMs' milliseconds. The process handle is duplicated, so
+        the caller may close theirs.
+        Returns the watch's ID, or 0 if it could not be added.
+    */
+    unsigned int MemoryWatcher::add(ProcessHandle handle, size_t address, BatchJob_type type,
+                                    unsigned int intervalMs, const WatchOptions &options)
+    {
+        size_t size = ValueScan::getValueSize(type);
+        unsigned int procId = ProcMem::getId(handle);
+        if( size == 0 || size > MEMORY_WATCH_VALUE_SIZE || procId == 0 )
+            return 0;
+
+        lockWatches();
+
+        unsigned int id = 0;
+        std::map<unsigned int, WatchedProcess>::iterator found = processes.find(procId);
+        if( found == processes.end() )
+        {
+            WatchedProcess process;
+            process.handle = ProcMem::duplicate(handle);
+            process.watchCount = 0;
+            if( ProcMem::isValid(process.handle) )
+                found = processes.insert(std::make_pair(procId, process)).first;
+        }
+
+        if( found != processes.end() )
+        {
+            Watch watch;
+            watch.procId = procId;
+            watch.address = address;
+            watch.type = type;
+            watch.size = size;
+            watch.interval = std::max(intervalMs, 1U) * NANOSECONDS_PER_MILLISECOND;
+            watch.nextDue = getNow().QuadPart;  // Read it right away, for something to compare against
+            watch.options = options;
+            watch.known = false;
+            watch.failed = false;
+
+            id = nextId++;
+            if( nextId == 0 )
+                nextId = 1;
+            watches[id] = watch;
+            ++found->second.watchCount;
+
+            #ifdef WIN32
+            if( !hThread )
+                hThread = CreateThread(NULL, 0, pollThread, (PVOID)this, 0, NULL);
+            #else
+            if( !threadRunning )
+                threadRunning = pthread_create(&thread, NULL, pollThread, this) == 0;
+            #endif
+            wakeThread();
+        }
+
+        unlockWatches();
+
+        return id;
+    }
+
+    // Returns false if there was no such watch
+    bool MemoryWatcher::remove(unsigned int id)
+    {
+        lockWatches();
+
+        std::map<unsigned int, Watch>::iterator found = watches.find(id);
+        bool removed = found != watches.end();
+        if( removed )
+        {
+            releaseProcess(found->second.procId);
+            watches.erase(found);
+        }
+
+        unlockWatches();
+
+        return removed;
+    }
+
+    // Remove every watch and stop the polling thread
+    void MemoryWatcher::clear()
+    {
+        lockWatches();
+        stopping = true;
+        wakeThread();
+        unlockWatches();
+
+        #ifdef WIN32
+        if( hThread )
+        {
+            WaitForSingleObject(hThread, INFINITE);
+            CloseHandle(hThread);
+            hThread = NULL;
+        }
+        #else
+        if( threadRunning )
+        {
+            pthread_join(thread, NULL);
+            threadRunning = false;
+        }
+        #endif
+
+        lockWatches();
+        watches.clear();
+        for(std::map<unsigned int, WatchedProcess>::iterator it = processes.begin(); it != processes.end(); ++it)
+            ProcMem::close(it->second.handle);
+        processes.clear();
+        stopping = false;
+        unlockWatches();
+    }
+
+    size_t MemoryWatcher::getCount()
+    {
+        lockWatches();
+
+        size_t count = watches.size();
+
+        unlockWatches();
+
+        return count;
+    }
+}
@@ -0,0 +1,128 @@
+/******************************************************************************
+	Project: 	MicroMacro
+	Author: 	SolarStrike Software
+	URL:		www.solarstrike.net
+	License:	Modified BSD (see license.txt)
+******************************************************************************/
+
+#ifndef MEMORYWATCH_H
+#define MEMORYWATCH_H
+
+	#include "types.h"
+	#include "procmem.h"
+	#include "wininclude.h"
+	#include <map>
+	#include <vector>
+	#include <stddef.h>
+
+	#ifndef WIN32
+		#include <pthread.h>
+	#endif
+
+	#define MEMORY_WATCH_READ_GAP		256		// Watched values this close together share a read
+	#define MEMORY_WATCH_VALUE_SIZE		8		// Largest value that can be watched
+
+	namespace MicroMacro
+	{
+		enum WatchReason{WATCH_CHANGED, WATCH_ABOVE, WATCH_BELOW, WATCH_FAILED};
+
+		struct WatchOptions
+		{
+			bool hasAbove;
+			bool hasBelow;
+			double above;		// Only report rising past this...
+			double below;		// ...or falling past this
+			double delta;		// Ignore changes smaller than this
+
+			WatchOptions() : hasAbove(false), hasBelow(false), above(0), below(0), delta(0) {}
+		};
+
+		/*	What is passed along when a watched value changes, or can no
+			longer be read (WATCH_FAILED, in which case 'value' is unset)
+		*/
+		struct WatchChange
+		{
+			unsigned int id;
+			size_t address;
+			BatchJob_type type;
+			WatchReason reason;
+			bool hasPrevious;		// False if it has never been read
+			unsigned char value[MEMORY_WATCH_VALUE_SIZE];
+			unsigned char previous[MEMORY_WATCH_VALUE_SIZE];
+		};
+
+		// Called from the polling thread, without the lock held; must be thread-safe
+		typedef void (*WatchCallback)(const WatchChange &);
+
+		/*	Polls watched values from a thread of its own, so that noticing
+			a change does not depend on how often the script gets around to
+			looking. Watches due at the same time in the same process are
+			read together, with nearby ones sharing a read; the callback is
+			only called when a value changes (or crosses a threshold), or
+			once when it stops being readable.
+			The thread is started by the first watch and runs until clear().
+		*/
+		class MemoryWatcher
+		{
+			protected:
+				struct Watch
+				{
+					unsigned int procId;
+					size_t address;
+					BatchJob_type type;
+					size_t size;
+					long long interval;			// Nanoseconds
+					long long nextDue;
+					WatchOptions options;
+					bool known;					// Whether it has been read yet
+					bool failed;				// Whether its last read failed (and was reported)
+					unsigned char last[MEMORY_WATCH_VALUE_SIZE];		// As of the last poll
+					unsigned char reported[MEMORY_WATCH_VALUE_SIZE];	// As last passed to the callback
+				};
+
+				struct WatchedProcess
+				{
+					ProcessHandle handle;		// Our own copy; see ProcMem::duplicate()
+					unsigned int watchCount;
+				};
+
+				std::map<unsigned int, Watch> watches;
+				std::map<unsigned int, WatchedProcess> processes;	// By process ID
+				unsigned int nextId;
+				WatchCallback callback;
+				bool stopping;
+
+				#ifdef WIN32
+				HANDLE hThread;
+				HANDLE hWakeEvent;
+				CRITICAL_SECTION lock;
+				static DWORD WINAPI pollThread(LPVOID);
+				#else
+				bool threadRunning;
+				pthread_t thread;
+				pthread_mutex_t lock;
+				pthread_cond_t wake;
+				static void *pollThread(void *);
+				#endif
+
+				void run();
+				long long poll(long long, std::vector<WatchChange> &);
+				bool check(unsigned int, Watch &, const unsigned char *, std::vector<WatchChange> &);
+				void readFailed(unsigned int, Watch &, std::vector<WatchChange> &);
+				void releaseProcess(unsigned int);
+				void lockWatches();
+				void unlockWatches();
+				void wakeThread();
+
+			public:
+				MemoryWatcher(WatchCallback);
+				~MemoryWatcher();
+
+				unsigned int add(ProcessHandle, size_t, BatchJob_type, unsigned int, const WatchOptions &);
+				bool remove(unsigned int);
+				void clear();
+				size_t getCount();
+		};
+	}
+
+#endif
@@ -0,0 +1,616 @@
+/******************************************************************************
+    Project:    MicroMacro
+    Author:     SolarStrike Software
+    URL:        www.solarstrike.net
+    License:    Modified BSD (see license.txt)
+******************************************************************************/
+
+#include "patternscan.h"
+#include "simd.h"
+
+#include <atomic>
+
+#ifndef WIN32
+    #include <pthread.h>
+    #include <unistd.h>
+#endif
+
+namespace MicroMacro
+{
+    // Byte values so common in code and data that they make poor anchors
+    static bool isCommonByte(unsigned char b)
+    {
+        return b == 0x00 || b == 0xFF || b == 0xCC || b == 0x90;
+    }
+
+    static size_t alignDown(size_t value, size_t alignment)
+    {
+        return value - (value % alignment);
+    }
+
+    BytePattern::BytePattern()
+        : anchor1(0), anchor2(0), hasFixed(false)
+    {
+    }
+
+    void BytePattern::set(const char *data, size_t dataLen, const char *mask, size_t maskLen)
+    {
+        bytes.assign(maskLen, 0);
+        care.assign(maskLen, 0);
+        hasFixed = false;
+
+        for(size_t i = 0; i < maskLen; i++)
+        {
+            if( mask[i] != 'x' || i >= dataLen )
+                continue; // Wildcard
+
+            bytes[i] = (unsigned char)data[i];
+            care[i] = 0xFF;
+            hasFixed = true;
+        }
+
+        if( !hasFixed )
+            return;
+
+        // Anchor on the first and last fixed bytes, preferring uncommon values
+        size_t firstFixed = maskLen, lastFixed = 0;
+        size_t firstRare = maskLen, lastRare = maskLen;
+        for(size_t i = 0; i < maskLen; i++)
+        {
+            if( !care[i] )
+                continue;
+
+            if( firstFixed == maskLen )
+                firstFixed = i;
+            lastFixed = i;
+
+            if( !isCommonByte(bytes[i]) )
+            {
+                if( firstRare == maskLen )
+                    firstRare = i;
+                lastRare = i;
+            }
+        }
+
+        anchor1 = firstRare != maskLen ? firstRare : firstFixed;
+        anchor2 = lastRare != maskLen && lastRare != anchor1 ? lastRare : lastFixed;
+    }
+
+    // Length of the longest stretch of non-wildcard bytes; 'start' gets where it begins
+    size_t BytePattern::longestFixedRun(size_t &start) const
+    {
+        size_t bestLen = 0, runLen = 0;
+        start = 0;
+        for(size_t i = 0; i < care.size(); i++)
+        {
+            runLen = care[i] ? runLen + 1 : 0;
+            if( runLen > bestLen )
+            {
+                bestLen = runLen;
+                start = i + 1 - runLen;
+            }
+        }
+        return bestLen;
+    }
+
+    // Whether the pattern matches at 'data'; there must be length() bytes available
+    bool BytePattern::matchAt(const unsigned char *data) const
+    {
+        for(size_t i = 0; i < bytes.size(); i++)
+        {
+            if( (data[i] ^ bytes[i]) & care[i] )
+                return false;
+        }
+        return true;
+    }
+
+    /*  Look through 'size' bytes of 'data' for the first match that starts
+        within the first 'count' bytes. Returns its offset, or
+        PATTERN_NOT_FOUND.
+    */
+    size_t BytePattern::find(const unsigned char *data, size_t size, size_t count) const
+    {
+        size_t len = bytes.size();
+        if( len == 0 || size < len )
+            return PATTERN_NOT_FOUND;
+
+        size_t limit = size - len + 1; // One past the last offset a full match fits at
+        if( count < limit )
+            limit = count;
+        if( !hasFixed )
+            return limit > 0 ? 0 : PATTERN_NOT_FOUND;
+
+        const unsigned char *first = data + anchor1;
+        const unsigned char *last = data + anchor2;
+        const unsigned char firstByte = bytes[anchor1];
+        const unsigned char lastByte = bytes[anchor2];
+        size_t i = 0;
+
+        #if defined(SIMD_AVX2)
+        const __m256i firstVec = _mm256_set1_epi8((char)firstByte);
+        const __m256i lastVec = _mm256_set1_epi8((char)lastByte);
+        for(; i + 32 <= limit; i += 32)
+        {
+            __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(first + i));
+            __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(last + i));
+            unsigned int candidates = (unsigned int)_mm256_movemask_epi8(
+                _mm256_and_si256(_mm256_cmpeq_epi8(a, firstVec), _mm256_cmpeq_epi8(b, lastVec)));
+
+            while( candidates )
+            {
+                size_t offset = i + lowestSetBit(candidates);
+                if( matchAt(data + offset) )
+                    return offset;
+                candidates &= candidates - 1;
+            }
+        }
+        #endif
+
+        #if defined(SIMD_SSE2)
+        const __m128i firstVec16 = _mm_set1_epi8((char)firstByte);
+        const __m128i lastVec16 = _mm_set1_epi8((char)lastByte);
+        for(; i + 16 <= limit; i += 16)
+        {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(first + i));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(last + i));
+            unsigned int candidates = (unsigned int)_mm_movemask_epi8(
+                _mm_and_si128(_mm_cmpeq_epi8(a, firstVec16), _mm_cmpeq_epi8(b, lastVec16)));
+
+            while( candidates )
+            {
+                size_t offset = i + lowestSetBit(candidates);
+                if( matchAt(data + offset) )
+                    return offset;
+                candidates &= candidates - 1;
+            }
+        }
+        #endif
+
+        for(; i < limit; i++)
+        {
+            if( first[i] == firstByte && last[i] == lastByte && matchAt(data + i) )
+                return i;
+        }
+
+        return PATTERN_NOT_FOUND;
+    }
+
+    PatternSet::PatternSet()
+        : maxLength(0), maxKeyLength(0)
+    {
+    }
+
+    // Patterns made only of wildcards can't be added
+    bool PatternSet::add(const BytePattern &pattern)
+    {
+        if( !pattern.hasFixedBytes() )
+            return false;
+
+        patterns.push_back(pattern);
+        if( pattern.length() > maxLength )
+            maxLength = pattern.length();
+        return true;
+    }
+
+    void PatternSet::build()
+    {
+        std::vector<std::vector<unsigned int> > stateOutputs(1);
+        transitions.assign(256, 0);
+        keyEnd.resize(patterns.size());
+
+        // A trie of each pattern's longest fixed run; 0 (the root) means "no edge" for now
+        for(unsigned int p = 0; p < patterns.size(); p++)
+        {
+            size_t keyStart;
+            size_t keyLen = patterns.at(p).longestFixedRun(keyStart);
+            const unsigned char *key = patterns.at(p).getBytes() + keyStart;
+            keyEnd.at(p) = keyStart + keyLen;
+            if( keyLen > maxKeyLength )
+                maxKeyLength = keyLen;
+
+            unsigned int state = 0;
+            for(size_t i = 0; i < keyLen; i++)
+            {
+                unsigned int &next = transitions[state * 256 + key[i]];
+                if( next == 0 )
+                {
+                    next = (unsigned int)stateOutputs.size();
+                    stateOutputs.push_back(std::vector<unsigned int>());
+                    transitions.resize(transitions.size() + 256, 0); // May move 'next'; don't touch it again
+                }
+                state = transitions[state * 256 + key[i]];
+            }
+            stateOutputs.at(state).push_back(p);
+        }
+
+        /*  Breadth first, point each missing edge where the failure link
+            would lead, so that matching never has to backtrack. A state
+            also reports whatever its failure state reports.
+        */
+        size_t stateCount = stateOutputs.size();
+        std::vector<unsigned int> fail(stateCount, 0);
+        std::vector<unsigned int> queue;
+        queue.reserve(stateCount);
+        queue.push_back(0);
+        for(size_t q = 0; q < queue.size(); q++)
+        {
+            unsigned int state = queue[q];
+            for(unsigned int c = 0; c < 256; c++)
+            {
+                unsigned int &next = transitions[state * 256 + c];
+                unsigned int fallback = state == 0 ? 0 : transitions[fail[state] * 256 + c];
+                if( next == 0 )
+                {
+                    next = fallback;
+                    continue;
+                }
+
+                fail[next] = fallback;
+                const std::vector<unsigned int> &inherited = stateOutputs.at(fallback);
+                stateOutputs.at(next).insert(stateOutputs.at(next).end(), inherited.begin(), inherited.end());
+                queue.push_back(next);
+            }
+        }
+
+        outputStart.resize(stateCount + 1);
+        outputs.clear();
+        for(size_t i = 0; i < stateCount; i++)
+        {
+            outputStart[i] = (unsigned int)outputs.size();
+            outputs.insert(outputs.end(), stateOutputs[i].begin(), stateOutputs[i].end());
+        }
+        outputStart[stateCount] = (unsigned int)outputs.size();
+
+        // Store each edge as its target's row offset, with bit 0 set if that state reports anything
+        for(size_t i = 0; i < transitions.size(); i++)
+        {
+            unsigned int next = transitions[i];
+            transitions[i] = next * 256 | (outputStart[next] != outputStart[next + 1] ? 1 : 0);
+        }
+    }
+
+    // The automaton reached 'state' on the byte at 'end'; check the patterns it reports
+    void PatternSet::checkOutputs(unsigned int state, size_t end, const unsigned char *data,
+                                  size_t size, size_t count, std::vector<PatternMatch> &matches) const
+    {
+        for(unsigned int o = outputStart[state]; o < outputStart[state + 1]; o++)
+        {
+            unsigned int p = outputs[o];
+            if( end + 1 < keyEnd[p] )
+                continue; // Would start before the data does
+
+            size_t start = end + 1 - keyEnd[p];
+            const BytePattern &pattern = patterns[p];
+            if( start < count && start + pattern.length() <= size && pattern.matchAt(data + start) )
+            {
+                PatternMatch match;
+                match.pattern = p;
+                match.offset = start;
+                matches.push_back(match);
+            }
+        }
+    }
+
+    /*  Append every match in 'size' bytes of 'data' that starts within the
+        first 'count' bytes to 'matches'. For any one pattern, matches come
+        out in order.
+        Each table lookup depends on the last, so a single walk through the
+        data spends most of its time waiting on memory. Instead, four walks
+        cover a quarter of the data each, interleaved. Each starts a little
+        early (from the root) so that it is in the right state by the time
+        its quarter begins; before then it reports nothing.
+    */
+    void PatternSet::find(const unsigned char *data, size_t size, size_t count,
+                          std::vector<PatternMatch> &matches) const
+    {
+        if( patterns.empty() || size == 0 )
+            return;
+
+        const unsigned int *table = &transitions[0];
+        const size_t streams = size >= 4096 ? 4 : 1;
+        size_t pos[4], reportFrom[4], end[4];
+        unsigned int edge[4];
+        std::vector<PatternMatch> found[4];
+
+        size_t steps = size;
+        for(size_t s = 0; s < streams; s++)
+        {
+            reportFrom[s] = size * s / streams;
+            end[s] = size * (s + 1) / streams;
+            pos[s] = reportFrom[s] > maxKeyLength ? reportFrom[s] - maxKeyLength : 0;
+            edge[s] = 0;
+            if( end[s] - pos[s] < steps )
+                steps = end[s] - pos[s];
+        }
+
+        if( streams == 4 )
+        {
+            for(size_t t = 0; t < steps; t++)
+            {
+                for(size_t s = 0; s < 4; s++)
+                {
+                    edge[s] = table[(edge[s] & ~0xFFu) + data[pos[s]]];
+                    if( (edge[s] & 1) && pos[s] >= reportFrom[s] )
+                        checkOutputs(edge[s] >> 8, pos[s], data, size, count, found[s]);
+                    ++pos[s];
+                }
+            }
+        }
+
+        // Whatever is left of each walk
+        for(size_t s = 0; s < streams; s++)
+        {
+            for(; pos[s] < end[s]; ++pos[s])
+            {
+                edge[s] = table[(edge[s] & ~0xFFu) + data[pos[s]]];
+                if( (edge[s] & 1) && pos[s] >= reportFrom[s] )
+                    checkOutputs(edge[s] >> 8, pos[s], data, size, count, found[s]);
+            }
+            matches.insert(matches.end(), found[s].begin(), found[s].end());
+        }
+    }
+
+    /*  Work out which parts of [address, address + length) can be read,
+        merging neighbouring readable regions so matches may span them.
+        'overlap' is how far past the end a match may need to read.
+        If the regions can't be listed the whole range is tried as-is.
+    */
+    void getScanRanges(ProcessHandle handle, size_t address, size_t length, size_t overlap,
+                       std::vector<ScanRange> &ranges)
+    {
+        ranges.clear();
+        size_t rangeEnd = length > (size_t)-1 - address ? (size_t)-1 : address + length;
+
+        std::vector<MemoryRegion> regions;
+        if( !ProcMem::getRegions(handle, regions) )
+        {
+            ScanRange range;
+            range.start = address;
+            range.end = rangeEnd;
+            range.readEnd = overlap > (size_t)-1 - rangeEnd ? (size_t)-1 : rangeEnd + overlap;
+            if( range.start < range.end )
+                ranges.push_back(range);
+            return;
+        }
+
+        size_t i = 0;
+        while( i < regions.size() )
+        {
+            if( !regions.at(i).readable )
+            {
+                i++;
+                continue;
+            }
+
+            // Extend this run of readable memory as far as it goes
+            size_t runStart = regions.at(i).base;
+            size_t runEnd = runStart + regions.at(i).size;
+            for(i++; i < regions.size() && regions.at(i).readable && regions.at(i).base == runEnd; i++)
+                runEnd += regions.at(i).size;
+
+            ScanRange range;
+            range.start = runStart > address ? runStart : address;
+            range.end = runEnd < rangeEnd ? runEnd : rangeEnd;
+            if( range.start >= range.end )
+                continue;
+
+            range.readEnd = runEnd - range.end > overlap ? range.end + overlap : runEnd;
+            ranges.push_back(range);
+        }
+    }
+
+    /*  Read up to 'want' bytes, a page at a time once a larger read comes
+        up short. Returns how many bytes, from the start, could be read.
+    */
+    size_t readAvailable(ProcessHandle handle, size_t address, unsigned char *buffer, size_t want)
+    {
+        size_t got = ProcMem::read(handle, address, buffer, want);
+        while( got < want )
+        {
+            size_t pageEnd = alignDown(address + got, SCAN_PAGE_SIZE) + SCAN_PAGE_SIZE;
+            size_t chunk = pageEnd - (address + got);
+            if( chunk > want - got )
+                chunk = want - got;
+
+            size_t n = ProcMem::read(handle, address + got, buffer + got, chunk);
+            got += n;
+            if( n < chunk )
+                break;
+        }
+        return got;
+    }
+
+    /*  Like getScanRanges(), but split further so that no piece crosses a
+        SCAN_PIECE_SIZE boundary. Each piece may still read 'overlap'
+        bytes into the next, so nothing is missed at the seams.
+    */
+    void getScanPieces(ProcessHandle handle, size_t address, size_t length, size_t overlap,
+                       std::vector<ScanRange> &pieces)
+    {
+        std::vector<ScanRange> ranges;
+        getScanRanges(handle, address, length, overlap, ranges);
+
+        pieces.clear();
+        for(size_t i = 0; i < ranges.size(); i++)
+        {
+            const ScanRange &range = ranges.at(i);
+            size_t pos = range.start;
+            while( pos < range.end )
+            {
+                ScanRange piece;
+                piece.start = pos;
+                piece.end = alignDown(pos, SCAN_PIECE_SIZE) + SCAN_PIECE_SIZE;
+                if( piece.end > range.end || piece.end < pos )
+                    piece.end = range.end;
+                piece.readEnd = range.readEnd - piece.end > overlap ? piece.end + overlap : range.readEnd;
+
+                pieces.push_back(piece);
+                pos = piece.end;
+            }
+        }
+    }
+
+    /*  Read a range in blocks (aligned to SCAN_BLOCK_SIZE, plus 'overlap'
+        bytes of the next) and hand each to 'callback', along with 'piece'.
+        Pages that turn out to be unreadable are skipped. 'buffer' is
+        reused between calls.
+        Returns the number of bytes read; 'stopped' is set if the callback
+        ended the scan.
+    */
+    size_t scanRange(ProcessHandle handle, const ScanRange &range, size_t piece, size_t overlap,
+                     std::vector<unsigned char> &buffer, ScanBlockCallback callback, void *param, bool &stopped)
+    {
+        if( buffer.size() < SCAN_BLOCK_SIZE + overlap )
+            buffer.resize(SCAN_BLOCK_SIZE + overlap);
+
+        size_t scanned = 0;
+        size_t pos = range.start;
+        stopped = false;
+        while( pos < range.end )
+        {
+            size_t ownedEnd = alignDown(pos, SCAN_BLOCK_SIZE) + SCAN_BLOCK_SIZE;
+            if( ownedEnd > range.end || ownedEnd < pos )
+                ownedEnd = range.end;
+            size_t readEnd = range.readEnd - ownedEnd > overlap ? ownedEnd + overlap : range.readEnd;
+
+            size_t got = readAvailable(handle, pos, &buffer[0], readEnd - pos);
+            scanned += got;
+
+            size_t count = ownedEnd - pos;
+            if( got < count )
+                count = got;
+
+            if( count > 0 && !callback(piece, pos, &buffer[0], got, count, param) )
+            {
+                stopped = true;
+                break;
+            }
+
+            if( got < ownedEnd - pos ) // Skip past the page we couldn't read
+                pos = alignDown(pos + got, SCAN_PAGE_SIZE) + SCAN_PAGE_SIZE;
+            else
+                pos = ownedEnd;
+        }
+
+        return scanned;
+    }
+
+    struct ScanShared
+    {
+        ProcessHandle handle;
+        const std::vector<ScanRange> *pieces;
+        size_t overlap;
+        ScanBlockCallback callback;
+        void *param;
+
+        std::atomic<size_t> nextPiece;
+        std::atomic<size_t> stopAfter;      // No piece past this one is wanted
+        std::atomic<size_t> bytesRead;
+    };
+
+    // Take pieces, in order, until there are none left (or none wanted)
+    static void scanWorker(ScanShared *shared)
+    {
+        std::vector<unsigned char> buffer;
+        while( true )
+        {
+            size_t piece = shared->nextPiece++;
+            if( piece >= shared->pieces->size() || piece > shared->stopAfter )
+                break;
+
+            bool stopped;
+            shared->bytesRead += scanRange(shared->handle, shared->pieces->at(piece), piece,
+                                           shared->overlap, buffer, shared->callback, shared->param, stopped);
+
+            if( stopped )
+            {
+                size_t current = shared->stopAfter;
+                while( piece < current && !shared->stopAfter.compare_exchange_weak(current, piece) )
+                    ;
+            }
+        }
+    }
+
+    #ifdef WIN32
+    static DWORD WINAPI scanThread(LPVOID param)
+    {
+        scanWorker(static_cast<ScanShared *>(param));
+        return 0;
+    }
+    #else
+    static void *scanThread(void *param)
+    {
+        scanWorker(static_cast<ScanShared *>(param));
+        return NULL;
+    }
+    #endif
+
+    /*  Scan pieces (from getScanPieces()) using up to 'threads' threads,
+        this one included. The callback is called from all of them, but
+        any one piece is only ever handled by one thread, in order; keep
+        results per piece and merge them in piece order for address
+        order. Once a callback returns false, pieces after its own are
+        skipped. Returns the number of bytes read.
+    */
+    size_t scanPieces(ProcessHandle handle, const std::vector<ScanRange> &pieces, size_t overlap,
+                      unsigned int threads, ScanBlockCallback callback, void *param)
+    {
+        ScanShared shared;
+        shared.handle = handle;
+        shared.pieces = &pieces;
+        shared.overlap = overlap;
+        shared.callback = callback;
+        shared.param = param;
+        shared.nextPiece = 0;
+        shared.stopAfter = (size_t)-1;
+        shared.bytesRead = 0;
+
+        if( threads > pieces.size() )
+            threads = (unsigned int)pieces.size();
+
+        // If a thread can't be started, those we have just take on more
+        #ifdef WIN32
+        std::vector<HANDLE> helpers;
+        for(unsigned int i = 1; i < threads; i++)
+        {
+            HANDLE hThread = CreateThread(NULL, 0, scanThread, (PVOID)&shared, 0, NULL);
+            if( hThread )
+                helpers.push_back(hThread);
+        }
+        #else
+        std::vector<pthread_t> helpers;
+        for(unsigned int i = 1; i < threads; i++)
+        {
+            pthread_t thread;
+            if( pthread_create(&thread, NULL, scanThread, &shared) == 0 )
+                helpers.push_back(thread);
+        }
+        #endif
+
+        scanWorker(&shared);
+
+        for(size_t i = 0; i < helpers.size(); i++)
+        {
+            #ifdef WIN32
+            WaitForSingleObject(helpers.at(i), INFINITE);
+            CloseHandle(helpers.at(i));
+            #else
+            pthread_join(helpers.at(i), NULL);
+            #endif
+        }
+
+        return shared.bytesRead;
+    }
+
+    unsigned int getProcessorCount()
+    {
+        #ifdef WIN32
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        return info.dwNumberOfProcessors > 0 ? info.dwNumberOfProcessors : 1;
+        #else
+        long count = sysconf(_SC_NPROCESSORS_ONLN);
+        return count > 0 ? (unsigned int)count : 1;
+        #endif
+    }
+}
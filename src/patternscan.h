@@ -0,0 +1,118 @@
+/******************************************************************************
+	Project: 	MicroMacro
+	Author: 	SolarStrike Software
+	URL:		www.solarstrike.net
+	License:	Modified BSD (see license.txt)
+******************************************************************************/
+
+#ifndef PATTERNSCAN_H
+#define PATTERNSCAN_H
+
+	#include "procmem.h"
+	#include <vector>
+	#include <stddef.h>
+
+	#define SCAN_BLOCK_SIZE			0x100000	// Bytes per read when scanning memory (1MB)
+	#define SCAN_PAGE_SIZE			0x1000		// Granularity at which unreadable memory is skipped
+	#define SCAN_PIECE_SIZE			0x400000	// Most memory one thread takes on at a time (4MB)
+	#define PATTERN_NOT_FOUND		((size_t)-1)
+
+	namespace MicroMacro
+	{
+		/*	A byte signature where some bytes may be wildcards, as given to
+			process.findPattern(): 'data' holds the bytes and 'mask' has an
+			'x' for each byte that must match; anything else is a wildcard.
+			Candidates are found by comparing two of the fixed ("anchor")
+			bytes 16 or 32 positions at a time; only those get the full
+			masked compare.
+		*/
+		class BytePattern
+		{
+			protected:
+				std::vector<unsigned char> bytes;
+				std::vector<unsigned char> care;	// 0xFF where the byte must match, 0 for wildcards
+				size_t anchor1;
+				size_t anchor2;
+				bool hasFixed;						// false if every byte is a wildcard
+
+			public:
+				BytePattern();
+
+				void set(const char *, size_t, const char *, size_t);
+				size_t length() const { return bytes.size(); }
+				bool hasFixedBytes() const { return hasFixed; }
+				size_t longestFixedRun(size_t &) const;
+				const unsigned char *getBytes() const { return &bytes[0]; }
+				bool matchAt(const unsigned char *) const;
+				size_t find(const unsigned char *, size_t, size_t) const;
+		};
+
+		struct PatternMatch
+		{
+			unsigned int pattern;	// Index into the PatternSet
+			size_t offset;			// Where the match starts in the data given
+		};
+
+		/*	Finds every match of many patterns in a single pass. The longest
+			run of fixed bytes in each pattern goes into an Aho-Corasick
+			automaton (a full 256-way transition table); wherever a run
+			turns up, the rest of its pattern, wildcards and all, is
+			checked with a masked compare.
+			Add every pattern, then build() before calling find().
+		*/
+		class PatternSet
+		{
+			protected:
+				std::vector<BytePattern> patterns;
+				std::vector<size_t> keyEnd;					// Offset just past each pattern's fixed run
+				std::vector<unsigned int> transitions;		// 256 per state
+				std::vector<unsigned int> outputStart;		// Per state; index into outputs
+				std::vector<unsigned int> outputs;			// Patterns whose run ends at that state
+				size_t maxLength;
+				size_t maxKeyLength;
+
+				void checkOutputs(unsigned int, size_t, const unsigned char *, size_t, size_t,
+					std::vector<PatternMatch> &) const;
+
+			public:
+				PatternSet();
+
+				bool add(const BytePattern &);
+				void build();
+				size_t size() const { return patterns.size(); }
+				size_t getMaxLength() const { return maxLength; }
+				void find(const unsigned char *, size_t, size_t, std::vector<PatternMatch> &) const;
+		};
+
+		/*	A stretch of readable memory to scan. Matches may start anywhere
+			from 'start' up to (not including) 'end', and may run on into
+			memory up to 'readEnd'.
+		*/
+		struct ScanRange
+		{
+			size_t start;
+			size_t end;
+			size_t readEnd;
+		};
+
+		/*	Called with each block of memory read while scanning. 'data' holds
+			'size' bytes copied from 'address'; only matches that start in
+			the first 'count' bytes belong to this block (the rest overlaps
+			the next block). 'piece' is the index of the piece (see
+			scanPieces()) the block is from.
+			Return false if nothing past this piece is wanted.
+		*/
+		typedef bool (*ScanBlockCallback)(size_t piece, size_t address, const unsigned char *data,
+			size_t size, size_t count, void *param);
+
+		size_t readAvailable(ProcessHandle, size_t, unsigned char *, size_t);
+		void getScanRanges(ProcessHandle, size_t, size_t, size_t, std::vector<ScanRange> &);
+		void getScanPieces(ProcessHandle, size_t, size_t, size_t, std::vector<ScanRange> &);
+		size_t scanRange(ProcessHandle, const ScanRange &, size_t, size_t, std::vector<unsigned char> &,
+			ScanBlockCallback, void *, bool &);
+		size_t scanPieces(ProcessHandle, const std::vector<ScanRange> &, size_t, unsigned int,
+			ScanBlockCallback, void *);
+		unsigned int getProcessorCount();
+	}
+
+#endif
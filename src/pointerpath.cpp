@@ -0,0 +1,245 @@
+/******************************************************************************
+    Project:    MicroMacro
+    Author:     SolarStrike Software
+    URL:        www.solarstrike.net
+    License:    Modified BSD (see license.txt)
+******************************************************************************/
+
+#include "pointerpath.h"
+
+#include <algorithm>
+
+namespace MicroMacro
+{
+    static bool byProcess(const PointerPath *a, const PointerPath *b)
+    {
+        return a->getProcess() < b->getProcess();
+    }
+
+    void PointerCache::release()
+    {
+        if( --refs == 0 )
+            delete this;
+    }
+
+    // The entry for 'key', made (unread) if no path has used it yet
+    PointerCache::EntryRef PointerCache::acquire(const Key &key)
+    {
+        EntryRef it = entries.find(key);
+        if( it == entries.end() )
+        {
+            Entry entry;
+            entry.valid = false;
+            entry.address = 0;
+            entry.value = 0;
+            entry.readAt.QuadPart = 0;
+            entry.users = 0;
+            it = entries.insert(std::make_pair(key, entry)).first;
+        }
+        ++it->second.users;
+        return it;
+    }
+
+    void PointerCache::drop(EntryRef it)
+    {
+        if( --it->second.users == 0 )
+            entries.erase(it);
+    }
+
+    /*  Forget the pointer at this entry, and every pointer beneath it; a
+        map orders keys so that those with this one as a prefix follow it.
+    */
+    void PointerCache::invalidate(EntryRef it)
+    {
+        const Key &prefix = it->first;
+        for(EntryRef below = it; below != entries.end(); ++below)
+        {
+            const Key &key = below->first;
+            if( key.size() < prefix.size() || !std::equal(prefix.begin(), prefix.end(), key.begin()) )
+                break;
+            below->second.valid = false;
+        }
+    }
+
+    PointerPath::PointerPath(ProcHandle *_process, size_t _base, const std::vector<size_t> &_offsets, double _ttl)
+        : process(_process), cache(NULL), base(_base), offsets(_offsets), ttl(_ttl), valid(false), address(0)
+    {
+        if( process->pointerCache == NULL )
+            process->pointerCache = new PointerCache();     // The handle's reference
+        cache = process->pointerCache;
+        cache->retain();
+
+        try {
+            PointerCache::Key key(1, base);
+            levels.reserve(offsets.size());
+            for(size_t level = 0; level < offsets.size(); level++)
+            {
+                levels.push_back(cache->acquire(key));
+                key.push_back(offsets.at(level));
+            }
+        } catch( std::bad_alloc & ) {
+            for(size_t i = 0; i < levels.size(); i++)
+                cache->drop(levels.at(i));
+            cache->release();
+            throw;
+        }
+    }
+
+    PointerPath::~PointerPath()
+    {
+        for(size_t i = 0; i < levels.size(); i++)
+            cache->drop(levels.at(i));
+        cache->release();
+    }
+
+    // Whether a pointer read earlier can stand in for reading 'from' at 'now'
+    bool PointerPath::isFresh(const PointerCache::Entry &entry, size_t from, TimeType now) const
+    {
+        if( !entry.valid || entry.address != from )
+            return false;
+        return ttl < 0.0 || deltaTime(now, entry.readAt) < ttl;
+    }
+
+    /*  Forget the pointers read from 'level' (0 being the one at 'base')
+        down, for this path and any other that goes through them.
+    */
+    void PointerPath::invalidate(size_t level)
+    {
+        if( level < levels.size() )
+            cache->invalidate(levels.at(level));
+        valid = false;
+    }
+
+    // The address the last resolve ended at; false if it failed
+    bool PointerPath::getAddress(size_t &out) const
+    {
+        if( !valid )
+            return false;
+        out = address;
+        return true;
+    }
+
+    bool PointerPath::resolve(size_t &out)
+    {
+        std::vector<PointerPath *> paths(1, this);
+        resolvePointerPaths(paths);
+        return getAddress(out);
+    }
+
+    /*  Resolve every path. Each level of every chain (for the same
+        process) is one scatter read of the distinct pointers that level
+        needs; pointers still in the cache, and read from the same address
+        as now, are not read again. Returns how many of the paths now have
+        an address.
+    */
+    size_t resolvePointerPaths(const std::vector<PointerPath *> &paths)
+    {
+        TimeType now = getNow();
+
+        std::vector<PointerPath *> pending(paths);
+        std::stable_sort(pending.begin(), pending.end(), byProcess);
+
+        std::vector<size_t> current;                // Where each chain has got to
+        std::vector<bool> failed;
+        std::vector<bool> needsRead;
+        std::vector<size_t> reads;                  // Distinct addresses to read at this level
+        std::vector<unsigned long long> pointers;   // Wide enough for either size of pointer
+        std::vector<ReadRequest> requests;
+
+        size_t groupStart = 0;
+        while( groupStart < pending.size() )
+        {
+            ProcHandle *process = pending.at(groupStart)->process;
+            size_t groupEnd = groupStart;
+            size_t depth = 0;
+            for(; groupEnd < pending.size() && pending.at(groupEnd)->process == process; groupEnd++)
+                depth = std::max(depth, pending.at(groupEnd)->offsets.size());
+
+            size_t count = groupEnd - groupStart;
+            size_t pointerSize = process->is32bit ? 4 : sizeof(size_t);
+            current.resize(count);
+            failed.assign(count, process->handle == 0);
+            needsRead.resize(count);
+            for(size_t i = 0; i < count; i++)
+                current[i] = pending.at(groupStart + i)->base;
+
+            for(size_t level = 0; level < depth; level++)
+            {
+                reads.clear();
+                for(size_t i = 0; i < count; i++)
+                {
+                    PointerPath *path = pending.at(groupStart + i);
+                    needsRead[i] = false;
+                    if( failed[i] || level >= path->offsets.size() )
+                        continue;
+
+                    const PointerCache::Entry &entry = path->levels.at(level)->second;
+                    if( path->isFresh(entry, current[i], now) )
+                        current[i] = entry.value + path->offsets.at(level);
+                    else
+                    {
+                        needsRead[i] = true;
+                        reads.push_back(current[i]);
+                    }
+                }
+                if( reads.empty() )
+                    continue;
+
+                std::sort(reads.begin(), reads.end());
+                reads.erase(std::unique(reads.begin(), reads.end()), reads.end());
+
+                // Pointers are little-endian, so a 32-bit one lands in the low half
+                pointers.assign(reads.size(), 0);
+                requests.resize(reads.size());
+                for(size_t k = 0; k < reads.size(); k++)
+                {
+                    requests[k].address = reads[k];
+                    requests[k].buffer = &pointers[k];
+                    requests[k].size = pointerSize;
+                    requests[k].ok = false;
+                }
+                ProcMem::readScatter(process->handle, &requests[0], requests.size());
+
+                for(size_t i = 0; i < count; i++)
+                {
+                    if( !needsRead[i] )
+                        continue;
+
+                    PointerPath *path = pending.at(groupStart + i);
+                    PointerCache::Entry &entry = path->levels.at(level)->second;
+                    size_t k = std::lower_bound(reads.begin(), reads.end(), current[i]) - reads.begin();
+                    if( requests[k].ok )
+                    {
+                        entry.valid = true;
+                        entry.address = current[i];
+                        entry.value = (size_t)pointers[k];
+                        entry.readAt = now;
+                        current[i] = entry.value + path->offsets.at(level);
+                    }
+                    else
+                    {
+                        entry.valid = false;
+                        failed[i] = true;
+                    }
+                }
+            }
+
+            for(size_t i = 0; i < count; i++)
+            {
+                PointerPath *path = pending.at(groupStart + i);
+                path->valid = !failed[i];
+                path->address = current[i];
+            }
+
+            groupStart = groupEnd;
+        }
+
+        size_t resolved = 0;
+        for(size_t i = 0; i < paths.size(); i++)
+        {
+            if( paths.at(i)->valid )
+                ++resolved;
+        }
+        return resolved;
+    }
+}
@@ -0,0 +1,97 @@
+/******************************************************************************
+	Project: 	MicroMacro
+	Author: 	SolarStrike Software
+	URL:		www.solarstrike.net
+	License:	Modified BSD (see license.txt)
+******************************************************************************/
+
+#ifndef POINTERPATH_H
+#define POINTERPATH_H
+
+	#include "types.h"
+	#include "timer.h"
+	#include <vector>
+	#include <map>
+	#include <stddef.h>
+
+	namespace MicroMacro
+	{
+		/*	The pointers that a process's pointer paths have read, one entry
+			per level of each chain, keyed by the chain's base and the offsets
+			leading up to that level. Paths that start the same way share the
+			same entries. Counts its references (the process handle and each
+			path that uses it) and deletes itself when the last is released.
+		*/
+		class PointerCache
+		{
+			public:
+				typedef std::vector<size_t> Key;	// Base, then offsets
+				struct Entry
+				{
+					bool valid;
+					size_t address;		// Where the pointer was read from
+					size_t value;		// ...and what it was
+					TimeType readAt;
+					unsigned int users;	// Paths that go through this entry
+				};
+				typedef std::map<Key, Entry>::iterator EntryRef;
+
+			protected:
+				std::map<Key, Entry> entries;
+				unsigned int refs;
+
+				~PointerCache() {}
+
+			public:
+				PointerCache() : refs(1) {}
+
+				void retain() { ++refs; }
+				void release();
+
+				EntryRef acquire(const Key &);
+				void drop(EntryRef);
+				void invalidate(EntryRef);
+		};
+
+		/*	A chain of pointers to follow, as with process.readPtr(): read a
+			pointer at 'base', add the first offset, read a pointer there,
+			add the next offset, and so on. Each pointer read is kept in the
+			process's PointerCache for 'ttl' seconds (or until invalidated,
+			if 'ttl' is negative), and is only read again once it expires or
+			the level above it changes.
+			Resolve many at once with resolvePointerPaths(); they follow
+			their chains a level at a time, one scatter read per level, and
+			chains that share a pointer only read it once.
+		*/
+		class PointerPath
+		{
+			protected:
+				ProcHandle *process;
+				PointerCache *cache;
+				size_t base;
+				std::vector<size_t> offsets;
+				std::vector<PointerCache::EntryRef> levels;	// One per offset
+				double ttl;
+
+				bool valid;				// Whether 'address' is from a successful resolve
+				size_t address;
+
+				bool isFresh(const PointerCache::Entry &, size_t, TimeType) const;
+
+				friend size_t resolvePointerPaths(const std::vector<PointerPath *> &);
+
+			public:
+				PointerPath(ProcHandle *, size_t, const std::vector<size_t> &, double);
+				~PointerPath();
+
+				ProcHandle *getProcess() const { return process; }
+				size_t getDepth() const { return offsets.size(); }
+				void invalidate(size_t);
+				bool getAddress(size_t &) const;
+				bool resolve(size_t &);
+		};
+
+		size_t resolvePointerPaths(const std::vector<PointerPath *> &);
+	}
+
+#endif
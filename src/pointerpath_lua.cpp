@@ -0,0 +1,113 @@
+/******************************************************************************
+    Project:    MicroMacro
+    Author:     SolarStrike Software
+    URL:        www.solarstrike.net
+    License:    Modified BSD (see license.txt)
+******************************************************************************/
+
+#include "pointerpath_lua.h"
+#include "pointerpath.h"
+#include "error.h"
+#include "strl.h"
+
+extern "C"
+{
+#include <lua.h>
+#include <lauxlib.h>
+#include <lualib.h>
+}
+
+const char *LuaType::metatable_pointerpath = "pointerpath";
+
+using MicroMacro::PointerPath;
+
+int PointerPath_lua::regmod(lua_State *L)
+{
+    const luaL_Reg meta[] = {
+        {"__gc", gc},
+        {"__tostring", tostring},
+        {NULL, NULL}
+    };
+
+    const luaL_Reg methods[] = {
+        {"resolve", resolve},
+        {"invalidate", invalidate},
+        {NULL, NULL}
+    };
+
+    luaL_newmetatable(L, LuaType::metatable_pointerpath);
+    luaL_setfuncs(L, meta, 0);
+    luaL_newlib(L, methods);
+    lua_setfield(L, -2, "__index");
+
+    lua_pop(L, 1); // Pop table
+
+    return MicroMacro::ERR_OK;
+}
+
+int PointerPath_lua::gc(lua_State *L)
+{
+    PointerPath **ppPath = static_cast<PointerPath **>(lua_touserdata(L, 1));
+    delete *ppPath;
+    *ppPath = NULL;
+    return 0;
+}
+
+int PointerPath_lua::tostring(lua_State *L)
+{
+    PointerPath **ppPath = static_cast<PointerPath **>(lua_touserdata(L, 1));
+    char buffer[64];
+    slprintf(buffer, sizeof(buffer), "Pointer path (%u levels)", (unsigned int)(*ppPath)->getDepth());
+
+    lua_pushstring(L, buffer);
+    return 1;
+}
+
+/*  pointerpath:resolve()
+    Returns (on success):   number address
+    Returns (on failure):   nil
+
+    Follows the path's pointers, unless it was resolved recently enough
+    (see process.pointerPath()), and returns the address it ends at.
+    Use process.resolvePaths() to resolve many paths at once.
+*/
+int PointerPath_lua::resolve(lua_State *L)
+{
+    if( lua_gettop(L) != 1 )
+        wrongArgs(L);
+    checkType(L, LT_USERDATA, 1);
+
+    PointerPath **ppPath = static_cast<PointerPath **>(lua_touserdata(L, 1));
+    size_t address;
+    if( !(*ppPath)->resolve(address) )
+        return 0;
+
+    lua_pushinteger(L, address);
+    return 1;
+}
+
+/*  pointerpath:invalidate([number level])
+    Returns:    nil
+
+    Forgets the pointers the path has read from 'level' down (1 being
+    the pointer at its address; the default), so that the next resolve
+    reads them again. Other paths that go through those pointers read
+    them again too.
+*/
+int PointerPath_lua::invalidate(lua_State *L)
+{
+    int top = lua_gettop(L);
+    if( top != 1 && top != 2 )
+        wrongArgs(L);
+    checkType(L, LT_USERDATA, 1);
+    if( top >= 2 )
+        checkType(L, LT_NUMBER, 2);
+
+    PointerPath **ppPath = static_cast<PointerPath **>(lua_touserdata(L, 1));
+    lua_Integer level = top >= 2 ? lua_tointeger(L, 2) : 1;
+    if( level < 1 )
+        luaL_error(L, "Invalid level %d; levels start at 1.", (int)level);
+
+    (*ppPath)->invalidate((size_t)(level - 1));
+    return 0;
+}
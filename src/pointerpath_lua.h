@@ -0,0 +1,30 @@
+/******************************************************************************
+	Project: 	MicroMacro
+	Author: 	SolarStrike Software
+	URL:		www.solarstrike.net
+	License:	Modified BSD (see license.txt)
+******************************************************************************/
+
+#ifndef POINTERPATH_LUA_H
+#define POINTERPATH_LUA_H
+
+	typedef struct lua_State lua_State;
+
+	namespace LuaType
+	{
+		extern const char *metatable_pointerpath;
+	}
+
+	class PointerPath_lua
+	{
+		protected:
+			static int gc(lua_State *);
+			static int tostring(lua_State *);
+			static int resolve(lua_State *);
+			static int invalidate(lua_State *);
+
+		public:
+			static int regmod(lua_State *);
+	};
+
+#endif
@@ -0,0 +1,122 @@
+/******************************************************************************
+    Project:    MicroMacro
+    Author:     SolarStrike Software
+    URL:        www.solarstrike.net
+    License:    Modified BSD (see license.txt)
+******************************************************************************/
+
+#include "pool.h"
+#include <new>
+
+using MicroMacro::BlockPool;
+
+// Every block must be able to hold a free list link and be suitably aligned for anything
+static size_t alignBlockSize(size_t size)
+{
+    const size_t align = alignof(std::max_align_t);
+    if( size < sizeof(void *) )
+        size = sizeof(void *);
+    return (size + align - 1) & ~(align - 1);
+}
+
+BlockPool::BlockPool(size_t nBlockSize, size_t nBlocksPerSlab)
+{
+    blockSize       =   alignBlockSize(nBlockSize);
+    blocksPerSlab   =   nBlocksPerSlab > 0 ? nBlocksPerSlab : 1;
+    freeList        =   NULL;
+    slabs           =   NULL;
+    slabCount       =   0;
+    inUse           =   0;
+    spinlock.clear();
+}
+
+BlockPool::~BlockPool()
+{
+    while( slabs )
+    {
+        Slab *next = slabs->next;
+        delete [](char *)slabs;
+        slabs = next;
+    }
+}
+
+void BlockPool::lock()
+{
+    while( spinlock.test_and_set(std::memory_order_acquire) )
+        ; // Critical sections are a handful of instructions; just spin
+}
+
+void BlockPool::unlock()
+{
+    spinlock.clear(std::memory_order_release);
+}
+
+// Allocate a new slab and thread its blocks onto the free list. Must hold the lock.
+bool BlockPool::grow()
+{
+    const size_t header = alignBlockSize(sizeof(Slab));
+    char *mem = new (std::nothrow) char[header + blockSize * blocksPerSlab];
+    if( !mem )
+        return false;
+
+    Slab *slab = (Slab *)mem;
+    slab->next = slabs;
+    slabs = slab;
+    ++slabCount;
+
+    char *first = mem + header;
+    for(size_t i = blocksPerSlab; i > 0; i--)
+    {
+        FreeBlock *block = (FreeBlock *)(first + (i - 1) * blockSize);
+        block->next = freeList;
+        freeList = block;
+    }
+
+    return true;
+}
+
+// Returns NULL only if the system is out of memory
+void *BlockPool::alloc()
+{
+    lock();
+    if( !freeList && !grow() )
+    {
+        unlock();
+        return NULL;
+    }
+
+    FreeBlock *block = freeList;
+    freeList = block->next;
+    ++inUse;
+    unlock();
+
+    return block;
+}
+
+void BlockPool::release(void *ptr)
+{
+    if( !ptr )
+        return;
+
+    FreeBlock *block = (FreeBlock *)ptr;
+    lock();
+    block->next = freeList;
+    freeList = block;
+    --inUse;
+    unlock();
+}
+
+size_t BlockPool::getBlockSize()
+{
+    return blockSize;
+}
+
+size_t BlockPool::getSlabCount()
+{
+    return slabCount;
+}
+
+size_t BlockPool::getBlocksInUse()
+{
+    return inUse;
+}
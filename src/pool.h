@@ -0,0 +1,63 @@
+/******************************************************************************
+	Project: 	MicroMacro
+	Author: 	SolarStrike Software
+	URL:		www.solarstrike.net
+	License:	Modified BSD (see license.txt)
+******************************************************************************/
+
+#ifndef POOL_H
+#define POOL_H
+
+	#include <atomic>
+	#include <cstddef>
+
+	namespace MicroMacro
+	{
+		/*	Fixed-size block allocator. Blocks are carved out of slabs that
+			are kept for the life of the pool, so once the pool has grown to
+			cover peak demand, alloc()/release() never touch the heap.
+			Safe to use from multiple threads.
+		*/
+		class BlockPool
+		{
+			private:
+				struct FreeBlock
+				{
+					FreeBlock *next;
+				};
+
+				struct Slab
+				{
+					Slab *next;
+				};
+
+				size_t blockSize;
+				size_t blocksPerSlab;
+				FreeBlock *freeList;
+				Slab *slabs;
+				std::atomic_flag spinlock;
+
+				size_t slabCount;
+				size_t inUse;
+
+				void lock();
+				void unlock();
+				bool grow();
+
+				BlockPool(const BlockPool &);
+				BlockPool &operator=(const BlockPool &);
+
+			public:
+				BlockPool(size_t, size_t);
+				~BlockPool();
+
+				void *alloc();
+				void release(void *);
+
+				size_t getBlockSize();
+				size_t getSlabCount();
+				size_t getBlocksInUse();
+		};
+	}
+
+#endif
@@ -16,6 +16,18 @@
 #include "debugmessages.h"
 #include "logger.h"
 #include "filesystem.h"
+#include "patternscan.h"
+#include "valuescan.h"
+#include "scanresult_lua.h"
+#include "pointerpath.h"
+#include "pointerpath_lua.h"
+#include "snapshot.h"
+#include "snapshot_lua.h"
+#include "batchformat.h"
+#include "memorywatch.h"
+#include "event.h"
+#include "timer.h"
+#include <stdint.h>
 
 extern "C"
 {
@@ -24,31 +36,43 @@ extern "C"
 #include <lualib.h>
 }
 
-#include <tlhelp32.h>
+const char *LuaType::metatable_batchformatcache = "batchformatcache";
 
 const char *Process_lua::szInvalidHandleError = "Invalid process handle.";
 const char *Process_lua::szInvalidDataType = "Invalid data type given. Cannot read/write memory without a proper type.";
+MicroMacro::MemoryWatcher Process_lua::memoryWatcher(Process_lua::watchChanged);
 
+#ifdef WIN32
 std::vector<DWORD> Process_lua::attachedThreadIds;
 
 typedef BOOL (WINAPI *LPFN_ISWOW64PROCESS) (HANDLE, PBOOL);
 LPFN_ISWOW64PROCESS fnIsWow64Process = NULL;
+#endif
 
 using MicroMacro::BatchJob;
+using MicroMacro::BatchFormat;
+using MicroMacro::BatchFormatCache;
 using MicroMacro::ProcHandle;
+using MicroMacro::ProcessHandle;
 using MicroMacro::MemoryChunk;
+using MicroMacro::Event;
+using MicroMacro::EventData;
+namespace ProcMem = MicroMacro::ProcMem;
 
+#ifdef WIN32
 struct EnumFilterWindows
 {
     DWORD dwPid;
     std::vector<HWND> hwndList;
 };
+#endif
 
 
 /* These are mostly just helper functions and are not actually registered
     into the Lua state. They are, however, used by functions that are
     accessible by Lua.
 */
+#ifdef WIN32
 int isWindows32()
 {
     return !isWindows64();
@@ -94,6 +118,7 @@ static BOOL CALLBACK EnumFilterWindowsByProcIdProc(HWND hwnd,  LPARAM lParam)
 
     return true;
 }
+#endif
 
 std::string Process_lua::narrowString(std::wstring instr)
 {
@@ -101,11 +126,10 @@ std::string Process_lua::narrowString(std::wstring instr)
     return holder;
 }
 
-std::string Process_lua::readString(HANDLE handle, size_t address, int &err, unsigned int len)
+std::string Process_lua::readString(ProcessHandle handle, size_t address, int &err, unsigned int len)
 {
     std::string fullstr;
     //unsigned char buffer = 0;
-    SIZE_T bytesread;
     err = 0;
     unsigned int memoryReadBufferSize =
         (unsigned int)Macro::instance()->getSettings()->getInt(CONFVAR_MEMORY_STRING_BUFFER_SIZE,
@@ -126,10 +150,10 @@ std::string Process_lua::readString(HANDLE handle, size_t address, int &err, uns
     bool done = false;
     while( !done ) // read until we hit a NULL
     {
-        int success = ReadProcessMemory(handle, (LPVOID)(address + stroffset),
-                                        (void*)readBuffer, memoryReadBufferSize, &bytesread);
+        size_t bytesread = ProcMem::read(handle, address + stroffset,
+                                         (void*)readBuffer, memoryReadBufferSize);
 
-        if( success == 0 || bytesread == 0 ) {
+        if( bytesread == 0 ) {
             fullstr.push_back('\0');
             err = MEMORY_READ_FAIL;
             break;
@@ -155,12 +179,11 @@ std::string Process_lua::readString(HANDLE handle, size_t address, int &err, uns
     return fullstr;
 }
 
-std::wstring Process_lua::readUString(HANDLE handle, size_t address, int &err,
+std::wstring Process_lua::readUString(ProcessHandle handle, size_t address, int &err,
                                       unsigned int len)
 {
     std::wstring fullstr;
     //wchar_t buffer = 0;
-    SIZE_T bytesread;
     err = 0;
     unsigned int memoryReadBufferSize =
         (unsigned int)Macro::instance()->getSettings()->getInt(CONFVAR_MEMORY_STRING_BUFFER_SIZE,
@@ -182,10 +205,10 @@ std::wstring Process_lua::readUString(HANDLE handle, size_t address, int &err,
     bool done = false;
     while( !done ) // read until we hit a NULL
     {
-        int success = ReadProcessMemory(handle, (LPVOID)(address + stroffset),
-                                        (void*)readBuffer, sizeof(wchar_t) * memoryReadBufferSize, &bytesread);
+        size_t bytesread = ProcMem::read(handle, address + stroffset,
+                                         (void*)readBuffer, sizeof(wchar_t) * memoryReadBufferSize);
 
-        if( success == 0 || bytesread == 0 ) {
+        if( bytesread == 0 ) {
             fullstr.push_back('\0');
             err = MEMORY_READ_FAIL;
             break;
@@ -211,136 +234,189 @@ std::wstring Process_lua::readUString(HANDLE handle, size_t address, int &err,
     return fullstr;
 }
 
-void Process_lua::writeString(HANDLE process, size_t address, char *data, int &err, unsigned int len)
+void Process_lua::writeString(ProcessHandle process, size_t address, char *data, int &err, unsigned int len)
 {
-    SIZE_T byteswritten = 0;
     err = 0;
-    int success = 0;
-    DWORD old;
 
-    VirtualProtectEx(process, (void *)address, (size_t)len, PAGE_READWRITE, &old);
-    success = WriteProcessMemory(process, (void *)address,
-                                 (void*)data, (size_t)len, &byteswritten);
-    VirtualProtectEx(process, (void *)address, (size_t)len, old, &old);
-
-    if( success == 0 )
+    if( !ProcMem::write(process, address, (const void *)data, (size_t)len) )
         err = MEMORY_WRITE_FAIL;
 }
 
-unsigned int Process_lua::readBatch_parsefmt(const char *fmt, std::vector<BatchJob> &out)
+// Read a pointer, sized for the target process rather than for us
+size_t Process_lua::readPointer(ProcHandle *pHandle, size_t address, int &err)
 {
-    unsigned int length = 0;
-    out.clear();
+    if( pHandle->is32bit )
+        return readMemory<unsigned int>(pHandle->handle, address, err);
+    return readMemory<size_t>(pHandle->handle, address, err);
+}
+
+/*  The format cache's registry key; only its address matters. (The
+    metatable's name is already taken, by the metatable itself.)
+*/
+static const char formatCacheKey = 0;
 
-    BatchJob job;
+// Each Lua state (the main one, and every worker thread's) keeps its own format cache
+BatchFormatCache *Process_lua::getFormatCache(lua_State *L)
+{
+    lua_rawgetp(L, LUA_REGISTRYINDEX, &formatCacheKey);
+    BatchFormatCache **ppCache = static_cast<BatchFormatCache **>(lua_touserdata(L, -1));
+    lua_pop(L, 1);
+    return *ppCache;
+}
 
-    for(unsigned int i = 0; i < strlen(fmt); i++)
+int Process_lua::formatCache_gc(lua_State *L)
+{
+    BatchFormatCache **ppCache = static_cast<BatchFormatCache **>(lua_touserdata(L, 1));
+    delete *ppCache;
+    *ppCache = NULL;
+    return 0;
+}
+
+// Adds the values of 'count' jobs to the table at the top of the stack
+void Process_lua::readBatch_unpack(lua_State *L, const BatchJob *jobs, size_t count, const unsigned char *data)
+{
+    luaL_checkstack(L, 3, NULL);
+    int tableIndex = 1;
+
+    for(size_t i = 0; i < count; i++)
     {
-        char c = fmt[i];
+        const BatchJob &job = jobs[i];
+        const unsigned char *src = data + job.offset;
 
-        // See if we are setting the varcount
-        if( c >= '0' && c <= '9' )
-        {
-            // Read the number as a string, convert to int, advance
-            char buffer[16];
-            memset(&buffer, 0, sizeof(buffer));
-            for(unsigned int j = 0; j < 15; j++)
+        if( job.type == MicroMacro::MEM_GROUP )
+        {   // A table of repeats, each a table of its own values
+            lua_createtable(L, job.count, 0);
+            for(unsigned int j = 0; j < job.count; j++)
             {
-                char p = fmt[i + j];
-                if( p < '0' || p > '9' )
-                {   // End
-                    buffer[j] = 0;
-                    job.count = atoi((char*)&buffer);
-                    i += j - 1;
-                    break;
-                }
-
-                buffer[j] = p;
+                lua_newtable(L);
+                readBatch_unpack(L, jobs + i + 1, job.length, src + j * job.stride);
+                lua_rawseti(L, -2, j + 1);
             }
-
-            continue;
+            lua_rawseti(L, -2, tableIndex++);
+            i += job.length;
         }
-        else // Setting a variable type
+        else if( job.type == MicroMacro::MEM_STRING )
+        {   // As long as it always has been: up to 'count - 1' characters
+            size_t len = job.count > 0 ? strnlen((const char *)src, job.count - 1) : 0;
+            lua_pushlstring(L, (const char *)src, len);
+            lua_rawseti(L, -2, tableIndex++);
+        }
+        else
         {
-            switch(c)
+            size_t size = MicroMacro::ValueScan::getValueSize(job.type);
+            for(unsigned int j = 0; j < job.count; j++)
             {
-                case 'b':
-                    job.type = MicroMacro::MEM_BYTE;
-                    length += sizeof(char) * job.count;
-                    out.push_back(job);
-                    break;
-                case 'B':
-                    job.type = MicroMacro::MEM_UBYTE;
-                    length += sizeof(unsigned char) * job.count;
-                    out.push_back(job);
-                    break;
-                case 's':
-                    job.type = MicroMacro::MEM_SHORT;
-                    length += sizeof(short) * job.count;
-                    out.push_back(job);
-                    break;
-                case 'S':
-                    job.type = MicroMacro::MEM_USHORT;
-                    length += sizeof(unsigned short) * job.count;
-                    out.push_back(job);
-                    break;
-                case 'i':
-                    job.type = MicroMacro::MEM_INT;
-                    length += sizeof(int) * job.count;
-                    out.push_back(job);
-                    break;
-                case 'I':
-                    job.type = MicroMacro::MEM_UINT;
-                    length += sizeof(unsigned int) * job.count;
-                    out.push_back(job);
-                    break;
-                case 'h':
-                    job.type = MicroMacro::MEM_INT64;
-                    length += sizeof(long long) * job.count;
-                    out.push_back(job);
-                    break;
-                case 'H':
-                    job.type = MicroMacro::MEM_UINT64;
-                    length += sizeof(unsigned long long) * job.count;
-                    out.push_back(job);
-                    break;
-                case 'f':
-                    job.type = MicroMacro::MEM_FLOAT;
-                    length += sizeof(float) * job.count;
-                    out.push_back(job);
-                    break;
-                case 'F':
-                    job.type = MicroMacro::MEM_DOUBLE;
-                    length += sizeof(double) * job.count;
-                    out.push_back(job);
-                    break;
-                case 'c':
-                    job.type = MicroMacro::MEM_STRING;
-                    length += sizeof(char) * job.count;
-                    out.push_back(job);
-                    break;
-                case '_':
-                    job.type = MicroMacro::MEM_SKIP;
-                    length += sizeof(char) * job.count;
-                    out.push_back(job);
-                    break;
+                ScanResult_lua::pushValue(L, job.type, src + j * size);
+                lua_rawseti(L, -2, tableIndex++);
             }
-
-            job.count = 1; // Reset count
         }
     }
+}
 
-    return length;
+template <class T>
+static T loadWatched(const unsigned char *in)
+{
+    T value;
+    memcpy(&value, in, sizeof(T));
+    return value;
 }
 
-bool Process_lua::procDataCompare(const char *data, const char *bmask, const char *szMask)
+// Store a watched value as event data; integers as 64-bit so nothing is lost
+void Process_lua::setWatchedValue(EventData &ced, MicroMacro::BatchJob_type type, const unsigned char *in)
 {
-    for(; *szMask; ++szMask, ++data, ++bmask)
+    switch( type )
     {
-        if( *szMask == 'x' && *data != *bmask )
-            return false;
+        case MicroMacro::MEM_BYTE:      ced.setValue((unsigned long long)loadWatched<char>(in));                break;
+        case MicroMacro::MEM_UBYTE:     ced.setValue((unsigned long long)loadWatched<unsigned char>(in));       break;
+        case MicroMacro::MEM_SHORT:     ced.setValue((unsigned long long)loadWatched<short>(in));               break;
+        case MicroMacro::MEM_USHORT:    ced.setValue((unsigned long long)loadWatched<unsigned short>(in));      break;
+        case MicroMacro::MEM_INT:       ced.setValue((unsigned long long)loadWatched<int>(in));                 break;
+        case MicroMacro::MEM_UINT:      ced.setValue((unsigned long long)loadWatched<unsigned int>(in));        break;
+        case MicroMacro::MEM_INT64:     ced.setValue((unsigned long long)loadWatched<long long>(in));           break;
+        case MicroMacro::MEM_UINT64:    ced.setValue(loadWatched<unsigned long long>(in));                      break;
+        case MicroMacro::MEM_FLOAT:     ced.setValue((double)loadWatched<float>(in));                           break;
+        case MicroMacro::MEM_DOUBLE:    ced.setValue(loadWatched<double>(in));                                  break;
+        default:                        ced.setValue();                                                         break;
     }
-    return (*szMask) == 0;
+}
+
+// Called from the memory watcher's own thread; turns a change into an event
+void Process_lua::watchChanged(const MicroMacro::WatchChange &change)
+{
+    static const char *reasons[] = {"changed", "above", "below", "failed"};
+
+    Event *pe = NULL;
+    try {
+        pe = new Event;
+        pe->type = MicroMacro::EVENT_MEMORYCHANGED;
+
+        EventData ced;
+        ced.setValue((int)change.id);
+        pe->data.push_back(ced);
+        if( change.reason == MicroMacro::WATCH_FAILED )
+            ced.setValue();
+        else
+            setWatchedValue(ced, change.type, change.value);
+        pe->data.push_back(ced);
+        if( change.hasPrevious )
+            setWatchedValue(ced, change.type, change.previous);
+        else
+            ced.setValue();
+        pe->data.push_back(ced);
+        ced.setValue(std::string(reasons[change.reason]));
+        pe->data.push_back(ced);
+    } catch( std::bad_alloc &ba ) {
+        // Called from the watcher's thread, where there is no one to tell; drop it
+        delete pe;
+        return;
+    }
+
+    Macro::instance()->pushEvent(pe);
+}
+
+// How many threads memory scans may use (see memoryScanThreads in config.lua)
+unsigned int Process_lua::getScanThreads()
+{
+    int threads = Macro::instance()->getSettings()->getInt(CONFVAR_MEMORY_SCAN_THREADS,
+                  CONFDEFAULT_MEMORY_SCAN_THREADS);
+    if( threads <= 0 )
+        return MicroMacro::getProcessorCount();
+    return (unsigned int)threads;
+}
+
+// Megabytes per second, as reported by scans
+double Process_lua::getThroughput(size_t bytes, double seconds)
+{
+    if( seconds <= 0.0 )
+        return 0.0;
+    return (double)bytes / (1024.0 * 1024.0) / seconds;
+}
+
+// Stops the scan after the first piece containing a match
+bool Process_lua::findPattern_block(size_t piece, size_t address, const unsigned char *data,
+                                    size_t size, size_t count, void *param)
+{
+    FindPatternState *state = static_cast<FindPatternState *>(param);
+    size_t offset = state->pattern.find(data, size, count);
+    if( offset == PATTERN_NOT_FOUND )
+        return true;
+
+    state->found.at(piece) = address + offset;
+    return false;
+}
+
+// Records every match, as an offset from the start of the scan
+bool Process_lua::findPatterns_block(size_t piece, size_t address, const unsigned char *data,
+                                     size_t size, size_t count, void *param)
+{
+    FindPatternsState *state = static_cast<FindPatternsState *>(param);
+    std::vector<MicroMacro::PatternMatch> &found = state->found.at(piece);
+    size_t first = found.size();
+    state->patterns.find(data, size, count, found);
+
+    for(size_t i = first; i < found.size(); i++)
+        found.at(i).offset += address - state->scanStart;
+    return true;
 }
 
 
@@ -355,37 +431,57 @@ int Process_lua::regmod(lua_State *L)
         {"close", Process_lua::close},
         {"read", Process_lua::read},
         {"readPtr", Process_lua::readPtr},
+        {"pointerPath", Process_lua::pointerPath},
+        {"resolvePaths", Process_lua::resolvePaths},
         {"readBatch", Process_lua::readBatch},
+        {"readMany", Process_lua::readMany},
         {"readChunk", Process_lua::readChunk},
         {"write", Process_lua::write},
         {"writePtr", Process_lua::writePtr},
         {"findPattern", Process_lua::findPattern},
+        {"findPatterns", Process_lua::findPatterns},
+        {"scanValue", Process_lua::scanValue},
+        {"snapshot", Process_lua::snapshot},
+        {"watch", Process_lua::watch},
+        {"unwatch", Process_lua::unwatch},
+        #ifdef WIN32
         {"findByWindow", Process_lua::findByWindow},
+        #endif
         {"findByExe", Process_lua::findByExe},
         {"getModuleAddress", Process_lua::getModuleAddress},
         {"getModuleFilename", Process_lua::getModuleFilename},
         {"getModules", Process_lua::getModules},
+        #ifdef WIN32
         {"attachInput", Process_lua::attachInput},
         {"detachInput", Process_lua::detachInput},
+        #endif
         {"is32bit", Process_lua::is32bit},
         {"is64bit", Process_lua::is64bit},
         {"terminate", Process_lua::terminate},
+        #ifdef WIN32
         {"getWindows", Process_lua::getWindows},
+        #endif
         {NULL, NULL}
     };
 
     luaL_newlib(L, _funcs);
     lua_setglobal(L, PROCESS_MODULE_NAME);
 
-    // Assign isWow64Process function for later use;
-    if( !fnIsWow64Process )
-        fnIsWow64Process = (LPFN_ISWOW64PROCESS)GetProcAddress(GetModuleHandle(TEXT("kernel32")), "IsWow64Process");
+    // Compiled readBatch() formats, kept in the registry; see getFormatCache()
+    BatchFormatCache **ppCache = static_cast<BatchFormatCache **>(lua_newuserdata(L, sizeof(BatchFormatCache *)));
+    *ppCache = new BatchFormatCache();
+    luaL_newmetatable(L, LuaType::metatable_batchformatcache);
+    lua_pushcfunction(L, Process_lua::formatCache_gc);
+    lua_setfield(L, -2, "__gc");
+    lua_setmetatable(L, -2);
+    lua_rawsetp(L, LUA_REGISTRYINDEX, &formatCacheKey);
 
     return MicroMacro::ERR_OK;
 }
 
 int Process_lua::cleanup(lua_State *)
 {
+    #ifdef WIN32
     // Detatach all processes
     DWORD thisThreadId = GetCurrentThreadId();
     for(unsigned int i = 0; i < attachedThreadIds.size(); i++)
@@ -394,6 +490,9 @@ int Process_lua::cleanup(lua_State *)
     }
 
     attachedThreadIds.clear(); // Empty it out
+    #endif
+
+    memoryWatcher.clear();
 
     return MicroMacro::ERR_OK;
 }
@@ -411,40 +510,24 @@ int Process_lua::open(lua_State *L)
         wrongArgs(L);
     checkType(L, LT_NUMBER, 1);
 
-    HANDLE handle;
-    DWORD procId = (DWORD)lua_tointeger(L, 1);
-    DWORD access = PROCESS_VM_OPERATION | PROCESS_VM_READ | PROCESS_VM_WRITE | PROCESS_QUERY_INFORMATION | PROCESS_TERMINATE;
-
-    handle = OpenProcess(access, false, procId);
+    unsigned int procId = (unsigned int)lua_tointeger(L, 1);
+    ProcessHandle handle = ProcMem::open(procId);
 
-    if( handle == NULL )
+    if( !ProcMem::isValid(handle) )
     {   // An error occurred!
         pushLuaErrorEvent(L, "Error opening process.");
         return 0;
     }
 
-    bool is32bit = true;
-    #ifdef _WIN64
-    // We only make use of this when MicroMacro is compiled as 64-bit
-    if( fnIsWow64Process )
-    {
-        BOOL iswow64;
-        bool success = fnIsWow64Process(handle, &iswow64);
-        if( success )
-        {
-            if( iswow64 || isWindows32() )
-                is32bit = true;
-            else
-                is32bit = false;
-        }
-    }
-    #endif
+    // Decides how wide pointers are when following them in readPtr()/writePtr()
+    bool is32bit = ProcMem::is32bit(handle);
 
     ProcHandle *pHandle = static_cast<ProcHandle *>(lua_newuserdata(L, sizeof(ProcHandle)));
     luaL_getmetatable(L, LuaType::metatable_handle);
     lua_setmetatable(L, -2);
     pHandle->handle = handle;
     pHandle->is32bit = is32bit;
+    pHandle->pointerCache = NULL;
 
 
     return 1;
@@ -462,7 +545,9 @@ int Process_lua::close(lua_State *L)
     checkType(L, LT_USERDATA, 1);
     ProcHandle *pHandle = static_cast<ProcHandle *>(lua_touserdata(L, 1));
 
-    CloseHandle(pHandle->handle);
+    if( ProcMem::isValid(pHandle->handle) )
+        ProcMem::close(pHandle->handle);
+    pHandle->handle = 0; // So that __gc doesn't close it again
     return 0;
 }
 
@@ -588,10 +673,10 @@ int Process_lua::read(lua_State *L)
 
     if( err )
     {   // Throw an error
-        int errCode = GetLastError();
+        int errCode = ProcMem::getLastError();
         pushLuaErrorEvent(L, "Failure reading memory from 0x%p at 0x%p. "\
                           "Error code %i (%s).",
-                          pHandle->handle, address, errCode, getWindowsErrorString(errCode).c_str());
+                          (void *)(intptr_t)pHandle->handle, (void *)address, errCode, ProcMem::getErrorString(errCode).c_str());
         return 0;
     }
 
@@ -681,14 +766,7 @@ int Process_lua::readPtr(lua_State *L)
         realAddress = address;
         for(unsigned int i = 0; i < offsets.size(); i++)
         {
-            #ifdef _WIN64
-            if( pHandle->is32bit )  // Must read as 32-bit pointer
-                realAddress = readMemory<unsigned long>(pHandle->handle, realAddress, err) + offsets.at(i); // Get value
-            else                    // 64-bit pointers are OK!
-                realAddress = readMemory<size_t>(pHandle->handle, realAddress, err) + offsets.at(i); // Get value
-            #else
-            realAddress = readMemory<size_t>(pHandle->handle, realAddress, err) + offsets.at(i); // Get value
-            #endif
+            realAddress = readPointer(pHandle, realAddress, err) + offsets.at(i); // Get value
 
             if( err )
                 break;
@@ -796,16 +874,134 @@ int Process_lua::readPtr(lua_State *L)
 
     if( err )
     {   // Throw an error
-        int errCode = GetLastError();
+        int errCode = ProcMem::getLastError();
         pushLuaErrorEvent(L, "Failure reading memory from 0x%p at 0x%p. "\
                           "Error code %i (%s)",
-                          pHandle->handle, address, errCode, getWindowsErrorString(errCode).c_str());
+                          (void *)(intptr_t)pHandle->handle, (void *)address, errCode, ProcMem::getErrorString(errCode).c_str());
         return 0;
     }
 
     return 1;
 }
 
+/*  process.pointerPath(handle proc, number address, number|table offsets [, number ttl])
+    Returns:    pointerpath
+
+    Prepares a chain of pointers to follow, as process.readPtr() would
+    with the same address and offsets, for pointerpath:resolve() or
+    process.resolvePaths() to follow later.
+
+    Each pointer a path reads is kept for 'ttl' seconds; within that time
+    resolving the path doesn't read it again, unless a pointer above it
+    has changed. If no 'ttl' is given, they are kept until
+    pointerpath:invalidate() is called. A 'ttl' of 0 never keeps them.
+    Paths on the same handle that start with the same address and
+    offsets share the pointers they have in common.
+*/
+int Process_lua::pointerPath(lua_State *L)
+{
+    int top = lua_gettop(L);
+    if( top != 3 && top != 4 )
+        wrongArgs(L);
+    checkType(L, LT_USERDATA, 1);
+    checkType(L, LT_NUMBER, 2);
+    checkType(L, LT_NUMBER | LT_TABLE, 3);
+    if( top >= 4 )
+        checkType(L, LT_NUMBER, 4);
+
+    ProcHandle *pHandle = static_cast<ProcHandle *>(lua_touserdata(L, 1));
+    size_t address = (size_t)lua_tointeger(L, 2);
+    double ttl = top >= 4 ? lua_tonumber(L, 4) : -1.0;
+    if( pHandle->handle == 0 )
+        luaL_error(L, szInvalidHandleError);
+
+    std::vector<size_t> offsets;
+    if( lua_isnumber(L, 3) )
+        offsets.push_back(lua_tointeger(L, 3));
+    else
+    {
+        size_t count = lua_rawlen(L, 3);
+        for(size_t i = 1; i <= count; i++)
+        {
+            lua_rawgeti(L, 3, i);
+            if( !lua_isnumber(L, -1) )
+            {
+                luaL_error(L, "Received invalid type (non-number) in offset list; key: %d.", (int)i);
+                return 0;
+            }
+            offsets.push_back(lua_tointeger(L, -1));
+            lua_pop(L, 1);
+        }
+    }
+
+    MicroMacro::PointerPath **ppPath = static_cast<MicroMacro::PointerPath **>(
+        lua_newuserdata(L, sizeof(MicroMacro::PointerPath *)));
+    try {
+        *ppPath = new MicroMacro::PointerPath(pHandle, address, offsets, ttl < 0.0 ? -1.0 : ttl);
+    } catch( std::bad_alloc &ba ) {
+        badAllocation();
+    }
+    luaL_getmetatable(L, LuaType::metatable_pointerpath);
+    lua_setmetatable(L, -2);
+
+    // Keep the handle around for as long as the path
+    lua_pushvalue(L, 1);
+    lua_setuservalue(L, -2);
+
+    return 1;
+}
+
+/*  process.resolvePaths(table paths)
+    Returns:    table addresses, number resolved
+
+    Resolves many pointer paths (see process.pointerPath()) at once.
+    Rather than following each chain in turn, all of them are followed a
+    level at a time, reading every pointer needed at that level in one
+    go; a pointer that several paths go through is only read once.
+    Pointers that are still cached are not read at all.
+
+    'addresses' holds the address each path resolved to, at the same
+    index as the path; paths that could not be resolved are left nil.
+    'resolved' is how many were.
+*/
+int Process_lua::resolvePaths(lua_State *L)
+{
+    if( lua_gettop(L) != 1 )
+        wrongArgs(L);
+    checkType(L, LT_TABLE, 1);
+
+    std::vector<MicroMacro::PointerPath *> paths;
+    size_t count = lua_rawlen(L, 1);
+    for(size_t i = 1; i <= count; i++)
+    {
+        lua_rawgeti(L, 1, i);
+        MicroMacro::PointerPath **ppPath = static_cast<MicroMacro::PointerPath **>(
+            luaL_testudata(L, -1, LuaType::metatable_pointerpath));
+        if( ppPath == NULL || *ppPath == NULL )
+        {
+            luaL_error(L, "Expected a pointerpath at index %d.", (int)i);
+            return 0;
+        }
+        paths.push_back(*ppPath);
+        lua_pop(L, 1);
+    }
+
+    size_t resolved = MicroMacro::resolvePointerPaths(paths);
+
+    lua_createtable(L, (int)paths.size(), 0);
+    for(size_t i = 0; i < paths.size(); i++)
+    {
+        size_t address;
+        if( !paths.at(i)->getAddress(address) )
+            continue;
+
+        lua_pushinteger(L, address);
+        lua_rawseti(L, -2, i + 1);
+    }
+    lua_pushinteger(L, resolved);
+    return 2;
+}
+
 /*  process.readBatch(handle proc, number address, string mask)
     Returns (on success):   table
     Returns (on failure):   nil
@@ -823,10 +1019,28 @@ int Process_lua::readPtr(lua_State *L)
     S               unsigned short
     i               int
     I               unsigned int
+    h               int64
+    H               unsigned int64
     f               float
     F               double
     c               string
     _               (skip ahead; do not return this)
+
+    Some characters instead describe where the next value is:
+    @N              Move to offset N (from the start of the group)
+    !N              Move ahead to the next multiple of N
+    N(...)          Read what is in the parentheses N times over, as
+                    for an array of structs
+
+    Each group becomes one value in the results: a table of N tables,
+    one per repeat, holding its values. Repeats are as far apart as the
+    group is long, including any '_', '@' or '!' at its end.
+    For example, "i 16(@0i @8f !16) I" reads an int, 16 structs of
+    16 bytes (an int and a float each), then an unsigned int.
+
+    Formats are compiled the first time they are used and kept for
+    reuse, so there is no need to avoid calling this with the same
+    format repeatedly.
 */
 int Process_lua::readBatch(lua_State *L)
 {
@@ -840,183 +1054,145 @@ int Process_lua::readBatch(lua_State *L)
     size_t address = (size_t)lua_tointeger(L, 2);
     const char *fmt = lua_tostring(L, 3);
 
-    std::vector<BatchJob> jobs;
-    size_t readLen = readBatch_parsefmt(fmt, jobs);
+    const BatchFormat *format = NULL;
+    {   // Let 'err' go before raising anything
+        std::string err;
+        format = getFormatCache(L)->get(fmt, err);
+        if( format == NULL )
+            lua_pushfstring(L, "%s.", err.c_str());
+    }
+    if( format == NULL )
+        return lua_error(L);
 
-    char *readBuffer = 0;
+    unsigned char *readBuffer = 0;
     try {
-        readBuffer = new char[readLen + 1];
+        readBuffer = new unsigned char[format->length + 1];
     } catch( std::bad_alloc &ba ) {
         badAllocation();
     }
 
-    SIZE_T bytesRead = 0;
-    int success = ReadProcessMemory(pHandle->handle, (LPVOID)address, (void *)readBuffer, readLen, &bytesRead);
-
-    if( !success || bytesRead != readLen )
+    if( !ProcMem::readExact(pHandle->handle, address, (void *)readBuffer, format->length) )
     {   // Throw error
         delete []readBuffer;
-        int errCode = GetLastError();
+        int errCode = ProcMem::getLastError();
         pushLuaErrorEvent(L, "Failure reading memory from 0x%p at 0x%p. "\
                           "Error code %i (%s)",
-                          pHandle->handle, address, errCode, getWindowsErrorString(errCode).c_str());
+                          (void *)(intptr_t)pHandle->handle, (void *)address, errCode, ProcMem::getErrorString(errCode).c_str());
 
         return 0;
     }
 
-    unsigned int cursorPos = 0;
-    unsigned int tableIndex = 1;
-
     lua_newtable(L);
-    for(unsigned int i = 0; i < jobs.size(); i++)
+    if( !format->jobs.empty() )
+        readBatch_unpack(L, &format->jobs.at(0), format->jobs.size(), readBuffer);
+    delete []readBuffer;
+
+    return 1;
+}
+
+/*  process.readMany(handle proc, table reads [, number gap])
+    Returns:    table values, table failed
+
+    Reads many values, wherever they are, in as few reads as possible.
+    'reads' should be a list of {address, type} pairs, where 'type' is as
+    for process.read(); strings need a length too: {address, "string", length}.
+
+    The reads are sorted by address, and any that lie no more than 'gap'
+    bytes (default 256) apart are read as one block. Where the system
+    allows, all of those blocks are then read at once.
+
+    'values' holds each value at the same index as its read; 'failed'
+    is true at each index that could not be read (its value is nil),
+    and false elsewhere.
+*/
+int Process_lua::readMany(lua_State *L)
+{
+    int top = lua_gettop(L);
+    if( top != 2 && top != 3 )
+        wrongArgs(L);
+    checkType(L, LT_USERDATA, 1);
+    checkType(L, LT_TABLE, 2);
+    if( top >= 3 )
+        checkType(L, LT_NUMBER, 3);
+
+    ProcHandle *pHandle = static_cast<ProcHandle *>(lua_touserdata(L, 1));
+    size_t gap = READ_MANY_GAP;
+    if( top >= 3 && lua_tointeger(L, 3) >= 0 )
+        gap = (size_t)lua_tointeger(L, 3);
+    if( pHandle->handle == 0 )
+        luaL_error(L, szInvalidHandleError);
+
+    size_t count = lua_rawlen(L, 2);
+    std::vector<MicroMacro::BatchJob_type> types(count);
+    std::vector<MicroMacro::ReadRequest> requests(count);
+    size_t total = 0;
+    for(size_t i = 0; i < count; i++)
     {
-        if( jobs.at(i).type == MicroMacro::MEM_SKIP )
-        {   // We skip over it. Duh.
-            cursorPos += sizeof(char) * jobs.at(i).count;
-            continue;
+        lua_rawgeti(L, 2, i + 1);
+        bool valid = lua_istable(L, -1);
+        size_t size = 0;
+        if( valid )
+        {
+            lua_rawgeti(L, -1, 1);
+            lua_rawgeti(L, -2, 2);
+            lua_rawgeti(L, -3, 3);
+            valid = lua_isnumber(L, -3) && lua_type(L, -2) == LUA_TSTRING;
+            if( valid && strcmp(lua_tostring(L, -2), "string") == 0 )
+            {
+                types[i] = MicroMacro::MEM_STRING;
+                valid = lua_isnumber(L, -1) && lua_tointeger(L, -1) > 0;
+                size = valid ? (size_t)lua_tointeger(L, -1) : 0;
+            }
+            else if( valid )
+            {
+                valid = ScanResult_lua::getValueType(lua_tostring(L, -2), types[i]);
+                size = valid ? MicroMacro::ValueScan::getValueSize(types[i]) : 0;
+            }
+
+            requests[i].address = (size_t)lua_tointeger(L, -3);
+            requests[i].size = size;
+            lua_pop(L, 3);
         }
+        lua_pop(L, 1);
 
-        switch(jobs.at(i).type)
+        if( !valid )
         {
-            case MicroMacro::MEM_BYTE:
-                for(unsigned int j = 0; j < jobs.at(i).count; j++)
-                {
-                    char data = readBuffer[cursorPos];
-                    cursorPos += sizeof(char);
-                    lua_pushinteger(L, tableIndex); // Push key
-                    lua_pushinteger(L, data); // Push value
-                    lua_settable(L, -3); // Set it
-                    ++tableIndex;
-                }
-                break;
-            case MicroMacro::MEM_UBYTE:
-                for(unsigned int j = 0; j < jobs.at(i).count; j++)
-                {
-                    unsigned char data = readBuffer[cursorPos];
-                    cursorPos += sizeof(unsigned char);
-                    lua_pushinteger(L, tableIndex); // Push key
-                    lua_pushinteger(L, data); // Push value
-                    lua_settable(L, -3); // Set it
-                    ++tableIndex;
-                }
-                break;
-            case MicroMacro::MEM_SHORT:
-                for(unsigned int j = 0; j < jobs.at(i).count; j++)
-                {
-                    short data = *(short*)&readBuffer[cursorPos];
-                    cursorPos += sizeof(short);
-                    lua_pushinteger(L, tableIndex); // Push key
-                    lua_pushinteger(L, data); // Push value
-                    lua_settable(L, -3); // Set it
-                    ++tableIndex;
-                }
-                break;
-            case MicroMacro::MEM_USHORT:
-                for(unsigned int j = 0; j < jobs.at(i).count; j++)
-                {
-                    unsigned short data = *(unsigned short*)&readBuffer[cursorPos];
-                    cursorPos += sizeof(unsigned short);
-                    lua_pushinteger(L, tableIndex); // Push key
-                    lua_pushinteger(L, data); // Push value
-                    lua_settable(L, -3); // Set it
-                    ++tableIndex;
-                }
-                break;
-            case MicroMacro::MEM_INT:
-                for(unsigned int j = 0; j < jobs.at(i).count; j++)
-                {
-                    int data = *(int*)&readBuffer[cursorPos];
-                    cursorPos += sizeof(int);
-                    lua_pushinteger(L, tableIndex); // Push key
-                    lua_pushinteger(L, data); // Push value
-                    lua_settable(L, -3); // Set it
-                    ++tableIndex;
-                }
-                break;
-            case MicroMacro::MEM_UINT:
-                for(unsigned int j = 0; j < jobs.at(i).count; j++)
-                {
-                    unsigned int data = *(unsigned int*)&readBuffer[cursorPos];
-                    cursorPos += sizeof(unsigned int);
-                    lua_pushinteger(L, tableIndex); // Push key
-                    lua_pushinteger(L, data); // Push value
-                    lua_settable(L, -3); // Set it
-                    ++tableIndex;
-                }
-                break;
-            case MicroMacro::MEM_INT64:
-                for(unsigned int j = 0; j < jobs.at(i).count; j++)
-                {
-                    long long data = *(long long*)&readBuffer[cursorPos];
-                    cursorPos += sizeof(long long);
-                    lua_pushinteger(L, tableIndex); // Push key
-                    lua_pushinteger(L, data); // Push value
-                    lua_settable(L, -3); // Set it
-                    ++tableIndex;
-                }
-                break;
-            case MicroMacro::MEM_UINT64:
-                for(unsigned int j = 0; j < jobs.at(i).count; j++)
-                {
-                    unsigned long long data = *(unsigned long long*)&readBuffer[cursorPos];
-                    cursorPos += sizeof(unsigned long long);
-                    lua_pushinteger(L, tableIndex); // Push key
-                    lua_pushinteger(L, data); // Push value
-                    lua_settable(L, -3); // Set it
-                    ++tableIndex;
-                }
-                break;
-            case MicroMacro::MEM_FLOAT:
-                for(unsigned int j = 0; j < jobs.at(i).count; j++)
-                {
-                    float data = *(float*)&readBuffer[cursorPos];
-                    cursorPos += sizeof(float);
-                    lua_pushinteger(L, tableIndex); // Push key
-                    lua_pushnumber(L, data); // Push value
-                    lua_settable(L, -3); // Set it
-                    ++tableIndex;
-                }
-                break;
-            case MicroMacro::MEM_DOUBLE:
-                for(unsigned int j = 0; j < jobs.at(i).count; j++)
-                {
-                    double data = *(double*)&readBuffer[cursorPos];
-                    cursorPos += sizeof(double);
-                    lua_pushinteger(L, tableIndex); // Push key
-                    lua_pushnumber(L, data); // Push value
-                    lua_settable(L, -3); // Set it
-                    ++tableIndex;
-                }
-                break;
-            case MicroMacro::MEM_STRING:
-                {
-                    unsigned int len = jobs.at(i).count;
-                    char *buffer = 0;
-                    try {
-                        buffer = new char[len + 2]; // Make sure we have room for terminator
-                    } catch( std::bad_alloc &ba ) {
-                        badAllocation();
-                    }
-
-                    // Copy this string segment into our buffer, push it, delete it
-                    strlcpy(buffer, (char*)&readBuffer[cursorPos], len);
-                    cursorPos += len;
-                    lua_pushinteger(L, tableIndex); // Push key
-                    lua_pushstring(L, buffer);
-                    lua_settable(L, -3); // Set it
-                    ++tableIndex;
-                    delete []buffer;
-                }
-                break;
-            default:
-                /* Hmmm... this shouldn't have happened.
-                    Oh well. Advance? */
-                cursorPos += sizeof(char) * jobs.at(i).count;
-                break;
+            luaL_error(L, "Invalid read at index %d; expected {address, type [, length]}.", (int)(i + 1));
+            return 0;
         }
+        total += size;
     }
 
-    return 1;
+    std::vector<unsigned char> buffer(total + 1);
+    total = 0;
+    for(size_t i = 0; i < count; i++)
+    {
+        requests[i].buffer = &buffer[total];
+        total += requests[i].size;
+    }
+
+    if( count > 0 )
+        ProcMem::readCoalesced(pHandle->handle, &requests[0], count, gap);
+
+    lua_createtable(L, (int)count, 0);
+    int valuesIndex = lua_gettop(L);
+    lua_createtable(L, (int)count, 0);
+    for(size_t i = 0; i < count; i++)
+    {
+        lua_pushboolean(L, !requests[i].ok);
+        lua_rawseti(L, -2, i + 1);
+        if( !requests[i].ok )
+            continue;
+
+        const char *data = static_cast<const char *>(requests[i].buffer);
+        if( types[i] == MicroMacro::MEM_STRING )
+            lua_pushlstring(L, data, strnlen(data, requests[i].size));
+        else
+            ScanResult_lua::pushValue(L, types[i], reinterpret_cast<const unsigned char *>(data));
+        lua_rawseti(L, valuesIndex, i + 1);
+    }
+
+    return 2;
 }
 
 /*  process.readChunk(handle proc, number address, number size)
@@ -1047,16 +1223,14 @@ int Process_lua::readChunk(lua_State *L)
     pChunk->address = address;
     pChunk->size = size;
 
-    SIZE_T bytesRead;
-    int success = ReadProcessMemory(pHandle->handle, (LPVOID)address, (void *)pChunk->data, size, &bytesRead);
-
-    if( !success || bytesRead != size )
+    if( !ProcMem::readExact(pHandle->handle, address, (void *)pChunk->data, size) )
     {   // Error
+        int errCode = ProcMem::getLastError();
+        delete []pChunk->data; // No metatable yet, so __gc won't free it for us
         lua_pop(L, 1); // Pop that memory chunk... looks like we don't need it!
-        int errCode = GetLastError();
         pushLuaErrorEvent(L, "Failure read memory from 0x%p at 0x%p. "\
                           "Error code %i (%s)",
-                          pHandle->handle, address, errCode, getWindowsErrorString(errCode).c_str());
+                          (void *)(intptr_t)pHandle->handle, (void *)address, errCode, ProcMem::getErrorString(errCode).c_str());
         return 0;
     }
 
@@ -1136,10 +1310,10 @@ int Process_lua::write(lua_State *L)
 
     if( err )
     {   // Throw an error
-        int errCode = GetLastError();
+        int errCode = ProcMem::getLastError();
         pushLuaErrorEvent(L, "Failure writing memory to 0x%p at 0x%p. "\
                           "Error code %i (%s)",
-                          pHandle->handle, address, errCode, getWindowsErrorString(errCode).c_str());
+                          (void *)(intptr_t)pHandle->handle, (void *)address, errCode, ProcMem::getErrorString(errCode).c_str());
     }
 
     lua_pushboolean(L, err == 0);
@@ -1228,14 +1402,7 @@ int Process_lua::writePtr(lua_State *L)
         realAddress = address;
         for(unsigned int i = 0; i < offsets.size(); i++)
         {
-            #ifdef _WIN64
-            if( pHandle->is32bit )
-                realAddress = readMemory<unsigned long>(pHandle->handle, realAddress, err) + offsets.at(i); // Get value
-            else
-                realAddress = readMemory<size_t>(pHandle->handle, realAddress, err) + offsets.at(i); // Get value
-            #else
-            realAddress = readMemory<size_t>(pHandle->handle, realAddress, err) + offsets.at(i); // Get value
-            #endif
+            realAddress = readPointer(pHandle, realAddress, err) + offsets.at(i); // Get value
 
             if( err )
                 break;
@@ -1290,24 +1457,28 @@ int Process_lua::writePtr(lua_State *L)
 
     if( err )
     {   // Throw an error
-        int errCode = GetLastError();
+        int errCode = ProcMem::getLastError();
         pushLuaErrorEvent(L, "Failure writing memory to 0x%p at 0x%p. "\
                           "Error code %i (%s)",
-                          pHandle->handle, address, errCode, getWindowsErrorString(errCode).c_str());
+                          (void *)(intptr_t)pHandle->handle, (void *)address, errCode, ProcMem::getErrorString(errCode).c_str());
     }
 
     lua_pushboolean(L, err == 0);
     return 1;
 }
 
-/*  process.findPattern(handle proc, number address, number length, string bitmask, string szmask)
-    Returns (on success):   number address
-    Returns (on failure):   nil
+/*  process.findPattern(handle proc, number address, number length, string bytes, string mask)
+    Returns (on success):   number address, number throughput
+    Returns (on failure):   nil, number throughput
 
     Attempt to find a pattern within a process, beginning at memory address 'address',
     with a max scan length of 'length'.
-    'bitmask' should contain an 'x' for a match, and '?' for wildcard.
-    'szmask' should contain the actual data we are checking against for a match.
+    'bytes' should contain the actual data we are checking against for a match.
+    'mask' should contain an 'x' for a match, and '?' for wildcard.
+
+    Memory that cannot be read is skipped over. Large scans are split
+    between threads (see memoryScanThreads in config.lua); 'throughput'
+    is how fast memory was scanned, in MB/s.
 */
 int Process_lua::findPattern(lua_State *L)
 {
@@ -1319,74 +1490,430 @@ int Process_lua::findPattern(lua_State *L)
     checkType(L, LT_STRING, 4);
     checkType(L, LT_STRING, 5);
 
-    // Get data, create buffers, etc.
-    size_t bmaskLen;
-    size_t szMaskLen;
+    size_t bytesLen;
+    size_t maskLen;
     ProcHandle *pHandle = static_cast<ProcHandle *>(lua_touserdata(L, 1));
     size_t address = lua_tointeger(L, 2);
     size_t scanLen = lua_tointeger(L, 3);
-    const char *bmask = lua_tolstring(L, 4, &bmaskLen);
-    const char *szMask = lua_tolstring(L, 5, &szMaskLen);
+    const char *bytes = lua_tolstring(L, 4, &bytesLen);
+    const char *mask = lua_tolstring(L, 5, &maskLen);
+    if( pHandle->handle == 0 )
+        luaL_error(L, szInvalidHandleError);
 
-    bool found = false;
-    size_t foundAddr = 0;
-    size_t bufferLen = szMaskLen * 50;
-    if( bufferLen < 1024 ) // Minimum of 1kb
-        bufferLen = 1024;
-    size_t addLen = bufferLen % szMaskLen;
-    if( addLen > 0 )
-        bufferLen = bufferLen + addLen;
-    size_t bufferStart = 0;
-    size_t curBufferLen = bufferLen;
-    unsigned char *buffer = 0;
+    FindPatternState state;
+    state.pattern.set(bytes, bytesLen, mask, maskLen);
+    if( state.pattern.length() == 0 )
+        return 0;
+
+    std::vector<MicroMacro::ScanRange> pieces;
+    MicroMacro::getScanPieces(pHandle->handle, address, scanLen, state.pattern.length() - 1, pieces);
+    state.found.assign(pieces.size(), PATTERN_NOT_FOUND);
+
+    TimeType startTime = getNow();
+    size_t bytesRead = MicroMacro::scanPieces(pHandle->handle, pieces, state.pattern.length() - 1,
+                                              getScanThreads(), findPattern_block, &state);
+    double elapsed = deltaTime(getNow(), startTime);
+
+    // The first piece with a match has the first match
+    size_t foundAddr = PATTERN_NOT_FOUND;
+    for(size_t i = 0; i < state.found.size() && foundAddr == PATTERN_NOT_FOUND; i++)
+        foundAddr = state.found.at(i);
+
+    if( foundAddr == PATTERN_NOT_FOUND )
+        lua_pushnil(L);
+    else
+        lua_pushinteger(L, foundAddr);
+    lua_pushnumber(L, getThroughput(bytesRead, elapsed));
+    return 2;
+}
+
+/*  process.findPatterns(handle proc, number address, number length, table patterns)
+    Returns:    table, number throughput
+
+    Like process.findPattern(), but looks for many patterns in a single pass
+    and finds every match rather than just the first.
+    'patterns' should be a table of {bytes, mask} pairs, keyed by name.
+    Every mask needs at least one 'x' within the length of its bytes, or
+    there would be nothing to look for.
+
+    The returned table has the same keys; each value is a table of
+    offsets (from 'address') at which that pattern matched, in order.
+    'throughput' is as in process.findPattern().
+*/
+int Process_lua::findPatterns(lua_State *L)
+{
+    if( lua_gettop(L) != 4 )
+        wrongArgs(L);
+    checkType(L, LT_USERDATA, 1);
+    checkType(L, LT_NUMBER, 2);
+    checkType(L, LT_NUMBER, 3);
+    checkType(L, LT_TABLE, 4);
+
+    ProcHandle *pHandle = static_cast<ProcHandle *>(lua_touserdata(L, 1));
+    size_t address = lua_tointeger(L, 2);
+    size_t scanLen = lua_tointeger(L, 3);
+    if( pHandle->handle == 0 )
+        luaL_error(L, szInvalidHandleError);
+
+    // Check every entry before we start allocating anything
+    lua_pushnil(L);
+    while( lua_next(L, 4) )
+    {
+        bool valid = false;
+        if( lua_istable(L, -1) )
+        {
+            lua_rawgeti(L, -1, 1);
+            lua_rawgeti(L, -2, 2);
+            if( lua_type(L, -2) == LUA_TSTRING && lua_type(L, -1) == LUA_TSTRING )
+            {   // An 'x' past the end of the bytes is still a wildcard, so see what it comes to
+                size_t bytesLen, maskLen;
+                const char *bytes = lua_tolstring(L, -2, &bytesLen);
+                const char *mask = lua_tolstring(L, -1, &maskLen);
+                MicroMacro::BytePattern pattern;
+                pattern.set(bytes, bytesLen, mask, maskLen);
+                valid = pattern.hasFixedBytes();
+            }
+            lua_pop(L, 2);
+        }
+
+        if( !valid )
+        {
+            lua_pop(L, 1); // Pop value, leaving the key
+            lua_pushvalue(L, -1);
+            const char *key = luaL_tolstring(L, -1, NULL);
+            luaL_error(L, "Invalid pattern for key %s; expected {bytes, mask} with at least one 'x' "\
+                       "in the mask that falls within the bytes.", key);
+            return 0;
+        }
+        lua_pop(L, 1);
+    }
+
+    FindPatternsState state;
+    std::vector<int> keyPatterns;   // Which pattern each key (in traversal order) became; -1 for none
+    lua_pushnil(L);
+    while( lua_next(L, 4) )
+    {
+        size_t bytesLen, maskLen;
+        lua_rawgeti(L, -1, 1);
+        lua_rawgeti(L, -2, 2);
+        const char *bytes = lua_tolstring(L, -2, &bytesLen);
+        const char *mask = lua_tolstring(L, -1, &maskLen);
+
+        MicroMacro::BytePattern pattern;
+        pattern.set(bytes, bytesLen, mask, maskLen);
+        keyPatterns.push_back(state.patterns.add(pattern) ? (int)state.patterns.size() - 1 : -1);
+        lua_pop(L, 3); // Bytes, mask, value
+    }
+
+    state.patterns.build();
+    state.scanStart = address;
+
+    size_t bytesRead = 0;
+    double elapsed = 0.0;
+    if( state.patterns.size() > 0 )
+    {
+        size_t overlap = state.patterns.getMaxLength() - 1;
+        std::vector<MicroMacro::ScanRange> pieces;
+        MicroMacro::getScanPieces(pHandle->handle, address, scanLen, overlap, pieces);
+        state.found.resize(pieces.size());
+
+        TimeType startTime = getNow();
+        bytesRead = MicroMacro::scanPieces(pHandle->handle, pieces, overlap, getScanThreads(),
+                                           findPatterns_block, &state);
+        elapsed = deltaTime(getNow(), startTime);
+    }
+
+    // Pieces are in address order, so this keeps each pattern's offsets in order
+    std::vector<std::vector<size_t> > results(state.patterns.size());
+    for(size_t i = 0; i < state.found.size(); i++)
+    {
+        const std::vector<MicroMacro::PatternMatch> &found = state.found.at(i);
+        for(size_t m = 0; m < found.size(); m++)
+            results.at(found.at(m).pattern).push_back(found.at(m).offset);
+    }
+
+    // Same traversal order as above, so keyPatterns lines up with the keys
+    lua_newtable(L);
+    int resultIndex = lua_gettop(L);
+    size_t k = 0;
+    lua_pushnil(L);
+    while( lua_next(L, 4) )
+    {
+        lua_pop(L, 1); // Don't need the value
+        lua_pushvalue(L, -1);
+
+        int p = k < keyPatterns.size() ? keyPatterns[k] : -1;
+        size_t count = p >= 0 ? results[p].size() : 0;
+        lua_createtable(L, (int)count, 0);
+        for(size_t i = 0; i < count; i++)
+        {
+            lua_pushinteger(L, results[p][i]);
+            lua_rawseti(L, -2, i + 1);
+        }
+        lua_settable(L, resultIndex);
+        ++k;
+    }
+
+    lua_pushnumber(L, getThroughput(bytesRead, elapsed));
+    return 2;
+}
+
+/*  process.scanValue(handle proc, string type, number value [, table range])
+    Returns:    scanresult, number throughput
+
+    Finds every address holding 'value', for a "first scan / next scan"
+    search; narrow the results down with scanresult:rescan().
+    'type' should be "byte", "ubyte", "short", "ushort", "int", "uint",
+    "int64", "uint64", "float" or "double". Only addresses aligned to the
+    size of the type are checked.
+    'range', if given, should be {address, length}; otherwise all readable
+    memory is scanned.
+
+    As with process.findPattern(), the scan is split between threads and
+    'throughput' is how fast memory was scanned, in MB/s.
+*/
+int Process_lua::scanValue(lua_State *L)
+{
+    int top = lua_gettop(L);
+    if( top != 3 && top != 4 )
+        wrongArgs(L);
+    checkType(L, LT_USERDATA, 1);
+    checkType(L, LT_STRING, 2);
+    checkType(L, LT_NUMBER, 3);
+    if( top >= 4 )
+        checkType(L, LT_TABLE, 4);
+
+    ProcHandle *pHandle = static_cast<ProcHandle *>(lua_touserdata(L, 1));
+    if( pHandle->handle == 0 )
+        luaL_error(L, szInvalidHandleError);
+
+    MicroMacro::BatchJob_type type;
+    if( !ScanResult_lua::getValueType(lua_tostring(L, 2), type) )
+    {
+        luaL_error(L, szInvalidDataType);
+        return 0;
+    }
+
+    unsigned char value[MAX_SCAN_VALUE_SIZE];
+    ScanResult_lua::toValue(L, 3, type, value);
+
+    size_t address = 0;
+    size_t scanLen = (size_t)-1;
+    if( top >= 4 )
+    {
+        lua_rawgeti(L, 4, 1);
+        lua_rawgeti(L, 4, 2);
+        if( !lua_isnumber(L, -2) || !lua_isnumber(L, -1) )
+        {
+            luaL_error(L, "Invalid range; expected {address, length}.");
+            return 0;
+        }
+        address = (size_t)lua_tointeger(L, -2);
+        scanLen = (size_t)lua_tointeger(L, -1);
+        lua_pop(L, 2);
+    }
+
+    MicroMacro::ScanResult *pResult = static_cast<MicroMacro::ScanResult *>(
+        lua_newuserdata(L, sizeof(MicroMacro::ScanResult)));
     try {
-        buffer = new unsigned char[bufferLen + 1];
+        pResult->scan = new MicroMacro::ValueScan(type);
     } catch( std::bad_alloc &ba ) {
         badAllocation();
     }
+    pResult->process = pHandle;
+    luaL_getmetatable(L, LuaType::metatable_scanresult);
+    lua_setmetatable(L, -2);
 
-    // Iterate through up until we reach the length or find something
-    for(size_t i = 0; i < scanLen; i++)
+    // Keep the handle around for as long as the results
+    lua_pushvalue(L, 1);
+    lua_setuservalue(L, -2);
+
+    TimeType startTime = getNow();
+    size_t bytesRead = 0;
+    try {
+        bytesRead = pResult->scan->scan(pHandle->handle, address, scanLen, value, getScanThreads());
+    } catch( std::bad_alloc &ba ) {
+        badAllocation();
+    }
+    double elapsed = deltaTime(getNow(), startTime);
+
+    lua_pushnumber(L, getThroughput(bytesRead, elapsed));
+    return 2;
+}
+
+/*  process.snapshot(handle proc [, table regions])
+    Returns:    snapshot, number throughput
+
+    Takes a copy of some of a process's memory, to compare with a later
+    one using snapshot:diff().
+    'regions' should be a list of {address, length} pairs; if not given,
+    all readable memory is copied. Memory that cannot be read is left out.
+
+    Memory is copied a block at a time, and pages of nothing but zeroes
+    are not stored, so a snapshot takes up no more than the memory it
+    holds, and often less. 'throughput' is how fast memory was read, in
+    MB/s.
+*/
+int Process_lua::snapshot(lua_State *L)
+{
+    int top = lua_gettop(L);
+    if( top != 1 && top != 2 )
+        wrongArgs(L);
+    checkType(L, LT_USERDATA, 1);
+    if( top >= 2 )
+        checkType(L, LT_TABLE, 2);
+
+    ProcHandle *pHandle = static_cast<ProcHandle *>(lua_touserdata(L, 1));
+    if( pHandle->handle == 0 )
+        luaL_error(L, szInvalidHandleError);
+
+    std::vector<MicroMacro::MemoryRange> regions;
+    if( top >= 2 )
     {
-        // Read a chunk (if needed)
-        size_t curAddr = address + i;
-        if( (curAddr - bufferStart + szMaskLen) >= curBufferLen )
+        size_t count = lua_rawlen(L, 2);
+        for(size_t i = 1; i <= count; i++)
         {
-            memset(buffer, 0, bufferLen);
-            SIZE_T bytesRead;
-            bool success = ReadProcessMemory(pHandle->handle, (LPCVOID)curAddr, buffer, bufferLen, &bytesRead);
-
-            bufferStart = curAddr;
-            if( !success && bytesRead == 0 )
-                continue;
-
-            if( !success && bytesRead < bufferLen )
-            {   // An error might have occurred, or we just couldn't complete the read. Ignore it.
-                debugMessage("findPattern() did not read full length. Got %d bytes, expected %d.",
-                             (int)bytesRead, bufferLen);
+            lua_rawgeti(L, 2, i);
+            bool valid = lua_istable(L, -1);
+            if( valid )
+            {
+                lua_rawgeti(L, -1, 1);
+                lua_rawgeti(L, -2, 2);
+                valid = lua_isnumber(L, -2) && lua_isnumber(L, -1);
+                MicroMacro::MemoryRange region = {(size_t)lua_tointeger(L, -2), (size_t)lua_tointeger(L, -1)};
+                regions.push_back(region);
+                lua_pop(L, 2);
             }
+            lua_pop(L, 1);
 
-            curBufferLen = bytesRead;
+            if( !valid )
+            {
+                luaL_error(L, "Invalid region at index %d; expected {address, length}.", (int)i);
+                return 0;
+            }
         }
+    }
+    else
+    {
+        MicroMacro::MemoryRange everything = {0, (size_t)-1};
+        regions.push_back(everything);
+    }
 
-        // Check for matches
-        if( procDataCompare((const char *)&buffer[curAddr - bufferStart], bmask, szMask) )
-        {
-            found = true;
-            foundAddr = address + i;
-            break;
-        }
+    MicroMacro::MemorySnapshot **ppSnapshot = static_cast<MicroMacro::MemorySnapshot **>(
+        lua_newuserdata(L, sizeof(MicroMacro::MemorySnapshot *)));
+    try {
+        *ppSnapshot = new MicroMacro::MemorySnapshot();
+    } catch( std::bad_alloc &ba ) {
+        badAllocation();
+    }
+    luaL_getmetatable(L, LuaType::metatable_snapshot);
+    lua_setmetatable(L, -2);
+
+    TimeType startTime = getNow();
+    size_t bytesRead = 0;
+    try {
+        bytesRead = (*ppSnapshot)->take(pHandle->handle, regions);
+    } catch( std::bad_alloc &ba ) {
+        badAllocation();
     }
+    double elapsed = deltaTime(getNow(), startTime);
 
-    delete []buffer;
+    lua_pushnumber(L, getThroughput(bytesRead, elapsed));
+    return 2;
+}
 
-    if( !found ) // If we didn't find anything, don't return anything
+/*  process.watch(handle proc, number address, string type, number interval [, table options])
+    Returns (on success):   number id
+    Returns (on failure):   nil
+
+    Keeps an eye on a value in the background, checking it every
+    'interval' milliseconds, and raises a "memorychanged" event when it
+    changes. 'type' is as for process.read(), except that strings cannot
+    be watched.
+    'options' may contain:
+        above       Only report the value rising past this
+        below       Only report the value falling past this
+        delta       Ignore changes smaller than this
+
+    The event is passed the watch's ID, the new value, the value before,
+    and why it was raised: "changed", "above" or "below". For changes,
+    the value before is the one last reported (so with 'delta' it may
+    be several polls old); for thresholds it is the one just before
+    crossing.
+    If the value cannot be read, the event is raised once with "failed"
+    and no new value (the value before is the last one read, if any);
+    the watch goes on being polled, and picks up again if it can be read.
+
+    Watches are polled from their own thread, so how quickly a change
+    is noticed does not depend on the script. Watches on one process
+    that come due together are read together. Watches continue after
+    'proc' is closed; use process.unwatch() to stop them.
+*/
+int Process_lua::watch(lua_State *L)
+{
+    int top = lua_gettop(L);
+    if( top != 4 && top != 5 )
+        wrongArgs(L);
+    checkType(L, LT_USERDATA, 1);
+    checkType(L, LT_NUMBER, 2);
+    checkType(L, LT_STRING, 3);
+    checkType(L, LT_NUMBER, 4);
+    if( top >= 5 )
+        checkType(L, LT_NIL | LT_TABLE, 5);
+
+    ProcHandle *pHandle = static_cast<ProcHandle *>(lua_touserdata(L, 1));
+    size_t address = (size_t)lua_tointeger(L, 2);
+    lua_Integer interval = lua_tointeger(L, 4);
+
+    if( pHandle->handle == 0 )
+        luaL_error(L, szInvalidHandleError);
+
+    MicroMacro::BatchJob_type type;
+    if( !ScanResult_lua::getValueType(lua_tostring(L, 3), type) )
+        luaL_error(L, szInvalidDataType);
+
+    if( interval < 1 )
+        luaL_argerror(L, 4, "interval must be at least 1 millisecond");
+
+    MicroMacro::WatchOptions options;
+    if( top >= 5 && lua_istable(L, 5) )
+    {
+        lua_getfield(L, 5, "above");
+        options.hasAbove = lua_isnumber(L, -1) != 0;
+        options.above = lua_tonumber(L, -1);
+        lua_getfield(L, 5, "below");
+        options.hasBelow = lua_isnumber(L, -1) != 0;
+        options.below = lua_tonumber(L, -1);
+        lua_getfield(L, 5, "delta");
+        options.delta = lua_tonumber(L, -1);
+        lua_pop(L, 3);
+    }
+
+    unsigned int id = memoryWatcher.add(pHandle->handle, address, type, (unsigned int)interval, options);
+    if( id == 0 )
         return 0;
 
-    lua_pushinteger(L, foundAddr);
+    lua_pushinteger(L, id);
     return 1;
 }
 
+/*  process.unwatch(number id)
+    Returns:    boolean
+
+    Stops a watch started by process.watch(). Returns false if there
+    was no such watch.
+*/
+int Process_lua::unwatch(lua_State *L)
+{
+    if( lua_gettop(L) != 1 )
+        wrongArgs(L);
+    checkType(L, LT_NUMBER, 1);
+
+    lua_pushboolean(L, memoryWatcher.remove((unsigned int)lua_tointeger(L, 1)));
+    return 1;
+}
+
+#ifdef WIN32
 /*  process.findByWindow(number hwnd)
     Returns (on success):   number procId
     Returns (on failure):   nil
@@ -1415,6 +1942,8 @@ int Process_lua::findByWindow(lua_State *L)
     return 1;
 }
 
+#endif
+
 /*  process.findByExe(string exeName)
     Returns (on success):   number procId
     Returns (on failure):   nil
@@ -1430,14 +1959,12 @@ int Process_lua::findByExe(lua_State *L)
     size_t nameLen = 0;
     const char *name = lua_tolstring(L, 1, &nameLen);
 
-    DWORD processes[8192];
-    DWORD bytesReturned;
-    int success = EnumProcesses(processes, sizeof(processes), &bytesReturned);
-    if( !success ) {
+    std::vector<MicroMacro::ProcessInfo> processes;
+    if( !ProcMem::getProcesses(processes) ) {
         // Throw error
-        int errCode = GetLastError();
+        int errCode = ProcMem::getLastError();
         pushLuaErrorEvent(L, "Failure to enumerate processes. Error code %i (%s)",
-                          errCode, getWindowsErrorString(errCode).c_str());
+                          errCode, ProcMem::getErrorString(errCode).c_str());
         return 0;
     }
 
@@ -1449,49 +1976,34 @@ int Process_lua::findByExe(lua_State *L)
     const char *lookFor[] = {"/", "\\", NULL};
     if( strcontains(name, lookFor) ) {
         comparePaths = true;
+        #ifdef WIN32
         GetFullPathName(name, MAX_PATH, fullPath, &namePtr);
+        #else
+        if( !realpath(name, fullPath) )
+            strlcpy(fullPath, name, MAX_PATH);
+        namePtr = strrchr(fullPath, '/');
+        if( namePtr )
+            ++namePtr;
+        #endif
+
+        // No separator to split on (ie. realpath() failed on a name with only '\\'), or it ends with one
+        if( namePtr == NULL )
+            namePtr = fullPath;
     }
     else
         strlcpy(fullPath, name, MAX_PATH);
+    nameLen = strlen(namePtr); // Resolving links may have changed it
 
-    DWORD foundProcId = 0;
-    DWORD proccount = bytesReturned / sizeof(DWORD);
-    for(unsigned int i = 0; i < proccount; i++)
+    unsigned int foundProcId = 0;
+    for(unsigned int i = 0; i < processes.size(); i++)
     {
-        if( processes[i] == 0 ) // Skip invalid entries
-            continue;
-
-        TCHAR szProcName[MAX_PATH] = TEXT("");
-        DWORD access = PROCESS_QUERY_INFORMATION | PROCESS_VM_READ;
-        HANDLE handle = OpenProcess(access, false, processes[i]);
-
-        if( handle == NULL )
-        {
-            int errCode = GetLastError();
-            if( errCode != ERROR_ACCESS_DENIED ) // Skip over processes we cannot access
-            {
-                continue;
-            }
-        }
-
-        // Check process's module names
-        HMODULE hModule;
-        DWORD bytesReturned2;
-        success = EnumProcessModules(handle, &hModule, sizeof(HMODULE), &bytesReturned2);
-        if( success )
-            GetModuleBaseName(handle, hModule, szProcName, sizeof(szProcName) / sizeof(TCHAR));
-
-        // Grab the module's filename
-        char modPath[MAX_PATH];
-        DWORD retval = GetModuleFileNameEx(handle, NULL, modPath, MAX_PATH);
-
-        // Close handle now, we're done with this one
-        CloseHandle(handle);
+        const MicroMacro::ProcessInfo &info = processes.at(i);
+        const char *szProcName = info.name.c_str();
 
         // Now try to match it... but first, convert to lowercase
         char *name_lower = 0;
         char *found_lower = 0;
-        size_t foundLen = strlen(szProcName);
+        size_t foundLen = info.name.size();
         try {
             name_lower = new char[nameLen + 1];
             found_lower = new char[foundLen + 1];
@@ -1523,7 +2035,7 @@ int Process_lua::findByExe(lua_State *L)
 
             // Convert to lower
             sztolower(givenPath_lower, getFilePath(fullPath, false).c_str(), MAX_PATH);
-            sztolower(targetPath_lower, getFilePath(modPath, false).c_str(), MAX_PATH);
+            sztolower(targetPath_lower, getFilePath(info.path, false).c_str(), MAX_PATH);
 
             // If the paths don't match, we must flip back to not found
             if( strcmp(givenPath_lower, targetPath_lower) != 0 )
@@ -1537,7 +2049,7 @@ int Process_lua::findByExe(lua_State *L)
 
         if( found )
         {   // We have a match
-            foundProcId = processes[i];
+            foundProcId = info.procId;
             break;
         }
     }
@@ -1564,9 +2076,18 @@ int Process_lua::getModuleAddress(lua_State *L)
     checkType(L, LT_STRING, 2);
 
     size_t modnameLen;
-    DWORD procId = (DWORD)lua_tointeger(L, 1);
+    unsigned int procId = (unsigned int)lua_tointeger(L, 1);
     const char *modname = lua_tolstring(L, 2, &modnameLen);
 
+    std::vector<MicroMacro::ModuleInfo> modules;
+    if( !ProcMem::getModules(procId, modules) )
+    {   // Throw error
+        int errCode = ProcMem::getLastError();
+        pushLuaErrorEvent(L, "Failure to list modules. Error code %i (%s)",
+                          errCode, ProcMem::getErrorString(errCode).c_str());
+        return 0;
+    }
+
     char *modname_lower = 0;
     try {
         modname_lower = new char[modnameLen + 1];
@@ -1575,47 +2096,21 @@ int Process_lua::getModuleAddress(lua_State *L)
     }
     sztolower(modname_lower, modname, modnameLen);
 
-    #ifdef _WIN64
-    DWORD cthFlags = TH32CS_SNAPMODULE | TH32CS_SNAPMODULE32;
-    #else
-    DWORD cthFlags = TH32CS_SNAPMODULE;
-    #endif
-
-    HANDLE snapshot = CreateToolhelp32Snapshot(cthFlags, procId);
-    if( snapshot == INVALID_HANDLE_VALUE )
-    {   // Throw error
-        int errCode = GetLastError();
-        pushLuaErrorEvent(L, "Failure to find window. Error code %i (%s)",
-                          errCode, getWindowsErrorString(errCode).c_str());
-    }
-
     bool found = false;
     size_t addrFound = 0;
-    MODULEENTRY32 mod;
-    mod.dwSize = sizeof(MODULEENTRY32);
-    if( Module32First(snapshot, &mod) )
+    for(unsigned int i = 0; i < modules.size(); i++)
     {
         char modname_snap[256];
-        sztolower(modname_snap, mod.szModule, sizeof(modname_snap) - 1);
+        sztolower(modname_snap, modules.at(i).name.c_str(), sizeof(modname_snap) - 1);
 
         if( strcmp(modname_snap, modname_lower) == 0 )
         {
             found = true;
-            addrFound = (size_t)mod.modBaseAddr;
-        }
-
-        while( !found && Module32Next(snapshot, &mod) )
-        {
-            sztolower(modname_snap, mod.szModule, sizeof(modname_snap) - 1);
-
-            if( strcmp(modname_snap, modname_lower) == 0 )
-            {
-                found = true;
-                addrFound = (size_t)mod.modBaseAddr;
-                break;
-            }
+            addrFound = modules.at(i).base;
+            break;
         }
     }
+    delete []modname_lower;
 
     if( !found )
         return 0;
@@ -1639,26 +2134,16 @@ int Process_lua::getModuleFilename(lua_State *L)
     if( pHandle->handle == 0 )
         luaL_error(L, szInvalidHandleError);
 
-    char *buffer = 0;
-    try {
-        buffer = new char[MAX_PATH + 1];
-    } catch( std::bad_alloc &ba ) {
-        badAllocation();
-    }
-
-    DWORD retval = GetModuleFileNameEx(pHandle->handle, NULL, buffer, MAX_PATH);
-    if( retval == 0 )
+    std::string filename;
+    if( !ProcMem::getExecutablePath(pHandle->handle, filename) )
     {
-        int errCode = GetLastError();
+        int errCode = ProcMem::getLastError();
         pushLuaErrorEvent(L, "Failure getting module filename. Error code %i (%s)",
-                          errCode, getWindowsErrorString(errCode).c_str());
-
-        delete []buffer;
+                          errCode, ProcMem::getErrorString(errCode).c_str());
         return 0;
     }
 
-    lua_pushstring(L, buffer);
-    delete []buffer;
+    lua_pushstring(L, filename.c_str());
     return 1;
 }
 
@@ -1674,48 +2159,31 @@ int Process_lua::getModules(lua_State *L)
         wrongArgs(L);
     checkType(L, LT_NUMBER, 1);
 
-    DWORD procId = (DWORD)lua_tointeger(L, 1);
+    unsigned int procId = (unsigned int)lua_tointeger(L, 1);
 
-    #ifdef _WIN64
-    DWORD cthFlags = TH32CS_SNAPMODULE | TH32CS_SNAPMODULE32;
-    #else
-    DWORD cthFlags = TH32CS_SNAPMODULE;
-    #endif
-
-    HANDLE snapshot = CreateToolhelp32Snapshot(cthFlags, procId);
-    if( snapshot == INVALID_HANDLE_VALUE )
+    std::vector<MicroMacro::ModuleInfo> modules;
+    if( !ProcMem::getModules(procId, modules) )
     {   // Throw error
-        int errCode = GetLastError();
-        pushLuaErrorEvent(L, "Failure to find window. Error code %i (%s)",
-                          errCode, getWindowsErrorString(errCode).c_str());
+        int errCode = ProcMem::getLastError();
+        pushLuaErrorEvent(L, "Failure to list modules. Error code %i (%s)",
+                          errCode, ProcMem::getErrorString(errCode).c_str());
+        return 0;
     }
 
-    bool found = false;
-    MODULEENTRY32 mod;
-    mod.dwSize = sizeof(MODULEENTRY32);
-    if( Module32First(snapshot, &mod) )
+    lua_newtable(L);
+    int newtab_index = lua_gettop(L);
+    for(unsigned int i = 0; i < modules.size(); i++)
     {
-        found = true;
-
-        lua_newtable(L);
-        int newtab_index = lua_gettop(L);
-
-        lua_pushstring(L, mod.szModule);                    // Key
-        lua_pushinteger(L, (size_t)mod.modBaseAddr);        // Value
+        lua_pushstring(L, modules.at(i).name.c_str());      // Key
+        lua_pushinteger(L, modules.at(i).base);             // Value
         lua_settable(L, newtab_index);                      // Set
-
-        while( Module32Next(snapshot, &mod) )
-        {
-            lua_pushstring(L, mod.szModule);                // Key
-            lua_pushinteger(L, (size_t)mod.modBaseAddr);    // Value
-            lua_settable(L, newtab_index);                  // Set
-        }
     }
 
-    return found;
+    return 1;
 }
 
 
+#ifdef WIN32
 /*  process.attachInput(number hwnd)
     Returns:    boolean
 
@@ -1786,6 +2254,8 @@ int Process_lua::detachInput(lua_State *L)
     return 1;
 }
 
+#endif
+
 /*  process.is32bit(handle proc)
     Returns:    boolean
 
@@ -1799,29 +2269,7 @@ int Process_lua::is32bit(lua_State *L)
     checkType(L, LT_USERDATA, 1);
     ProcHandle *pHandle = static_cast<ProcHandle *>(lua_touserdata(L, 1));
 
-    BOOL iswow64 = false;
-    bool success;
-
-    if( fnIsWow64Process )
-        success = fnIsWow64Process(pHandle->handle, &iswow64);
-    else
-    {   // Assume 32-bit
-        lua_pushboolean(L, true);
-        return 1;
-    }
-
-    if( !success )
-        Logger::instance()->add("Failed to call IsWow64Process() in %s. Error code: %d",
-                                __FUNCTION__, GetLastError());
-
-    if( iswow64 )
-    {   // 32 bit process, running under 64-bit Windows
-        lua_pushboolean(L, true);
-    }
-    else
-    {
-        lua_pushboolean(L, isWindows32());
-    }
+    lua_pushboolean(L, ProcMem::is32bit(pHandle->handle));
     return 1;
 }
 
@@ -1838,30 +2286,7 @@ int Process_lua::is64bit(lua_State *L)
     checkType(L, LT_USERDATA, 1);
     ProcHandle *pHandle = static_cast<ProcHandle *>(lua_touserdata(L, 1));
 
-
-    BOOL iswow64 = false;
-    bool success;
-
-    if( fnIsWow64Process )
-        success = fnIsWow64Process(pHandle->handle, &iswow64);
-    else
-    {
-        lua_pushboolean(L, false);  // Assume 32-bit
-        return 1;
-    }
-
-    if( !success )
-        Logger::instance()->add("Failed to call IsWow64Process() in %s. Error code: %d",
-                                __FUNCTION__, GetLastError());
-
-    if( iswow64 )
-    {   // 32 bit process, running under 64-bit Windows
-        lua_pushboolean(L, false);
-    }
-    else
-    {
-        lua_pushboolean(L, isWindows64());
-    }
+    lua_pushboolean(L, !ProcMem::is32bit(pHandle->handle));
     return 1;
 }
 
@@ -1887,12 +2312,13 @@ int Process_lua::terminate(lua_State *L)
         exitCode = lua_tointeger(L, 2);
     }
 
-    bool success = TerminateProcess(pHandle->handle, exitCode);
+    bool success = ProcMem::terminate(pHandle->handle, exitCode);
 
     lua_pushboolean(L, success);
     return 1;
 }
 
+#ifdef WIN32
 /*  process.getWindows(number procId)
     Returns:    table
 
@@ -1944,3 +2370,4 @@ int Process_lua::getWindows(lua_State *L)
 
     return 1;
 }
+#endif
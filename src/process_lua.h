@@ -11,16 +11,29 @@
 	#include <string>
 	#include <vector>
 	#include "types.h"
+	#include "procmem.h"
+	#include "patternscan.h"
+	#include "batchformat.h"
+	#include "memorywatch.h"
+	#include "eventdata.h"
 	#include "wininclude.h"
 
 	#define PROCESS_MODULE_NAME			"process"
 	#define MEMORY_READ_FAIL			0x00000001 // cannot read memory
 	#define MEMORY_WRITE_FAIL			0x00000010 // cannot write memory
+	#define READ_MANY_GAP				256 // Default for process.readMany()'s 'gap'
 
 	typedef struct lua_State lua_State;
 
+	namespace LuaType
+	{
+		extern const char *metatable_batchformatcache;
+	}
+
+	#ifdef WIN32
 	int isWindows32();
 	int isWindows64();
+	#endif
 
 	class Process_lua
 	{
@@ -29,73 +42,100 @@
 			static const char *szInvalidHandleError;
 			static const char *szInvalidDataType;
 
+			#ifdef WIN32
 			// Necessary data
 			static std::vector<DWORD> attachedThreadIds;
+			#endif
+
+			static MicroMacro::MemoryWatcher memoryWatcher;
 
 			// Helper functions
 			static std::string narrowString(std::wstring);
-			static std::string readString(HANDLE, size_t, int &, unsigned int);
-			static std::wstring readUString(HANDLE, size_t, int &, unsigned int);
-			static void writeString(HANDLE, size_t, char *, int &, unsigned int);
+			static std::string readString(MicroMacro::ProcessHandle, size_t, int &, unsigned int);
+			static std::wstring readUString(MicroMacro::ProcessHandle, size_t, int &, unsigned int);
+			static void writeString(MicroMacro::ProcessHandle, size_t, char *, int &, unsigned int);
+			static size_t readPointer(MicroMacro::ProcHandle *, size_t, int &);
 
 			template <class T>
-			static T readMemory(HANDLE process, size_t address, int &err)
+			static T readMemory(MicroMacro::ProcessHandle process, size_t address, int &err)
 			{
 				T buffer;
-				SIZE_T bytesread = 0;
 				err = 0;
-				int success = 0;
 
-				success = ReadProcessMemory(process, (LPCVOID)address,
-				(void *)&buffer, sizeof(T), &bytesread);
-
-				if( success == 0 )
+				if( !MicroMacro::ProcMem::readExact(process, address, (void *)&buffer, sizeof(T)) )
 					err = MEMORY_READ_FAIL;
 
 				return buffer;
 			}
 
 			template <class T>
-			static void writeMemory(HANDLE process, size_t address, T data, int &err)
+			static void writeMemory(MicroMacro::ProcessHandle process, size_t address, T data, int &err)
 			{
-				SIZE_T byteswritten = 0;
 				err = 0;
-				int success = 0;
-				DWORD old;
-
-				VirtualProtectEx(process, (void *)address, sizeof(T), PAGE_READWRITE, &old);
-				success = WriteProcessMemory(process, (void *)address,
-				(void*)&data, sizeof(T), &byteswritten);
-				VirtualProtectEx(process, (void *)address, sizeof(T), old, &old);
 
-				if( success == 0 )
+				if( !MicroMacro::ProcMem::write(process, address, (const void *)&data, sizeof(T)) )
 					err = MEMORY_WRITE_FAIL;
 			}
 
-			static unsigned int readBatch_parsefmt(const char *, std::vector<MicroMacro::BatchJob> &);
-			static bool procDataCompare(const char *, const char *, const char *);
+			static MicroMacro::BatchFormatCache *getFormatCache(lua_State *);
+			static int formatCache_gc(lua_State *);
+			static void readBatch_unpack(lua_State *, const MicroMacro::BatchJob *, size_t, const unsigned char *);
+			static void setWatchedValue(MicroMacro::EventData &, MicroMacro::BatchJob_type, const unsigned char *);
+			static void watchChanged(const MicroMacro::WatchChange &);
+
+			static unsigned int getScanThreads();
+			static double getThroughput(size_t, double);
+
+			struct FindPatternState
+			{
+				MicroMacro::BytePattern pattern;
+				std::vector<size_t> found;		// Per piece; first match, or PATTERN_NOT_FOUND
+			};
+			static bool findPattern_block(size_t, size_t, const unsigned char *, size_t, size_t, void *);
+
+			struct FindPatternsState
+			{
+				MicroMacro::PatternSet patterns;
+				size_t scanStart;
+				std::vector<std::vector<MicroMacro::PatternMatch> > found;	// Per piece; offsets from scanStart
+			};
+			static bool findPatterns_block(size_t, size_t, const unsigned char *, size_t, size_t, void *);
 
 			// Actual Lua functions
 			static int open(lua_State *);
 			static int close(lua_State *);
 			static int read(lua_State *);
 			static int readPtr(lua_State *);
+			static int pointerPath(lua_State *);
+			static int resolvePaths(lua_State *);
 			static int readBatch(lua_State *);
+			static int readMany(lua_State *);
 			static int readChunk(lua_State *);
 			static int write(lua_State *);
 			static int writePtr(lua_State *);
 			static int findPattern(lua_State *);
+			static int findPatterns(lua_State *);
+			static int scanValue(lua_State *);
+			static int snapshot(lua_State *);
+			static int watch(lua_State *);
+			static int unwatch(lua_State *);
+			#ifdef WIN32
 			static int findByWindow(lua_State *);
+			#endif
 			static int findByExe(lua_State *);
 			static int getModuleAddress(lua_State *);
 			static int getModuleFilename(lua_State *);
 			static int getModules(lua_State *);
+			#ifdef WIN32
 			static int attachInput(lua_State *);
 			static int detachInput(lua_State *);
+			#endif
 			static int is32bit(lua_State *);
 			static int is64bit(lua_State *);
 			static int terminate(lua_State *);
+			#ifdef WIN32
 			static int getWindows(lua_State *);
+			#endif
 
 		public:
 			static int regmod(lua_State *);
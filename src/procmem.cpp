@@ -0,0 +1,690 @@
+/******************************************************************************
+    Project:    MicroMacro
+    Author:     SolarStrike Software
+    URL:        www.solarstrike.net
+    License:    Modified BSD (see license.txt)
+******************************************************************************/
+
+#include "procmem.h"
+
+#include <string.h>
+#include <algorithm>
+#include <map>
+
+#ifdef WIN32
+    #include "error.h"
+    #include <tlhelp32.h>
+#else
+    #include <sys/types.h>
+    #include <sys/uio.h>
+    #include <dirent.h>
+    #include <elf.h>
+    #include <errno.h>
+    #include <fcntl.h>
+    #include <signal.h>
+    #include <stdio.h>
+    #include <stdlib.h>
+    #include <unistd.h>
+
+    #define SCATTER_READ_MAX        1024    // Most reads per process_vm_readv() (Linux's IOV_MAX)
+#endif
+
+namespace MicroMacro
+{
+    namespace ProcMem
+    {
+        #ifdef WIN32
+        typedef BOOL (WINAPI *LPFN_ISWOW64PROCESS) (HANDLE, PBOOL);
+
+        ProcessHandle open(unsigned int procId)
+        {
+            DWORD access = PROCESS_VM_OPERATION | PROCESS_VM_READ | PROCESS_VM_WRITE
+                | PROCESS_QUERY_INFORMATION | PROCESS_TERMINATE;
+            return OpenProcess(access, false, procId);
+        }
+
+        void close(ProcessHandle handle)
+        {
+            CloseHandle(handle);
+        }
+
+        // A handle of our own, which stays open if the original is closed
+        ProcessHandle duplicate(ProcessHandle handle)
+        {
+            HANDLE copy = NULL;
+            if( !DuplicateHandle(GetCurrentProcess(), handle, GetCurrentProcess(), &copy,
+                                 0, false, DUPLICATE_SAME_ACCESS) )
+                return NULL;
+            return copy;
+        }
+
+        unsigned int getId(ProcessHandle handle)
+        {
+            return GetProcessId(handle);
+        }
+
+        bool isValid(ProcessHandle handle)
+        {
+            return handle != NULL;
+        }
+
+        bool is32bit(ProcessHandle handle)
+        {
+            static LPFN_ISWOW64PROCESS fnIsWow64Process =
+                (LPFN_ISWOW64PROCESS)GetProcAddress(GetModuleHandle(TEXT("kernel32")), "IsWow64Process");
+
+            if( !fnIsWow64Process ) // No WOW64 means a 32-bit Windows
+                return true;
+
+            BOOL iswow64 = false;
+            if( !fnIsWow64Process(handle, &iswow64) )
+                return sizeof(void *) == 4;
+
+            if( iswow64 ) // 32-bit process on 64-bit Windows
+                return true;
+
+            #ifdef _WIN64
+            return false;
+            #else
+            // Not WOW64 either way; so it's as wide as Windows itself
+            BOOL selfWow64 = false;
+            fnIsWow64Process(GetCurrentProcess(), &selfWow64);
+            return !selfWow64;
+            #endif
+        }
+
+        // Returns how many bytes were read; a read may stop short at an unreadable page
+        size_t read(ProcessHandle handle, size_t address, void *buffer, size_t length)
+        {
+            SIZE_T bytesRead = 0;
+            if( !ReadProcessMemory(handle, (LPCVOID)address, buffer, length, &bytesRead) && GetLastError() != ERROR_PARTIAL_COPY )
+                return 0;
+            return bytesRead;
+        }
+
+        bool write(ProcessHandle handle, size_t address, const void *data, size_t length)
+        {
+            SIZE_T bytesWritten = 0;
+            DWORD old;
+
+            VirtualProtectEx(handle, (void *)address, length, PAGE_READWRITE, &old);
+            int success = WriteProcessMemory(handle, (void *)address, data, length, &bytesWritten);
+            VirtualProtectEx(handle, (void *)address, length, old, &old);
+
+            return success != 0 && bytesWritten == length;
+        }
+
+        // Windows has no scatter read, so this is just one read after another
+        size_t readScatter(ProcessHandle handle, ReadRequest *requests, size_t count)
+        {
+            size_t succeeded = 0;
+            for(size_t i = 0; i < count; i++)
+            {
+                requests[i].ok = readExact(handle, requests[i].address, requests[i].buffer, requests[i].size);
+                if( requests[i].ok )
+                    ++succeeded;
+            }
+            return succeeded;
+        }
+
+        // Committed regions of the process's address space, in address order
+        bool getRegions(ProcessHandle handle, std::vector<MemoryRegion> &regions)
+        {
+            const DWORD readableFlags = PAGE_READONLY | PAGE_READWRITE | PAGE_WRITECOPY
+                | PAGE_EXECUTE_READ | PAGE_EXECUTE_READWRITE | PAGE_EXECUTE_WRITECOPY;
+            const DWORD writableFlags = PAGE_READWRITE | PAGE_WRITECOPY
+                | PAGE_EXECUTE_READWRITE | PAGE_EXECUTE_WRITECOPY;
+            const DWORD executableFlags = PAGE_EXECUTE | PAGE_EXECUTE_READ
+                | PAGE_EXECUTE_READWRITE | PAGE_EXECUTE_WRITECOPY;
+
+            regions.clear();
+            MEMORY_BASIC_INFORMATION mbi;
+            size_t address = 0;
+            while( VirtualQueryEx(handle, (LPCVOID)address, &mbi, sizeof(mbi)) == sizeof(mbi) )
+            {
+                size_t next = (size_t)mbi.BaseAddress + mbi.RegionSize;
+                if( mbi.State == MEM_COMMIT )
+                {
+                    MemoryRegion region;
+                    region.base = (size_t)mbi.BaseAddress;
+                    region.size = mbi.RegionSize;
+                    bool guarded = (mbi.Protect & (PAGE_GUARD | PAGE_NOACCESS)) != 0;
+                    region.readable = !guarded && (mbi.Protect & readableFlags) != 0;
+                    region.writable = !guarded && (mbi.Protect & writableFlags) != 0;
+                    region.executable = (mbi.Protect & executableFlags) != 0;
+                    regions.push_back(region);
+                }
+
+                if( next <= address ) // Wrapped around the top of the address space
+                    break;
+                address = next;
+            }
+
+            return !regions.empty();
+        }
+
+        bool getModules(unsigned int procId, std::vector<ModuleInfo> &modules)
+        {
+            #ifdef _WIN64
+            DWORD cthFlags = TH32CS_SNAPMODULE | TH32CS_SNAPMODULE32;
+            #else
+            DWORD cthFlags = TH32CS_SNAPMODULE;
+            #endif
+
+            modules.clear();
+            HANDLE snapshot = CreateToolhelp32Snapshot(cthFlags, procId);
+            if( snapshot == INVALID_HANDLE_VALUE )
+                return false;
+
+            MODULEENTRY32 mod;
+            mod.dwSize = sizeof(MODULEENTRY32);
+            bool more = Module32First(snapshot, &mod);
+            while( more )
+            {
+                ModuleInfo info;
+                info.name = mod.szModule;
+                info.path = mod.szExePath;
+                info.base = (size_t)mod.modBaseAddr;
+                info.size = mod.modBaseSize;
+                modules.push_back(info);
+
+                more = Module32Next(snapshot, &mod);
+            }
+
+            CloseHandle(snapshot);
+            return !modules.empty();
+        }
+
+        bool getExecutablePath(ProcessHandle handle, std::string &path)
+        {
+            char buffer[MAX_PATH + 1];
+            DWORD length = GetModuleFileNameEx(handle, NULL, buffer, MAX_PATH);
+            if( length == 0 )
+                return false;
+
+            path.assign(buffer, length);
+            return true;
+        }
+
+        // Every process we can see; names are empty for processes we may not open
+        bool getProcesses(std::vector<ProcessInfo> &processes)
+        {
+            DWORD procIds[8192];
+            DWORD bytesReturned;
+            if( !EnumProcesses(procIds, sizeof(procIds), &bytesReturned) )
+                return false;
+
+            processes.clear();
+            DWORD count = bytesReturned / sizeof(DWORD);
+            for(DWORD i = 0; i < count; i++)
+            {
+                if( procIds[i] == 0 ) // Skip invalid entries
+                    continue;
+
+                ProcessInfo info;
+                info.procId = procIds[i];
+
+                HANDLE handle = OpenProcess(PROCESS_QUERY_INFORMATION | PROCESS_VM_READ, false, procIds[i]);
+                if( handle != NULL )
+                {
+                    HMODULE hModule;
+                    DWORD unused;
+                    char buffer[MAX_PATH + 1];
+                    if( EnumProcessModules(handle, &hModule, sizeof(HMODULE), &unused)
+                        && GetModuleBaseName(handle, hModule, buffer, MAX_PATH) )
+                        info.name = buffer;
+
+                    getExecutablePath(handle, info.path);
+                    CloseHandle(handle);
+                }
+
+                processes.push_back(info);
+            }
+
+            return true;
+        }
+
+        bool terminate(ProcessHandle handle, unsigned int exitCode)
+        {
+            return TerminateProcess(handle, exitCode) != 0;
+        }
+
+        int getLastError()
+        {
+            return GetLastError();
+        }
+
+        std::string getErrorString(int errCode)
+        {
+            return getWindowsErrorString(errCode);
+        }
+
+        #else
+
+        struct MapsEntry
+        {
+            size_t start;
+            size_t end;
+            char perms[5];
+            std::string path;
+        };
+
+        // Parse /proc/<pid>/maps; each line is "start-end perms offset dev inode [path]"
+        static bool readMaps(int procId, std::vector<MapsEntry> &entries)
+        {
+            char filename[64];
+            snprintf(filename, sizeof(filename), "/proc/%d/maps", procId);
+            FILE *file = fopen(filename, "r");
+            if( !file )
+                return false;
+
+            char line[MAX_PATH + 256];
+            while( fgets(line, sizeof(line), file) )
+            {
+                MapsEntry entry;
+                unsigned long start, end;
+                int pathStart = 0;
+                if( sscanf(line, "%lx-%lx %4s %*s %*s %*s %n", &start, &end, entry.perms, &pathStart) < 3 )
+                    continue;
+
+                entry.start = start;
+                entry.end = end;
+                if( pathStart > 0 )
+                {
+                    entry.path = line + pathStart;
+                    while( !entry.path.empty() && (entry.path[entry.path.size() - 1] == '\n' || entry.path[entry.path.size() - 1] == ' ') )
+                        entry.path.erase(entry.path.size() - 1);
+                }
+                entries.push_back(entry);
+            }
+
+            fclose(file);
+            return true;
+        }
+
+        static std::string baseName(const std::string &path)
+        {
+            size_t slash = path.find_last_of('/');
+            return slash == std::string::npos ? path : path.substr(slash + 1);
+        }
+
+        // /proc/<pid>/mem can also reach pages process_vm_readv/writev can't (ie. read-only ones)
+        static ssize_t procMemTransfer(int procId, size_t address, void *buffer, size_t length, bool writing)
+        {
+            char filename[64];
+            snprintf(filename, sizeof(filename), "/proc/%d/mem", procId);
+            int fd = ::open(filename, writing ? O_RDWR : O_RDONLY);
+            if( fd < 0 )
+                return -1;
+
+            ssize_t result = writing ? pwrite(fd, buffer, length, (off_t)address) : pread(fd, buffer, length, (off_t)address);
+            int savedErrno = errno;
+            ::close(fd);
+            errno = savedErrno;
+            return result;
+        }
+
+        ProcessHandle open(unsigned int procId)
+        {
+            char filename[64];
+            snprintf(filename, sizeof(filename), "/proc/%u", procId);
+            if( procId == 0 || access(filename, F_OK) != 0 )
+                return 0;
+            return (ProcessHandle)procId;
+        }
+
+        void close(ProcessHandle)
+        {
+        }
+
+        ProcessHandle duplicate(ProcessHandle handle)
+        {
+            return handle;
+        }
+
+        unsigned int getId(ProcessHandle handle)
+        {
+            return (unsigned int)handle;
+        }
+
+        bool isValid(ProcessHandle handle)
+        {
+            return handle > 0;
+        }
+
+        bool is32bit(ProcessHandle handle)
+        {
+            char filename[64];
+            snprintf(filename, sizeof(filename), "/proc/%d/exe", handle);
+            unsigned char ident[EI_NIDENT];
+            int fd = ::open(filename, O_RDONLY);
+            if( fd >= 0 )
+            {
+                ssize_t got = ::read(fd, ident, sizeof(ident));
+                ::close(fd);
+                if( got == (ssize_t)sizeof(ident) && memcmp(ident, ELFMAG, SELFMAG) == 0 )
+                    return ident[EI_CLASS] == ELFCLASS32;
+            }
+
+            return sizeof(void *) == 4;
+        }
+
+        size_t read(ProcessHandle handle, size_t address, void *buffer, size_t length)
+        {
+            struct iovec local = {buffer, length};
+            struct iovec remote = {(void *)address, length};
+            ssize_t result = process_vm_readv(handle, &local, 1, &remote, 1, 0);
+            if( result < 0 && errno == ENOSYS )
+                result = procMemTransfer(handle, address, buffer, length, false);
+
+            return result < 0 ? 0 : (size_t)result;
+        }
+
+        /*  Many reads, as few calls as possible: process_vm_readv() takes
+            up to SCATTER_READ_MAX of them at once, but stops at the first
+            that fails. That one is marked failed and the rest go in
+            another call, unless the process is gone, in which case they
+            all fail. Returns how many reads succeeded.
+        */
+        size_t readScatter(ProcessHandle handle, ReadRequest *requests, size_t count)
+        {
+            struct iovec local[SCATTER_READ_MAX];
+            struct iovec remote[SCATTER_READ_MAX];
+            size_t succeeded = 0;
+            size_t i = 0;
+            while( i < count )
+            {
+                size_t batch = count - i < SCATTER_READ_MAX ? count - i : SCATTER_READ_MAX;
+                for(size_t k = 0; k < batch; k++)
+                {
+                    local[k].iov_base = requests[i + k].buffer;
+                    local[k].iov_len = requests[i + k].size;
+                    remote[k].iov_base = (void *)requests[i + k].address;
+                    remote[k].iov_len = requests[i + k].size;
+                }
+
+                ssize_t result = process_vm_readv(handle, local, batch, remote, batch, 0);
+                if( result < 0 && errno == ESRCH )
+                {   // The process is gone; none of the rest can succeed either
+                    for(size_t k = i; k < count; k++)
+                        requests[k].ok = false;
+                    return succeeded;
+                }
+
+                if( result < 0 && errno == ENOSYS )
+                {   // One at a time, through /proc/<pid>/mem
+                    for(size_t k = i; k < i + batch; k++)
+                    {
+                        requests[k].ok = read(handle, requests[k].address, requests[k].buffer,
+                                              requests[k].size) == requests[k].size;
+                        if( requests[k].ok )
+                            ++succeeded;
+                    }
+                    i += batch;
+                    continue;
+                }
+
+                // Everything up to the first failure was read in full
+                size_t remaining = result < 0 ? 0 : (size_t)result;
+                size_t end = i + batch;
+                while( i < end && requests[i].size <= remaining )
+                {
+                    remaining -= requests[i].size;
+                    requests[i].ok = true;
+                    ++succeeded;
+                    ++i;
+                }
+
+                if( i < end )
+                    requests[i++].ok = false;
+            }
+            return succeeded;
+        }
+
+        bool write(ProcessHandle handle, size_t address, const void *data, size_t length)
+        {
+            struct iovec local = {const_cast<void *>(data), length};
+            struct iovec remote = {(void *)address, length};
+            ssize_t result = process_vm_writev(handle, &local, 1, &remote, 1, 0);
+            if( result == (ssize_t)length )
+                return true;
+
+            // Like the VirtualProtectEx() dance on Windows: get past read-only pages
+            size_t done = result > 0 ? (size_t)result : 0;
+            result = procMemTransfer(handle, address + done, const_cast<char *>((const char *)data) + done, length - done, true);
+            return result == (ssize_t)(length - done);
+        }
+
+        bool getRegions(ProcessHandle handle, std::vector<MemoryRegion> &regions)
+        {
+            std::vector<MapsEntry> entries;
+            if( !readMaps(handle, entries) )
+                return false;
+
+            regions.clear();
+            for(size_t i = 0; i < entries.size(); i++)
+            {
+                const MapsEntry &entry = entries.at(i);
+                if( entry.path == "[vsyscall]" ) // Listed, but process_vm_readv() can't reach it
+                    continue;
+
+                MemoryRegion region;
+                region.base = entry.start;
+                region.size = entry.end - entry.start;
+                region.readable = entry.perms[0] == 'r';
+                region.writable = entry.perms[1] == 'w';
+                region.executable = entry.perms[2] == 'x';
+                regions.push_back(region);
+            }
+
+            return !regions.empty();
+        }
+
+        // Each mapped file is a module; it spans from its lowest to its highest mapping
+        bool getModules(unsigned int procId, std::vector<ModuleInfo> &modules)
+        {
+            std::vector<MapsEntry> entries;
+            if( !readMaps(procId, entries) )
+                return false;
+
+            modules.clear();
+            std::map<std::string, size_t> byPath;
+            for(size_t i = 0; i < entries.size(); i++)
+            {
+                const MapsEntry &entry = entries.at(i);
+                if( entry.path.empty() || entry.path[0] != '/' )
+                    continue; // Anonymous, [heap], [stack], etc.
+
+                std::map<std::string, size_t>::iterator found = byPath.find(entry.path);
+                if( found == byPath.end() )
+                {
+                    ModuleInfo info;
+                    info.name = baseName(entry.path);
+                    info.path = entry.path;
+                    info.base = entry.start;
+                    info.size = entry.end - entry.start;
+                    byPath[entry.path] = modules.size();
+                    modules.push_back(info);
+                }
+                else
+                {
+                    ModuleInfo &info = modules.at(found->second);
+                    if( entry.start < info.base )
+                    {
+                        info.size += info.base - entry.start;
+                        info.base = entry.start;
+                    }
+                    if( entry.end > info.base + info.size )
+                        info.size = entry.end - info.base;
+                }
+            }
+
+            return !modules.empty();
+        }
+
+        static bool readExeLink(int procId, std::string &path)
+        {
+            char filename[64];
+            char buffer[MAX_PATH + 1];
+            snprintf(filename, sizeof(filename), "/proc/%d/exe", procId);
+            ssize_t length = readlink(filename, buffer, MAX_PATH);
+            if( length <= 0 )
+                return false;
+
+            path.assign(buffer, length);
+            return true;
+        }
+
+        bool getExecutablePath(ProcessHandle handle, std::string &path)
+        {
+            return readExeLink(handle, path);
+        }
+
+        bool getProcesses(std::vector<ProcessInfo> &processes)
+        {
+            DIR *dir = opendir("/proc");
+            if( !dir )
+                return false;
+
+            processes.clear();
+            struct dirent *ent;
+            while( (ent = readdir(dir)) != NULL )
+            {
+                char *end;
+                unsigned long procId = strtoul(ent->d_name, &end, 10);
+                if( *end != '\0' || procId == 0 )
+                    continue; // Not a process
+
+                ProcessInfo info;
+                info.procId = (unsigned int)procId;
+                if( readExeLink((int)procId, info.path) )
+                    info.name = baseName(info.path);
+                else
+                {   // Not ours to look at; comm still gives the (possibly truncated) name
+                    char filename[64];
+                    char buffer[64] = "";
+                    snprintf(filename, sizeof(filename), "/proc/%lu/comm", procId);
+                    FILE *file = fopen(filename, "r");
+                    if( file )
+                    {
+                        if( fgets(buffer, sizeof(buffer), file) )
+                            buffer[strcspn(buffer, "\n")] = '\0';
+                        fclose(file);
+                    }
+                    info.name = buffer;
+                }
+
+                processes.push_back(info);
+            }
+
+            closedir(dir);
+            return true;
+        }
+
+        bool terminate(ProcessHandle handle, unsigned int)
+        {
+            return kill(handle, SIGKILL) == 0;
+        }
+
+        int getLastError()
+        {
+            return errno;
+        }
+
+        std::string getErrorString(int errCode)
+        {
+            return strerror(errCode);
+        }
+        #endif
+
+        bool readExact(ProcessHandle handle, size_t address, void *buffer, size_t length)
+        {
+            return read(handle, address, buffer, length) == length;
+        }
+
+        static bool byAddress(const ReadRequest *a, const ReadRequest *b)
+        {
+            return a->address < b->address;
+        }
+
+        /*  Many small reads, merged wherever no more than 'gap' bytes lie
+            between them, then read together with readScatter(). Should a
+            merged read fail, its parts are retried on their own, so one
+            bad address doesn't take its neighbours with it. Returns how
+            many reads succeeded.
+        */
+        size_t readCoalesced(ProcessHandle handle, ReadRequest *requests, size_t count, size_t gap)
+        {
+            std::vector<ReadRequest *> sorted(count);
+            for(size_t i = 0; i < count; i++)
+                sorted[i] = &requests[i];
+            std::stable_sort(sorted.begin(), sorted.end(), byAddress);
+
+            std::vector<ReadRequest> spans;
+            std::vector<size_t> spanFirst;     // Index into 'sorted' of each span's first read
+            for(size_t i = 0; i < count; i++)
+            {
+                size_t start = sorted[i]->address;
+                size_t end = start + sorted[i]->size;
+                if( spans.empty() || start - spans.back().address > spans.back().size + gap )
+                {
+                    ReadRequest span = {start, NULL, end - start, false};
+                    spans.push_back(span);
+                    spanFirst.push_back(i);
+                }
+                else if( end - spans.back().address > spans.back().size )
+                    spans.back().size = end - spans.back().address;
+            }
+            spanFirst.push_back(count);
+
+            size_t total = 0;
+            for(size_t s = 0; s < spans.size(); s++)
+                total += spans[s].size;
+
+            std::vector<unsigned char> buffer(total);
+            total = 0;
+            for(size_t s = 0; s < spans.size(); s++)
+            {
+                spans[s].buffer = &buffer[total];
+                total += spans[s].size;
+            }
+
+            if( !spans.empty() )
+                readScatter(handle, &spans[0], spans.size());
+
+            size_t succeeded = 0;
+            std::vector<ReadRequest> retries;
+            std::vector<ReadRequest *> retried;
+            for(size_t s = 0; s < spans.size(); s++)
+            {
+                for(size_t i = spanFirst[s]; i < spanFirst[s + 1]; i++)
+                {
+                    ReadRequest *request = sorted[i];
+                    if( spans[s].ok )
+                    {
+                        memcpy(request->buffer, static_cast<unsigned char *>(spans[s].buffer)
+                               + (request->address - spans[s].address), request->size);
+                        request->ok = true;
+                        ++succeeded;
+                    }
+                    else if( spanFirst[s + 1] - spanFirst[s] == 1 )
+                        request->ok = false; // Nothing to gain from trying again
+                    else
+                    {
+                        retries.push_back(*request);
+                        retried.push_back(request);
+                    }
+                }
+            }
+
+            if( !retries.empty() )
+            {
+                succeeded += readScatter(handle, &retries[0], retries.size());
+                for(size_t i = 0; i < retries.size(); i++)
+                    retried[i]->ok = retries[i].ok;
+            }
+
+            return succeeded;
+        }
+    }
+}
@@ -0,0 +1,89 @@
+/******************************************************************************
+	Project: 	MicroMacro
+	Author: 	SolarStrike Software
+	URL:		www.solarstrike.net
+	License:	Modified BSD (see license.txt)
+******************************************************************************/
+
+#ifndef PROCMEM_H
+#define PROCMEM_H
+
+	#include "wininclude.h"
+	#include <string>
+	#include <vector>
+	#include <stddef.h>
+
+	/*	Platform layer for reading and writing another process's memory and
+		listing its modules and regions.
+		On Windows this wraps ReadProcessMemory() and friends. On Linux it
+		uses process_vm_readv()/process_vm_writev() and /proc; there is no
+		handle to open, so a ProcessHandle is simply the PID.
+	*/
+	namespace MicroMacro
+	{
+		#ifdef WIN32
+		typedef HANDLE ProcessHandle;
+		#else
+		typedef int ProcessHandle;
+		#endif
+
+		struct MemoryRegion
+		{
+			size_t base;
+			size_t size;
+			bool readable;
+			bool writable;
+			bool executable;
+		};
+
+		struct ModuleInfo
+		{
+			std::string name;		// Just the file name
+			std::string path;		// Full path, if known
+			size_t base;
+			size_t size;
+		};
+
+		struct ProcessInfo
+		{
+			unsigned int procId;
+			std::string name;		// Executable's file name
+			std::string path;		// Full path, if we were allowed to see it
+		};
+
+		/* One of many reads given to ProcMem::readScatter() */
+		struct ReadRequest
+		{
+			size_t address;
+			void *buffer;
+			size_t size;
+			bool ok;			// Set once read; false if any of it couldn't be
+		};
+
+		namespace ProcMem
+		{
+			ProcessHandle open(unsigned int);
+			void close(ProcessHandle);
+			ProcessHandle duplicate(ProcessHandle);
+			unsigned int getId(ProcessHandle);
+			bool isValid(ProcessHandle);
+			bool is32bit(ProcessHandle);
+
+			size_t read(ProcessHandle, size_t, void *, size_t);
+			bool readExact(ProcessHandle, size_t, void *, size_t);
+			size_t readScatter(ProcessHandle, ReadRequest *, size_t);
+			size_t readCoalesced(ProcessHandle, ReadRequest *, size_t, size_t);
+			bool write(ProcessHandle, size_t, const void *, size_t);
+
+			bool getRegions(ProcessHandle, std::vector<MemoryRegion> &);
+			bool getModules(unsigned int, std::vector<ModuleInfo> &);
+			bool getExecutablePath(ProcessHandle, std::string &);
+			bool getProcesses(std::vector<ProcessInfo> &);
+			bool terminate(ProcessHandle, unsigned int);
+
+			int getLastError();
+			std::string getErrorString(int);
+		}
+	}
+
+#endif
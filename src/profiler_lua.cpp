@@ -0,0 +1,481 @@
+/******************************************************************************
+    Project:    MicroMacro
+    Author:     SolarStrike Software
+    URL:        www.solarstrike.net
+    License:    Modified BSD (see license.txt)
+******************************************************************************/
+
+#include "profiler_lua.h"
+#include "luaengine.h"
+#include "luatypes.h"
+#include "timer.h"
+#include "error.h"
+#include "strl.h"
+
+#include <map>
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include <mmsystem.h>
+
+extern "C"
+{
+#include <lua.h>
+#include <lauxlib.h>
+#include <lualib.h>
+}
+
+std::vector<Profiler_lua::FunctionEntry> Profiler_lua::functions;
+std::vector<unsigned int> Profiler_lua::functionSlots;
+std::vector<Profiler_lua::StackEntry> Profiler_lua::stacks;
+std::vector<unsigned int> Profiler_lua::stackSlots;
+std::vector<unsigned int> Profiler_lua::stackFrames;
+unsigned int Profiler_lua::sampleCount = 0;
+unsigned int Profiler_lua::staleCount = 0;
+HANDLE Profiler_lua::hThread = NULL;
+HANDLE Profiler_lua::hStopEvent = NULL;
+std::atomic<unsigned int> Profiler_lua::intervalMs(PROFILER_DEFAULT_INTERVAL);
+std::atomic<LONGLONG> Profiler_lua::requestTime(0);
+bool Profiler_lua::running = false;
+
+int Profiler_lua::regmod(lua_State *L)
+{
+    static const luaL_Reg _funcs[] = {
+        {"start", Profiler_lua::start},
+        {"stop", Profiler_lua::stop},
+        {"isRunning", Profiler_lua::isRunning},
+        {NULL, NULL}
+    };
+
+    luaL_newlib(L, _funcs);
+    lua_setglobal(L, PROFILER_MODULE_NAME);
+
+    return MicroMacro::ERR_OK;
+}
+
+// Called when the Lua state is about to be closed; results are discarded
+int Profiler_lua::cleanup(lua_State *)
+{
+    stopThread();
+    resetResults(false);
+
+    return MicroMacro::ERR_OK;
+}
+
+/*  Discard any results. If 'allocate', make room for the next run's;
+    otherwise give the memory back.
+*/
+void Profiler_lua::resetResults(bool allocate)
+{
+    std::vector<FunctionEntry>().swap(functions);
+    std::vector<unsigned int>().swap(functionSlots);
+    std::vector<StackEntry>().swap(stacks);
+    std::vector<unsigned int>().swap(stackSlots);
+    std::vector<unsigned int>().swap(stackFrames);
+    sampleCount = 0;
+    staleCount = 0;
+
+    if( allocate )
+    {   // Hash tables are kept at most half full
+        functions.reserve(PROFILER_MAX_FUNCTIONS);
+        functionSlots.assign(PROFILER_MAX_FUNCTIONS * 2, 0);
+        stacks.reserve(PROFILER_MAX_STACKS);
+        stackSlots.assign(PROFILER_MAX_STACKS * 2, 0);
+        stackFrames.reserve(PROFILER_MAX_STACK_FRAMES);
+    }
+}
+
+/*  Wakes up every intervalMs and asks the engine for a sample. The sample
+    itself is taken on the Lua thread from within the interrupt hook, so
+    this thread never touches the Lua state.
+*/
+DWORD WINAPI Profiler_lua::timerThread(LPVOID)
+{
+    timeBeginPeriod(1);
+    while( WaitForSingleObject(hStopEvent, intervalMs) == WAIT_TIMEOUT )
+    {
+        requestTime = getNow().QuadPart;
+        LuaEngine::requestSample();
+    }
+    timeEndPeriod(1);
+
+    return 0;
+}
+
+void Profiler_lua::stopThread()
+{
+    if( hThread )
+    {
+        SetEvent(hStopEvent);
+        WaitForSingleObject(hThread, INFINITE);
+        CloseHandle(hThread);
+        hThread = NULL;
+    }
+
+    if( hStopEvent )
+    {
+        CloseHandle(hStopEvent);
+        hStopEvent = NULL;
+    }
+
+    LuaEngine::setSampleHandler(NULL);
+    running = false;
+}
+
+// FNV-1a, over at most 'max' characters of 'str'
+static unsigned int hashString(unsigned int hash, const char *str, size_t max)
+{
+    for(size_t i = 0; i < max && str[i]; i++)
+    {
+        hash ^= (unsigned char)str[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static unsigned int hashValue(unsigned int hash, unsigned int value)
+{
+    for(size_t i = 0; i < sizeof(value); i++)
+    {
+        hash ^= (value >> (i * 8)) & 0xFF;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/*  Returns the index in 'functions' of the function running at this
+    frame, adding it if it is new, or -1 if there is no more room.
+    Functions are told apart by their source, name and where they are
+    defined, as their labels are.
+*/
+int Profiler_lua::findFunction(lua_Debug *ar)
+{
+    const char *name = ar->name ? ar->name : "?";
+    char what = ar->what[0] == 'C' ? 'C' : (ar->what[0] == 'm' ? 'm' : 'L');
+    unsigned int hash = hashString(2166136261u, ar->short_src, PROFILER_LABEL_SIZE - 1);
+    hash = hashString(hash, name, PROFILER_LABEL_SIZE - 1);
+    hash = hashValue(hash, (unsigned int)ar->linedefined);
+
+    size_t mask = functionSlots.size() - 1;
+    for(size_t i = hash & mask; ; i = (i + 1) & mask)
+    {
+        unsigned int slot = functionSlots[i];
+        if( slot == 0 )
+        {
+            if( functions.size() >= PROFILER_MAX_FUNCTIONS )
+                return -1;
+
+            FunctionEntry entry;
+            entry.hash = hash;
+            entry.line = ar->linedefined;
+            entry.what = what;
+            strlcpy(entry.source, ar->short_src, sizeof(entry.source));
+            strlcpy(entry.name, name, sizeof(entry.name));
+            entry.self = 0;
+            entry.total = 0;
+            entry.lastSample = 0;
+            functions.push_back(entry);     // Within what start() reserved
+            functionSlots[i] = (unsigned int)functions.size();
+            return (int)functions.size() - 1;
+        }
+
+        const FunctionEntry &entry = functions[slot - 1];
+        if( entry.hash == hash && entry.line == ar->linedefined && entry.what == what
+            && strncmp(entry.source, ar->short_src, PROFILER_LABEL_SIZE - 1) == 0
+            && strncmp(entry.name, name, PROFILER_LABEL_SIZE - 1) == 0 )
+            return (int)slot - 1;
+    }
+}
+
+/*  Returns the index in 'stacks' of the stack made of these functions
+    (top first), adding it if it is new, or -1 if there is no more room.
+*/
+int Profiler_lua::findStack(const unsigned int *ids, unsigned int depth)
+{
+    unsigned int hash = 2166136261u;
+    for(unsigned int i = 0; i < depth; i++)
+        hash = hashValue(hash, ids[i]);
+
+    size_t mask = stackSlots.size() - 1;
+    for(size_t i = hash & mask; ; i = (i + 1) & mask)
+    {
+        unsigned int slot = stackSlots[i];
+        if( slot == 0 )
+        {
+            if( stacks.size() >= PROFILER_MAX_STACKS || stackFrames.size() + depth > PROFILER_MAX_STACK_FRAMES )
+                return -1;
+
+            StackEntry entry;
+            entry.hash = hash;
+            entry.first = (unsigned int)stackFrames.size();
+            entry.depth = depth;
+            entry.count = 0;
+            stackFrames.insert(stackFrames.end(), ids, ids + depth);
+            stacks.push_back(entry);
+            stackSlots[i] = (unsigned int)stacks.size();
+            return (int)stacks.size() - 1;
+        }
+
+        const StackEntry &entry = stacks[slot - 1];
+        if( entry.hash == hash && entry.depth == depth
+            && std::equal(ids, ids + depth, stackFrames.begin() + entry.first) )
+            return (int)slot - 1;
+    }
+}
+
+// Build a label for one stack frame; these become the flamegraph's boxes
+std::string Profiler_lua::getLabel(const FunctionEntry &entry)
+{
+    char buffer[PROFILER_LABEL_SIZE * 2 + 32];
+
+    if( entry.what == 'C' )
+        slprintf(buffer, sizeof(buffer), "[C] %s", entry.name);
+    else if( entry.what == 'm' )
+        slprintf(buffer, sizeof(buffer), "main chunk (%s)", entry.source);
+    else
+        slprintf(buffer, sizeof(buffer), "%s (%s:%d)", entry.name, entry.source, entry.line);
+
+    // ';' separates frames in the folded format; don't let one sneak in
+    for(char *c = buffer; *c; c++)
+    {
+        if( *c == ';' )
+            *c = ':';
+    }
+
+    return buffer;
+}
+
+/*  Runs on the Lua thread from LuaEngine's interrupt hook.
+    If the script was idle (sitting in C++, such as the main loop's wait)
+    when the sample was requested, the hook only fires once Lua resumes,
+    which would attribute idle time to whatever happens to run next.
+    Such stale samples are counted but otherwise dropped, as are any
+    that would need more functions or stacks than there is room for.
+    Nothing here allocates.
+*/
+void Profiler_lua::sample(lua_State *L)
+{
+    TimeType requested;
+    requested.QuadPart = requestTime;
+    if( deltaTime(getNow(), requested) * 1000.0 > intervalMs * 2.0 )
+    {
+        ++staleCount;
+        return;
+    }
+
+    // Walk from the top of the stack (level 0) down towards the root
+    unsigned int ids[PROFILER_MAX_DEPTH];
+    unsigned int depth = 0;
+    lua_Debug ar;
+    for(int level = 0; level < PROFILER_MAX_DEPTH && lua_getstack(L, level, &ar); level++)
+    {
+        lua_getinfo(L, "Sn", &ar);
+        int id = findFunction(&ar);
+        if( id < 0 )
+        {
+            ++staleCount;
+            return;
+        }
+        ids[depth++] = (unsigned int)id;
+    }
+
+    if( depth == 0 )
+        return;
+
+    int stack = findStack(ids, depth);
+    if( stack < 0 )
+    {
+        ++staleCount;
+        return;
+    }
+
+    ++sampleCount;
+    ++stacks[stack].count;
+    ++functions[ids[0]].self;
+    for(unsigned int i = 0; i < depth; i++)
+    {
+        // Count recursive functions only once per sample
+        FunctionEntry &entry = functions[ids[i]];
+        if( entry.lastSample != sampleCount )
+        {
+            entry.lastSample = sampleCount;
+            ++entry.total;
+        }
+    }
+}
+
+// Write folded stacks ("root;child;leaf count"), as consumed by flamegraph.pl and friends
+int Profiler_lua::writeFolded(const char *filename)
+{
+    FILE *file = fopen(filename, "w");
+    if( !file )
+        return MicroMacro::ERR_FILE;
+
+    std::vector<std::string> labels(functions.size());
+    for(size_t i = 0; i < functions.size(); i++)
+        labels.at(i) = getLabel(functions.at(i));
+
+    // Folded stacks are written root-first
+    std::map<std::string, unsigned int> folded;
+    for(size_t i = 0; i < stacks.size(); i++)
+    {
+        const StackEntry &entry = stacks.at(i);
+        std::string line;
+        for(unsigned int f = entry.depth; f > 0; f--)
+        {
+            if( !line.empty() )
+                line += ';';
+            line += labels.at(stackFrames.at(entry.first + f - 1));
+        }
+        folded[line] += entry.count;
+    }
+
+    std::map<std::string, unsigned int>::iterator iter;
+    for(iter = folded.begin(); iter != folded.end(); ++iter)
+        fprintf(file, "%s %u\n", iter->first.c_str(), iter->second);
+
+    fclose(file);
+    return MicroMacro::ERR_OK;
+}
+
+/*  profiler.start([number interval])
+    Returns:    boolean
+
+    Begins sampling the script's call stack every 'interval'
+    milliseconds (default: 1). Any results from a previous run
+    are discarded.
+    Returns false if the profiler could not be started.
+
+    Only the main Lua thread is sampled; code running inside
+    coroutines is attributed to the function that resumed them.
+*/
+int Profiler_lua::start(lua_State *L)
+{
+    int top = lua_gettop(L);
+    if( top != 0 && top != 1 )
+        wrongArgs(L);
+    if( top >= 1 )
+        checkType(L, LT_NIL | LT_NUMBER, 1);
+
+    lua_Integer interval = luaL_optinteger(L, 1, PROFILER_DEFAULT_INTERVAL);
+    if( interval < 1 )
+        luaL_argerror(L, 1, "interval must be at least 1 millisecond");
+
+    stopThread();
+    try {
+        resetResults(true);
+    } catch( std::bad_alloc &ba ) {
+        resetResults(false);
+        badAllocation();
+    }
+    intervalMs = (unsigned int)interval;
+
+    hStopEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if( hStopEvent )
+    {
+        LuaEngine::setSampleHandler(Profiler_lua::sample);
+        hThread = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE)timerThread, NULL, 0, NULL);
+    }
+
+    if( !hThread )
+    {
+        stopThread();
+        lua_pushboolean(L, false);
+        return 1;
+    }
+
+    running = true;
+    lua_pushboolean(L, true);
+    return 1;
+}
+
+/*  profiler.stop([string filename [, number count]])
+    Returns (on success):   table summary, number samples, number skipped
+    Returns (on failure):   nil, string errmsg
+
+    Stops the profiler. If 'filename' is given, the collected
+    stacks are written there in the folded format understood by
+    flamegraph tools (ie. flamegraph.pl, speedscope, inferno).
+
+    'summary' holds the 'count' (default: 20) functions with the
+    most samples of their own, hottest first. Each entry is a table
+    containing: name, self, total, selfPercent, totalPercent.
+    'self' counts samples taken while the function itself was
+    running, 'total' includes time spent in anything it called.
+    'skipped' is the number of samples dropped because the script
+    was idle (waiting in the main loop) when they came due, or
+    because they needed more distinct functions or stacks than the
+    profiler has room for.
+*/
+int Profiler_lua::stop(lua_State *L)
+{
+    int top = lua_gettop(L);
+    if( top > 2 )
+        wrongArgs(L);
+    if( top >= 1 )
+        checkType(L, LT_NIL | LT_STRING, 1);
+    if( top >= 2 )
+        checkType(L, LT_NIL | LT_NUMBER, 2);
+
+    const char *filename = luaL_optstring(L, 1, NULL);
+    lua_Integer count = luaL_optinteger(L, 2, PROFILER_DEFAULT_TOP);
+
+    stopThread();
+
+    if( filename && writeFolded(filename) != MicroMacro::ERR_OK )
+    {
+        lua_pushnil(L);
+        lua_pushfstring(L, "Unable to open \'%s\' for writing.", filename);
+        return 2;
+    }
+
+    // Sort by self samples, hottest first; ties broken by total
+    std::vector<FunctionEntry> sorted(functions);
+    std::sort(sorted.begin(), sorted.end(), [](const FunctionEntry &a, const FunctionEntry &b) {
+        if( a.self != b.self )
+            return a.self > b.self;
+        return a.total > b.total;
+    });
+
+    if( count >= 0 && (size_t)count < sorted.size() )
+        sorted.resize((size_t)count);
+
+    double scale = sampleCount ? 100.0 / sampleCount : 0.0;
+    lua_newtable(L);
+    for(size_t i = 0; i < sorted.size(); i++)
+    {
+        const FunctionEntry &entry = sorted.at(i);
+        lua_newtable(L);
+
+        lua_pushstring(L, getLabel(entry).c_str());
+        lua_setfield(L, -2, "name");
+        lua_pushinteger(L, entry.self);
+        lua_setfield(L, -2, "self");
+        lua_pushinteger(L, entry.total);
+        lua_setfield(L, -2, "total");
+        lua_pushnumber(L, entry.self * scale);
+        lua_setfield(L, -2, "selfPercent");
+        lua_pushnumber(L, entry.total * scale);
+        lua_setfield(L, -2, "totalPercent");
+
+        lua_rawseti(L, -2, i + 1);
+    }
+
+    lua_pushinteger(L, sampleCount);
+    lua_pushinteger(L, staleCount);
+    return 3;
+}
+
+/*  profiler.isRunning()
+    Returns:    boolean
+
+    Returns true if the profiler is currently collecting samples.
+*/
+int Profiler_lua::isRunning(lua_State *L)
+{
+    if( lua_gettop(L) != 0 )
+        wrongArgs(L);
+
+    lua_pushboolean(L, running);
+    return 1;
+}
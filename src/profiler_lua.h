@@ -0,0 +1,87 @@
+/******************************************************************************
+	Project: 	MicroMacro
+	Author: 	SolarStrike Software
+	URL:		www.solarstrike.net
+	License:	Modified BSD (see license.txt)
+******************************************************************************/
+
+#ifndef PROFILER_LUA_H
+#define PROFILER_LUA_H
+
+	#include "wininclude.h"
+	#include <vector>
+	#include <string>
+	#include <atomic>
+
+	#define PROFILER_MODULE_NAME		"profiler"
+	#define PROFILER_DEFAULT_INTERVAL	1		// Milliseconds between samples
+	#define PROFILER_MAX_DEPTH			64		// Deepest stack we'll walk per sample
+	#define PROFILER_DEFAULT_TOP		20		// Entries returned by profiler.stop()
+	#define PROFILER_MAX_FUNCTIONS		4096	// Distinct functions tracked per run
+	#define PROFILER_MAX_STACKS			16384	// Distinct call stacks tracked per run
+	#define PROFILER_MAX_STACK_FRAMES	(PROFILER_MAX_STACKS * 16)	// Frames held by all of those stacks
+	#define PROFILER_LABEL_SIZE			64		// Longest source or function name kept (including NULL-terminator)
+
+	typedef struct lua_State lua_State;
+	typedef struct lua_Debug lua_Debug;
+
+	class Profiler_lua
+	{
+		protected:
+			/*	Everything a sample records lives in tables allocated by
+				start(), so that the hook itself never allocates; labels
+				for the report are only built by stop().
+			*/
+			struct FunctionEntry
+			{
+				unsigned int hash;
+				int line;					// Where it is defined
+				char what;					// 'L'ua function, 'C' function or 'm'ain chunk
+				char source[PROFILER_LABEL_SIZE];
+				char name[PROFILER_LABEL_SIZE];
+				unsigned int self;			// Samples where this function was on top
+				unsigned int total;			// Samples where it appeared anywhere on the stack
+				unsigned int lastSample;	// So that recursion only counts once per sample
+			};
+
+			struct StackEntry
+			{
+				unsigned int hash;
+				unsigned int first;			// Where its functions (top first) start in stackFrames
+				unsigned int depth;
+				unsigned int count;
+			};
+
+			static std::vector<FunctionEntry> functions;
+			static std::vector<unsigned int> functionSlots;	// Hash table; index into 'functions' + 1
+			static std::vector<StackEntry> stacks;
+			static std::vector<unsigned int> stackSlots;	// Hash table; index into 'stacks' + 1
+			static std::vector<unsigned int> stackFrames;
+			static unsigned int sampleCount;
+			static unsigned int staleCount;
+
+			static HANDLE hThread;
+			static HANDLE hStopEvent;
+			static std::atomic<unsigned int> intervalMs;
+			static std::atomic<LONGLONG> requestTime;	// When the pending sample was requested
+			static bool running;
+
+			static DWORD WINAPI timerThread(LPVOID);
+			static void sample(lua_State *);
+			static void stopThread();
+			static void resetResults(bool);
+			static int findFunction(lua_Debug *);
+			static int findStack(const unsigned int *, unsigned int);
+			static std::string getLabel(const FunctionEntry &);
+			static int writeFolded(const char *);
+
+			static int start(lua_State *);
+			static int stop(lua_State *);
+			static int isRunning(lua_State *);
+
+		public:
+			static int regmod(lua_State *);
+			static int cleanup(lua_State *);
+	};
+
+#endif
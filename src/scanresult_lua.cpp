@@ -0,0 +1,327 @@
+/******************************************************************************
+    Project:    MicroMacro
+    Author:     SolarStrike Software
+    URL:        www.solarstrike.net
+    License:    Modified BSD (see license.txt)
+******************************************************************************/
+
+#include "scanresult_lua.h"
+#include "valuescan.h"
+#include "error.h"
+#include "strl.h"
+#include "types.h"
+
+#include <string.h>
+
+extern "C"
+{
+#include <lua.h>
+#include <lauxlib.h>
+#include <lualib.h>
+}
+
+const char *LuaType::metatable_scanresult = "scanresult";
+
+using MicroMacro::BatchJob_type;
+using MicroMacro::ScanResult;
+using MicroMacro::ValueScan;
+
+namespace
+{
+    struct ValueTypeName
+    {
+        const char *name;
+        BatchJob_type type;
+    };
+
+    const ValueTypeName valueTypeNames[] = {
+        {"byte", MicroMacro::MEM_BYTE},
+        {"ubyte", MicroMacro::MEM_UBYTE},
+        {"short", MicroMacro::MEM_SHORT},
+        {"ushort", MicroMacro::MEM_USHORT},
+        {"int", MicroMacro::MEM_INT},
+        {"uint", MicroMacro::MEM_UINT},
+        {"int64", MicroMacro::MEM_INT64},
+        {"uint64", MicroMacro::MEM_UINT64},
+        {"float", MicroMacro::MEM_FLOAT},
+        {"double", MicroMacro::MEM_DOUBLE},
+        {NULL, MicroMacro::MEM_SKIP}
+    };
+
+    struct CompareName
+    {
+        const char *name;
+        MicroMacro::ValueCompare op;
+        int values;     // How many values must follow
+    };
+
+    const CompareName compareNames[] = {
+        {"equal", MicroMacro::VALUE_EQUAL, 1},
+        {"unchanged", MicroMacro::VALUE_UNCHANGED, 0},
+        {"changed", MicroMacro::VALUE_CHANGED, 0},
+        {"increased", MicroMacro::VALUE_INCREASED, 0},
+        {"decreased", MicroMacro::VALUE_DECREASED, 0},
+        {"between", MicroMacro::VALUE_BETWEEN, 2},
+        {NULL, MicroMacro::VALUE_EQUAL, 0}
+    };
+
+    template <class T>
+    void storeValue(unsigned char *out, T value)
+    {
+        memcpy(out, &value, sizeof(T));
+    }
+
+    template <class T>
+    T loadValue(const unsigned char *in)
+    {
+        T value;
+        memcpy(&value, in, sizeof(T));
+        return value;
+    }
+}
+
+int ScanResult_lua::regmod(lua_State *L)
+{
+    const luaL_Reg meta[] = {
+        {"__gc", gc},
+        {"__tostring", tostring},
+        {NULL, NULL}
+    };
+
+    const luaL_Reg methods[] = {
+        {"rescan", rescan},
+        {"getCount", getCount},
+        {"getType", getType},
+        {"getAddresses", getAddresses},
+        {NULL, NULL}
+    };
+
+    luaL_newmetatable(L, LuaType::metatable_scanresult);
+    luaL_setfuncs(L, meta, 0);
+    luaL_newlib(L, methods);
+    lua_setfield(L, -2, "__index");
+
+    lua_pop(L, 1); // Pop table
+
+    return MicroMacro::ERR_OK;
+}
+
+// Type of value from its name, as given to process.read()
+bool ScanResult_lua::getValueType(const char *name, BatchJob_type &type)
+{
+    for(unsigned int i = 0; valueTypeNames[i].name != NULL; i++)
+    {
+        if( strcmp(valueTypeNames[i].name, name) == 0 )
+        {
+            type = valueTypeNames[i].type;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char *ScanResult_lua::getValueTypeName(BatchJob_type type)
+{
+    for(unsigned int i = 0; valueTypeNames[i].name != NULL; i++)
+    {
+        if( valueTypeNames[i].type == type )
+            return valueTypeNames[i].name;
+    }
+    return "unknown";
+}
+
+// Store the number at 'index' as a value of the given type
+void ScanResult_lua::toValue(lua_State *L, int index, BatchJob_type type, unsigned char *out)
+{
+    switch( type )
+    {
+        case MicroMacro::MEM_BYTE:      storeValue<char>(out, (char)lua_tointeger(L, index));                      break;
+        case MicroMacro::MEM_UBYTE:     storeValue<unsigned char>(out, (unsigned char)lua_tointeger(L, index));    break;
+        case MicroMacro::MEM_SHORT:     storeValue<short>(out, (short)lua_tointeger(L, index));                    break;
+        case MicroMacro::MEM_USHORT:    storeValue<unsigned short>(out, (unsigned short)lua_tointeger(L, index));  break;
+        case MicroMacro::MEM_INT:       storeValue<int>(out, (int)lua_tointeger(L, index));                        break;
+        case MicroMacro::MEM_UINT:      storeValue<unsigned int>(out, (unsigned int)lua_tointeger(L, index));      break;
+        case MicroMacro::MEM_INT64:     storeValue<long long>(out, (long long)lua_tointeger(L, index));            break;
+        case MicroMacro::MEM_UINT64:    storeValue<unsigned long long>(out, (unsigned long long)lua_tointeger(L, index)); break;
+        case MicroMacro::MEM_FLOAT:     storeValue<float>(out, (float)lua_tonumber(L, index));                     break;
+        case MicroMacro::MEM_DOUBLE:    storeValue<double>(out, (double)lua_tonumber(L, index));                   break;
+        default:                                                                                                    break;
+    }
+}
+
+void ScanResult_lua::pushValue(lua_State *L, BatchJob_type type, const unsigned char *in)
+{
+    switch( type )
+    {
+        case MicroMacro::MEM_BYTE:      lua_pushinteger(L, loadValue<char>(in));                break;
+        case MicroMacro::MEM_UBYTE:     lua_pushinteger(L, loadValue<unsigned char>(in));       break;
+        case MicroMacro::MEM_SHORT:     lua_pushinteger(L, loadValue<short>(in));               break;
+        case MicroMacro::MEM_USHORT:    lua_pushinteger(L, loadValue<unsigned short>(in));      break;
+        case MicroMacro::MEM_INT:       lua_pushinteger(L, loadValue<int>(in));                 break;
+        case MicroMacro::MEM_UINT:      lua_pushinteger(L, loadValue<unsigned int>(in));        break;
+        case MicroMacro::MEM_INT64:     lua_pushinteger(L, loadValue<long long>(in));           break;
+        case MicroMacro::MEM_UINT64:    lua_pushinteger(L, loadValue<unsigned long long>(in));  break;
+        case MicroMacro::MEM_FLOAT:     lua_pushnumber(L, loadValue<float>(in));                break;
+        case MicroMacro::MEM_DOUBLE:    lua_pushnumber(L, loadValue<double>(in));               break;
+        default:                        lua_pushnil(L);                                         break;
+    }
+}
+
+int ScanResult_lua::gc(lua_State *L)
+{
+    ScanResult *pResult = static_cast<ScanResult *>(lua_touserdata(L, 1));
+    delete pResult->scan;
+    pResult->scan = NULL;
+    return 0;
+}
+
+int ScanResult_lua::tostring(lua_State *L)
+{
+    ScanResult *pResult = static_cast<ScanResult *>(lua_touserdata(L, 1));
+    char buffer[64];
+    slprintf(buffer, sizeof(buffer), "Scan result (%u %s values)",
+             (unsigned int)pResult->scan->getCount(), getValueTypeName(pResult->scan->getType()));
+
+    lua_pushstring(L, buffer);
+    return 1;
+}
+
+/*  scanresult:rescan(string compare [, number value [, number value2]])
+    Returns:    number
+
+    Re-reads every remaining address and keeps those that pass.
+    'compare' should be one of:
+        "equal", value      now holds 'value'
+        "between", lo, hi   now holds 'lo' through 'hi' (inclusive)
+        "unchanged"         same as the last scan
+        "changed"           different from the last scan
+        "increased"         greater than at the last scan
+        "decreased"         less than at the last scan
+
+    Nearby addresses are read together, and addresses that can no longer
+    be read are dropped. Returns how many addresses remain.
+*/
+int ScanResult_lua::rescan(lua_State *L)
+{
+    int top = lua_gettop(L);
+    if( top < 2 || top > 4 )
+        wrongArgs(L);
+    checkType(L, LT_USERDATA, 1);
+    checkType(L, LT_STRING, 2);
+
+    ScanResult *pResult = static_cast<ScanResult *>(lua_touserdata(L, 1));
+    const char *opName = lua_tostring(L, 2);
+
+    const CompareName *compare = NULL;
+    for(unsigned int i = 0; compareNames[i].name != NULL; i++)
+    {
+        if( strcmp(compareNames[i].name, opName) == 0 )
+            compare = &compareNames[i];
+    }
+
+    if( compare == NULL )
+    {
+        luaL_error(L, "Invalid comparison '%s'.", opName);
+        return 0;
+    }
+
+    if( top != 2 + compare->values )
+        wrongArgs(L);
+
+    BatchJob_type type = pResult->scan->getType();
+    unsigned char a[MAX_SCAN_VALUE_SIZE];
+    unsigned char b[MAX_SCAN_VALUE_SIZE];
+    if( compare->values >= 1 )
+    {
+        checkType(L, LT_NUMBER, 3);
+        toValue(L, 3, type, a);
+    }
+    if( compare->values >= 2 )
+    {
+        checkType(L, LT_NUMBER, 4);
+        toValue(L, 4, type, b);
+    }
+
+    if( pResult->process->handle == 0 )
+        luaL_error(L, "Invalid process handle.");
+
+    try {
+        pResult->scan->rescan(pResult->process->handle, compare->op, a, b);
+    } catch( std::bad_alloc &ba ) {
+        badAllocation();
+    }
+    lua_pushinteger(L, pResult->scan->getCount());
+    return 1;
+}
+
+/*  scanresult:getCount()
+    Returns:    number
+
+    Returns how many addresses remain.
+*/
+int ScanResult_lua::getCount(lua_State *L)
+{
+    if( lua_gettop(L) != 1 )
+        wrongArgs(L);
+    checkType(L, LT_USERDATA, 1);
+
+    ScanResult *pResult = static_cast<ScanResult *>(lua_touserdata(L, 1));
+    lua_pushinteger(L, pResult->scan->getCount());
+    return 1;
+}
+
+/*  scanresult:getType()
+    Returns:    string
+
+    Returns the type of value that was scanned for ("int", "float", etc.)
+*/
+int ScanResult_lua::getType(lua_State *L)
+{
+    if( lua_gettop(L) != 1 )
+        wrongArgs(L);
+    checkType(L, LT_USERDATA, 1);
+
+    ScanResult *pResult = static_cast<ScanResult *>(lua_touserdata(L, 1));
+    lua_pushstring(L, getValueTypeName(pResult->scan->getType()));
+    return 1;
+}
+
+/*  scanresult:getAddresses([number max])
+    Returns:    table addresses, table values
+
+    Returns the remaining addresses, in order, along with the value each
+    held when last scanned. At most 'max' are returned, if given.
+*/
+int ScanResult_lua::getAddresses(lua_State *L)
+{
+    int top = lua_gettop(L);
+    if( top != 1 && top != 2 )
+        wrongArgs(L);
+    checkType(L, LT_USERDATA, 1);
+    if( top >= 2 )
+        checkType(L, LT_NUMBER, 2);
+
+    ScanResult *pResult = static_cast<ScanResult *>(lua_touserdata(L, 1));
+    size_t max = (size_t)-1;
+    if( top >= 2 && lua_tointeger(L, 2) >= 0 )
+        max = (size_t)lua_tointeger(L, 2);
+
+    std::vector<size_t> addresses;
+    std::vector<unsigned char> values;
+    size_t found = pResult->scan->getCandidates(max, addresses, values);
+
+    BatchJob_type type = pResult->scan->getType();
+    size_t valueSize = ValueScan::getValueSize(type);
+    lua_createtable(L, (int)found, 0);
+    lua_createtable(L, (int)found, 0);
+    for(size_t i = 0; i < found; i++)
+    {
+        lua_pushinteger(L, addresses.at(i));
+        lua_rawseti(L, -3, i + 1);
+
+        pushValue(L, type, &values.at(i * valueSize));
+        lua_rawseti(L, -2, i + 1);
+    }
+
+    return 2;
+}
@@ -0,0 +1,39 @@
+/******************************************************************************
+	Project: 	MicroMacro
+	Author: 	SolarStrike Software
+	URL:		www.solarstrike.net
+	License:	Modified BSD (see license.txt)
+******************************************************************************/
+
+#ifndef SCANRESULT_LUA_H
+#define SCANRESULT_LUA_H
+
+	#include "types.h"
+
+	typedef struct lua_State lua_State;
+
+	namespace LuaType
+	{
+		extern const char *metatable_scanresult;
+	}
+
+	class ScanResult_lua
+	{
+		protected:
+			static int gc(lua_State *);
+			static int tostring(lua_State *);
+			static int rescan(lua_State *);
+			static int getCount(lua_State *);
+			static int getType(lua_State *);
+			static int getAddresses(lua_State *);
+
+		public:
+			static int regmod(lua_State *);
+
+			static bool getValueType(const char *, MicroMacro::BatchJob_type &);
+			static const char *getValueTypeName(MicroMacro::BatchJob_type);
+			static void toValue(lua_State *, int, MicroMacro::BatchJob_type, unsigned char *);
+			static void pushValue(lua_State *, MicroMacro::BatchJob_type, const unsigned char *);
+	};
+
+#endif
@@ -0,0 +1,170 @@
+/******************************************************************************
+    Project:    MicroMacro
+    Author:     SolarStrike Software
+    URL:        www.solarstrike.net
+    License:    Modified BSD (see license.txt)
+******************************************************************************/
+
+#include "scheduler.h"
+#include <mmsystem.h>
+#include <string.h>
+
+// In wait mode without a frame rate, never block longer than this (so HID still gets polled)
+#define UNPACED_WAIT_MSECS      1
+// Maximum frame rate we will try to honor
+#define MAX_FRAME_RATE          1000
+
+using MicroMacro::Scheduler;
+using MicroMacro::IdleMode;
+
+Scheduler::Scheduler()
+{
+    wakeEvent       =   CreateEvent(NULL, FALSE, FALSE, NULL); // Auto-reset
+    mode            =   IDLE_SLEEP;
+    frameRate       =   0;
+    frameStart      =   getNow();
+    hasDeadline     =   false;
+    timerPeriodSet  =   false;
+    deadline.QuadPart = 0;
+}
+
+Scheduler::~Scheduler()
+{
+    setTimerPeriod(false);
+
+    if( wakeEvent )
+        CloseHandle(wakeEvent);
+    wakeEvent = NULL;
+}
+
+/*  Waiting on a kernel object is only as precise as the system
+    timer; ask for 1ms resolution only while we actually need it.
+*/
+void Scheduler::setTimerPeriod(bool enable)
+{
+    if( enable && !timerPeriodSet )
+        timerPeriodSet = (timeBeginPeriod(1) == TIMERR_NOERROR);
+    else if( !enable && timerPeriodSet )
+    {
+        timeEndPeriod(1);
+        timerPeriodSet = false;
+    }
+}
+
+// Called when a script starts so that settings from the previous script don't leak over
+void Scheduler::reset(IdleMode newMode, unsigned int newFrameRate)
+{
+    setIdleMode(newMode);
+    setFrameRate(newFrameRate);
+    hasDeadline = false;
+    frameStart = getNow();
+}
+
+// Safe to call from any thread; cuts the current (or next) wait short
+void Scheduler::wake()
+{
+    if( wakeEvent )
+        SetEvent(wakeEvent);
+}
+
+/*  Ask to be woken no later than `when` during the current cycle.
+    The earliest request wins; requests are cleared every cycle.
+*/
+void Scheduler::requestWakeAt(TimeType when)
+{
+    if( !hasDeadline || when.QuadPart < deadline.QuadPart )
+        deadline = when;
+    hasDeadline = true;
+}
+
+void Scheduler::idle()
+{
+    TimeType now = getNow();
+    TimeType target = now;
+    bool paced = (frameRate > 0);
+
+    if( paced )
+        target.QuadPart = frameStart.QuadPart + getFrequency().QuadPart / frameRate;
+    else if( mode == IDLE_WAIT )
+        target.QuadPart = now.QuadPart + getFrequency().QuadPart * UNPACED_WAIT_MSECS / 1000;
+
+    if( hasDeadline && deadline.QuadPart < target.QuadPart )
+        target = deadline;
+    hasDeadline = false;
+
+    if( !paced && mode != IDLE_WAIT )
+    {   // Legacy behavior: just yield once
+        Sleep(mode == IDLE_SLEEP ? 1 : 0);
+        frameStart = getNow();
+        return;
+    }
+
+    while( now.QuadPart < target.QuadPart )
+    {
+        double remainingMsecs = deltaTime(target, now) * 1000;
+        if( mode == IDLE_WAIT && remainingMsecs >= 1.0 )
+        {
+            DWORD result = MsgWaitForMultipleObjects(1, &wakeEvent, FALSE,
+                (DWORD)remainingMsecs, QS_ALLINPUT);
+            if( result != WAIT_TIMEOUT )
+                break; // Something needs our attention now
+        }
+        else if( mode == IDLE_SLEEP && remainingMsecs >= 1.0 )
+            Sleep(1);
+        else
+            Sleep(0);
+
+        now = getNow();
+    }
+
+    frameStart = getNow();
+}
+
+IdleMode Scheduler::getIdleMode()
+{
+    return mode;
+}
+
+void Scheduler::setIdleMode(IdleMode newMode)
+{
+    mode = newMode;
+    setTimerPeriod(mode == IDLE_WAIT);
+}
+
+unsigned int Scheduler::getFrameRate()
+{
+    return frameRate;
+}
+
+void Scheduler::setFrameRate(unsigned int newFrameRate)
+{
+    if( newFrameRate > MAX_FRAME_RATE )
+        newFrameRate = MAX_FRAME_RATE;
+    frameRate = newFrameRate;
+}
+
+const char *Scheduler::getIdleModeName(IdleMode idleMode)
+{
+    switch( idleMode )
+    {
+        case IDLE_SPIN:     return "spin";
+        case IDLE_SLEEP:    return "sleep";
+        case IDLE_WAIT:     return "wait";
+    }
+    return "unknown";
+}
+
+// Returns false if the name isn't recognized (and leaves `out` untouched)
+bool Scheduler::parseIdleMode(const char *name, IdleMode &out)
+{
+    const IdleMode modes[] = {IDLE_SPIN, IDLE_SLEEP, IDLE_WAIT};
+    for(unsigned int i = 0; i < sizeof(modes)/sizeof(modes[0]); i++)
+    {
+        if( strcmp(name, getIdleModeName(modes[i])) == 0 )
+        {
+            out = modes[i];
+            return true;
+        }
+    }
+    return false;
+}
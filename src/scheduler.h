@@ -0,0 +1,64 @@
+/******************************************************************************
+	Project: 	MicroMacro
+	Author: 	SolarStrike Software
+	URL:		www.solarstrike.net
+	License:	Modified BSD (see license.txt)
+******************************************************************************/
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+	#include "wininclude.h"
+	#include "timer.h"
+
+	namespace MicroMacro
+	{
+		enum IdleMode
+		{
+			IDLE_SPIN,		// Sleep(0); lowest latency, pegs a core
+			IDLE_SLEEP,		// Sleep(1); the classic yieldTimeSlice behavior
+			IDLE_WAIT,		// Block until the next deadline or until woken
+		};
+
+		/*	Decides how long the main loop idles between cycles.
+			In IDLE_WAIT mode the loop blocks until the next frame (as set by
+			the frame rate), the earliest deadline requested this cycle, a
+			queued event (see wake()), or a Windows message -- whichever
+			comes first.
+		*/
+		class Scheduler
+		{
+			private:
+				HANDLE wakeEvent;
+				IdleMode mode;
+				unsigned int frameRate;		// Target cycles per second; 0 = unpaced
+				TimeType frameStart;
+				TimeType deadline;
+				bool hasDeadline;
+				bool timerPeriodSet;
+
+				void setTimerPeriod(bool);
+
+				Scheduler(const Scheduler &);
+				Scheduler &operator=(const Scheduler &);
+
+			public:
+				Scheduler();
+				~Scheduler();
+
+				void reset(IdleMode, unsigned int);
+				void wake();
+				void requestWakeAt(TimeType);
+				void idle();
+
+				IdleMode getIdleMode();
+				void setIdleMode(IdleMode);
+				unsigned int getFrameRate();
+				void setFrameRate(unsigned int);
+
+				static const char *getIdleModeName(IdleMode);
+				static bool parseIdleMode(const char *, IdleMode &);
+		};
+	}
+
+#endif
@@ -12,11 +12,18 @@
 const char *CONFIG_FILENAME                     =   "config.lua";
 const char *CONFIG_DEFAULT_FILENAME             =   "config.default.lua";
 const char *CONFVAR_MEMORY_STRING_BUFFER_SIZE   =   "memoryStringBufferSize";
+const char *CONFVAR_MEMORY_SCAN_THREADS         =   "memoryScanThreads";
 const char *CONFVAR_LOG_DIRECTORY               =   "logDirectory";
 const char *CONFVAR_LOG_REMOVAL_DAYS            =   "logRemovalDays";
 const char *CONFVAR_LOG_LEVEL                   =   "logLevel";
 const char *CONFVAR_SCRIPT_DIRECTORY            =   "scriptDirectory";
 const char *CONFVAR_YIELD_TIME_SLICE            =   "yieldTimeSlice";
+const char *CONFVAR_IDLE_MODE                   =   "idleMode";
+const char *CONFVAR_FRAME_RATE                  =   "frameRate";
+const char *CONFVAR_STATS_LOG_INTERVAL          =   "statsLogInterval";
+const char *CONFVAR_CLOCK_SOURCE                =   "clockSource";
+const char *CONFVAR_GAMEPAD_DEADZONE            =   "gamepadDeadzone";
+const char *CONFVAR_GAMEPAD_AXIS_MIN_DELTA      =   "gamepadAxisMinDelta";
 const char *CONFVAR_NETWORK_ENABLED             =   "networkEnabled";
 const char *CONFVAR_NETWORK_BUFFER_SIZE         =   "networkBufferSize";
 const char *CONFVAR_RECV_QUEUE_SIZE             =   "recvQueueSize";
@@ -26,11 +33,18 @@ const char *CONFVAR_LINE_NUMBER_STYLE           =   "lineNumberStyle";
 const char *CONFVAR_MESSAGE_STYLE               =   "errMessageStyle";
 
 const int CONFDEFAULT_MEMORY_STRING_BUFFER_SIZE =   128;
+const int CONFDEFAULT_MEMORY_SCAN_THREADS       =   0;      // 0 = one per processor
 const int CONFDEFAULT_LOG_REMOVAL_DAYS          =   7;
 const char *CONFDEFAULT_LOG_DIRECTORY           =   "logs";
 const LogLevel CONFDEFAULT_LOG_LEVEL            =   LogLevel::info;
 const char *CONFDEFAULT_SCRIPT_DIRECTORY        =   "scripts";
 const int CONFDEFAULT_YIELD_TIME_SLICE          =   1;
+const char *CONFDEFAULT_IDLE_MODE               =   "";     // Empty = pick from yieldTimeSlice
+const int CONFDEFAULT_FRAME_RATE                =   0;
+const int CONFDEFAULT_STATS_LOG_INTERVAL        =   0;
+const char *CONFDEFAULT_CLOCK_SOURCE            =   "system";
+const double CONFDEFAULT_GAMEPAD_DEADZONE        =   0.0;
+const double CONFDEFAULT_GAMEPAD_AXIS_MIN_DELTA  =   0.0;
 const int CONFDEFAULT_NETWORK_ENABLED           =   1;
 const int CONFDEFAULT_NETWORK_BUFFER_SIZE       =   10240;
 const int CONFDEFAULT_RECV_QUEUE_SIZE           =   100;
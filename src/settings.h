@@ -18,11 +18,18 @@
 	extern const char *CONFIG_FILENAME;
 	extern const char *CONFIG_DEFAULT_FILENAME;
 	extern const char *CONFVAR_MEMORY_STRING_BUFFER_SIZE;
+	extern const char *CONFVAR_MEMORY_SCAN_THREADS;
 	extern const char *CONFVAR_LOG_DIRECTORY;
 	extern const char *CONFVAR_LOG_REMOVAL_DAYS;
 	extern const char *CONFVAR_LOG_LEVEL;
 	extern const char *CONFVAR_SCRIPT_DIRECTORY;
 	extern const char *CONFVAR_YIELD_TIME_SLICE;
+	extern const char *CONFVAR_IDLE_MODE;
+	extern const char *CONFVAR_FRAME_RATE;
+	extern const char *CONFVAR_STATS_LOG_INTERVAL;
+	extern const char *CONFVAR_CLOCK_SOURCE;
+	extern const char *CONFVAR_GAMEPAD_DEADZONE;
+	extern const char *CONFVAR_GAMEPAD_AXIS_MIN_DELTA;
 	extern const char *CONFVAR_NETWORK_ENABLED;
 	extern const char *CONFVAR_NETWORK_BUFFER_SIZE;
 	extern const char *CONFVAR_RECV_QUEUE_SIZE;
@@ -32,11 +39,18 @@
 	extern const char *CONFVAR_MESSAGE_STYLE;
 
 	extern const int CONFDEFAULT_MEMORY_STRING_BUFFER_SIZE;
+	extern const int CONFDEFAULT_MEMORY_SCAN_THREADS;
 	extern const int CONFDEFAULT_LOG_REMOVAL_DAYS;
 	extern const char *CONFDEFAULT_LOG_DIRECTORY;
 	extern const LogLevel CONFDEFAULT_LOG_LEVEL;
 	extern const char *CONFDEFAULT_SCRIPT_DIRECTORY;
 	extern const int CONFDEFAULT_YIELD_TIME_SLICE;
+	extern const char *CONFDEFAULT_IDLE_MODE;
+	extern const int CONFDEFAULT_FRAME_RATE;
+	extern const int CONFDEFAULT_STATS_LOG_INTERVAL;
+	extern const char *CONFDEFAULT_CLOCK_SOURCE;
+	extern const double CONFDEFAULT_GAMEPAD_DEADZONE;
+	extern const double CONFDEFAULT_GAMEPAD_AXIS_MIN_DELTA;
 	extern const int CONFDEFAULT_NETWORK_ENABLED;
 	extern const int CONFDEFAULT_NETWORK_BUFFER_SIZE;
 	extern const int CONFDEFAULT_RECV_QUEUE_SIZE;
@@ -0,0 +1,45 @@
+/******************************************************************************
+	Project: 	MicroMacro
+	Author: 	SolarStrike Software
+	URL:		www.solarstrike.net
+	License:	Modified BSD (see license.txt)
+******************************************************************************/
+
+#ifndef SIMD_H
+#define SIMD_H
+
+	/*	Which vector instructions the compiler was told it may use. These
+		are compile-time choices (ie. -mavx2 or /arch:AVX2); every path
+		has a plain C++ fallback.
+	*/
+	#if defined(__AVX2__)
+		#define SIMD_AVX2
+	#endif
+
+	#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+		#define SIMD_SSE2
+	#endif
+
+	#if defined(SIMD_AVX2)
+		#include <immintrin.h>
+	#elif defined(SIMD_SSE2)
+		#include <emmintrin.h>
+	#endif
+
+	#ifdef _MSC_VER
+		#include <intrin.h>
+	#endif
+
+	// Index of the lowest set bit; 'bits' must not be 0
+	inline unsigned int lowestSetBit(unsigned int bits)
+	{
+		#ifdef _MSC_VER
+			unsigned long index;
+			_BitScanForward(&index, bits);
+			return (unsigned int)index;
+		#else
+			return (unsigned int)__builtin_ctz(bits);
+		#endif
+	}
+
+#endif
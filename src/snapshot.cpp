@@ -0,0 +1,252 @@
+/******************************************************************************
+    Project:    MicroMacro
+    Author:     SolarStrike Software
+    URL:        www.solarstrike.net
+    License:    Modified BSD (see license.txt)
+******************************************************************************/
+
+#include "snapshot.h"
+#include "patternscan.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <string.h>
+
+namespace MicroMacro
+{
+    static const unsigned char zeroPage[SCAN_PAGE_SIZE] = {0};
+
+    static size_t alignDown(size_t value, size_t alignment)
+    {
+        return value - (value % alignment);
+    }
+
+    static bool byAddress(const MemoryRange &a, const MemoryRange &b)
+    {
+        return a.address < b.address;
+    }
+
+    static bool isZero(const unsigned char *data, size_t size)
+    {
+        return memcmp(data, zeroPage, size) == 0;
+    }
+
+    // Add a changed range, joining it to the last one if they touch
+    static void addChanged(std::vector<MemoryRange> &changes, size_t address, size_t size)
+    {
+        if( !changes.empty() && changes.back().address + changes.back().size == address )
+        {
+            changes.back().size += size;
+            return;
+        }
+
+        MemoryRange range = {address, size};
+        changes.push_back(range);
+    }
+
+    #if defined(SIMD_AVX2) || defined(SIMD_SSE2)
+    // Add each run of bits set in 'mask' (bit N being the byte at address + N)
+    static void addChangedBits(std::vector<MemoryRange> &changes, size_t address, unsigned int mask)
+    {
+        while( mask )
+        {
+            unsigned int start = lowestSetBit(mask);
+            unsigned int rest = ~(mask >> start);
+            unsigned int length = rest ? lowestSetBit(rest) : 32 - start;
+            addChanged(changes, address + start, length);
+
+            mask = start + length >= 32 ? 0 : mask & (~0u << (start + length));
+        }
+    }
+    #endif
+
+    // Add the ranges where 'a' and 'b' differ, a vector of bytes at a time
+    static void diffBytes(size_t address, const unsigned char *a, const unsigned char *b, size_t size,
+                          std::vector<MemoryRange> &changes)
+    {
+        if( memcmp(a, b, size) == 0 )
+            return;
+
+        size_t i = 0;
+        #if defined(SIMD_AVX2)
+        for(; i + 32 <= size; i += 32)
+        {
+            __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+            __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i));
+            unsigned int changed = ~(unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb));
+            if( changed )
+                addChangedBits(changes, address + i, changed);
+        }
+        #elif defined(SIMD_SSE2)
+        for(; i + 16 <= size; i += 16)
+        {
+            __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+            __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+            unsigned int changed = ~(unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) & 0xFFFF;
+            if( changed )
+                addChangedBits(changes, address + i, changed);
+        }
+        #endif
+
+        for(; i < size; i++)
+        {
+            if( a[i] != b[i] )
+                addChanged(changes, address + i, 1);
+        }
+    }
+
+    MemorySnapshot::MemorySnapshot()
+        : slotsUsed(0)
+    {
+    }
+
+    // Keep a page's bytes; returns the slot they went in
+    unsigned int MemorySnapshot::store(const unsigned char *data, size_t size)
+    {
+        unsigned int slot = slotsUsed++;
+        if( slot / SNAPSHOT_SLAB_PAGES >= slabs.size() )
+        {
+            slabs.push_back(std::vector<unsigned char>());
+            slabs.back().resize(SNAPSHOT_SLAB_PAGES * SCAN_PAGE_SIZE);
+        }
+
+        memcpy(&slabs[slot / SNAPSHOT_SLAB_PAGES][(slot % SNAPSHOT_SLAB_PAGES) * SCAN_PAGE_SIZE], data, size);
+        return slot;
+    }
+
+    const unsigned char *MemorySnapshot::getPageData(const SnapshotPage &page) const
+    {
+        if( page.slot == SNAPSHOT_ZERO_PAGE )
+            return zeroPage;
+        return &slabs[page.slot / SNAPSHOT_SLAB_PAGES][(page.slot % SNAPSHOT_SLAB_PAGES) * SCAN_PAGE_SIZE];
+    }
+
+    /*  Copy what can be read of the given regions, which may overlap or be
+        in any order. Returns the number of bytes read.
+    */
+    size_t MemorySnapshot::take(ProcessHandle handle, std::vector<MemoryRange> regions)
+    {
+        pages.clear();
+        slabs.clear();
+        slotsUsed = 0;
+
+        // Sort and join the regions, so the pages come out in order with no repeats
+        std::sort(regions.begin(), regions.end(), byAddress);
+        std::vector<MemoryRange> merged;
+        for(size_t i = 0; i < regions.size(); i++)
+        {
+            const MemoryRange &region = regions.at(i);
+            size_t end = region.size > (size_t)-1 - region.address ? (size_t)-1 : region.address + region.size;
+            if( region.size == 0 )
+                continue;
+
+            if( !merged.empty() && region.address <= merged.back().address + merged.back().size )
+            {
+                if( end > merged.back().address + merged.back().size )
+                    merged.back().size = end - merged.back().address;
+            }
+            else
+            {
+                MemoryRange range = {region.address, end - region.address};
+                merged.push_back(range);
+            }
+        }
+        if( merged.empty() )
+            return 0;
+
+        // List readable memory once, for all of them
+        std::vector<ScanRange> readable;
+        getScanRanges(handle, merged.front().address,
+                      merged.back().address + merged.back().size - merged.front().address, 0, readable);
+
+        std::vector<unsigned char> buffer(SCAN_BLOCK_SIZE);
+        size_t bytesRead = 0;
+        size_t r = 0;
+        for(size_t m = 0; m < merged.size(); m++)
+        {
+            size_t regionStart = merged.at(m).address;
+            size_t regionEnd = regionStart + merged.at(m).size;
+            while( r < readable.size() && readable.at(r).end <= regionStart )
+                ++r;
+
+            for(size_t k = r; k < readable.size() && readable.at(k).start < regionEnd; k++)
+            {
+                size_t pos = std::max(regionStart, readable.at(k).start);
+                size_t end = std::min(regionEnd, readable.at(k).end);
+                while( pos < end )
+                {
+                    size_t want = SCAN_BLOCK_SIZE - pos % SCAN_BLOCK_SIZE;
+                    if( want > end - pos )
+                        want = end - pos;
+
+                    size_t got = readAvailable(handle, pos, &buffer[0], want);
+                    bytesRead += got;
+
+                    for(size_t p = pos; p < pos + got; )
+                    {
+                        size_t pageEnd = std::min(alignDown(p, SCAN_PAGE_SIZE) + SCAN_PAGE_SIZE, pos + got);
+                        const unsigned char *data = &buffer[p - pos];
+
+                        SnapshotPage page;
+                        page.address = p;
+                        page.size = (unsigned int)(pageEnd - p);
+                        page.slot = isZero(data, page.size) ? SNAPSHOT_ZERO_PAGE : store(data, page.size);
+                        pages.push_back(page);
+                        p = pageEnd;
+                    }
+
+                    if( got < want ) // Skip the page we couldn't read
+                        pos = alignDown(pos + got, SCAN_PAGE_SIZE) + SCAN_PAGE_SIZE;
+                    else
+                        pos += want;
+                }
+            }
+        }
+
+        std::vector<SnapshotPage>(pages).swap(pages); // Shrink to fit
+        return bytesRead;
+    }
+
+    // Bytes of memory the snapshot holds
+    size_t MemorySnapshot::getSize() const
+    {
+        size_t size = 0;
+        for(size_t i = 0; i < pages.size(); i++)
+            size += pages.at(i).size;
+        return size;
+    }
+
+    // Bytes the snapshot takes up to hold them
+    size_t MemorySnapshot::getStoredSize() const
+    {
+        return slabs.size() * SNAPSHOT_SLAB_PAGES * SCAN_PAGE_SIZE + pages.size() * sizeof(SnapshotPage);
+    }
+
+    /*  The ranges of memory held in both snapshots that differ between them,
+        in address order. Memory only one of them holds isn't compared.
+    */
+    void MemorySnapshot::diff(const MemorySnapshot &other, std::vector<MemoryRange> &changes) const
+    {
+        changes.clear();
+
+        size_t i = 0, k = 0;
+        while( i < pages.size() && k < other.pages.size() )
+        {
+            const SnapshotPage &a = pages.at(i);
+            const SnapshotPage &b = other.pages.at(k);
+            size_t start = std::max(a.address, b.address);
+            size_t end = std::min(a.address + a.size, b.address + b.size);
+
+            if( start < end && !(a.slot == SNAPSHOT_ZERO_PAGE && b.slot == SNAPSHOT_ZERO_PAGE) )
+            {
+                diffBytes(start, getPageData(a) + (start - a.address),
+                          other.getPageData(b) + (start - b.address), end - start, changes);
+            }
+
+            if( a.address + a.size <= b.address + b.size )
+                ++i;
+            else
+                ++k;
+        }
+    }
+}
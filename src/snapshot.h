@@ -0,0 +1,60 @@
+/******************************************************************************
+	Project: 	MicroMacro
+	Author: 	SolarStrike Software
+	URL:		www.solarstrike.net
+	License:	Modified BSD (see license.txt)
+******************************************************************************/
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+	#include "procmem.h"
+	#include <vector>
+	#include <stddef.h>
+
+	#define SNAPSHOT_SLAB_PAGES		256			// Pages per allocation of snapshot storage (1MB)
+	#define SNAPSHOT_ZERO_PAGE		((unsigned int)-1)
+
+	namespace MicroMacro
+	{
+		/* Part of a page of memory held in a snapshot */
+		struct SnapshotPage
+		{
+			size_t address;
+			unsigned int size;		// Never crosses a page boundary
+			unsigned int slot;		// Where its bytes are kept, or SNAPSHOT_ZERO_PAGE if all 0
+		};
+
+		struct MemoryRange
+		{
+			size_t address;
+			size_t size;
+		};
+
+		/*	A copy of some of a process's memory, for process.snapshot().
+			Memory is read a block at a time and kept a page at a time, in
+			slabs that are never reallocated, so taking a snapshot needs
+			little more memory than the snapshot itself. Pages of nothing
+			but zeroes aren't kept at all, nor are those that can't be read.
+		*/
+		class MemorySnapshot
+		{
+			protected:
+				std::vector<SnapshotPage> pages;						// In address order
+				std::vector<std::vector<unsigned char> > slabs;
+				unsigned int slotsUsed;
+
+				unsigned int store(const unsigned char *, size_t);
+				const unsigned char *getPageData(const SnapshotPage &) const;
+
+			public:
+				MemorySnapshot();
+
+				size_t take(ProcessHandle, std::vector<MemoryRange>);
+				size_t getSize() const;
+				size_t getStoredSize() const;
+				void diff(const MemorySnapshot &, std::vector<MemoryRange> &) const;
+		};
+	}
+
+#endif
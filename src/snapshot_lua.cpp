@@ -0,0 +1,139 @@
+/******************************************************************************
+    Project:    MicroMacro
+    Author:     SolarStrike Software
+    URL:        www.solarstrike.net
+    License:    Modified BSD (see license.txt)
+******************************************************************************/
+
+#include "snapshot_lua.h"
+#include "snapshot.h"
+#include "error.h"
+#include "strl.h"
+
+extern "C"
+{
+#include <lua.h>
+#include <lauxlib.h>
+#include <lualib.h>
+}
+
+const char *LuaType::metatable_snapshot = "snapshot";
+
+using MicroMacro::MemorySnapshot;
+using MicroMacro::MemoryRange;
+
+int Snapshot_lua::regmod(lua_State *L)
+{
+    const luaL_Reg meta[] = {
+        {"__gc", gc},
+        {"__tostring", tostring},
+        {NULL, NULL}
+    };
+
+    const luaL_Reg methods[] = {
+        {"diff", diff},
+        {"getSize", getSize},
+        {"getStoredSize", getStoredSize},
+        {NULL, NULL}
+    };
+
+    luaL_newmetatable(L, LuaType::metatable_snapshot);
+    luaL_setfuncs(L, meta, 0);
+    luaL_newlib(L, methods);
+    lua_setfield(L, -2, "__index");
+
+    lua_pop(L, 1); // Pop table
+
+    return MicroMacro::ERR_OK;
+}
+
+int Snapshot_lua::gc(lua_State *L)
+{
+    MemorySnapshot **ppSnapshot = static_cast<MemorySnapshot **>(lua_touserdata(L, 1));
+    delete *ppSnapshot;
+    *ppSnapshot = NULL;
+    return 0;
+}
+
+int Snapshot_lua::tostring(lua_State *L)
+{
+    MemorySnapshot **ppSnapshot = static_cast<MemorySnapshot **>(lua_touserdata(L, 1));
+    char buffer[64];
+    slprintf(buffer, sizeof(buffer), "Memory snapshot (%u bytes)", (unsigned int)(*ppSnapshot)->getSize());
+
+    lua_pushstring(L, buffer);
+    return 1;
+}
+
+/*  snapshot:diff(snapshot other)
+    Returns:    table
+
+    Compares two snapshots, returning the ranges of memory that changed
+    between them as a list of {address, length} pairs, in address order.
+    Only memory held in both snapshots is compared.
+*/
+int Snapshot_lua::diff(lua_State *L)
+{
+    if( lua_gettop(L) != 2 )
+        wrongArgs(L);
+    checkType(L, LT_USERDATA, 1);
+    checkType(L, LT_USERDATA, 2);
+
+    MemorySnapshot **ppSnapshot = static_cast<MemorySnapshot **>(lua_touserdata(L, 1));
+    MemorySnapshot **ppOther = static_cast<MemorySnapshot **>(
+        luaL_testudata(L, 2, LuaType::metatable_snapshot));
+    if( ppOther == NULL )
+    {
+        luaL_error(L, "Expected a snapshot to compare with.");
+        return 0;
+    }
+
+    std::vector<MemoryRange> changes;
+    (*ppSnapshot)->diff(**ppOther, changes);
+
+    lua_createtable(L, (int)changes.size(), 0);
+    for(size_t i = 0; i < changes.size(); i++)
+    {
+        lua_createtable(L, 2, 0);
+        lua_pushinteger(L, changes.at(i).address);
+        lua_rawseti(L, -2, 1);
+        lua_pushinteger(L, changes.at(i).size);
+        lua_rawseti(L, -2, 2);
+        lua_rawseti(L, -2, i + 1);
+    }
+
+    return 1;
+}
+
+/*  snapshot:getSize()
+    Returns:    number
+
+    Returns how many bytes of memory the snapshot holds.
+*/
+int Snapshot_lua::getSize(lua_State *L)
+{
+    if( lua_gettop(L) != 1 )
+        wrongArgs(L);
+    checkType(L, LT_USERDATA, 1);
+
+    MemorySnapshot **ppSnapshot = static_cast<MemorySnapshot **>(lua_touserdata(L, 1));
+    lua_pushinteger(L, (*ppSnapshot)->getSize());
+    return 1;
+}
+
+/*  snapshot:getStoredSize()
+    Returns:    number
+
+    Returns how many bytes the snapshot takes up. Pages that were all
+    zeroes take almost nothing.
+*/
+int Snapshot_lua::getStoredSize(lua_State *L)
+{
+    if( lua_gettop(L) != 1 )
+        wrongArgs(L);
+    checkType(L, LT_USERDATA, 1);
+
+    MemorySnapshot **ppSnapshot = static_cast<MemorySnapshot **>(lua_touserdata(L, 1));
+    lua_pushinteger(L, (*ppSnapshot)->getStoredSize());
+    return 1;
+}
@@ -0,0 +1,31 @@
+/******************************************************************************
+	Project: 	MicroMacro
+	Author: 	SolarStrike Software
+	URL:		www.solarstrike.net
+	License:	Modified BSD (see license.txt)
+******************************************************************************/
+
+#ifndef SNAPSHOT_LUA_H
+#define SNAPSHOT_LUA_H
+
+	typedef struct lua_State lua_State;
+
+	namespace LuaType
+	{
+		extern const char *metatable_snapshot;
+	}
+
+	class Snapshot_lua
+	{
+		protected:
+			static int gc(lua_State *);
+			static int tostring(lua_State *);
+			static int diff(lua_State *);
+			static int getSize(lua_State *);
+			static int getStoredSize(lua_State *);
+
+		public:
+			static int regmod(lua_State *);
+	};
+
+#endif
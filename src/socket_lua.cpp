@@ -14,6 +14,7 @@
 #include "strl.h"
 #include "logger.h"
 #include "debugmessages.h"
+#include "async_lua.h"
 
 extern "C"
 {
@@ -26,8 +27,6 @@ extern "C"
 #include "macro.h"
 #include "settings.h"
 
-#define DEFAULT_LOCK_TIMEOUT        1000
-
 using MicroMacro::Socket;
 using MicroMacro::Event;
 using MicroMacro::Mutex;
@@ -61,7 +60,7 @@ DWORD WINAPI Socket_lua::tcpThread(Socket *pSocket)
             ced.setValue((int)pSocket->socket);
             e.data.push_back(ced);
 
-            // Push the received data
+            // Push the received data; 'ced' keeps its own (pooled) copy for the receive queue
             ced.setValue(readBuff, result);
             e.data.push_back(ced);
 
@@ -70,8 +69,9 @@ DWORD WINAPI Socket_lua::tcpThread(Socket *pSocket)
                 while( pSocket->recvQueue.size() > (maxRecvQueueSize + 1) )
                     pSocket->recvQueue.pop();
 
-                pSocket->eventQueue.push(e);
-                pSocket->recvQueue.push(std::string(readBuff, result));
+                pSocket->eventQueue.push(new Event(std::move(e)));
+                Macro::instance()->getScheduler()->wake();
+                pSocket->recvQueue.push(std::move(ced));
                 pSocket->mutex.unlock(__FUNCTION__);
             }
         }
@@ -85,7 +85,8 @@ DWORD WINAPI Socket_lua::tcpThread(Socket *pSocket)
 
             if( pSocket->mutex.lock(DEFAULT_LOCK_TIMEOUT, __FUNCTION__) )
             {
-                pSocket->eventQueue.push(e);
+                pSocket->eventQueue.push(new Event(std::move(e)));
+                Macro::instance()->getScheduler()->wake();
                 pSocket->mutex.unlock(__FUNCTION__);
             }
             break;
@@ -109,7 +110,8 @@ DWORD WINAPI Socket_lua::tcpThread(Socket *pSocket)
 
                             if( pSocket->open )
                             {
-                                pSocket->eventQueue.push(e);
+                                pSocket->eventQueue.push(new Event(std::move(e)));
+                                Macro::instance()->getScheduler()->wake();
 
                             }
                         }
@@ -128,7 +130,8 @@ DWORD WINAPI Socket_lua::tcpThread(Socket *pSocket)
 
                             if( pSocket->open )
                             {
-                                pSocket->eventQueue.push(e);
+                                pSocket->eventQueue.push(new Event(std::move(e)));
+                                Macro::instance()->getScheduler()->wake();
                             }
                         }
                         break;
@@ -150,7 +153,8 @@ DWORD WINAPI Socket_lua::tcpThread(Socket *pSocket)
 
                             if( pSocket->open )
                             {
-                                pSocket->eventQueue.push(e);
+                                pSocket->eventQueue.push(new Event(std::move(e)));
+                                Macro::instance()->getScheduler()->wake();
                             }
                         }
                         break;
@@ -214,7 +218,8 @@ DWORD WINAPI Socket_lua::listenThread(Socket *pSocket)
 
                         if( pSocket->mutex.lock(DEFAULT_LOCK_TIMEOUT, __FUNCTION__) )
                         {
-                            pSocket->eventQueue.push(e);
+                            pSocket->eventQueue.push(new Event(std::move(e)));
+                            Macro::instance()->getScheduler()->wake();
                             pSocket->mutex.unlock(__FUNCTION__);
                         }
                     }
@@ -234,7 +239,8 @@ DWORD WINAPI Socket_lua::listenThread(Socket *pSocket)
 
                         if( pSocket->mutex.lock(DEFAULT_LOCK_TIMEOUT, __FUNCTION__) )
                         {
-                            pSocket->eventQueue.push(e);
+                            pSocket->eventQueue.push(new Event(std::move(e)));
+                            Macro::instance()->getScheduler()->wake();
                             closesocket(pSocket->socket);
                             pSocket->socket     =   INVALID_SOCKET;
                             pSocket->connected  =   true;
@@ -263,7 +269,8 @@ DWORD WINAPI Socket_lua::listenThread(Socket *pSocket)
 
                         if( pSocket->mutex.lock(DEFAULT_LOCK_TIMEOUT, __FUNCTION__) )
                         {
-                            pSocket->eventQueue.push(e);
+                            pSocket->eventQueue.push(new Event(std::move(e)));
+                            Macro::instance()->getScheduler()->wake();
                             pSocket->mutex.unlock(__FUNCTION__);
                         }
                     }
@@ -294,7 +301,7 @@ DWORD WINAPI Socket_lua::listenThread(Socket *pSocket)
             ced.setValue((int)pSocket->socket);
             e.data.push_back(ced);
 
-            npSocket->eventQueue.push(e);
+            npSocket->eventQueue.push(new Event(std::move(e)));
 
             /* Now we can record some more info and start the new thread
                 Note: We don't need to mutex this because it cannot be accessed
@@ -355,7 +362,8 @@ DWORD WINAPI Socket_lua::udpThread(Socket *pSocket)
 
                                     if( pSocket->mutex.lock(DEFAULT_LOCK_TIMEOUT, __FUNCTION__) )
                                     {
-                                        pSocket->eventQueue.push(e);
+                                        pSocket->eventQueue.push(new Event(std::move(e)));
+                                        Macro::instance()->getScheduler()->wake();
                                         pSocket->mutex.unlock(__FUNCTION__);
                                     }
                                 }
@@ -376,7 +384,8 @@ DWORD WINAPI Socket_lua::udpThread(Socket *pSocket)
 
                         if( pSocket->mutex.lock(DEFAULT_LOCK_TIMEOUT, __FUNCTION__) )
                         {
-                            pSocket->eventQueue.push(e);
+                            pSocket->eventQueue.push(new Event(std::move(e)));
+                            Macro::instance()->getScheduler()->wake();
                             closesocket(pSocket->socket);
                             pSocket->socket     =   INVALID_SOCKET;
                             pSocket->connected  =   true;
@@ -406,7 +415,8 @@ DWORD WINAPI Socket_lua::udpThread(Socket *pSocket)
 
                         if( pSocket->mutex.lock(DEFAULT_LOCK_TIMEOUT, __FUNCTION__) )
                         {
-                            pSocket->eventQueue.push(e);
+                            pSocket->eventQueue.push(new Event(std::move(e)));
+                            Macro::instance()->getScheduler()->wake();
                             pSocket->mutex.unlock(__FUNCTION__);
                         }
                     }
@@ -439,7 +449,7 @@ DWORD WINAPI Socket_lua::udpThread(Socket *pSocket)
             ced.setValue(&remoteAddr);
             e.data.push_back(ced);
 
-            // Push the received data
+            // Push the received data; 'ced' keeps its own (pooled) copy for the receive queue
             ced.setValue(readBuff, result);
             e.data.push_back(ced);
 
@@ -448,8 +458,9 @@ DWORD WINAPI Socket_lua::udpThread(Socket *pSocket)
                 while( pSocket->recvQueue.size() > (maxRecvQueueSize + 1) )
                     pSocket->recvQueue.pop();
 
-                pSocket->eventQueue.push(e);
-                pSocket->recvQueue.push(std::string(readBuff, result));
+                pSocket->eventQueue.push(new Event(std::move(e)));
+                Macro::instance()->getScheduler()->wake();
+                pSocket->recvQueue.push(std::move(ced));
                 pSocket->mutex.unlock(__FUNCTION__);
             }
         }
@@ -472,6 +483,7 @@ int Socket_lua::regmod(lua_State *L)
         {"send", send},
         {"sendto", sendto},
         {"recv", recv},
+        {"recvAsync", recvAsync},
         {"flushRecvQueue", flushRecvQueue},
         {"getRecvQueueSize", getRecvQueueSize},
         {"close", close},
@@ -835,7 +847,7 @@ int Socket_lua::recv(lua_State *L)
     {
         if( !pSocket->recvQueue.empty() )
         {
-            lua_pushlstring(L, pSocket->recvQueue.front().c_str(), pSocket->recvQueue.front().size());
+            lua_pushlstring(L, pSocket->recvQueue.front().getString(), pSocket->recvQueue.front().length);
             pSocket->recvQueue.pop();
             retVal = 1;
         }
@@ -846,6 +858,29 @@ int Socket_lua::recv(lua_State *L)
     return retVal;
 }
 
+/*  socket:recvAsync([number timeout])
+    Returns (on success):   string data
+    Returns (on failure):   nil, string reason
+
+    Like socket:recv(), but if nothing has been received yet,
+    suspends the current task until data arrives rather than
+    returning nothing. 'reason' is "closed" if the socket closed
+    first, or "timeout" if 'timeout' (in milliseconds) passed.
+    Must be called from within a task (see macro.spawn()).
+*/
+int Socket_lua::recvAsync(lua_State *L)
+{
+    int top = lua_gettop(L);
+    if( top != 1 && top != 2 )
+        wrongArgs(L);
+    checkType(L, LT_USERDATA, 1);
+    if( top >= 2 )
+        checkType(L, LT_NIL | LT_NUMBER, 2);
+
+    Socket *pSocket = *static_cast<Socket **>(lua_touserdata(L, 1));
+    return Async_lua::recvAsync(L, pSocket, lua_isnumber(L, 2) ? lua_tonumber(L, 2) : -1);
+}
+
 int Socket_lua::flushRecvQueue(lua_State *L)
 {
     int top = lua_gettop(L);
@@ -856,7 +891,7 @@ int Socket_lua::flushRecvQueue(lua_State *L)
     Socket *pSocket = *static_cast<Socket **>(lua_touserdata(L, 1));
     if( pSocket->mutex.lock(DEFAULT_LOCK_TIMEOUT, __FUNCTION__) )
     {   // We use 'swap' instead of just popping elements for performance reasons
-        std::queue<std::string> emptyQueue;
+        std::queue<EventData> emptyQueue;
         swap(pSocket->recvQueue, emptyQueue);
         pSocket->mutex.unlock(__FUNCTION__);
     }
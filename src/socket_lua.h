@@ -15,6 +15,7 @@
 	#include <vector>
 
 	#define LISTEN_BUFFER		10
+	#define DEFAULT_LOCK_TIMEOUT	1000
 
 	typedef struct lua_State lua_State;
 
@@ -39,6 +40,7 @@
 			static int send(lua_State *);
 			static int sendto(lua_State *);
 			static int recv(lua_State *);
+			static int recvAsync(lua_State *);
 			static int flushRecvQueue(lua_State *);
 			static int getRecvQueueSize(lua_State *);
 			static int close(lua_State *);
@@ -60,7 +60,7 @@ int slprintf(char *dest, size_t size, const char *fmt, ...)
     va_end(args);
 
     // Ensure NULL terminator
-    dest[size] = 0;
+    dest[size - 1] = 0;
     return ret;
 }
 
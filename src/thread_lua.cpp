@@ -0,0 +1,882 @@
+/******************************************************************************
+    Project:    MicroMacro
+    Author:     SolarStrike Software
+    URL:        www.solarstrike.net
+    License:    Modified BSD (see license.txt)
+******************************************************************************/
+
+#include "thread_lua.h"
+#include "frozen_lua.h"
+#include "luaengine.h"
+#include "luatypes.h"
+#include "error.h"
+#include "event.h"
+#include "macro.h"
+#include "logger.h"
+#include "timer.h"
+#include "strl.h"
+
+#include <algorithm>
+#include <string.h>
+
+extern "C"
+{
+#include <lua.h>
+#include <lauxlib.h>
+#include <lualib.h>
+}
+
+// Registry key under which a worker state keeps a pointer to its Worker
+#define THREAD_WORKER_KEY       "MicroMacro.worker"
+
+using MicroMacro::Channel;
+using MicroMacro::ChannelResult;
+using MicroMacro::Event;
+using MicroMacro::EventData;
+using MicroMacro::FrozenStore;
+
+const char *LuaType::metatable_thread = "thread";
+
+std::vector<Thread_lua::Worker *> Thread_lua::workers;
+unsigned int Thread_lua::nextId = 0;
+
+// Main state module
+int Thread_lua::regmod(lua_State *L)
+{
+    const luaL_Reg meta[] = {
+        {"__gc", gc},
+        {"__tostring", tostring},
+        {NULL, NULL}
+    };
+
+    const luaL_Reg methods[] = {
+        {"send", send},
+        {"receive", receive},
+        {"isRunning", isRunning},
+        {"getResult", getResult},
+        {"stop", stop},
+        {"join", join},
+        {"id", id},
+        {NULL, NULL}
+    };
+
+    static const luaL_Reg _funcs[] = {
+        {"spawn", Thread_lua::spawn},
+        {NULL, NULL}
+    };
+
+    luaL_newmetatable(L, LuaType::metatable_thread);
+    luaL_setfuncs(L, meta, 0);
+    luaL_newlib(L, methods);
+    lua_setfield(L, -2, "__index");
+    lua_pop(L, 1); // Pop metatable
+
+    luaL_newlib(L, _funcs);
+    lua_setglobal(L, THREAD_MODULE_NAME);
+
+    return MicroMacro::ERR_OK;
+}
+
+// Worker state module; talks to the main state that spawned it
+int Thread_lua::regworker(lua_State *L)
+{
+    static const luaL_Reg _funcs[] = {
+        {"send", Thread_lua::worker_send},
+        {"receive", Thread_lua::worker_receive},
+        {"id", Thread_lua::worker_id},
+        {"isStopping", Thread_lua::worker_isStopping},
+        {NULL, NULL}
+    };
+
+    luaL_newlib(L, _funcs);
+    lua_setglobal(L, THREAD_MODULE_NAME);
+
+    return MicroMacro::ERR_OK;
+}
+
+/*  The main state is going away; stop every worker and give them a
+    moment to finish up. A worker stuck inside a long C call is left to
+    finish on its own rather than killed.
+*/
+int Thread_lua::cleanup(lua_State *)
+{
+    for(size_t i = 0; i < workers.size(); i++)
+        requestStop(workers.at(i));
+
+    TimeType start = getNow();
+    for(size_t i = 0; i < workers.size(); i++)
+    {
+        Worker *worker = workers.at(i);
+        double elapsed = deltaTime(getNow(), start) * 1000;
+        DWORD remaining = elapsed < THREAD_STOP_TIMEOUT ? (DWORD)(THREAD_STOP_TIMEOUT - elapsed) : 0;
+        if( worker->hThread && WaitForSingleObject(worker->hThread, remaining) == WAIT_TIMEOUT )
+            Logger::instance()->add("Thread %u did not stop in time; leaving it to finish on its own.", worker->id);
+
+        release(worker);
+    }
+    workers.clear();
+
+    return MicroMacro::ERR_OK;
+}
+
+void Thread_lua::release(Worker *worker)
+{
+    if( --worker->refCount == 0 )
+    {
+        if( worker->hThread )
+            CloseHandle(worker->hThread);
+
+        // Messages nobody received may still hold frozen tables
+        std::string message;
+        while( worker->inbox.receive(message) == MicroMacro::CHANNEL_OK )
+            releaseValues(message);
+        while( worker->outbox.receive(message) == MicroMacro::CHANNEL_OK )
+            releaseValues(message);
+        releaseValues(worker->args);
+        releaseValues(worker->result);
+
+        delete worker;
+    }
+}
+
+void Thread_lua::stopHook(lua_State *L, lua_Debug *)
+{
+    lua_pushliteral(L, "Thread stopped.");
+    lua_error(L);
+}
+
+// Make the worker's script raise an error as soon as it next runs any Lua
+void Thread_lua::requestStop(Worker *worker)
+{
+    worker->stopRequested = true;
+    worker->inbox.close(); // Wakes it up if it's waiting in thread.receive()
+
+    if( worker->stateLock.lock(INFINITE, __FUNCTION__) )
+    {
+        if( worker->lstate )
+            lua_sethook(worker->lstate, stopHook, LUA_MASKCALL | LUA_MASKRET | LUA_MASKCOUNT, 1);
+        worker->stateLock.unlock(__FUNCTION__);
+    }
+}
+
+Thread_lua::Worker *Thread_lua::checkWorker(lua_State *L, int index)
+{
+    return *static_cast<Worker **>(luaL_checkudata(L, index, LuaType::metatable_thread));
+}
+
+Thread_lua::Worker *Thread_lua::getCurrentWorker(lua_State *L)
+{
+    lua_getfield(L, LUA_REGISTRYINDEX, THREAD_WORKER_KEY);
+    Worker *worker = static_cast<Worker *>(lua_touserdata(L, -1));
+    lua_pop(L, 1);
+    return worker;
+}
+
+void Thread_lua::notifyFinished(Worker *worker)
+{
+    Event *pe = new Event;
+    pe->type = MicroMacro::EVENT_THREADFINISHED;
+
+    EventData ced;
+    ced.setValue((int)worker->id);
+    pe->data.push_back(ced);
+    ced.setValue((int)worker->succeeded);
+    pe->data.push_back(ced);
+    if( !worker->succeeded )
+    {
+        ced.setValue(worker->error);
+        pe->data.push_back(ced);
+    }
+
+    Macro::instance()->pushEvent(pe);
+}
+
+/*  Called (protected) with the thread's loaded script; unpacks the
+    arguments it was spawned with and runs it, returning whatever it does.
+*/
+int Thread_lua::runScript(lua_State *L)
+{
+    int nargs = unpackValues(L, getCurrentWorker(L)->args);
+    lua_call(L, nargs, LUA_MULTRET);
+    return lua_gettop(L);
+}
+
+DWORD WINAPI Thread_lua::workerThread(LPVOID param)
+{
+    Worker *worker = static_cast<Worker *>(param);
+    lua_State *L = luaL_newstate();
+    if( !L )
+        worker->error = "Failed to create Lua state for thread.";
+    else
+    {
+        luaL_openlibs(L);
+        int success = LuaEngine::openModules(L, true, worker->basePath);
+
+        lua_pushlightuserdata(L, worker);
+        lua_setfield(L, LUA_REGISTRYINDEX, THREAD_WORKER_KEY);
+
+        if( worker->stateLock.lock(INFINITE, __FUNCTION__) )
+        {
+            worker->lstate = L;
+            if( worker->stopRequested )
+                lua_sethook(L, stopHook, LUA_MASKCALL | LUA_MASKRET | LUA_MASKCOUNT, 1);
+            worker->stateLock.unlock(__FUNCTION__);
+        }
+
+        lua_pushcfunction(L, LuaEngine::err_msgh);
+        int msgh = lua_gettop(L);
+
+        int failstate = LUA_OK;
+        if( success != MicroMacro::ERR_OK )
+        {
+            lua_pushliteral(L, "One or more modules failed to load.");
+            failstate = LUA_ERRRUN;
+        }
+        else
+            failstate = luaL_loadfile(L, worker->script.c_str());
+
+        if( failstate == LUA_OK )
+        {   // Unpacking the arguments can raise an error too, so it happens inside the protected call
+            lua_pushcfunction(L, runScript);
+            lua_insert(L, -2);
+            failstate = lua_pcall(L, 1, LUA_MULTRET, msgh);
+            releaseValues(worker->args);
+        }
+
+        if( failstate == LUA_OK )
+        {
+            std::string err;
+            worker->succeeded = packValues(L, msgh + 1, lua_gettop(L), worker->result, err);
+            if( !worker->succeeded )
+                worker->error = "Cannot return values from thread: " + err;
+        }
+        else
+        {
+            const char *msg = lua_tostring(L, -1);
+            worker->error = msg ? msg : "Unknown error occurred (entered error state but no error message returned).";
+        }
+
+        if( worker->stateLock.lock(INFINITE, __FUNCTION__) )
+        {
+            worker->lstate = NULL;
+            worker->stateLock.unlock(__FUNCTION__);
+        }
+        lua_close(L);
+    }
+
+    worker->inbox.close();
+    worker->outbox.close();
+    worker->finished = true;
+    notifyFinished(worker);
+    release(worker);
+
+    return 0;
+}
+
+/*  Values are packed as a type tag followed by a fixed-size payload:
+        'n' nil, 'f' false, 't' true, 'i' integer, 'd' number,
+        's' string (32-bit length + bytes), 'T' table (key/value pairs
+        up to an 'e'), 'F' frozen table (store pointer + node)
+    A packed frozen table holds its own reference to the store until
+    the message is released with releaseValues().
+*/
+bool Thread_lua::packValue(lua_State *L, int index, std::string &out, std::string &err, int depth)
+{
+    index = lua_absindex(L, index);
+    switch( lua_type(L, index) )
+    {
+        case LUA_TNIL:
+            out += 'n';
+            return true;
+
+        case LUA_TBOOLEAN:
+            out += lua_toboolean(L, index) ? 't' : 'f';
+            return true;
+
+        case LUA_TNUMBER:
+            if( lua_isinteger(L, index) )
+            {
+                lua_Integer value = lua_tointeger(L, index);
+                out += 'i';
+                out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+            }
+            else
+            {
+                lua_Number value = lua_tonumber(L, index);
+                out += 'd';
+                out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+            }
+            return true;
+
+        case LUA_TSTRING:
+            {
+                size_t len;
+                const char *str = lua_tolstring(L, index, &len);
+                unsigned int len32 = (unsigned int)len;
+                out += 's';
+                out.append(reinterpret_cast<const char *>(&len32), sizeof(len32));
+                out.append(str, len);
+            }
+            return true;
+
+        case LUA_TTABLE:
+            if( depth >= THREAD_MAX_DEPTH )
+            {
+                err = "tables are nested too deeply (or contain a cycle)";
+                return false;
+            }
+
+            luaL_checkstack(L, 3, NULL);
+            out += 'T';
+            lua_pushnil(L);
+            while( lua_next(L, index) )
+            {
+                if( !packValue(L, -2, out, err, depth + 1) || !packValue(L, -1, out, err, depth + 1) )
+                {
+                    lua_pop(L, 2);
+                    return false;
+                }
+                lua_pop(L, 1);
+            }
+            out += 'e';
+            return true;
+
+        case LUA_TUSERDATA:
+            {
+                FrozenStore *store;
+                unsigned int node;
+                if( Frozen_lua::get(L, index, store, node) )
+                {
+                    store->retain();
+                    out += 'F';
+                    out.append(reinterpret_cast<const char *>(&store), sizeof(store));
+                    out.append(reinterpret_cast<const char *>(&node), sizeof(node));
+                    return true;
+                }
+            }
+            // Fall through
+
+        default:
+            err = std::string("cannot send a value of type ") + luaL_typename(L, index);
+            return false;
+    }
+}
+
+bool Thread_lua::unpackValue(lua_State *L, const char *&p, const char *end)
+{
+    if( p >= end )
+        return false;
+
+    luaL_checkstack(L, 3, NULL);
+    char tag = *p++;
+    switch( tag )
+    {
+        case 'n': lua_pushnil(L); return true;
+        case 'f': lua_pushboolean(L, false); return true;
+        case 't': lua_pushboolean(L, true); return true;
+
+        case 'i':
+            {
+                lua_Integer value;
+                if( end - p < (ptrdiff_t)sizeof(value) )
+                    return false;
+                memcpy(&value, p, sizeof(value));
+                p += sizeof(value);
+                lua_pushinteger(L, value);
+            }
+            return true;
+
+        case 'd':
+            {
+                lua_Number value;
+                if( end - p < (ptrdiff_t)sizeof(value) )
+                    return false;
+                memcpy(&value, p, sizeof(value));
+                p += sizeof(value);
+                lua_pushnumber(L, value);
+            }
+            return true;
+
+        case 's':
+            {
+                unsigned int len;
+                if( end - p < (ptrdiff_t)sizeof(len) )
+                    return false;
+                memcpy(&len, p, sizeof(len));
+                p += sizeof(len);
+                if( (size_t)(end - p) < len )
+                    return false;
+                lua_pushlstring(L, p, len);
+                p += len;
+            }
+            return true;
+
+        case 'T':
+            lua_newtable(L);
+            while( p < end && *p != 'e' )
+            {
+                if( !unpackValue(L, p, end) || !unpackValue(L, p, end) )
+                    return false;
+                lua_rawset(L, -3);
+            }
+            if( p >= end )
+                return false;
+            ++p; // Skip 'e'
+            return true;
+
+        case 'F':
+            {
+                FrozenStore *store;
+                unsigned int node;
+                if( end - p < (ptrdiff_t)(sizeof(store) + sizeof(node)) )
+                    return false;
+                memcpy(&store, p, sizeof(store));
+                memcpy(&node, p + sizeof(store), sizeof(node));
+                p += sizeof(store) + sizeof(node);
+                Frozen_lua::push(L, store, node);
+            }
+            return true;
+    }
+
+    return false;
+}
+
+// Walks one packed value, dropping the references held by any frozen tables in it
+bool Thread_lua::releaseValue(const char *&p, const char *end)
+{
+    if( p >= end )
+        return false;
+
+    switch( *p++ )
+    {
+        case 'n': case 'f': case 't':
+            return true;
+
+        case 'i':
+            p += sizeof(lua_Integer);
+            return p <= end;
+
+        case 'd':
+            p += sizeof(lua_Number);
+            return p <= end;
+
+        case 's':
+            {
+                unsigned int len;
+                if( end - p < (ptrdiff_t)sizeof(len) )
+                    return false;
+                memcpy(&len, p, sizeof(len));
+                p += sizeof(len) + len;
+            }
+            return p <= end;
+
+        case 'T':
+            while( p < end && *p != 'e' )
+            {
+                if( !releaseValue(p, end) || !releaseValue(p, end) )
+                    return false;
+            }
+            if( p >= end )
+                return false;
+            ++p;
+            return true;
+
+        case 'F':
+            {
+                FrozenStore *store;
+                if( end - p < (ptrdiff_t)(sizeof(store) + sizeof(unsigned int)) )
+                    return false;
+                memcpy(&store, p, sizeof(store));
+                p += sizeof(store) + sizeof(unsigned int);
+                store->release();
+            }
+            return true;
+    }
+
+    return false;
+}
+
+// Done with a packed message (received, or never will be); it is cleared
+void Thread_lua::releaseValues(std::string &packed)
+{
+    const char *p = packed.data();
+    const char *end = p + packed.size();
+    while( p < end && releaseValue(p, end) )
+    {}
+    packed.clear();
+}
+
+// Pack stack values first..last (inclusive) into 'out'
+bool Thread_lua::packValues(lua_State *L, int first, int last, std::string &out, std::string &err)
+{
+    out.clear();
+    for(int i = first; i <= last; i++)
+    {
+        if( !packValue(L, i, out, err, 0) )
+        {   // A partly packed message may already hold frozen tables
+            releaseValues(out);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Push everything packed into 'packed'; returns the number of values pushed
+int Thread_lua::unpackValues(lua_State *L, const std::string &packed)
+{
+    int base = lua_gettop(L);
+    const char *p = packed.data();
+    const char *end = p + packed.size();
+    while( p < end )
+    {
+        if( !unpackValue(L, p, end) )
+        {
+            lua_settop(L, base);
+            luaL_error(L, "Corrupt thread message.");
+        }
+    }
+
+    return lua_gettop(L) - base;
+}
+
+int Thread_lua::receiveFrom(lua_State *L, Channel &channel, int timeoutMsecs)
+{
+    std::string message;
+    ChannelResult result = channel.receive(message, timeoutMsecs);
+    if( result == MicroMacro::CHANNEL_OK )
+    {
+        int count = unpackValues(L, message);
+        releaseValues(message);
+        return count;
+    }
+
+    lua_pushnil(L);
+    if( result == MicroMacro::CHANNEL_CLOSED )
+    {
+        lua_pushliteral(L, "closed");
+        return 2;
+    }
+    return 1;
+}
+
+/*  thread.spawn(string script, ...)
+    Returns (on success):   thread
+    Returns (on failure):   nil, string errmsg
+
+    Runs 'script' in its own Lua state on its own OS thread, passing
+    any additional arguments to it (as ...). The new state has the same
+    modules as the main one, except for those that belong to the main
+    loop (input hooks, ncurses, networking, timers, tasks and the
+    profiler); its 'thread' module talks back to us instead.
+
+    Arguments, messages and results are copied between states: nil,
+    booleans, numbers, strings and tables of those are allowed
+    (metatables are not kept). Frozen tables (see frozen.new()) are
+    shared rather than copied.
+
+    When the script ends, a "threadfinished" event is raised with
+    the thread's ID, whether it succeeded, and the error message if
+    it did not.
+*/
+int Thread_lua::spawn(lua_State *L)
+{
+    int top = lua_gettop(L);
+    if( top < 1 )
+        wrongArgs(L);
+    checkType(L, LT_STRING, 1);
+
+    Worker *worker = new Worker;
+    worker->id = ++nextId;
+    worker->script = lua_tostring(L, 1);
+    worker->basePath = Macro::instance()->getEngine()->getBasePath();
+    worker->hThread = NULL;
+    worker->lstate = NULL;
+    worker->stopRequested = false;
+    worker->finished = false;
+    worker->succeeded = false;
+    worker->refCount = 1; // Held by the Lua handle
+
+    std::string err;
+    if( !packValues(L, 2, top, worker->args, err) )
+    {
+        delete worker;
+        return luaL_error(L, "Cannot pass arguments to thread: %s", err.c_str());
+    }
+
+    Worker **ppWorker = static_cast<Worker **>(lua_newuserdata(L, sizeof(Worker *)));
+    *ppWorker = worker;
+    luaL_getmetatable(L, LuaType::metatable_thread);
+    lua_setmetatable(L, -2);
+
+    ++worker->refCount; // For the OS thread
+    worker->hThread = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE)workerThread, (PVOID)worker, 0, NULL);
+    if( !worker->hThread )
+    {
+        --worker->refCount;
+        worker->finished = true;
+        lua_pushnil(L);
+        lua_pushfstring(L, "Failed to create thread. Err code: %d", (int)GetLastError());
+        return 2;
+    }
+
+    ++worker->refCount; // For our list
+    workers.push_back(worker);
+    return 1;
+}
+
+int Thread_lua::gc(lua_State *L)
+{
+    Worker *worker = checkWorker(L, 1);
+
+    // Once it's done, nobody else needs to track it
+    if( worker->finished )
+    {
+        std::vector<Worker *>::iterator found = std::find(workers.begin(), workers.end(), worker);
+        if( found != workers.end() )
+        {
+            workers.erase(found);
+            release(worker);
+        }
+    }
+
+    release(worker);
+    return 0;
+}
+
+int Thread_lua::tostring(lua_State *L)
+{
+    Worker *worker = checkWorker(L, 1);
+
+    char buffer[64];
+    slprintf(buffer, sizeof(buffer), "Thread %u (%s)", worker->id, worker->finished ? "finished" : "running");
+    lua_pushstring(L, buffer);
+    return 1;
+}
+
+/*  thread:send(...)
+    Returns:    boolean
+
+    Sends the given values to the thread, which receives them all
+    together from thread.receive(). Returns false if the thread is
+    no longer accepting messages (it finished or was stopped).
+*/
+int Thread_lua::send(lua_State *L)
+{
+    int top = lua_gettop(L);
+    if( top < 2 )
+        wrongArgs(L);
+    Worker *worker = checkWorker(L, 1);
+
+    std::string message, err;
+    if( !packValues(L, 2, top, message, err) )
+        return luaL_error(L, "Cannot send to thread: %s", err.c_str());
+
+    bool sent = worker->inbox.send(std::move(message));
+    if( !sent )
+        releaseValues(message);
+
+    lua_pushboolean(L, sent);
+    return 1;
+}
+
+/*  thread:receive([number timeout])
+    Returns (on message):   ...
+    Returns (on timeout):   nil
+    Returns (when done):    nil, "closed"
+
+    Takes the next message the thread sent with thread.send(). By
+    default this does not wait at all; pass 'timeout' (in
+    milliseconds) to wait for one. Once the thread has finished and
+    all of its messages have been received, returns nil, "closed".
+*/
+int Thread_lua::receive(lua_State *L)
+{
+    int top = lua_gettop(L);
+    if( top != 1 && top != 2 )
+        wrongArgs(L);
+    Worker *worker = checkWorker(L, 1);
+    if( top >= 2 )
+        checkType(L, LT_NIL | LT_NUMBER, 2);
+
+    int timeout = (int)luaL_optinteger(L, 2, 0);
+    return receiveFrom(L, worker->outbox, timeout < 0 ? 0 : timeout);
+}
+
+/*  thread:isRunning()
+    Returns:    boolean
+
+    Returns true if the thread's script has not yet finished.
+*/
+int Thread_lua::isRunning(lua_State *L)
+{
+    if( lua_gettop(L) != 1 )
+        wrongArgs(L);
+    Worker *worker = checkWorker(L, 1);
+
+    lua_pushboolean(L, !worker->finished);
+    return 1;
+}
+
+/*  thread:getResult()
+    Returns (if running):   nil
+    Returns (on success):   true, ...
+    Returns (on failure):   false, string errmsg
+
+    Returns whatever the thread's script returned, once it has finished.
+*/
+int Thread_lua::getResult(lua_State *L)
+{
+    if( lua_gettop(L) != 1 )
+        wrongArgs(L);
+    Worker *worker = checkWorker(L, 1);
+
+    if( !worker->finished )
+    {
+        lua_pushnil(L);
+        return 1;
+    }
+
+    lua_pushboolean(L, worker->succeeded);
+    if( !worker->succeeded )
+    {
+        lua_pushstring(L, worker->error.c_str());
+        return 2;
+    }
+
+    return 1 + unpackValues(L, worker->result);
+}
+
+/*  thread:stop()
+    Returns:    nil
+
+    Asks the thread to stop. Its script raises a "Thread stopped." error
+    the next time it runs any Lua code, and thread.receive() stops
+    waiting. This does not wait for it to actually finish; see
+    thread:join().
+*/
+int Thread_lua::stop(lua_State *L)
+{
+    if( lua_gettop(L) != 1 )
+        wrongArgs(L);
+    Worker *worker = checkWorker(L, 1);
+
+    requestStop(worker);
+    return 0;
+}
+
+/*  thread:join([number timeout])
+    Returns:    boolean
+
+    Waits for the thread to finish, for at most 'timeout' milliseconds
+    if given. Returns true if it has finished.
+    Note that this blocks the whole script while waiting.
+*/
+int Thread_lua::join(lua_State *L)
+{
+    int top = lua_gettop(L);
+    if( top != 1 && top != 2 )
+        wrongArgs(L);
+    Worker *worker = checkWorker(L, 1);
+    if( top >= 2 )
+        checkType(L, LT_NIL | LT_NUMBER, 2);
+
+    DWORD timeout = lua_isnumber(L, 2) ? (DWORD)std::max((lua_Integer)0, lua_tointeger(L, 2)) : INFINITE;
+    if( worker->hThread )
+        WaitForSingleObject(worker->hThread, timeout);
+
+    lua_pushboolean(L, worker->finished);
+    return 1;
+}
+
+/*  thread:id()
+    Returns:    number
+
+    Returns the thread's ID, as given in its "threadfinished" event.
+*/
+int Thread_lua::id(lua_State *L)
+{
+    if( lua_gettop(L) != 1 )
+        wrongArgs(L);
+    Worker *worker = checkWorker(L, 1);
+
+    lua_pushinteger(L, worker->id);
+    return 1;
+}
+
+/*  thread.send(...)
+    Returns:    boolean
+
+    (Within a thread) Sends the given values back to the main script,
+    which receives them from thread:receive().
+*/
+int Thread_lua::worker_send(lua_State *L)
+{
+    int top = lua_gettop(L);
+    if( top < 1 )
+        wrongArgs(L);
+
+    Worker *worker = getCurrentWorker(L);
+    std::string message, err;
+    if( !packValues(L, 1, top, message, err) )
+        return luaL_error(L, "Cannot send from thread: %s", err.c_str());
+
+    bool sent = worker->outbox.send(std::move(message));
+    if( sent )
+        Macro::instance()->getScheduler()->wake();
+    else
+        releaseValues(message);
+
+    lua_pushboolean(L, sent);
+    return 1;
+}
+
+/*  thread.receive([number timeout])
+    Returns (on message):   ...
+    Returns (on timeout):   nil
+    Returns (when stopped): nil, "closed"
+
+    (Within a thread) Waits for the next message sent by the main
+    script with thread:send(). Waits forever unless 'timeout' (in
+    milliseconds) is given.
+*/
+int Thread_lua::worker_receive(lua_State *L)
+{
+    int top = lua_gettop(L);
+    if( top > 1 )
+        wrongArgs(L);
+    if( top >= 1 )
+        checkType(L, LT_NIL | LT_NUMBER, 1);
+
+    Worker *worker = getCurrentWorker(L);
+    int timeout = lua_isnumber(L, 1) ? (int)lua_tointeger(L, 1) : (int)INFINITE;
+    return receiveFrom(L, worker->inbox, timeout < 0 ? (int)INFINITE : timeout);
+}
+
+/*  thread.id()
+    Returns:    number
+
+    (Within a thread) Returns this thread's ID.
+*/
+int Thread_lua::worker_id(lua_State *L)
+{
+    if( lua_gettop(L) != 0 )
+        wrongArgs(L);
+
+    lua_pushinteger(L, getCurrentWorker(L)->id);
+    return 1;
+}
+
+/*  thread.isStopping()
+    Returns:    boolean
+
+    (Within a thread) Returns true if the main script has asked this
+    thread to stop; long-running loops may check this to finish cleanly.
+*/
+int Thread_lua::worker_isStopping(lua_State *L)
+{
+    if( lua_gettop(L) != 0 )
+        wrongArgs(L);
+
+    lua_pushboolean(L, getCurrentWorker(L)->stopRequested);
+    return 1;
+}
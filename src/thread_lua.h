@@ -0,0 +1,95 @@
+/******************************************************************************
+	Project: 	MicroMacro
+	Author: 	SolarStrike Software
+	URL:		www.solarstrike.net
+	License:	Modified BSD (see license.txt)
+******************************************************************************/
+
+#ifndef THREAD_LUA_H
+#define THREAD_LUA_H
+
+	#include "wininclude.h"
+	#include "channel.h"
+	#include "mutex.h"
+	#include <atomic>
+	#include <string>
+	#include <vector>
+
+	#define THREAD_MODULE_NAME			"thread"
+	#define THREAD_MAX_DEPTH			32		// Deepest nesting of tables we'll send
+	#define THREAD_STOP_TIMEOUT			5000	// Milliseconds to wait for workers when the script ends
+
+	typedef struct lua_State lua_State;
+	typedef struct lua_Debug lua_Debug;
+
+	namespace LuaType
+	{
+		extern const char *metatable_thread;
+	}
+
+	class Thread_lua
+	{
+		protected:
+			struct Worker
+			{
+				unsigned int id;
+				std::string script;
+				std::string basePath;
+				std::string args;				// Packed arguments for the script
+				std::string result;				// Packed return values, once finished
+				std::string error;
+				MicroMacro::Channel inbox;		// Main state -> worker
+				MicroMacro::Channel outbox;		// Worker -> main state
+				HANDLE hThread;
+				MicroMacro::Mutex stateLock;	// Guards lstate against a concurrent stop()
+				lua_State *lstate;
+				std::atomic<bool> stopRequested;
+				std::atomic<bool> finished;
+				bool succeeded;
+				std::atomic<int> refCount;		// Held by the Lua handle and by the OS thread
+			};
+
+			static std::vector<Worker *> workers;
+			static unsigned int nextId;
+
+			static DWORD WINAPI workerThread(LPVOID);
+			static int runScript(lua_State *);
+			static void release(Worker *);
+			static void requestStop(Worker *);
+			static void stopHook(lua_State *, lua_Debug *);
+			static Worker *checkWorker(lua_State *, int);
+			static Worker *getCurrentWorker(lua_State *);
+			static void notifyFinished(Worker *);
+
+			static bool packValue(lua_State *, int, std::string &, std::string &, int);
+			static bool unpackValue(lua_State *, const char *&, const char *);
+			static bool packValues(lua_State *, int, int, std::string &, std::string &);
+			static int unpackValues(lua_State *, const std::string &);
+			static bool releaseValue(const char *&, const char *);
+			static void releaseValues(std::string &);
+			static int receiveFrom(lua_State *, MicroMacro::Channel &, int);
+
+			static int spawn(lua_State *);
+
+			static int gc(lua_State *);
+			static int tostring(lua_State *);
+			static int send(lua_State *);
+			static int receive(lua_State *);
+			static int isRunning(lua_State *);
+			static int getResult(lua_State *);
+			static int stop(lua_State *);
+			static int join(lua_State *);
+			static int id(lua_State *);
+
+			static int worker_send(lua_State *);
+			static int worker_receive(lua_State *);
+			static int worker_id(lua_State *);
+			static int worker_isStopping(lua_State *);
+
+		public:
+			static int regmod(lua_State *);
+			static int regworker(lua_State *);
+			static int cleanup(lua_State *);
+	};
+
+#endif
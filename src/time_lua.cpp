@@ -25,6 +25,9 @@ int Time_lua::regmod(lua_State *L)
         {"getNow", Time_lua::getNow},
         {"deltaTime", Time_lua::deltaTime},
         {"diff", Time_lua::diff},
+        {"diffNs", Time_lua::diffNs},
+        {"getClockSource", Time_lua::getClockSource},
+        {"setClockSource", Time_lua::setClockSource},
         {NULL, NULL}
     };
 
@@ -37,7 +40,9 @@ int Time_lua::regmod(lua_State *L)
 /*  time.getNow()
     Returns:    integer
 
-    Returns the current high-precision time as an int64.
+    Returns the current high-precision time as an int64 count of
+    nanoseconds. The starting point is arbitrary; only compare it
+    against other values from time.getNow().
 */
 int Time_lua::getNow(lua_State *L)
 {
@@ -101,3 +106,74 @@ int Time_lua::diff(lua_State *L)
     lua_pushnumber(L, dt);
     return 1;
 }
+
+/*  time.diffNs(number t2, number t1)
+    time.diffNs(number t1)
+    Returns:    integer delta
+
+    Like time.diff(), but returns the elapsed time as an integer
+    number of nanoseconds, so no precision is lost.
+*/
+int Time_lua::diffNs(lua_State *L)
+{
+    int top = lua_gettop(L);
+    if( top != 1 && top != 2 )
+        wrongArgs(L);
+
+    TimeType t2, t1;
+    checkType(L, LT_NUMBER, 1);
+
+    if( top == 2 )
+    {
+        checkType(L, LT_NUMBER, 2);
+
+        t2.QuadPart = lua_tointeger(L, 1);
+        t1.QuadPart = lua_tointeger(L, 2);
+    }
+    else
+    {
+        t2 = ::getNow();
+        t1.QuadPart = lua_tointeger(L, 1);
+    }
+
+    lua_pushinteger(L, ::deltaNanoseconds(t2, t1));
+    return 1;
+}
+
+/*  time.getClockSource()
+    Returns:    string
+
+    Returns the name of the clock that time values are read from;
+    either "system" or "tsc".
+*/
+int Time_lua::getClockSource(lua_State *L)
+{
+    if( lua_gettop(L) != 0 )
+        wrongArgs(L);
+
+    lua_pushstring(L, ::getClockSourceName(::getClockSource()));
+    return 1;
+}
+
+/*  time.setClockSource(string source)
+    Returns:    boolean
+
+    Changes the clock that time values are read from. 'source' may be
+    "system" (the OS's monotonic clock) or "tsc" (the CPU's timestamp
+    counter, calibrated against the system clock; cheaper to read).
+    Returns false if the source is not usable on this machine.
+    Normally set through 'clockSource' in config.lua instead.
+*/
+int Time_lua::setClockSource(lua_State *L)
+{
+    if( lua_gettop(L) != 1 )
+        wrongArgs(L);
+    checkType(L, LT_STRING, 1);
+
+    ClockSource source;
+    if( !::parseClockSource(lua_tostring(L, 1), source) )
+        return luaL_argerror(L, 1, "expected \'system\' or \'tsc\'");
+
+    lua_pushboolean(L, ::setClockSource(source));
+    return 1;
+}
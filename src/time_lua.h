@@ -17,6 +17,9 @@
 			static int getNow(lua_State *);
 			static int deltaTime(lua_State *);
 			static int diff(lua_State *);
+			static int diffNs(lua_State *);
+			static int getClockSource(lua_State *);
+			static int setClockSource(lua_State *);
 
 		public:
 			static int regmod(lua_State *);
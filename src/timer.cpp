@@ -6,19 +6,144 @@
 ******************************************************************************/
 
 #include "timer.h"
+#include <atomic>
+#include <string.h>
+
+#ifndef WIN32
+    #include <time.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+    #define HAVE_TSC
+    #ifdef _MSC_VER
+        #include <intrin.h>
+    #else
+        #include <x86intrin.h>
+        #include <cpuid.h>
+    #endif
+#endif
 
 #define WINDOWS_TICKS_PER_SECOND        10000000
 #define EPOCH_DIFFERENCE                11644473600LL
 
-// Returns CPU frequency; cached (does not change during run-time)
-TimeType getFrequency()
+// How long to measure the TSC against the system clock for
+#define TSC_CALIBRATION_NS              20000000LL
+
+static std::atomic<int> clockSource(CLOCK_SOURCE_SYSTEM);
+
+#ifdef HAVE_TSC
+/*  Written once, by calibrateTsc(), before clockSource can first become
+    CLOCK_SOURCE_TSC; getNow() only reads them after seeing that (with
+    acquire ordering), so other threads always see them complete.
+*/
+static long long tscTicksPerSecond  =   0;
+static unsigned long long tscBase   =   0;
+static long long tscBaseNs          =   0;
+#endif
+
+// Convert ticks at 'freq' per second to nanoseconds without overflowing or going through a double
+static inline long long ticksToNanoseconds(unsigned long long ticks, long long freq)
+{
+    return (long long)(ticks / freq) * NANOSECONDS_PER_SECOND
+        + (long long)(ticks % freq) * NANOSECONDS_PER_SECOND / freq;
+}
+
+#ifdef WIN32
+// The performance counter frequency is fixed at boot; only ask for it once
+static long long queryPerformanceFrequency()
+{
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    return frequency.QuadPart;
+}
+#endif
+
+// Nanoseconds from the OS monotonic clock
+static inline long long systemNow()
 {
-    static bool queried = false;
-    static TimeType frequency;
+    #ifdef WIN32
+    static const long long frequency = queryPerformanceFrequency();
+    // Usually 10MHz, which converts with a single multiply
+    static const long long multiplier = (NANOSECONDS_PER_SECOND % frequency == 0) ?
+        NANOSECONDS_PER_SECOND / frequency : 0;
 
-    if( queried == false )
-        QueryPerformanceFrequency(&frequency);
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    if( multiplier )
+        return counter.QuadPart * multiplier;
+    return ticksToNanoseconds(counter.QuadPart, frequency);
+    #else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * NANOSECONDS_PER_SECOND + ts.tv_nsec;
+    #endif
+}
+
+#ifdef HAVE_TSC
+// Only a TSC that ticks at a constant rate regardless of power state is any use as a clock
+static bool hasInvariantTsc()
+{
+    unsigned int eax, ebx, ecx, edx;
+    #ifdef _MSC_VER
+    int regs[4];
+    __cpuid(regs, 0x80000000);
+    if( (unsigned int)regs[0] < 0x80000007 )
+        return false;
+    __cpuid(regs, 0x80000007);
+    edx = regs[3];
+    (void)eax; (void)ebx; (void)ecx;
+    #else
+    if( __get_cpuid_max(0x80000000, NULL) < 0x80000007 )
+        return false;
+    __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+    #endif
+
+    return (edx & (1 << 8)) != 0;
+}
+
+// Measure the TSC rate against the system clock, and line the two up
+static bool calibrateTsc()
+{
+    if( !hasInvariantTsc() )
+        return false;
+
+    long long startNs = systemNow();
+    unsigned long long startTicks = __rdtsc();
+    long long endNs;
+    do {
+        endNs = systemNow();
+    } while( endNs - startNs < TSC_CALIBRATION_NS );
+    unsigned long long endTicks = __rdtsc();
+
+    long long ticksPerSecond = (long long)((endTicks - startTicks) * NANOSECONDS_PER_SECOND
+        / (unsigned long long)(endNs - startNs));
+    if( ticksPerSecond <= 0 )
+        return false;
 
+    tscTicksPerSecond = ticksPerSecond;
+    tscBase = endTicks;
+    tscBaseNs = endNs;
+    return true;
+}
+
+// Calibrates the first time only; the results must never change while another thread may be reading them
+static bool calibrateTscOnce()
+{
+    static const bool calibrated = calibrateTsc();     // Initialised thread-safely, exactly once
+    return calibrated;
+}
+
+static inline long long tscNow()
+{
+    return tscBaseNs + ticksToNanoseconds(__rdtsc() - tscBase, tscTicksPerSecond);
+}
+#endif
+
+// Always nanoseconds; see timer.h
+TimeType getFrequency()
+{
+    TimeType frequency;
+    frequency.QuadPart = NANOSECONDS_PER_SECOND;
     return frequency;
 }
 
@@ -26,8 +151,12 @@ TimeType getFrequency()
 TimeType getNow()
 {
     TimeType now;
-    //QueryPerformanceFrequency(&timer::frequency);
-    QueryPerformanceCounter(&now);
+    #ifdef HAVE_TSC
+    if( clockSource.load(std::memory_order_acquire) == CLOCK_SOURCE_TSC )
+        now.QuadPart = tscNow();
+    else
+    #endif
+        now.QuadPart = systemNow();
 
     return now;
 }
@@ -35,9 +164,61 @@ TimeType getNow()
 // Returns the number of seconds elapsed since t1 till t2.
 double deltaTime(TimeType t2, TimeType t1)
 {
-    TimeType diff;
+    return (double)(t2.QuadPart - t1.QuadPart) / NANOSECONDS_PER_SECOND;
+}
+
+// Returns the number of nanoseconds elapsed since t1 till t2.
+long long deltaNanoseconds(TimeType t2, TimeType t1)
+{
+    return t2.QuadPart - t1.QuadPart;
+}
+
+/*  Switch what getNow() reads. Call this early (ie. right after loading
+    the config); the TSC is calibrated against the system clock (the
+    first time it is chosen) so times stay continuous, but there may be
+    a small step.
+    Returns false (and keeps the current source) if the source is not
+    available on this machine.
+*/
+bool setClockSource(ClockSource source)
+{
+    if( source == CLOCK_SOURCE_TSC )
+    {
+        #ifdef HAVE_TSC
+        if( !calibrateTscOnce() )
+            return false;
+        #else
+        return false;
+        #endif
+    }
+
+    clockSource.store(source, std::memory_order_release);
+    return true;
+}
+
+ClockSource getClockSource()
+{
+    return (ClockSource)clockSource.load();
+}
+
+const char *getClockSourceName(ClockSource source)
+{
+    switch( source )
+    {
+        case CLOCK_SOURCE_SYSTEM:   return "system";
+        case CLOCK_SOURCE_TSC:      return "tsc";
+    }
+    return "unknown";
+}
+
+bool parseClockSource(const char *name, ClockSource &source)
+{
+    if( strcmp(name, "system") == 0 )
+        source = CLOCK_SOURCE_SYSTEM;
+    else if( strcmp(name, "tsc") == 0 )
+        source = CLOCK_SOURCE_TSC;
+    else
+        return false;
 
-    diff.QuadPart = t2.QuadPart - t1.QuadPart;
-    double fdiff = ((double)diff.QuadPart / getFrequency().QuadPart);
-    return fdiff;
+    return true;
 }
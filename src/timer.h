@@ -10,9 +10,33 @@
 
 	#include "wininclude.h"
 
-	typedef LARGE_INTEGER		TimeType;
+	#define NANOSECONDS_PER_SECOND		1000000000LL
+	#define NANOSECONDS_PER_MILLISECOND	1000000LL
+
+	/*	All times are integer nanoseconds on a monotonic clock, so
+		getFrequency() is a constant; it is kept so code can convert
+		without caring about the unit.
+	*/
+	#ifdef WIN32
+		typedef LARGE_INTEGER		TimeType;
+	#else
+		typedef union { long long QuadPart; } TimeType;
+	#endif
+
+	enum ClockSource
+	{
+		CLOCK_SOURCE_SYSTEM,		// QueryPerformanceCounter() / clock_gettime(CLOCK_MONOTONIC)
+		CLOCK_SOURCE_TSC,			// Calibrated CPU timestamp counter; needs an invariant TSC
+	};
+
 	TimeType getFrequency();
 	TimeType getNow();
 	double deltaTime(TimeType, TimeType);
+	long long deltaNanoseconds(TimeType, TimeType);
+
+	bool setClockSource(ClockSource);
+	ClockSource getClockSource();
+	const char *getClockSourceName(ClockSource);
+	bool parseClockSource(const char *, ClockSource &);
 
 #endif
@@ -0,0 +1,195 @@
+/******************************************************************************
+    Project:    MicroMacro
+    Author:     SolarStrike Software
+    URL:        www.solarstrike.net
+    License:    Modified BSD (see license.txt)
+******************************************************************************/
+
+#include "timer_lua.h"
+#include "timer.h"
+#include "luatypes.h"
+#include "error.h"
+#include "macro.h"
+
+#include <math.h>
+
+extern "C"
+{
+#include <lua.h>
+#include <lauxlib.h>
+#include <lualib.h>
+}
+
+using MicroMacro::TimerWheel;
+using MicroMacro::TickType;
+
+TimerWheel Timer_lua::wheel;
+
+int Timer_lua::regmod(lua_State *L)
+{
+    static const luaL_Reg _funcs[] = {
+        {"after", Timer_lua::after},
+        {"every", Timer_lua::every},
+        {"cancel", Timer_lua::cancel},
+        {"count", Timer_lua::count},
+        {NULL, NULL}
+    };
+
+    luaL_newlib(L, _funcs);
+    lua_setglobal(L, TIMER_MODULE_NAME);
+
+    wheel.reset(getNowTick());
+    return MicroMacro::ERR_OK;
+}
+
+// Called before the Lua state is closed; the callbacks' references die with it
+int Timer_lua::cleanup(lua_State *)
+{
+    wheel.reset(getNowTick());
+    return MicroMacro::ERR_OK;
+}
+
+// The current high-precision time, in milliseconds
+TickType Timer_lua::getNowTick()
+{
+    return (TickType)(getNow().QuadPart / NANOSECONDS_PER_MILLISECOND);
+}
+
+/*  Calls every timer callback that has fallen due. 'msgh' is the stack
+    index of the message handler to use for lua_pcall().
+    Also lets the main loop know when it next needs to wake for us.
+*/
+int Timer_lua::runTimers(lua_State *L, int msgh, std::string &errMsg)
+{
+    if( wheel.getCount() == 0 )
+        return MicroMacro::ERR_OK;
+
+    std::vector<TimerWheel::Timer *> due;
+    wheel.advance(getNowTick(), due);
+
+    int success = MicroMacro::ERR_OK;
+    for(size_t i = 0; i < due.size(); i++)
+    {
+        TimerWheel::Timer *timer = due.at(i);
+
+        // A callback may have cancelled this one; after an error we just clean up
+        if( success == MicroMacro::ERR_OK && !timer->cancelled )
+        {
+            lua_rawgeti(L, LUA_REGISTRYINDEX, timer->data);
+            lua_pushinteger(L, timer->id);
+            int failstate = lua_pcall(L, 1, 1, msgh);
+            if( failstate )
+            {
+                if( lua_isstring(L, -1) )
+                    errMsg = lua_tostring(L, -1);
+                else
+                    errMsg = "Unknown error occurred (entered error state but no error message returned).";
+                success = mapLuaError(failstate);
+            }
+            else if( timer->interval > 0 && lua_isboolean(L, -1) && !lua_toboolean(L, -1) )
+            {   // Repeating timer returned false; stop it
+                int data;
+                if( wheel.cancel(timer->id, data) )
+                    luaL_unref(L, LUA_REGISTRYINDEX, data);
+            }
+            lua_pop(L, 1);
+        }
+
+        bool cancelled = timer->cancelled;
+        int data = timer->data;
+        if( !wheel.finish(timer) && !cancelled )
+            luaL_unref(L, LUA_REGISTRYINDEX, data);
+    }
+
+    TickType next;
+    if( wheel.getNextExpiry(next) )
+    {
+        TimeType wakeAt;
+        wakeAt.QuadPart = (long long)next * NANOSECONDS_PER_MILLISECOND;
+        Macro::instance()->getScheduler()->requestWakeAt(wakeAt);
+    }
+
+    return success;
+}
+
+// Shared by timer.after() and timer.every()
+int Timer_lua::addTimer(lua_State *L, bool repeating)
+{
+    if( lua_gettop(L) != 2 )
+        wrongArgs(L);
+    checkType(L, LT_NUMBER, 1);
+    checkType(L, LT_FUNCTION, 2);
+
+    double msecs = lua_tonumber(L, 1);
+    if( msecs < 0 || (repeating && msecs < 1) )
+        return luaL_argerror(L, 1, repeating ? "interval must be at least 1 millisecond" : "delay cannot be negative");
+
+    TickType delay = (TickType)ceil(msecs);
+    lua_pushvalue(L, 2);
+    int ref = luaL_ref(L, LUA_REGISTRYINDEX);
+
+    unsigned int id = wheel.add(getNowTick() + delay, repeating ? delay : 0, ref);
+    lua_pushinteger(L, id);
+    return 1;
+}
+
+/*  timer.after(number msecs, function callback)
+    Returns:    number id
+
+    Calls 'callback' once, from the main loop, after 'msecs'
+    milliseconds have passed. The callback is given the timer's
+    ID. Returns an ID that may be passed to timer.cancel().
+*/
+int Timer_lua::after(lua_State *L)
+{
+    return addTimer(L, false);
+}
+
+/*  timer.every(number msecs, function callback)
+    Returns:    number id
+
+    Calls 'callback' every 'msecs' milliseconds, from the main
+    loop, until cancelled with timer.cancel() or the callback
+    returns false. The callback is given the timer's ID.
+    If the script falls behind, a missed interval is skipped
+    rather than run several times in a row.
+*/
+int Timer_lua::every(lua_State *L)
+{
+    return addTimer(L, true);
+}
+
+/*  timer.cancel(number id)
+    Returns:    boolean
+
+    Stops a timer created by timer.after() or timer.every().
+    Returns true if the timer was still pending, else false.
+*/
+int Timer_lua::cancel(lua_State *L)
+{
+    if( lua_gettop(L) != 1 )
+        wrongArgs(L);
+    checkType(L, LT_NUMBER, 1);
+
+    int data;
+    bool cancelled = wheel.cancel((unsigned int)lua_tointeger(L, 1), data);
+    if( cancelled )
+        luaL_unref(L, LUA_REGISTRYINDEX, data);
+
+    lua_pushboolean(L, cancelled);
+    return 1;
+}
+
+/*  timer.count()
+    Returns:    number
+
+    Returns the number of timers still pending.
+*/
+int Timer_lua::count(lua_State *L)
+{
+    if( lua_gettop(L) != 0 )
+        wrongArgs(L);
+
+    lua_pushinteger(L, wheel.getCount());
+    return 1;
+}
@@ -0,0 +1,38 @@
+/******************************************************************************
+	Project: 	MicroMacro
+	Author: 	SolarStrike Software
+	URL:		www.solarstrike.net
+	License:	Modified BSD (see license.txt)
+******************************************************************************/
+
+#ifndef TIMER_LUA_H
+#define TIMER_LUA_H
+
+	#include "timerwheel.h"
+	#include <string>
+
+	#define TIMER_MODULE_NAME		"timer"
+
+	typedef struct lua_State lua_State;
+
+	class Timer_lua
+	{
+		protected:
+			static MicroMacro::TimerWheel wheel;	// One tick per millisecond
+
+			static MicroMacro::TickType getNowTick();
+			static int addTimer(lua_State *, bool);
+
+			static int after(lua_State *);
+			static int every(lua_State *);
+			static int cancel(lua_State *);
+			static int count(lua_State *);
+
+		public:
+			static int regmod(lua_State *);
+			static int cleanup(lua_State *);
+
+			static int runTimers(lua_State *, int, std::string &);
+	};
+
+#endif
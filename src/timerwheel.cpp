@@ -0,0 +1,267 @@
+/******************************************************************************
+    Project:    MicroMacro
+    Author:     SolarStrike Software
+    URL:        www.solarstrike.net
+    License:    Modified BSD (see license.txt)
+******************************************************************************/
+
+#include "timerwheel.h"
+#include <algorithm>
+#include <string.h>
+
+#define TIMERWHEEL_ROOT_MASK        (TIMERWHEEL_ROOT_SIZE - 1)
+#define TIMERWHEEL_LEVEL_MASK       (TIMERWHEEL_LEVEL_SIZE - 1)
+#define TIMERWHEEL_POOL_SLAB        64
+
+using MicroMacro::TimerWheel;
+using MicroMacro::TickType;
+
+TimerWheel::TimerWheel() : pool(sizeof(Timer), TIMERWHEEL_POOL_SLAB)
+{
+    memset(root, 0, sizeof(root));
+    memset(outer, 0, sizeof(outer));
+    overflow    =   NULL;
+    current     =   0;
+    linkedCount =   0;
+    nextId      =   0;
+}
+
+TimerWheel::~TimerWheel()
+{
+    reset(0);
+}
+
+// Drop every timer and start counting from 'now'
+void TimerWheel::reset(TickType now)
+{
+    std::map<unsigned int, Timer *>::iterator iter;
+    for(iter = timersById.begin(); iter != timersById.end(); ++iter)
+        destroy(iter->second);
+    timersById.clear();
+
+    memset(root, 0, sizeof(root));
+    memset(outer, 0, sizeof(outer));
+    overflow    =   NULL;
+    current     =   now;
+    linkedCount =   0;
+}
+
+// Link the timer into whichever slot covers its expiry
+void TimerWheel::insert(Timer *timer)
+{
+    if( timer->expires < current )
+        timer->expires = current;
+
+    TickType delta = timer->expires - current;
+    Timer **slot = &overflow;
+    if( delta < TIMERWHEEL_ROOT_SIZE )
+        slot = &root[timer->expires & TIMERWHEEL_ROOT_MASK];
+    else
+    {
+        for(unsigned int level = 0; level < TIMERWHEEL_OUTER_LEVELS; level++)
+        {
+            unsigned int shift = TIMERWHEEL_ROOT_BITS + level * TIMERWHEEL_LEVEL_BITS;
+            if( delta < ((TickType)1 << (shift + TIMERWHEEL_LEVEL_BITS)) )
+            {
+                slot = &outer[level][(timer->expires >> shift) & TIMERWHEEL_LEVEL_MASK];
+                break;
+            }
+        }
+    }
+
+    timer->prev = NULL;
+    timer->next = *slot;
+    if( *slot )
+        (*slot)->prev = timer;
+    *slot = timer;
+    timer->slot = slot;
+    ++linkedCount;
+}
+
+void TimerWheel::unlink(Timer *timer)
+{
+    if( timer->prev )
+        timer->prev->next = timer->next;
+    else
+        *timer->slot = timer->next;
+
+    if( timer->next )
+        timer->next->prev = timer->prev;
+
+    timer->next = NULL;
+    timer->prev = NULL;
+    timer->slot = NULL;
+    --linkedCount;
+}
+
+// Redistribute an outer slot now that its timers are within reach of a finer one
+void TimerWheel::cascade(Timer **slot)
+{
+    Timer *timer = *slot;
+    *slot = NULL;
+    while( timer )
+    {
+        Timer *next = timer->next;
+        --linkedCount;
+        insert(timer);
+        timer = next;
+    }
+}
+
+void TimerWheel::destroy(Timer *timer)
+{
+    pool.release(timer);
+}
+
+/*  Schedule a timer to expire at tick 'expires' and then every 'interval'
+    ticks after that (0 for a one-shot). 'data' is handed back untouched.
+    Returns the new timer's ID (never 0).
+*/
+unsigned int TimerWheel::add(TickType expires, TickType interval, int data)
+{
+    Timer *timer = static_cast<Timer *>(pool.alloc());
+    if( ++nextId == 0 )
+        ++nextId;
+    while( timersById.find(nextId) != timersById.end() )
+        ++nextId;
+
+    timer->id           =   nextId;
+    timer->expires      =   expires;
+    timer->interval     =   interval;
+    timer->data         =   data;
+    timer->cancelled    =   false;
+    timer->slot         =   NULL;
+
+    insert(timer);
+    timersById[timer->id] = timer;
+    return timer->id;
+}
+
+/*  Cancel a timer. If it is still pending it is freed right away; if it
+    was already handed out by advance(), it is flagged and left for
+    finish() to free. Either way its data is returned so the caller can
+    release it, and the timer will not be handed out again.
+*/
+bool TimerWheel::cancel(unsigned int id, int &data)
+{
+    std::map<unsigned int, Timer *>::iterator found = timersById.find(id);
+    if( found == timersById.end() )
+        return false;
+
+    Timer *timer = found->second;
+    timersById.erase(found);
+    data = timer->data;
+
+    if( timer->slot )
+    {
+        unlink(timer);
+        destroy(timer);
+    }
+    else
+        timer->cancelled = true;
+
+    return true;
+}
+
+/*  Process every tick up to and including 'now'. Timers that fall due
+    are unlinked and appended to 'due' in expiry order; each must then be
+    passed to finish() once the caller is done with it.
+*/
+void TimerWheel::advance(TickType now, std::vector<Timer *> &due)
+{
+    while( current <= now )
+    {
+        if( linkedCount == 0 )
+        {   // Nothing to wait for; skip straight ahead
+            current = now + 1;
+            break;
+        }
+
+        unsigned int index = current & TIMERWHEEL_ROOT_MASK;
+        if( index == 0 )
+        {   // The root wheel wrapped; pull the next slot of each outer level down as they wrap too
+            unsigned int level;
+            for(level = 0; level < TIMERWHEEL_OUTER_LEVELS; level++)
+            {
+                unsigned int shift = TIMERWHEEL_ROOT_BITS + level * TIMERWHEEL_LEVEL_BITS;
+                unsigned int outerIndex = (current >> shift) & TIMERWHEEL_LEVEL_MASK;
+                cascade(&outer[level][outerIndex]);
+                if( outerIndex != 0 )
+                    break;
+            }
+
+            if( level == TIMERWHEEL_OUTER_LEVELS )
+                cascade(&overflow);
+        }
+
+        size_t first = due.size();
+        while( root[index] )
+        {
+            Timer *timer = root[index];
+            unlink(timer);
+            due.push_back(timer);
+        }
+
+        // Keep timers that share a tick in the order they were created
+        std::sort(due.begin() + first, due.end(), [](const Timer *a, const Timer *b) {
+            return a->id < b->id;
+        });
+
+        ++current;
+    }
+}
+
+/*  Hand back a timer obtained from advance(). Repeating timers are
+    rescheduled (returns true); anything else is freed (returns false).
+    A repeating timer that fell behind fires once, not once per missed
+    interval.
+*/
+bool TimerWheel::finish(Timer *timer)
+{
+    if( !timer->cancelled && timer->interval > 0 )
+    {
+        // advance() has been through 'current - 1'; one that fell behind goes from there
+        timer->expires += timer->interval;
+        if( timer->expires < current )
+            timer->expires = current - 1 + timer->interval;
+        insert(timer);
+        return true;
+    }
+
+    if( !timer->cancelled )
+        timersById.erase(timer->id);
+
+    destroy(timer);
+    return false;
+}
+
+/*  Returns (via 'tick') the earliest tick something might fall due. This
+    is exact for timers within the root wheel; otherwise it is the next
+    time an outer slot cascades, which is never later than the real expiry.
+*/
+bool TimerWheel::getNextExpiry(TickType &tick)
+{
+    if( linkedCount == 0 )
+        return false;
+
+    for(TickType i = 0; i < TIMERWHEEL_ROOT_SIZE; i++)
+    {
+        TickType candidate = current + i;
+        if( (candidate & TIMERWHEEL_ROOT_MASK) == 0 && i > 0 )
+            break; // Anything beyond here still needs to cascade
+        if( root[candidate & TIMERWHEEL_ROOT_MASK] )
+        {
+            tick = candidate;
+            return true;
+        }
+    }
+
+    tick = ((current >> TIMERWHEEL_ROOT_BITS) + 1) << TIMERWHEEL_ROOT_BITS;
+    return true;
+}
+
+// Number of timers that have not been cancelled or completed
+size_t TimerWheel::getCount()
+{
+    return timersById.size();
+}
@@ -0,0 +1,79 @@
+/******************************************************************************
+	Project: 	MicroMacro
+	Author: 	SolarStrike Software
+	URL:		www.solarstrike.net
+	License:	Modified BSD (see license.txt)
+******************************************************************************/
+
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+	#include "pool.h"
+	#include <map>
+	#include <vector>
+
+	#define TIMERWHEEL_ROOT_BITS		8		// 256 one-tick slots
+	#define TIMERWHEEL_LEVEL_BITS		6		// 64 slots per outer level
+	#define TIMERWHEEL_OUTER_LEVELS		3		// Covers 2^26 ticks (~18 hours at 1ms); beyond that is overflow
+	#define TIMERWHEEL_ROOT_SIZE		(1 << TIMERWHEEL_ROOT_BITS)
+	#define TIMERWHEEL_LEVEL_SIZE		(1 << TIMERWHEEL_LEVEL_BITS)
+
+	namespace MicroMacro
+	{
+		typedef unsigned long long TickType;
+
+		/*	Hierarchical timing wheel. Adding and cancelling a timer is O(1);
+			advancing costs one slot visit per elapsed tick plus the timers
+			that actually fall due (and the occasional cascade of an outer
+			slot), no matter how many timers are pending.
+			The wheel itself knows nothing about wall time; callers feed it
+			ticks (see Timer_lua for the millisecond version).
+		*/
+		class TimerWheel
+		{
+			public:
+				struct Timer
+				{
+					Timer *next;
+					Timer *prev;
+					Timer **slot;			// List we're linked into; NULL once handed out by advance()
+					unsigned int id;
+					TickType expires;
+					TickType interval;		// 0 for one-shot timers
+					int data;				// Owned by the caller (ie. a Lua registry reference)
+					bool cancelled;
+				};
+
+			private:
+				Timer *root[TIMERWHEEL_ROOT_SIZE];
+				Timer *outer[TIMERWHEEL_OUTER_LEVELS][TIMERWHEEL_LEVEL_SIZE];
+				Timer *overflow;
+				TickType current;			// Next tick to be processed
+				size_t linkedCount;			// Timers currently sitting in a slot
+				unsigned int nextId;
+				std::map<unsigned int, Timer *> timersById;
+				BlockPool pool;
+
+				void insert(Timer *);
+				void unlink(Timer *);
+				void cascade(Timer **);
+				void destroy(Timer *);
+
+				TimerWheel(const TimerWheel &);
+				TimerWheel &operator=(const TimerWheel &);
+
+			public:
+				TimerWheel();
+				~TimerWheel();
+
+				void reset(TickType);
+				unsigned int add(TickType, TickType, int);
+				bool cancel(unsigned int, int &);
+				void advance(TickType, std::vector<Timer *> &);
+				bool finish(Timer *);
+				bool getNextExpiry(TickType &);
+				size_t getCount();
+		};
+	}
+
+#endif
@@ -21,6 +21,9 @@ BatchJob &BatchJob::operator=(const BatchJob &o)
 {
     this->count = o.count;
     this->type = o.type;
+    this->offset = o.offset;
+    this->stride = o.stride;
+    this->length = o.length;
     return *this;
 }
 
@@ -186,6 +189,13 @@ Socket::~Socket()
     //deleteMe  =   true;
     if( socket )
         closesocket(socket);
+
+    // Drop any events that never made it to Lua
+    while( !eventQueue.empty() )
+    {
+        delete eventQueue.front();
+        eventQueue.pop();
+    }
 }
 
 SerialPort::SerialPort()
@@ -12,6 +12,7 @@
 	#include <vector>
 	#include <queue>
 	#include "wininclude.h"
+	#include "procmem.h"
 	#include "mutex.h"
 	#include "event.h"
 	#include "strl.h"
@@ -27,7 +28,7 @@
 
 		enum Multivar_type{VT_NUMBER, VT_STRING, VT_NIL};
 		enum BatchJob_type{MEM_BYTE, MEM_UBYTE, MEM_SHORT, MEM_USHORT, MEM_INT, MEM_UINT,
-			MEM_INT64, MEM_UINT64, MEM_FLOAT, MEM_DOUBLE, MEM_STRING, MEM_SKIP};
+			MEM_INT64, MEM_UINT64, MEM_FLOAT, MEM_DOUBLE, MEM_STRING, MEM_SKIP, MEM_GROUP};
 
 		typedef unsigned int ALuint;
 		//class Event;
@@ -49,10 +50,12 @@
 		};
 
 		/* Holds a handle to a process and any extra info about an open process */
+		class PointerCache;
 		struct ProcHandle
 		{
-			HANDLE handle;
+			ProcessHandle handle;
 			bool is32bit;
+			PointerCache *pointerCache;		// Shared by its pointer paths; created by the first one
 		};
 
 		/* Currently has no use */
@@ -66,9 +69,13 @@
 		/* Describes a memory read job (type and length) */
 		struct BatchJob
 		{
-			unsigned int count;
+			unsigned int count;		// Values to read, string length, or times to repeat a group
 			BatchJob_type type;
+			size_t offset;			// From the start of the enclosing group
+			size_t stride;			// MEM_GROUP only: bytes between repeats
+			unsigned int length;	// MEM_GROUP only: how many of the following jobs are in it
 
+			BatchJob() : count(1), type(MEM_SKIP), offset(0), stride(0), length(0) {}
 			BatchJob &operator=(const BatchJob &);
 		};
 
@@ -80,6 +87,29 @@
 			char *data;
 		};
 
+		/* One field of a MemoryLayout */
+		struct LayoutField
+		{
+			BatchJob_type type;
+			size_t offset;
+			size_t size;			// Of each value (or the whole string)
+			unsigned int count;		// More than one gives an array
+		};
+
+		/* A struct layout compiled by memorychunk.layout() */
+		struct MemoryLayout
+		{
+			std::vector<LayoutField> fields;
+		};
+
+		/* Results of process.scanValue(); 'process' is kept alive along with it */
+		class ValueScan;
+		struct ScanResult
+		{
+			ValueScan *scan;
+			ProcHandle *process;
+		};
+
 		/* Holds SQLite3 database info */
 		struct SQLiteDb
 		{
@@ -160,8 +190,8 @@
 			bool deleteMe;
 			bool inLua;
 
-			std::queue<Event> eventQueue;
-			std::queue<std::string> recvQueue;
+			std::queue<Event *> eventQueue;
+			std::queue<EventData> recvQueue;	// Packets, in pooled storage
 			Mutex mutex;
 		};
 		#endif
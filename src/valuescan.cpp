@@ -0,0 +1,462 @@
+/******************************************************************************
+    Project:    MicroMacro
+    Author:     SolarStrike Software
+    URL:        www.solarstrike.net
+    License:    Modified BSD (see license.txt)
+******************************************************************************/
+
+#include "valuescan.h"
+#include "patternscan.h"
+#include "simd.h"
+
+#include <string.h>
+
+namespace MicroMacro
+{
+    typedef bool (*CompareFunc)(ValueCompare, const unsigned char *, const unsigned char *,
+                                const unsigned char *, const unsigned char *);
+
+    static size_t alignDown(size_t value, size_t alignment)
+    {
+        return value - (value % alignment);
+    }
+
+    static bool isFloatType(BatchJob_type type)
+    {
+        return type == MEM_FLOAT || type == MEM_DOUBLE;
+    }
+
+    // Whether the value at 'current' passes; 'previous' is what was there last time
+    template <class T>
+    static bool compareAs(ValueCompare op, const unsigned char *current, const unsigned char *previous,
+                          const unsigned char *a, const unsigned char *b)
+    {
+        T cur, prev, lo, hi;
+        memcpy(&cur, current, sizeof(T));
+        switch( op )
+        {
+            case VALUE_EQUAL:
+                memcpy(&lo, a, sizeof(T));
+                return cur == lo;
+            case VALUE_UNCHANGED:
+                return memcmp(current, previous, sizeof(T)) == 0;
+            case VALUE_CHANGED:
+                return memcmp(current, previous, sizeof(T)) != 0;
+            case VALUE_INCREASED:
+                memcpy(&prev, previous, sizeof(T));
+                return cur > prev;
+            case VALUE_DECREASED:
+                memcpy(&prev, previous, sizeof(T));
+                return cur < prev;
+            case VALUE_BETWEEN:
+                memcpy(&lo, a, sizeof(T));
+                memcpy(&hi, b, sizeof(T));
+                return cur >= lo && cur <= hi;
+        }
+        return false;
+    }
+
+    static CompareFunc getCompareFunc(BatchJob_type type)
+    {
+        switch( type )
+        {
+            case MEM_BYTE:      return compareAs<char>;
+            case MEM_UBYTE:     return compareAs<unsigned char>;
+            case MEM_SHORT:     return compareAs<short>;
+            case MEM_USHORT:    return compareAs<unsigned short>;
+            case MEM_INT:       return compareAs<int>;
+            case MEM_UINT:      return compareAs<unsigned int>;
+            case MEM_INT64:     return compareAs<long long>;
+            case MEM_UINT64:    return compareAs<unsigned long long>;
+            case MEM_FLOAT:     return compareAs<float>;
+            case MEM_DOUBLE:    return compareAs<double>;
+            default:            return NULL;
+        }
+    }
+
+    struct ValueScanState
+    {
+        size_t valueSize;
+        const unsigned char *value;
+        CompareFunc compare;
+        bool bytewise;      // Integers can be matched byte for byte
+        bool keepValues;    // Floats that match can differ (ie. 0.0 and -0.0), so keep each
+        std::vector<std::vector<CandidateBlock> > found;    // Per piece
+    };
+
+    // Switch a block from a list of slots to a bitmap
+    static void makeDense(CandidateBlock &block, size_t valueSize)
+    {
+        size_t slotsPerBlock = CANDIDATE_BLOCK_SIZE / valueSize;
+        block.bitmap.assign((slotsPerBlock + 31) / 32, 0);
+        for(size_t i = 0; i < block.slots.size(); i++)
+            block.bitmap[block.slots[i] / 32] |= 1u << (block.slots[i] % 32);
+
+        std::vector<unsigned short>().swap(block.slots);
+        block.dense = true;
+    }
+
+    // Switch a block to a bitmap if that is smaller
+    static void finishBlock(CandidateBlock &block, size_t valueSize)
+    {
+        size_t bitmapBytes = CANDIDATE_BLOCK_SIZE / valueSize / 8;
+        if( block.dense || block.count * sizeof(unsigned short) <= bitmapBytes )
+            std::vector<unsigned short>(block.slots).swap(block.slots); // Shrink to fit
+        else
+            makeDense(block, valueSize);
+    }
+
+    /*  Add the candidates in 'from' to those in 'into', for the same block;
+        'from' comes later in memory, and is left empty
+    */
+    static void mergeBlock(CandidateBlock &into, CandidateBlock &from, size_t valueSize)
+    {
+        if( !into.dense && !from.dense )
+            into.slots.insert(into.slots.end(), from.slots.begin(), from.slots.end());
+        else
+        {
+            if( !into.dense )
+                makeDense(into, valueSize);
+
+            for(size_t i = 0; i < from.slots.size(); i++)
+                into.bitmap[from.slots[i] / 32] |= 1u << (from.slots[i] % 32);
+            for(size_t w = 0; w < from.bitmap.size(); w++)
+                into.bitmap[w] |= from.bitmap[w];
+        }
+
+        into.values.insert(into.values.end(), from.values.begin(), from.values.end());
+        into.count += from.count;
+        std::vector<unsigned short>().swap(from.slots);
+        std::vector<unsigned char>().swap(from.values);
+        std::vector<unsigned int>().swap(from.bitmap);
+        finishBlock(into, valueSize);
+    }
+
+    /*  Candidates arrive in address order, so once one lands in a new
+        block the last one is complete, and can be made as small as it will
+        go; otherwise a first scan would hold every candidate as a slot
+        until the end. 'value', if not NULL, is kept as the candidate's value.
+    */
+    static void addCandidate(std::vector<CandidateBlock> &blocks, size_t address, size_t valueSize,
+                             const unsigned char *value)
+    {
+        size_t base = alignDown(address, CANDIDATE_BLOCK_SIZE);
+        if( blocks.empty() || blocks.back().base != base )
+        {
+            if( !blocks.empty() )
+                finishBlock(blocks.back(), valueSize);
+            blocks.push_back(CandidateBlock());
+            blocks.back().base = base;
+            blocks.back().count = 0;
+            blocks.back().dense = false;
+        }
+
+        CandidateBlock &block = blocks.back();
+        block.slots.push_back((unsigned short)((address - base) / valueSize));
+        if( value )
+            block.values.insert(block.values.end(), value, value + valueSize);
+        ++block.count;
+    }
+
+    #if defined(SIMD_AVX2) || defined(SIMD_SSE2)
+    /*  'bytes' has a bit for each byte that matched its byte of the value;
+        cut it down to a bit at the start (marked in 'starts') of each value
+        whose bytes all match.
+    */
+    static unsigned int wholeValues(unsigned int bytes, size_t valueSize, unsigned int starts)
+    {
+        unsigned int whole = bytes;
+        for(size_t i = 1; i < valueSize; i++)
+            whole &= bytes >> i;
+        return whole & starts;
+    }
+    #endif
+
+    // Adds each aligned value in the first 'count' bytes (that fits within 'size') that matches
+    static bool valueScan_block(size_t piece, size_t address, const unsigned char *data,
+                                size_t size, size_t count, void *param)
+    {
+        ValueScanState *state = static_cast<ValueScanState *>(param);
+        std::vector<CandidateBlock> &blocks = state->found.at(piece);
+        size_t valueSize = state->valueSize;
+        if( size < valueSize )
+            return true;
+
+        size_t limit = size - valueSize + 1;
+        if( count < limit )
+            limit = count;
+
+        size_t i = (valueSize - address % valueSize) % valueSize;
+
+        #if defined(SIMD_AVX2) || defined(SIMD_SSE2)
+        if( state->bytewise && i == 0 )
+        {
+            unsigned char repeated[32];
+            unsigned int starts = 0;
+            for(size_t b = 0; b < 32; b++)
+            {
+                repeated[b] = state->value[b % valueSize];
+                if( b % valueSize == 0 )
+                    starts |= 1u << b;
+            }
+
+            #if defined(SIMD_AVX2)
+            const __m256i valueVec = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(repeated));
+            for(; i + 32 <= limit; i += 32)
+            {
+                __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+                unsigned int matches = wholeValues((unsigned int)_mm256_movemask_epi8(
+                    _mm256_cmpeq_epi8(a, valueVec)), valueSize, starts);
+
+                while( matches )
+                {
+                    addCandidate(blocks, address + i + lowestSetBit(matches), valueSize, NULL);
+                    matches &= matches - 1;
+                }
+            }
+            #else
+            const __m128i valueVec = _mm_loadu_si128(reinterpret_cast<const __m128i *>(repeated));
+            for(; i + 16 <= limit; i += 16)
+            {
+                __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+                unsigned int matches = wholeValues((unsigned int)_mm_movemask_epi8(
+                    _mm_cmpeq_epi8(a, valueVec)), valueSize, starts & 0xFFFF);
+
+                while( matches )
+                {
+                    addCandidate(blocks, address + i + lowestSetBit(matches), valueSize, NULL);
+                    matches &= matches - 1;
+                }
+            }
+            #endif
+        }
+        #endif
+
+        for(; i < limit; i += valueSize)
+        {
+            if( state->compare(VALUE_EQUAL, data + i, NULL, state->value, NULL) )
+                addCandidate(blocks, address + i, valueSize, state->keepValues ? data + i : NULL);
+        }
+
+        return true;
+    }
+
+    ValueScan::ValueScan(BatchJob_type _type)
+        : type(_type), valueSize(getValueSize(_type)), count(0), uniform(false)
+    {
+        memset(uniformValue, 0, sizeof(uniformValue));
+    }
+
+    // Bytes per value of the given type, or 0 if it cannot be scanned for
+    size_t ValueScan::getValueSize(BatchJob_type type)
+    {
+        switch( type )
+        {
+            case MEM_BYTE:
+            case MEM_UBYTE:     return sizeof(char);
+            case MEM_SHORT:
+            case MEM_USHORT:    return sizeof(short);
+            case MEM_INT:
+            case MEM_UINT:      return sizeof(int);
+            case MEM_INT64:
+            case MEM_UINT64:    return sizeof(long long);
+            case MEM_FLOAT:     return sizeof(float);
+            case MEM_DOUBLE:    return sizeof(double);
+            default:            return 0;
+        }
+    }
+
+    void ValueScan::getSlots(const CandidateBlock &block, std::vector<unsigned short> &slots) const
+    {
+        if( !block.dense )
+        {
+            slots = block.slots;
+            return;
+        }
+
+        slots.clear();
+        slots.reserve(block.count);
+        for(size_t w = 0; w < block.bitmap.size(); w++)
+        {
+            unsigned int bits = block.bitmap[w];
+            while( bits )
+            {
+                slots.push_back((unsigned short)(w * 32 + lowestSetBit(bits)));
+                bits &= bits - 1;
+            }
+        }
+    }
+
+    /*  Find every address in the range, aligned to the value's size, that
+        holds 'value'. This replaces any earlier results. Returns the number
+        of bytes read.
+    */
+    size_t ValueScan::scan(ProcessHandle handle, size_t address, size_t length, const void *value,
+                           unsigned int threads)
+    {
+        blocks.clear();
+        count = 0;
+        uniform = !isFloatType(type);
+        memcpy(uniformValue, value, valueSize);
+
+        ValueScanState state;
+        state.valueSize = valueSize;
+        state.value = uniformValue;
+        state.compare = getCompareFunc(type);
+        state.bytewise = !isFloatType(type);
+        state.keepValues = !uniform;
+
+        std::vector<ScanRange> pieces;
+        getScanPieces(handle, address, length, valueSize - 1, pieces);
+        state.found.resize(pieces.size());
+
+        size_t bytesRead = scanPieces(handle, pieces, valueSize - 1, threads, valueScan_block, &state);
+
+        // Pieces are in address order, but two may share a block
+        for(size_t p = 0; p < state.found.size(); p++)
+        {
+            std::vector<CandidateBlock> &found = state.found.at(p);
+            for(size_t b = 0; b < found.size(); b++)
+            {
+                CandidateBlock &block = found.at(b);
+                count += block.count;
+                if( !blocks.empty() && blocks.back().base == block.base )
+                    mergeBlock(blocks.back(), block, valueSize);
+                else
+                {
+                    blocks.push_back(CandidateBlock());
+                    CandidateBlock &added = blocks.back();
+                    added.base = block.base;
+                    added.count = block.count;
+                    added.dense = block.dense;
+                    added.slots.swap(block.slots);
+                    added.bitmap.swap(block.bitmap);
+                    added.values.swap(block.values);
+                    finishBlock(added, valueSize);  // The last of each piece is not yet
+                }
+            }
+            std::vector<CandidateBlock>().swap(found);
+        }
+
+        return bytesRead;
+    }
+
+    /*  Re-read every candidate and keep only those that pass 'op'. 'a' is
+        the value for VALUE_EQUAL, and 'a' and 'b' the (inclusive) bounds for
+        VALUE_BETWEEN; the others compare against the last value read.
+        Candidates that can no longer be read are dropped. Returns the
+        number of bytes read.
+    */
+    size_t ValueScan::rescan(ProcessHandle handle, ValueCompare op, const void *a, const void *b)
+    {
+        CompareFunc compare = getCompareFunc(type);
+        const unsigned char *lo = static_cast<const unsigned char *>(a);
+        const unsigned char *hi = static_cast<const unsigned char *>(b);
+
+        // Whether every survivor will hold the same value, which we then needn't keep
+        bool keepUniform = (op == VALUE_EQUAL && !isFloatType(type)) || (op == VALUE_UNCHANGED && uniform);
+
+        std::vector<CandidateBlock> survivors;
+        std::vector<unsigned short> slots;
+        std::vector<unsigned char> buffer(CANDIDATE_BLOCK_SIZE);
+        size_t newCount = 0;
+        size_t bytesRead = 0;
+
+        for(size_t bi = 0; bi < blocks.size(); bi++)
+        {
+            const CandidateBlock &block = blocks.at(bi);
+            getSlots(block, slots);
+
+            survivors.push_back(CandidateBlock());
+            CandidateBlock &kept = survivors.back();
+            kept.base = block.base;
+            kept.count = 0;
+            kept.dense = false;
+
+            size_t n = slots.size();
+            size_t i = 0;
+            while( i < n )
+            {
+                // Take in every candidate up to CANDIDATE_READ_GAP past the last
+                size_t runStart = block.base + slots[i] * valueSize;
+                size_t runEnd = runStart + valueSize;
+                size_t j = i + 1;
+                while( j < n && block.base + slots[j] * valueSize - runEnd <= CANDIDATE_READ_GAP )
+                {
+                    runEnd = block.base + slots[j] * valueSize + valueSize;
+                    ++j;
+                }
+
+                size_t got = readAvailable(handle, runStart, &buffer[0], runEnd - runStart);
+                bytesRead += got;
+
+                size_t k = i;
+                for(; k < j; k++)
+                {
+                    size_t offset = slots[k] * valueSize + block.base - runStart;
+                    if( offset + valueSize > got )
+                        break;
+
+                    const unsigned char *current = &buffer[offset];
+                    const unsigned char *previous = uniform ? uniformValue : &block.values[k * valueSize];
+                    if( !compare(op, current, previous, lo, hi) )
+                        continue;
+
+                    kept.slots.push_back(slots[k]);
+                    ++kept.count;
+                    if( !keepUniform )
+                        kept.values.insert(kept.values.end(), current, current + valueSize);
+                }
+
+                if( k < j )
+                {   // Drop whatever else was on the page we couldn't read
+                    size_t failedEnd = alignDown(runStart + got, SCAN_PAGE_SIZE) + SCAN_PAGE_SIZE;
+                    while( k < n && block.base + slots[k] * valueSize < failedEnd )
+                        ++k;
+                }
+                i = k;
+            }
+
+            if( kept.count == 0 )
+            {
+                survivors.pop_back();
+                continue;
+            }
+            finishBlock(kept, valueSize);
+            newCount += kept.count;
+        }
+
+        blocks.swap(survivors);
+        count = newCount;
+        if( op == VALUE_EQUAL && keepUniform )
+            memcpy(uniformValue, lo, valueSize);
+        uniform = keepUniform;
+
+        return bytesRead;
+    }
+
+    /*  Up to 'max' candidates, in address order. 'values' gets the last value
+        read at each, valueSize bytes apiece. Returns how many were given.
+    */
+    size_t ValueScan::getCandidates(size_t max, std::vector<size_t> &addresses,
+                                    std::vector<unsigned char> &values) const
+    {
+        addresses.clear();
+        values.clear();
+
+        std::vector<unsigned short> slots;
+        for(size_t b = 0; b < blocks.size() && addresses.size() < max; b++)
+        {
+            const CandidateBlock &block = blocks.at(b);
+            getSlots(block, slots);
+            for(size_t i = 0; i < slots.size() && addresses.size() < max; i++)
+            {
+                const unsigned char *value = uniform ? uniformValue : &block.values[i * valueSize];
+                addresses.push_back(block.base + slots[i] * valueSize);
+                values.insert(values.end(), value, value + valueSize);
+            }
+        }
+
+        return addresses.size();
+    }
+}
@@ -0,0 +1,77 @@
+/******************************************************************************
+	Project: 	MicroMacro
+	Author: 	SolarStrike Software
+	URL:		www.solarstrike.net
+	License:	Modified BSD (see license.txt)
+******************************************************************************/
+
+#ifndef VALUESCAN_H
+#define VALUESCAN_H
+
+	#include "types.h"
+	#include "procmem.h"
+	#include <vector>
+	#include <stddef.h>
+
+	#define CANDIDATE_BLOCK_SIZE	0x10000		// Memory covered by one CandidateBlock (64KB)
+	#define CANDIDATE_READ_GAP		0x1000		// Candidates closer than this share a read when rescanning
+	#define MAX_SCAN_VALUE_SIZE		8
+
+	namespace MicroMacro
+	{
+		enum ValueCompare{VALUE_EQUAL, VALUE_UNCHANGED, VALUE_CHANGED, VALUE_INCREASED,
+			VALUE_DECREASED, VALUE_BETWEEN};
+
+		/*	The candidates found within one CANDIDATE_BLOCK_SIZE-aligned block
+			of memory. Values are only looked for at addresses aligned to their
+			size, so each candidate is a "slot" number: its offset from 'base'
+			divided by the value size.
+			Blocks with few candidates keep a sorted list of slots; busier
+			ones keep a bitmap with a bit per slot instead, whichever is
+			smaller.
+		*/
+		struct CandidateBlock
+		{
+			size_t base;
+			unsigned int count;
+			bool dense;
+			std::vector<unsigned short> slots;		// When sparse
+			std::vector<unsigned int> bitmap;		// When dense
+			std::vector<unsigned char> values;		// Last value read for each candidate, in slot order
+		};
+
+		/*	The "first scan / next scan" value search behind process.scanValue().
+			scan() finds every aligned address in a range that holds a value;
+			each rescan() re-reads the remaining candidates, a block of nearby
+			ones at a time, and keeps those that pass the comparison.
+			When every candidate is known to hold the same value (ie. after
+			looking for an exact integer), that value is kept once rather
+			than once per candidate.
+		*/
+		class ValueScan
+		{
+			protected:
+				BatchJob_type type;
+				size_t valueSize;
+				std::vector<CandidateBlock> blocks;
+				size_t count;
+				bool uniform;
+				unsigned char uniformValue[MAX_SCAN_VALUE_SIZE];
+
+				void getSlots(const CandidateBlock &, std::vector<unsigned short> &) const;
+
+			public:
+				ValueScan(BatchJob_type);
+
+				static size_t getValueSize(BatchJob_type);
+
+				size_t scan(ProcessHandle, size_t, size_t, const void *, unsigned int);
+				size_t rescan(ProcessHandle, ValueCompare, const void *, const void *);
+
+				BatchJob_type getType() const { return type; }
+				size_t getCount() const { return count; }
+				size_t getCandidates(size_t, std::vector<size_t> &, std::vector<unsigned char> &) const;
+		};
+	}
+
+#endif
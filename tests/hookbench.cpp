@@ -0,0 +1,115 @@
+/******************************************************************************
+    Project:    MicroMacro
+    Author:     SolarStrike Software
+    URL:        www.solarstrike.net
+    License:    Modified BSD (see license.txt)
+******************************************************************************/
+
+/*  Runs commands/benchmark.lua twice: first with the CTRL+C hook that
+    LuaEngine::init() used to install on every script (a C hook called
+    on every line, and every 100 instructions), then with no hook, which
+    is how scripts now run until CTRL+C is pressed.
+
+    Build and run (from the repository root), against Lua 5.4:
+        g++ -std=c++11 -O2 tests/hookbench.cpp $(pkg-config --cflags --libs lua5.4) -o hookbench
+        ./hookbench commands/benchmark.lua [iterations]
+
+    Only what benchmark.lua needs of MicroMacro is provided: printf(),
+    sprintf(), args, and time.getNow() and time.diff().
+*/
+
+#include <stdio.h>
+#include <time.h>
+
+extern "C"
+{
+#include <lua.h>
+#include <lauxlib.h>
+#include <lualib.h>
+}
+
+static volatile bool closeState = false;
+
+// As it was in LuaEngine, before being armed only on demand
+static void closeHook(lua_State *L, lua_Debug *)
+{
+    if( closeState )
+    {
+        lua_pushliteral(L, "CTRL+C pressed.");
+        lua_error(L);
+    }
+}
+
+static long long nowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int time_getNow(lua_State *L)
+{
+    lua_pushinteger(L, nowNs());
+    return 1;
+}
+
+static int time_diff(lua_State *L)
+{
+    long long t2 = lua_gettop(L) >= 2 ? luaL_checkinteger(L, 1) : nowNs();
+    long long t1 = luaL_checkinteger(L, lua_gettop(L) >= 2 ? 2 : 1);
+    lua_pushnumber(L, (t2 - t1) / 1e9);
+    return 1;
+}
+
+static bool runScript(const char *script, int argc, char **argv, bool hooked)
+{
+    lua_State *L = luaL_newstate();
+    luaL_openlibs(L);
+
+    static const luaL_Reg timeFuncs[] = {
+        {"getNow", time_getNow},
+        {"diff", time_diff},
+        {NULL, NULL}
+    };
+    luaL_newlib(L, timeFuncs);
+    lua_setglobal(L, "time");
+
+    luaL_dostring(L, "function sprintf(...) return string.format(...) end "
+                     "function printf(...) io.write(string.format(...)) end");
+
+    lua_newtable(L);
+    for(int i = 2; i < argc; i++)
+    {
+        lua_pushstring(L, argv[i]);
+        lua_rawseti(L, -2, i - 1);
+    }
+    lua_setglobal(L, "args");
+
+    if( hooked )
+        lua_sethook(L, closeHook, LUA_MASKLINE | LUA_MASKCOUNT, 100);
+
+    bool ok = luaL_dofile(L, script) == LUA_OK;
+    if( !ok )
+        fprintf(stderr, "%s\n", lua_tostring(L, -1));
+    lua_close(L);
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    if( argc < 2 )
+    {
+        fprintf(stderr, "Usage: %s script.lua [args...]\n", argv[0]);
+        return 1;
+    }
+
+    printf("=== With the old per-line CTRL+C hook ===\n");
+    if( !runScript(argv[1], argc, argv, true) )
+        return 1;
+
+    printf("\n=== With no hook (as now) ===\n");
+    if( !runScript(argv[1], argc, argv, false) )
+        return 1;
+
+    return 0;
+}
@@ -0,0 +1,242 @@
+/******************************************************************************
+    Project:    MicroMacro
+    Author:     SolarStrike Software
+    URL:        www.solarstrike.net
+    License:    Modified BSD (see license.txt)
+******************************************************************************/
+
+/*  Tests the Linux ProcMem backend against a child process.
+
+    Build and run (from the repository root):
+        g++ -std=c++11 -Isrc tests/procmem_test.cpp src/procmem.cpp -o procmem_test
+        ./procmem_test
+
+    The child is forked with known data already in place; the parent then
+    scribbles over its own copies, so that anything read back can only
+    have come from the child. Exits with the number of failed checks.
+*/
+
+#include "procmem.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+using namespace MicroMacro;
+
+static int failures = 0;
+
+#define CHECK(cond) \
+    do { \
+        if( !(cond) ) \
+        { \
+            fprintf(stderr, "FAIL: %s (line %d)\n", #cond, __LINE__); \
+            ++failures; \
+        } \
+    } while( 0 )
+
+static const size_t PAGE = 4096;
+static const size_t DATA_SIZE = 3 * PAGE;
+static const size_t MANY_READS = 1500;     // More than process_vm_readv() takes at once
+
+static unsigned char dataPattern(size_t i)
+{
+    return (unsigned char)(i * 7 + 3);
+}
+
+static const char *baseName(const char *path)
+{
+    const char *slash = strrchr(path, '/');
+    return slash ? slash + 1 : path;
+}
+
+int main()
+{
+    // Known data; then a page that the child unmaps, so that there is a hole right after it
+    unsigned char *mapping = (unsigned char *)mmap(NULL, DATA_SIZE + PAGE, PROT_READ | PROT_WRITE,
+                                                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if( mapping == MAP_FAILED )
+    {
+        perror("mmap");
+        return 1;
+    }
+    unsigned char *data = mapping;
+    unsigned char *hole = mapping + DATA_SIZE;
+    for(size_t i = 0; i < DATA_SIZE; i++)
+        data[i] = dataPattern(i);
+
+    int ready[2];
+    if( pipe(ready) != 0 )
+    {
+        perror("pipe");
+        return 1;
+    }
+
+    pid_t child = fork();
+    if( child < 0 )
+    {
+        perror("fork");
+        return 1;
+    }
+
+    if( child == 0 )
+    {   // Make the hole, say so, then wait to be killed
+        munmap(hole, PAGE);
+        char c = 1;
+        if( write(ready[1], &c, 1) != 1 )
+            _exit(1);
+        for(;;)
+            pause();
+    }
+
+    char c;
+    if( read(ready[0], &c, 1) != 1 )
+    {
+        fprintf(stderr, "Child did not start\n");
+        kill(child, SIGKILL);
+        return 1;
+    }
+    memset(data, 0, DATA_SIZE);     // Our copy no longer matches the child's
+
+    // open / getId / duplicate
+    ProcessHandle handle = ProcMem::open(child);
+    CHECK(ProcMem::isValid(handle));
+    CHECK(ProcMem::getId(handle) == (unsigned int)child);
+    ProcessHandle copy = ProcMem::duplicate(handle);
+    CHECK(ProcMem::isValid(copy));
+    CHECK(ProcMem::getId(copy) == (unsigned int)child);
+    ProcMem::close(copy);
+
+    // read / readExact
+    std::vector<unsigned char> buffer(DATA_SIZE);
+    CHECK(ProcMem::read(handle, (size_t)data, &buffer[0], DATA_SIZE) == DATA_SIZE);
+    bool same = true;
+    for(size_t i = 0; i < DATA_SIZE; i++)
+        same = same && buffer[i] == dataPattern(i);
+    CHECK(same);
+
+    unsigned char value = 0;
+    CHECK(ProcMem::readExact(handle, (size_t)data + 100, &value, 1) && value == dataPattern(100));
+    CHECK(ProcMem::read(handle, (size_t)hole, buffer.data(), 16) == 0);
+    CHECK(!ProcMem::readExact(handle, (size_t)hole, buffer.data(), 16));
+    CHECK(!ProcMem::readExact(handle, (size_t)hole - 8, buffer.data(), 16));  // Runs into the hole
+    CHECK(!ProcMem::readExact(handle, 0, buffer.data(), 1));
+
+    // write, then read back
+    const char message[] = "written by procmem_test";
+    CHECK(ProcMem::write(handle, (size_t)data + PAGE, message, sizeof(message)));
+    char readBack[sizeof(message)] = {0};
+    CHECK(ProcMem::readExact(handle, (size_t)data + PAGE, readBack, sizeof(readBack)));
+    CHECK(memcmp(readBack, message, sizeof(message)) == 0);
+    CHECK(!ProcMem::write(handle, (size_t)hole, message, sizeof(message)));
+
+    // readScatter: a failure in the middle doesn't take the rest with it
+    unsigned char a = 0, b = 0, h = 0;
+    ReadRequest three[3] = {
+        {(size_t)data + 1, &a, 1, false},
+        {(size_t)hole, &h, 1, true},
+        {(size_t)data + 2 * PAGE, &b, 1, false},
+    };
+    CHECK(ProcMem::readScatter(handle, three, 3) == 2);
+    CHECK(three[0].ok && a == dataPattern(1));
+    CHECK(!three[1].ok);
+    CHECK(three[2].ok && b == dataPattern(2 * PAGE));
+
+    // ...and spans more than one batch, with every 100th read failing
+    std::vector<ReadRequest> many(MANY_READS);
+    std::vector<unsigned char> manyValues(MANY_READS);
+    for(size_t i = 0; i < MANY_READS; i++)
+    {
+        ReadRequest request = {i % 100 == 99 ? (size_t)hole + i : (size_t)data + i, &manyValues[i], 1, false};
+        many[i] = request;
+    }
+    CHECK(ProcMem::readScatter(handle, &many[0], MANY_READS) == MANY_READS - MANY_READS / 100);
+    bool manyRight = true;
+    for(size_t i = 0; i < MANY_READS; i++)
+    {
+        if( i % 100 == 99 )
+            manyRight = manyRight && !many[i].ok;
+        else
+            manyRight = manyRight && many[i].ok && manyValues[i] == dataPattern(i);
+    }
+    CHECK(manyRight);
+
+    // readCoalesced: nearby reads share one, out of order
+    unsigned int x = 0, y = 0;
+    unsigned char z = 0;
+    ReadRequest near[3] = {
+        {(size_t)data + 64, &x, sizeof(x), false},
+        {(size_t)data + 8, &y, sizeof(y), false},
+        {(size_t)hole + 4, &z, 1, true},
+    };
+    CHECK(ProcMem::readCoalesced(handle, near, 3, 256) == 2);
+    unsigned int expectX, expectY;
+    unsigned char expected[8];
+    for(size_t i = 0; i < 4; i++)
+    {
+        expected[i] = dataPattern(64 + i);
+        expected[4 + i] = dataPattern(8 + i);
+    }
+    memcpy(&expectX, expected, 4);
+    memcpy(&expectY, expected + 4, 4);
+    CHECK(near[0].ok && x == expectX);
+    CHECK(near[1].ok && y == expectY);
+    CHECK(!near[2].ok);
+
+    // getRegions: the data is readable and writable, and the hole isn't there
+    std::vector<MemoryRegion> regions;
+    CHECK(ProcMem::getRegions(handle, regions));
+    bool dataFound = false, holeFound = false;
+    for(size_t i = 0; i < regions.size(); i++)
+    {
+        const MemoryRegion &region = regions[i];
+        if( region.base <= (size_t)data && (size_t)data + DATA_SIZE <= region.base + region.size )
+            dataFound = region.readable && region.writable;
+        if( region.base <= (size_t)hole && (size_t)hole < region.base + region.size )
+            holeFound = true;
+    }
+    CHECK(dataFound);
+    CHECK(!holeFound);
+
+    // getModules / getExecutablePath: the child runs this very executable
+    char selfPath[4096] = {0};
+    CHECK(readlink("/proc/self/exe", selfPath, sizeof(selfPath) - 1) > 0);
+    std::string exePath;
+    CHECK(ProcMem::getExecutablePath(handle, exePath) && exePath == selfPath);
+
+    std::vector<ModuleInfo> modules;
+    CHECK(ProcMem::getModules(child, modules));
+    bool exeFound = false, libcFound = false;
+    for(size_t i = 0; i < modules.size(); i++)
+    {
+        const ModuleInfo &module = modules[i];
+        char magic[4] = {0};
+        bool elf = ProcMem::readExact(handle, module.base, magic, 4) && memcmp(magic, "\x7f" "ELF", 4) == 0;
+        if( module.path == selfPath )
+            exeFound = elf && module.name == baseName(selfPath) && module.size > 0;
+        if( module.name.compare(0, 5, "libc.") == 0 || module.name.compare(0, 5, "libc-") == 0 )
+            libcFound = elf;
+    }
+    CHECK(exeFound);
+    CHECK(libcFound);
+
+    // Once the child is gone, every read fails
+    CHECK(ProcMem::terminate(handle, 0));
+    waitpid(child, NULL, 0);
+    ReadRequest after[3] = {
+        {(size_t)data, &a, 1, true},
+        {(size_t)data + 1, &b, 1, true},
+        {(size_t)data + 2, &h, 1, true},
+    };
+    CHECK(ProcMem::readScatter(handle, after, 3) == 0);
+    CHECK(!after[0].ok && !after[1].ok && !after[2].ok);
+    CHECK(!ProcMem::readExact(handle, (size_t)data, &value, 1));
+    ProcMem::close(handle);
+
+    printf("%s (%d failed)\n", failures ? "FAILED" : "All procmem checks passed", failures);
+    return failures;
+}